@@ -7,17 +7,34 @@
 #ifndef SENSORS_H
 #define SENSORS_H
 
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+//topic of the bus the distances are published on, one tof_snapshot_t per reading
+#define TOF_TOPIC       "/tof"
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+//distance measured by the TOF sensor
+typedef struct tof_snapshot_t
+{
+    uint32_t seq;           //number of readings published, this one included
+    systime_t timestamp;    //system time of the reading
+    uint16_t distance;      //in mm
+} tof_snapshot_t;
+
 /*===========================================================================*/
 /* External declarations.                                                    */
 /*===========================================================================*/
 
+/** Broadcast once per reading published on TOF_TOPIC. */
+extern event_source_t tof_event;
+
 /**
- * @brief               gets the value of the TOF sensor
- * @return              value of the TOF sensor
-**/
-uint16_t get_TOF_value(void);
-/**
- * @brief               starts VL53L0X sensor threads
+ * @brief               starts VL53L0X sensor threads and advertises TOF_TOPIC
  * @return              none
  */
 void sensor_start(void);
@@ -0,0 +1,37 @@
+/**
+ * @file	approach.h
+ * @brief	Exported functions and constants related to
+ * 			the approach of a balloon, on its distance and its bearing.
+**/
+
+#ifndef APPROACH_H
+#define APPROACH_H
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+//distance the approach stops at, in mm
+#define GOAL_DISTANCE       50
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief               	Starts a new approach at the next update, the robot
+ * 							speeds up from a standstill.
+ * @return              	none
+**/
+void approach_reset(void);
+
+/**
+ * @brief               	Sets the speeds of the wheels to move to the balloon,
+ * 							to call at each new measure.
+ * @param[in]	distance	the distance of the balloon in mm
+ * @param[in]	position	the position of the balloon in the line
+ * @return              	true once the balloon is reached, the robot is then stopped
+**/
+bool approach_update(uint16_t distance, uint16_t position);
+
+#endif /* APPROACH_H */
@@ -0,0 +1,45 @@
+/**
+ * @file	camera_exposure.h
+ * @brief	Exported functions and constants related to
+ * 			the control of the exposure and of the gain of the camera.
+**/
+
+#ifndef CAMERA_EXPOSURE_H
+#define CAMERA_EXPOSURE_H
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief               	Disables the automatic exposure and white balance of the
+ * 							po8030 and sets the initial exposure and gain.
+ * @return              	none
+**/
+void exposure_init(void);
+
+/**
+ * @brief               	Computes the exposure and the gain of the next frames from
+ * 							the histogram of the green channel of a captured line.
+ * @param[in]	line    	the pixels of the line in RGB565
+ * @param[in]	nb_pixels	the number of pixels of the line
+ * @return              	none
+**/
+void exposure_update(const uint8_t* line, uint16_t nb_pixels);
+
+/**
+ * @brief               	Writes the exposure and the gain computed by exposure_update
+ * 							to the po8030, if they changed.
+ * @return              	none
+**/
+void exposure_apply(void);
+
+/**
+ * @brief               	Gets the current settings of the camera.
+ * @param[out]	exposure	the integration time in lines
+ * @param[out]	gain    	the gain of the green channel, 64 for 1
+ * @return              	none
+**/
+void get_exposure(uint16_t* exposure, uint8_t* gain);
+
+#endif /* CAMERA_EXPOSURE_H */
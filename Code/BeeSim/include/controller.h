@@ -11,23 +11,85 @@
 /* File data structures and types.                                           */
 /*===========================================================================*/
 
+//states of the robot, the indented ones are inside the state above them
 //attribute packed to use one byte only
-typedef enum __attribute__((__packed__)) action_type_t
+typedef enum __attribute__((__packed__)) controller_state_t
 {
-	SEARCHING, 
-    APPROACHING, 
-    POLLINATING,
-    ATTACKING
-} action_type_t;
+    NO_STATE,
+    STATE_STOPPED,
+    STATE_MOVING_TO_BALLOON,
+        STATE_SEARCHING,
+        STATE_APPROACHING,
+        STATE_POLLINATING,
+            STATE_PUSHING_FLOWER,
+            STATE_GIGGLING,
+        STATE_ATTACKING,
+            STATE_TURNING_AROUND,
+            STATE_STINGING,
+    STATE_COMMUNICATING,
+        STATE_DANCING,
+    STATE_FACING_OPERATOR,
+    NB_STATES
+} controller_state_t;
+
+//events making the robot change state
+typedef enum __attribute__((__packed__)) controller_event_t
+{
+    EVENT_NONE,
+    EVENT_STOP,                 //the mode is STOPPED
+    EVENT_MOVE,                 //the mode is MOVING_TO_BALLOON
+    EVENT_COMMUNICATE,          //the mode is COMMUNICATING_WITH_PEERS
+    EVENT_COMMAND,              //a command came from a known direction
+    EVENT_BALLOON_SEEN,
+    EVENT_BALLOON_LOST,
+    EVENT_FLOWER_REACHED,
+    EVENT_ENEMY_REACHED,
+    EVENT_MOTION_DONE,          //the maneuver of the state is done
+    NB_EVENTS
+} controller_event_t;
+
+//change of state, from the innermost state left to the innermost state entered
+typedef struct controller_transition_t
+{
+    systime_t time;
+    controller_event_t event;
+    controller_state_t from;
+    controller_state_t to;
+} controller_transition_t;
+
+//counters of the controller thread
+typedef struct controller_stats_t
+{
+    uint32_t wakeups;               //wakeups since the start, none while the robot is stopped
+    uint32_t stalls;                //times the robot was stopped on the inputs of its state going stale
+    uint32_t command_latency;       //ms between the last command recognised and the change of state it made
+    uint32_t max_command_latency;   //highest latency since the start, in ms
+    uint32_t free_stack;            //bytes of the stack never used, 0 without CH_DBG_FILL_THREADS
+} controller_stats_t;
 
 /*===========================================================================*/
 /* External declarations.                                                    */
 /*===========================================================================*/
 
+/**
+ * @brief                   Gets the counters of the controller thread.
+ * @param[out]  stats       the counters
+ * @return                  none
+**/
+void get_controller_stats(controller_stats_t* stats);
+
+/**
+ * @brief                   Gets the last changes of state, if CONTROLLER_TRACE is TRUE.
+ * @param[out]  transitions the changes, the oldest first
+ * @param[in]   max         the number of changes transitions can hold
+ * @return                  the number of changes written
+**/
+uint8_t get_controller_trace(controller_transition_t* transitions, uint8_t max);
+
 /**
  * @brief   Initializes motors and starts controller thread.
  * @return  none
 **/
 void controller_start(void);
 
-#endif /* CONTROLLER_H */
\ No newline at end of file
+#endif /* CONTROLLER_H */
@@ -0,0 +1,69 @@
+/**
+ * @file	goertzel.h
+ * @brief	Exported functions and constants related to
+ * 			the single bin Goertzel filters.
+**/
+
+#ifndef GOERTZEL_H
+#define GOERTZEL_H
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+//state of a filter evaluating one bin of a size points DFT
+typedef struct goertzel_t
+{
+	float coeff;	//2*cos(w)
+	float cosine;	//cos(w)
+	float sine;		//sin(w)
+	float s1;		//last output of the resonator
+	float s2;		//second last output of the resonator
+} goertzel_t;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief               	Initializes a filter on one bin of a DFT.
+ * @param[out]	filter  	the filter to initialize
+ * @param[in]	bin     	the index of the bin to evaluate
+ * @param[in]	size    	the number of points of the equivalent DFT
+ * @return              	none
+**/
+void goertzel_init(goertzel_t* filter, uint16_t bin, uint16_t size);
+
+/**
+ * @brief               	Clears the state of the filter to start a new frame.
+ * @param[in]	filter  	the filter to reset
+ * @return              	none
+**/
+void goertzel_reset(goertzel_t* filter);
+
+/**
+ * @brief               	Feeds samples to the filter.
+ * @param[in]	filter  	the filter to update
+ * @param[in]	data    	the samples to process
+ * @param[in]	length  	the number of samples to process
+ * @return              	none
+**/
+void goertzel_process(goertzel_t* filter, const float* data, uint16_t length);
+
+/**
+ * @brief               	Computes the magnitude of the evaluated bin, the same
+ * 							value arm_cmplx_mag_f32 gives on the FFT output.
+ * @param[in]	filter  	the filter to read
+ * @return              	the magnitude of the bin
+**/
+float goertzel_magnitude(const goertzel_t* filter);
+
+/**
+ * @brief               	Computes the complex value of the evaluated bin.
+ * @param[in]	filter  	the filter to read
+ * @param[out]	phasor  	real and imaginary parts of the bin
+ * @return              	none
+**/
+void goertzel_phasor(const goertzel_t* filter, float* phasor);
+
+#endif /* GOERTZEL_H */
@@ -0,0 +1,56 @@
+/**
+ * @file	image_kernels.h
+ * @brief	Exported functions and constants related to
+ * 			the processing of the camera lines, four pixels at a time.
+**/
+
+#ifndef IMAGE_KERNELS_H
+#define IMAGE_KERNELS_H
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief               	Extracts the green channel of RGB565 pixels.
+ * @param[in]	rgb565  	the pixels as sent by the camera, two bytes each
+ * @param[out]	green   	the green values, 6 bits shifted to the left by 2
+ * @param[in]	nb_pixels	the number of pixels
+ * @return              	none
+**/
+void image_extract_green(const uint8_t* rgb565, uint8_t* green, uint16_t nb_pixels);
+
+/**
+ * @brief               	Averages two lines of green values, rounded down.
+ * 							The green values are multiples of 4 so the result is exact.
+ * @param[in]	a       	the first line
+ * @param[in]	b       	the second line
+ * @param[out]	average 	the average, can be one of the lines
+ * @param[in]	length  	the number of pixels
+ * @return              	none
+**/
+void image_average(const uint8_t* a, const uint8_t* b, uint8_t* average, uint16_t length);
+
+/**
+ * @brief               	Computes the difference between each pixel and the one
+ * 							offset pixels further, halved. The green values are
+ * 							even so the result is exact and fits a byte.
+ * @param[in]	green   	the green values, length + offset of them
+ * @param[out]	gradient	(green[i] - green[i+offset]) / 2
+ * @param[in]	length  	the number of differences to compute
+ * @param[in]	offset  	the distance between the compared pixels
+ * @return              	none
+**/
+void image_gradient(const uint8_t* green, int8_t* gradient, uint16_t length, uint16_t offset);
+
+/**
+ * @brief               	Finds the next difference above a threshold, whatever its sign.
+ * @param[in]	gradient	the differences computed by image_gradient
+ * @param[in]	start   	the index to start the search at
+ * @param[in]	end     	the index to stop the search at, excluded
+ * @param[in]	threshold	the absolute difference to exceed
+ * @return              	the index of the difference, end if there is none
+**/
+uint16_t image_find_edge(const int8_t* gradient, uint16_t start, uint16_t end, uint8_t threshold);
+
+#endif /* IMAGE_KERNELS_H */
@@ -0,0 +1,53 @@
+/**
+ * @file	mic_array.h
+ * @brief	Exported functions and constants related to
+ * 			the combination of the four microphones.
+**/
+
+#ifndef MIC_ARRAY_H
+#define MIC_ARRAY_H
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define NB_MICS					4
+
+//maximum number of samples per microphone given to mic_array_process
+#define MIC_BLOCK_SIZE			160
+
+//maximum number of bins the direction can be estimated on
+#define MAX_DIRECTION_BINS		4
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief               		Sets the bins used to estimate the direction of the sound.
+ * @param[in]	bins        	the bins to evaluate on every microphone
+ * @param[in]	nb_bins     	the number of bins, at most MAX_DIRECTION_BINS
+ * @param[in]	frame_size  	the number of points of the equivalent DFT
+ * @param[in]	min_magnitude	the magnitude a bin needs on every microphone to be used
+ * @return              		none
+**/
+void mic_array_init(const uint16_t* bins, uint8_t nb_bins, uint16_t frame_size, float min_magnitude);
+
+/**
+ * @brief               		Combines the four interleaved microphones into one signal
+ * 								and updates the direction estimate.
+ * @param[in]	data        	the interleaved samples of the four microphones
+ * @param[in]	num_samples 	the number of samples, at most NB_MICS*MIC_BLOCK_SIZE
+ * @param[out]	output      	the combined signal, num_samples/NB_MICS samples
+ * @return              		the number of samples written to output
+**/
+uint16_t mic_array_process(const int16_t* data, uint16_t num_samples, float* output);
+
+/**
+ * @brief               		Gets the direction of the sound during the last frame.
+ * @param[out]	bearing     	the direction in degrees, 0 in front, positive to the left
+ * @return              		true if one of the bins was loud enough to estimate it
+**/
+bool mic_array_get_bearing(int16_t* bearing);
+
+#endif /* MIC_ARRAY_H */
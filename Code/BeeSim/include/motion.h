@@ -0,0 +1,80 @@
+/**
+ * @file	motion.h
+ * @brief	Exported functions and constants related to
+ * 			the maneuvers of the robot, closed on the steps of the motors.
+**/
+
+#ifndef MOTION_H
+#define MOTION_H
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+//wheels of the e-puck2, in mm
+#define STEPS_PER_TURN      1000
+#define WHEEL_PERIMETER     130
+#define WHEEL_DISTANCE      53
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+//called by motion_update once a maneuver is done, it can start the next one
+typedef void (*motion_callback_t)(void);
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief               	Starts to turn on the spot, replacing the current maneuver.
+ * @param[in]	angle   	the angle in degrees, positive to the left
+ * @param[in]	speed   	the highest speed of the wheels in steps/s
+ * @param[in]	done    	called once the angle is reached, can be NULL
+ * @return              	none
+**/
+void motion_rotate(int16_t angle, uint16_t speed, motion_callback_t done);
+
+/**
+ * @brief               	Starts to drive straight, replacing the current maneuver.
+ * @param[in]	distance	the distance in mm, negative backward
+ * @param[in]	speed   	the highest speed of the wheels in steps/s
+ * @param[in]	done    	called once the distance is reached, can be NULL
+ * @return              	none
+**/
+void motion_drive(int16_t distance, uint16_t speed, motion_callback_t done);
+
+/**
+ * @brief               	Starts to drive along a circle, replacing the current maneuver.
+ * @param[in]	radius  	the radius in mm at the center of the robot, positive to turn
+ * 							left and negative to turn right
+ * @param[in]	angle   	the angle of the circle in degrees, negative backward
+ * @param[in]	speed   	the highest speed of the outer wheel in steps/s
+ * @param[in]	done    	called once the angle is reached, can be NULL
+ * @return              	none
+**/
+void motion_arc(int16_t radius, int16_t angle, uint16_t speed, motion_callback_t done);
+
+/**
+ * @brief               	Sets the speeds of the wheels for the current maneuver, stops
+ * 							the robot and calls its callback once it is done.
+ * 							To call periodically while a maneuver runs.
+ * @return              	true while a maneuver runs, the one started by the callback included
+**/
+bool motion_update(void);
+
+/**
+ * @brief               	Stops the robot and drops the current maneuver without
+ * 							calling its callback.
+ * @return              	none
+**/
+void motion_stop(void);
+
+/**
+ * @brief               	Tells if a maneuver runs.
+ * @return              	true if the robot is moving to a target
+**/
+bool motion_is_running(void);
+
+#endif /* MOTION_H */
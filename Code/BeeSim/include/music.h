@@ -0,0 +1,66 @@
+/**
+ * @file	music.h
+ * @brief	Exported functions and constants related to
+ * 			the music played by the speaker.
+**/
+
+#ifndef MUSIC_H
+#define MUSIC_H
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+typedef struct note_t
+{
+	uint16_t frequency;	//Hz, 0 for a rest
+	uint16_t duration;	//ms
+} note_t;
+
+typedef struct track_t
+{
+	const note_t* notes;
+	uint8_t length;
+	bool loop;			//the track plays until stopped or until another one is queued
+} track_t;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+//the Miel pops tune, looped
+extern const track_t miel_pops;
+
+/**
+ * @brief               Stops the music and plays a track right away.
+ * @param[in]   track   the track to play
+ * @return              none
+**/
+void music_play(const track_t* track);
+
+/**
+ * @brief               Plays a track after the queued ones, a looped track
+ * 						ends at the end of its current loop.
+ * @param[in]   track   the track to play
+ * @return              false if the queue is full
+**/
+bool music_queue(const track_t* track);
+
+/**
+ * @brief   Stops the music and empties the queue.
+ * @return  none
+**/
+void music_stop(void);
+
+/**
+ * @brief   Returns true while a track is playing.
+**/
+bool music_is_playing(void);
+
+/**
+ * @brief   Starts the music thread.
+ * @return  none
+**/
+void music_start(void);
+
+#endif /* MUSIC_H */
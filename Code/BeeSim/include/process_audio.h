@@ -19,16 +19,25 @@ typedef enum __attribute__((__packed__)) mode_selected_t
     COMMUNICATING_WITH_PEERS
 } mode_selected_t;
 
+//counters of the audio pipeline, the samples are counted per microphone
+//from the start, which gives sample accurate timestamps
+typedef struct audio_stats_t
+{
+    uint32_t blocks;                //blocks received from the microphones
+    uint32_t overruns;              //blocks lost because the audio thread was late
+    uint32_t samples;               //samples processed
+    uint32_t spectra;               //spectra analysed
+    uint32_t mode_change_sample;    //sample the last command was recognised at
+    systime_t mode_change_time;     //system time the last command was recognised at
+    uint32_t processing_time_ms;    //time spent processing the samples
+} audio_stats_t;
+
 /*===========================================================================*/
 /* External declarations.                                                    */
 /*===========================================================================*/
 
-/**
- * @brief                   Play a predefined music.
- * @param[in]   end_music   the condition to stop the music
- * @return                  none
-**/
-void play_music(bool end_music);
+/** Broadcast once per command recognised, after the mode and its direction are set. */
+extern event_source_t command_event;
 
 /**
  * @brief   Returns mode_activated.
@@ -40,6 +49,20 @@ mode_selected_t get_mode(void);
 **/
 void set_mode(mode_selected_t mode);
 
+/**
+ * @brief                   Gets the direction of the operator who gave the last command.
+ * @param[out]  bearing     the direction in degrees, 0 in front, positive to the left
+ * @return                  true once after each command whose direction could be estimated
+**/
+bool get_command_bearing(int16_t* bearing);
+
+/**
+ * @brief                   Gets the counters of the audio pipeline.
+ * @param[out]  stats       the counters
+ * @return                  none
+**/
+void get_audio_stats(audio_stats_t* stats);
+
 /**
  * @brief   Starts the process audio thread.
  * @return  none
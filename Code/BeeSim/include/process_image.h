@@ -13,32 +13,63 @@
 
 //buffer size
 #define IMAGE_BUFFER_SIZE   640
+//focal length of the camera in pixels, about 45 degrees over IMAGE_BUFFER_SIZE pixels
+#define FOCAL_LENGTH        772.0f
+
+//topic of the bus the detections are published on, one balloon_snapshot_t per frame processed
+#define BALLOON_TOPIC       "/balloon"
 
 /*===========================================================================*/
 /* File data structures and types.                                           */
 /*===========================================================================*/
 
 //attribute packed to use one byte only
+//the colors of the classes are set in tools/color_table.py, a class is added
+//here and in the CLASSES of the tool, in the same order
 typedef enum __attribute__((__packed__)) balloon_type_t
 {
 	NONE, 
     FLOWER, 
-    ENNEMY
+    ENNEMY,
+    NB_BALLOON_TYPES
 } balloon_type_t;
 
+//detection of a frame, published as a whole so its fields always belong together
+typedef struct balloon_snapshot_t
+{
+    uint32_t seq;           //number of the frame the balloon was found in
+    systime_t timestamp;    //system time at the end of the capture of the frame
+    uint16_t position;      //in the line, when the frame was captured
+    uint16_t width;         //in pixels
+    uint16_t extent;        //height in rows seen by the bands
+    uint16_t distance;      //in mm estimated from the width, 0 if it cannot be estimated
+    balloon_type_t type;    //NONE if there is no balloon
+} balloon_snapshot_t;
+
+//counters of the image pipeline
+typedef struct image_stats_t
+{
+    uint32_t captured;      //frames captured by the camera
+    uint32_t processed;     //frames whose balloons were detected
+    uint32_t dropped;       //frames overwritten by newer ones before or during their processing
+    uint32_t pixels;        //pixels searched per band, only around the balloon while it is tracked
+    uint32_t latency;       //ms between the end of the capture of the last frame and its detection
+    uint32_t max_latency;   //highest latency since the start, in ms
+} image_stats_t;
+
 /*===========================================================================*/
 /* External declarations.                                                    */
 /*===========================================================================*/
- 
-/**
- * @brief   returns balloon_position
-**/
-uint16_t get_balloon_position(void);
 
+/** Broadcast once per frame processed, after its detection is published on BALLOON_TOPIC. */
+extern event_source_t balloon_event;
+ 
 /**
- * @brief   returns balloon_type
+ * @brief                   Gets the counters of the image pipeline.
+ * @param[out]  stats       the counters
+ * @return                  none
 **/
-balloon_type_t get_balloon_type(void);
+void get_image_stats(image_stats_t* stats);
 
 /**
  * @brief   sets capture_image
@@ -46,7 +77,7 @@ balloon_type_t get_balloon_type(void);
 void set_capture_image(bool capture);
 
 /**
- * @brief   Starts the camera, image capture and image processing threads.
+ * @brief   Advertises BALLOON_TOPIC and starts the camera, image capture and image processing threads.
  * @return  none
 **/
 void process_image_start(void);
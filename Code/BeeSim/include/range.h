@@ -0,0 +1,37 @@
+/**
+ * @file	range.h
+ * @brief	Exported functions and constants related to
+ * 			the distance of a balloon estimated from its width in the image.
+**/
+
+#ifndef RANGE_H
+#define RANGE_H
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief               	Estimates the distance of a balloon with the pinhole model
+ * 							distance = coeff / (width - offset).
+ * @param[in]	width   	the width of the balloon in pixels
+ * @return              	the distance in mm, 0 if the width is too small to be trusted
+**/
+uint16_t range_from_width(float width);
+
+/**
+ * @brief               	Calibrates the model with a balloon at a known distance,
+ * 							the model is fitted by least squares on the samples.
+ * @param[in]	width   	the width of the balloon in pixels
+ * @param[in]	distance	the distance of the balloon in mm
+ * @return              	none
+**/
+void range_add_sample(float width, uint16_t distance);
+
+/**
+ * @brief               	Forgets the samples and goes back to the default model.
+ * @return              	none
+**/
+void range_reset_calibration(void);
+
+#endif /* RANGE_H */
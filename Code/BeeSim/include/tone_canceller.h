@@ -0,0 +1,30 @@
+/**
+ * @file	tone_canceller.h
+ * @brief	Exported functions and constants related to
+ * 			the removal of the played notes from the microphones signal.
+**/
+
+#ifndef TONE_CANCELLER_H
+#define TONE_CANCELLER_H
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+/**
+ * @brief               	Sets the note played by the speaker. Can be called
+ * 							from another thread than tone_canceller_process.
+ * @param[in]	frequency	the frequency of the note in Hz, 0 if nothing is played
+ * @return              	none
+**/
+void tone_canceller_set_note(uint16_t frequency);
+
+/**
+ * @brief               	Removes the note and its harmonics from the signal.
+ * @param[in]	data    	the samples to filter, filtered in place
+ * @param[in]	length  	the number of samples
+ * @return              	none
+**/
+void tone_canceller_process(float* data, uint16_t length);
+
+#endif /* TONE_CANCELLER_H */
@@ -15,7 +15,15 @@
 #include "include/process_image.h"
 #include "include/controller.h"
 #include "include/TOF_sensor.h"
+#include "include/music.h"
 
+/*===========================================================================*/
+/* Global variables.                                                         */
+/*===========================================================================*/
+
+messagebus_t bus;
+MUTEX_DECL(bus_lock);
+CONDVAR_DECL(bus_condvar);
 
 /*===========================================================================*/
 /* Local functions.                                                          */
@@ -27,11 +35,15 @@ static void init_all(void)
     chSysInit();
     mpu_init();	
 
+	//the threads publish and read their data on the bus
+	messagebus_init(&bus, &bus_lock, &bus_condvar);
+
 	//starts the rgb LEDs
     spi_comm_start();
 
-	//stars the threads for the audio processing, the image processing,
+	//stars the threads for the music, the audio processing, the image processing,
 	// the controller and the  TOF sensor
+	music_start();
 	process_audio_start();
 	process_image_start();
 	controller_start();
@@ -12,18 +12,66 @@
 
 //Project headers
 
+#include "main.h"
 #include "include/TOF_sensor.h"
 
 /*===========================================================================*/
-/* File exported functions.                                                  */
+/* File constants.                                                           */
+/*===========================================================================*/
+
+//period of the readings of the last distance measured by the sensor, in ms
+#define TOF_PERIOD      30
+
+/*===========================================================================*/
+/* Global variables.                                                         */
+/*===========================================================================*/
+
+EVENTSOURCE_DECL(tof_event);
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static messagebus_topic_t tof_topic;
+static MUTEX_DECL(tof_topic_lock);
+static CONDVAR_DECL(tof_topic_condvar);
+static tof_snapshot_t tof_topic_value;
+
+/*===========================================================================*/
+/* File threads.                                                             */
 /*===========================================================================*/
 
-uint16_t get_TOF_value(void)
+static THD_WORKING_AREA(waPublishTOF, 256);
+static THD_FUNCTION(PublishTOF, arg)
 {
-    return VL53L0X_get_dist_mm();
+    chRegSetThreadName(__FUNCTION__);
+    (void)arg;
+
+    tof_snapshot_t tof = {0};
+    systime_t time;
+
+    while(1){
+        time = chVTGetSystemTime();
+        //every reading is published with its time, a distance repeated tells it still holds
+        tof.seq++;
+        tof.timestamp = time;
+        tof.distance = VL53L0X_get_dist_mm();
+        messagebus_topic_publish(&tof_topic, &tof, sizeof(tof));
+        chEvtBroadcast(&tof_event);
+        chThdSleepUntilWindowed(time, time + MS2ST(TOF_PERIOD));
+    }
 }
 
+/*===========================================================================*/
+/* File exported functions.                                                  */
+/*===========================================================================*/
+
 void sensor_start(void)
 {
+    messagebus_topic_init(&tof_topic, &tof_topic_lock, &tof_topic_condvar,
+                            &tof_topic_value, sizeof(tof_topic_value));
+    messagebus_advertise_topic(&bus, &tof_topic, TOF_TOPIC);
+
     VL53L0X_start();
+    chThdCreateStatic(waPublishTOF, sizeof(waPublishTOF), NORMALPRIO, PublishTOF, NULL);
 }
\ No newline at end of file
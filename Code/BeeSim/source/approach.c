@@ -0,0 +1,265 @@
+/**
+ * @file	approach.c
+ * @brief 	Moves the robot to a balloon, a PID on the distance and a PID on
+ * 			the bearing following a trapezoidal speed profile.
+ * @note 	The profile accelerates to the cruise speed and brakes to stop on
+ * 			GOAL_DISTANCE, its speed is fed forward and the PID on the distance
+ * 			only corrects the gap between the robot and the profile. The speed of
+ * 			each wheel is then limited in acceleration so they do not slip.
+**/
+
+//C headers
+#include <math.h>
+
+//ChibiOS headers
+#include <ch.h>
+#include <hal.h>
+
+//E-puck 2 headers
+#include <motors.h>
+
+//Project headers
+#include "include/approach.h"
+#include "include/process_image.h"
+#include "include/motion.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define STEPS_PER_MM            ((float)STEPS_PER_TURN / WHEEL_PERIMETER)
+
+//speed profile, in steps/s and steps/s^2, under the limits of the wheels
+//to leave a margin to the corrections
+#define CRUISE_SPEED            900
+#define PROFILE_ACCELERATION    1500
+//the robot still moves at this speed close to the goal, to reach it
+#define MIN_SPEED               100
+
+//acceleration of the wheels, in steps/s^2
+#define MAX_ACCELERATION        3000
+
+//PID on the distance to the profile, in mm to steps/s
+#define RANGE_KP                3.0f
+#define RANGE_KI                0.5f
+#define RANGE_KD                0.1f
+#define RANGE_LIMIT             300.0f
+//the profile starts again from the measure if the gap is larger, in mm,
+//when the distance goes from the camera to the TOF sensor
+#define MAX_RANGE_GAP           100
+
+//PID on the bearing, in radians to steps/s of difference between the wheels
+#define BEARING_KP              1500.0f
+#define BEARING_KI              100.0f
+#define BEARING_KD              50.0f
+#define BEARING_LIMIT           400.0f
+
+//longest period between two updates, in ms, the robot is considered stopped
+#define MAX_UPDATE_PERIOD       100
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+typedef struct pid_controller_t
+{
+    float kp;
+    float ki;
+    float kd;
+    float limit;            //highest correction, the integral stops growing beyond it
+    float integral;
+    float last_error;
+    bool started;           //false until the first error, no derivative then
+} pid_controller_t;
+
+typedef struct approach_t
+{
+    float reference;        //distance of the profile, in mm
+    float speed;            //speed of the profile, in steps/s
+    float left_speed;       //speeds set to the wheels, in steps/s
+    float right_speed;
+    systime_t last_update;
+    bool started;
+} approach_t;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static pid_controller_t range_pid = {RANGE_KP, RANGE_KI, RANGE_KD, RANGE_LIMIT, 0, 0, false};
+static pid_controller_t bearing_pid = {BEARING_KP, BEARING_KI, BEARING_KD, BEARING_LIMIT, 0, 0, false};
+
+static approach_t approach = {0};
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               Forgets the integral and the last error of a PID.
+ * @param[out]  pid     the PID
+ * @return              none
+**/
+static void pid_reset(pid_controller_t* pid)
+{
+    pid->integral = 0;
+    pid->last_error = 0;
+    pid->started = false;
+}
+
+/**
+ * @brief               Computes the correction of a PID with anti-windup, the
+ *                      integral is frozen while the correction is saturated.
+ * @param[in,out] pid   the PID
+ * @param[in]   error   the error to correct
+ * @param[in]   period  the time since the last error, in s
+ * @return              the correction, between -limit and limit
+**/
+static float pid_update(pid_controller_t* pid, float error, float period)
+{
+    float derivative = pid->started ? (error - pid->last_error) / period : 0;
+    float integral = pid->integral + error * period;
+    float correction = pid->kp * error + pid->ki * integral + pid->kd * derivative;
+
+    pid->last_error = error;
+    pid->started = true;
+    if(correction > pid->limit)
+    {
+        return pid->limit;
+    } else if(correction < -pid->limit) {
+        return -pid->limit;
+    }
+    pid->integral = integral;
+    return correction;
+}
+
+/**
+ * @brief               Moves the profile by a period, it accelerates to CRUISE_SPEED
+ *                      and brakes to stop on GOAL_DISTANCE.
+ * @param[in]   period  the time since the last update, in s
+ * @return              none
+**/
+static void update_profile(float period)
+{
+    float remaining = (approach.reference - GOAL_DISTANCE) * STEPS_PER_MM;
+    float braking_speed = remaining > 0 ? sqrtf(2.0f * PROFILE_ACCELERATION * remaining) : 0;
+
+    approach.speed += PROFILE_ACCELERATION * period;
+    if(approach.speed > CRUISE_SPEED)
+    {
+        approach.speed = CRUISE_SPEED;
+    }
+    if(approach.speed > braking_speed)
+    {
+        approach.speed = braking_speed;
+    }
+    if(approach.speed < MIN_SPEED)
+    {
+        approach.speed = MIN_SPEED;
+    }
+    approach.reference -= approach.speed * period / STEPS_PER_MM;
+    if(approach.reference < GOAL_DISTANCE)
+    {
+        approach.reference = GOAL_DISTANCE;
+    }
+}
+
+/**
+ * @brief               Changes the speed of a wheel by at most the acceleration allowed.
+ * @param[in]   speed   the speed of the wheel, in steps/s
+ * @param[in]   target  the speed wanted, in steps/s
+ * @param[in]   period  the time since the last update, in s
+ * @return              the new speed of the wheel
+**/
+static float limit_acceleration(float speed, float target, float period)
+{
+    float step = MAX_ACCELERATION * period;
+
+    if(target > speed + step)
+    {
+        target = speed + step;
+    } else if(target < speed - step) {
+        target = speed - step;
+    }
+    if(target > MOTOR_SPEED_LIMIT)
+    {
+        return MOTOR_SPEED_LIMIT;
+    } else if(target < -MOTOR_SPEED_LIMIT) {
+        return -MOTOR_SPEED_LIMIT;
+    }
+    return target;
+}
+
+/*===========================================================================*/
+/* File exported functions.                                                  */
+/*===========================================================================*/
+
+void approach_reset(void)
+{
+    approach.started = false;
+}
+
+bool approach_update(uint16_t distance, uint16_t position)
+{
+    systime_t time = chVTGetSystemTime();
+    float period = ST2MS(time - approach.last_update) / 1000.0f;
+    //positive to the right
+    float bearing = atanf((position - IMAGE_BUFFER_SIZE/2) / FOCAL_LENGTH);
+    float speed = 0, turn = 0, braking_speed = 0;
+
+    if(distance <= GOAL_DISTANCE)
+    {
+        approach.left_speed = 0;
+        approach.right_speed = 0;
+        right_motor_set_speed(0);
+        left_motor_set_speed(0);
+        return true;
+    }
+
+    //the profile starts from the robot, stopped, at the first update and after a pause,
+    //the wheels may still turn at the speed of the search
+    if(!approach.started || period > MAX_UPDATE_PERIOD / 1000.0f)
+    {
+        approach.reference = distance;
+        approach.speed = MIN_SPEED;
+        approach.left_speed = 0;
+        approach.right_speed = 0;
+        right_motor_set_speed(0);
+        left_motor_set_speed(0);
+        approach.last_update = time;
+        approach.started = true;
+        pid_reset(&range_pid);
+        pid_reset(&bearing_pid);
+        return false;
+    }
+    //two measures at the same time
+    if(period <= 0)
+    {
+        return false;
+    }
+    approach.last_update = time;
+    //the profile goes on from the measure if it jumps from the camera to the TOF sensor
+    if(fabsf(distance - approach.reference) > MAX_RANGE_GAP)
+    {
+        approach.reference = distance;
+        pid_reset(&range_pid);
+    }
+
+    update_profile(period);
+    //the speed of the profile, corrected by the gap, the robot is late if farther
+    speed = approach.speed + pid_update(&range_pid, distance - approach.reference, period);
+    //never faster than the wheels can brake to the goal from the measure
+    braking_speed = sqrtf(2.0f * MAX_ACCELERATION * (distance - GOAL_DISTANCE) * STEPS_PER_MM);
+    if(speed > braking_speed)
+    {
+        speed = braking_speed > MIN_SPEED ? braking_speed : MIN_SPEED;
+    }
+    //turns toward the balloon, and at the rate its bearing changes because of the forward motion
+    turn = speed * sinf(bearing) * WHEEL_DISTANCE / (2 * distance) + pid_update(&bearing_pid, bearing, period);
+
+    approach.left_speed = limit_acceleration(approach.left_speed, speed + turn, period);
+    approach.right_speed = limit_acceleration(approach.right_speed, speed - turn, period);
+    left_motor_set_speed(approach.left_speed);
+    right_motor_set_speed(approach.right_speed);
+    return false;
+}
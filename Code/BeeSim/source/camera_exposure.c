@@ -0,0 +1,227 @@
+/**
+ * @file	camera_exposure.c
+ * @brief 	Controls the exposure and the gain of the camera so the brightest
+ * 			pixels of the line stay just under the saturation.
+ * @note 	The steps of the balloons then use most of the 8 bits of the green
+ * 			channel. The exposure is only lengthened past BLUR_EXPOSURE once the
+ * 			gain is at its highest, so the frames stay short, with little motion blur.
+**/
+
+//ChibiOS headers
+#include <ch.h>
+#include <hal.h>
+
+//E-puck 2 headers
+#include <camera/po8030.h>
+
+//Project headers
+#include "include/camera_exposure.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+//levels of the green channel of RGB565
+#define NB_LEVELS           64
+//the pixels of this share of the line are darker than the level controlled, in percent
+#define HIGH_PERCENTILE     95
+//level the percentile is held at, a quarter below the saturation
+#define TARGET_LEVEL        48
+//no change within this range around the target
+#define LEVEL_DEADBAND      4
+//share of saturated pixels above which the percentile cannot be trusted, in percent
+#define MAX_SATURATED       2
+//fraction of the correction applied per update, in percent, the po8030 takes a few
+//frames to apply new settings
+#define CORRECTION_RATE     50
+//frames between two updates
+#define UPDATE_PERIOD       3
+
+//integration time in lines, the longest exposure before the gain is raised
+//limits the motion blur, the longest one the frame rate
+#define MIN_EXPOSURE        8
+#define BLUR_EXPOSURE       128
+#define MAX_EXPOSURE        512
+#define INITIAL_EXPOSURE    BLUR_EXPOSURE
+
+//gain in 1/64, the red and blue channels keep the default white balance of the po8030
+#define UNITY_GAIN          64
+#define MAX_GAIN            160
+#define RED_BALANCE         0x5E
+#define GREEN_BALANCE       0x40
+#define BLUE_BALANCE        0x5D
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+typedef struct exposure_settings_t
+{
+    uint16_t exposure;      //integration time in lines
+    uint8_t gain;           //in 1/64
+} exposure_settings_t;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+//computed by the processing, written to the camera by the capture
+static exposure_settings_t settings = {INITIAL_EXPOSURE, UNITY_GAIN};
+static volatile bool settings_changed = false;
+
+static uint16_t histogram[NB_LEVELS];
+static uint8_t frames_since_update = 0;
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               Counts the pixels of the line at each level of green.
+ * @param[in]   line    the pixels in RGB565
+ * @param[in]   nb_pixels the number of pixels
+ * @return              none
+**/
+static void compute_histogram(const uint8_t* line, uint16_t nb_pixels)
+{
+    for(uint8_t level = 0 ; level < NB_LEVELS ; level++)
+    {
+        histogram[level] = 0;
+    }
+    for(uint16_t i = 0 ; i < nb_pixels ; i++)
+    {
+        //3 LSbits of the first byte and 3 MSbits of the second byte
+        histogram[((line[2 * i] & 0x07) << 3) | (line[2 * i + 1] >> 5)]++;
+    }
+}
+
+/**
+ * @brief               Finds the level of green a share of the pixels is below.
+ * @param[in]   nb_pixels the number of pixels of the histogram
+ * @param[in]   percent the share of the pixels
+ * @return              the level
+**/
+static uint8_t find_percentile(uint16_t nb_pixels, uint8_t percent)
+{
+    uint32_t count = 0, limit = (uint32_t)nb_pixels * percent / 100;
+    uint8_t level = 0;
+
+    for(level = 0 ; level < NB_LEVELS - 1 ; level++)
+    {
+        count += histogram[level];
+        if(count >= limit)
+        {
+            break;
+        }
+    }
+    return level;
+}
+
+/**
+ * @brief               Splits a brightness between the exposure and the gain, the
+ *                      exposure up to BLUR_EXPOSURE first, then the gain, then the
+ *                      exposure again.
+ * @param[in]   brightness the product of the exposure and of the gain
+ * @return              none
+**/
+static void split_brightness(uint32_t brightness)
+{
+    uint32_t exposure = brightness / UNITY_GAIN;
+    uint32_t gain = UNITY_GAIN;
+
+    if(exposure > BLUR_EXPOSURE)
+    {
+        exposure = BLUR_EXPOSURE;
+        gain = brightness / BLUR_EXPOSURE;
+        if(gain > MAX_GAIN)
+        {
+            gain = MAX_GAIN;
+            exposure = brightness / MAX_GAIN;
+        }
+    }
+    if(exposure < MIN_EXPOSURE)
+    {
+        exposure = MIN_EXPOSURE;
+    } else if(exposure > MAX_EXPOSURE) {
+        exposure = MAX_EXPOSURE;
+    }
+
+    if(exposure != settings.exposure || gain != settings.gain)
+    {
+        chSysLock();
+        settings.exposure = exposure;
+        settings.gain = gain;
+        settings_changed = true;
+        chSysUnlock();
+    }
+}
+
+/*===========================================================================*/
+/* File exported functions.                                                  */
+/*===========================================================================*/
+
+void exposure_init(void)
+{
+    po8030_set_ae(0);
+    po8030_set_awb(0);
+    settings_changed = true;
+    exposure_apply();
+}
+
+void exposure_update(const uint8_t* line, uint16_t nb_pixels)
+{
+    int32_t brightness = (int32_t)settings.exposure * settings.gain;
+    int32_t correction = 0;
+    uint8_t level = 0;
+
+    //the last settings must have reached the frames
+    if(++frames_since_update < UPDATE_PERIOD)
+    {
+        return;
+    }
+    frames_since_update = 0;
+
+    compute_histogram(line, nb_pixels);
+    if(histogram[NB_LEVELS - 1] * 100 > (uint32_t)nb_pixels * MAX_SATURATED)
+    {
+        //the actual level is unknown, halves the brightness
+        split_brightness(brightness / 2);
+        return;
+    }
+    level = find_percentile(nb_pixels, HIGH_PERCENTILE);
+    if(level + LEVEL_DEADBAND >= TARGET_LEVEL && level <= TARGET_LEVEL + LEVEL_DEADBAND)
+    {
+        return;
+    }
+    //the level is proportional to the brightness, at most doubled per update
+    if(level < TARGET_LEVEL / 2)
+    {
+        level = TARGET_LEVEL / 2;
+    }
+    correction = brightness * (TARGET_LEVEL - level) / level;
+    split_brightness(brightness + correction * CORRECTION_RATE / 100);
+}
+
+void exposure_apply(void)
+{
+    exposure_settings_t applied;
+
+    if(!settings_changed)
+    {
+        return;
+    }
+    chSysLock();
+    applied = settings;
+    settings_changed = false;
+    chSysUnlock();
+
+    po8030_set_exposure(applied.exposure, 0);
+    po8030_set_rgb_gain(RED_BALANCE * applied.gain / UNITY_GAIN, GREEN_BALANCE * applied.gain / UNITY_GAIN,
+                        BLUE_BALANCE * applied.gain / UNITY_GAIN);
+}
+
+void get_exposure(uint16_t* exposure, uint8_t* gain)
+{
+    *exposure = settings.exposure;
+    *gain = settings.gain;
+}
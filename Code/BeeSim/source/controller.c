@@ -15,10 +15,14 @@
 #include <leds.h>
 
 //Project headers
+#include "main.h"
 #include "include/controller.h"
 #include "include/process_image.h"
 #include "include/process_audio.h"
 #include "include/TOF_sensor.h"
+#include "include/music.h"
+#include "include/motion.h"
+#include "include/approach.h"
 
 /*===========================================================================*/
 /* File constants.                                                           */
@@ -26,33 +30,102 @@
 
 //speed constants
 #define NORMAL_SPEED 150
-#define ROTATION_THRESHOLD 10
-#define ROTATION_COEFF 2
 
 //detection constants
-#define GOAL_DISTANCE 50
+//farthest distance the TOF sensor is trusted at, the camera estimates it beyond
+#define TOF_MAX_RANGE 500
 
-//P controller constant
-#define KP 2
+//speed of the maneuvers in steps/s, they end on their target whatever the speed
+#define MANEUVER_SPEED 1000
 
-//attack constants
-#define ATTACK_ENEMY 40
-#define ROTATE_180_DEGREES 138
+//attack constants, in degrees and mm
+#define ATTACK_ROTATION 180
+#define ATTACK_DISTANCE 60
 
-//pollinate constants
-#define MOVE_FORWARD 180
-#define GIGGLE_FLOWER 17 
+//pollinate constants, in mm and degrees
+#define POLLINATE_DISTANCE 35
+#define GIGGLE_ANGLE 8
+#define NB_GIGGLES 10
 
 //communicate constants
-#define ROTATE_360_DEGREES 352
+#define NB_DANCE_TURNS 4
+
+//keeps the last changes of state for get_controller_trace
+#define CONTROLLER_TRACE TRUE
+#define TRACE_SIZE 16
+
+//levels of states inside one another
+#define MAX_STATE_DEPTH 3
+
+//period of the updates of the maneuvers, in ms, the controller sleeps otherwise
+#define MOTION_PERIOD 10
+
+//longest times without the inputs of a state the wheels keep turning for, in ms
+//the search turns with the camera publishing every frame
+#define SEARCH_WATCHDOG 500
+//the approach restarts from a standstill after this time without any update
+#define APPROACH_WATCHDOG 100
+
+//events the controller waits for
+#define COMMAND_EVENT   EVENT_MASK(0)
+#define BALLOON_EVENT   EVENT_MASK(1)
+#define TOF_EVENT       EVENT_MASK(2)
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+//a state, its actions are NULL if it has none
+typedef struct state_t
+{
+    controller_state_t parent;      //NO_STATE for the top states
+    controller_state_t initial;     //state entered inside it, NO_STATE if none
+    void (*entry)(void);
+    void (*exit)(void);
+    controller_event_t (*during)(void);   //at each wakeup while it is the innermost state
+    eventmask_t inputs;             //data waking the controller up besides the commands
+    uint16_t watchdog;              //ms without inputs the robot is stopped after, 0 if its
+                                    //wheels do not depend on them
+} state_t;
+
+//change of state on an event, taken if its guard is NULL or true
+typedef struct transition_t
+{
+    controller_state_t target;      //NO_STATE if the state does not handle the event
+    bool (*guard)(void);
+    void (*action)(void);
+} transition_t;
 
 /*===========================================================================*/
 /* File local variables.                                                     */
 /*===========================================================================*/
 
-//in case of a non expected mode change, we reset every static variablle to default 
-//to avoid any unwanted behavior
-static bool reset_variable = false;
+//topics of the detections of the camera and of the distances of the TOF sensor
+static messagebus_topic_t* balloon_topic = NULL;
+static messagebus_topic_t* tof_topic = NULL;
+
+//innermost state of the robot
+static controller_state_t current_state = NO_STATE;
+
+//inputs of the states, updated at each tick
+static balloon_snapshot_t balloon = {.type = NONE};
+static int16_t operator_bearing = 0;
+static bool motion_done = false;
+
+//progress of the repeated maneuvers
+static uint8_t giggles = 0;
+static uint8_t dance_turns = 0;
+
+//counters of the controller thread
+static uint32_t wakeups = 0;
+static uint32_t stalls = 0;
+static uint32_t command_latency = 0;
+static uint32_t max_command_latency = 0;
+
+#if CONTROLLER_TRACE
+static controller_transition_t trace[TRACE_SIZE];
+static uint32_t nb_transitions = 0;
+#endif
 
 /*===========================================================================*/
 /* Local functions.                                                          */
@@ -73,302 +146,595 @@ static void set_leds(uint8_t red, uint8_t green, uint8_t blue)
     }
 }
 
+/**
+ * @brief                   Gets the distance to the balloon, from the TOF sensor when it is
+ *                          in its range and from the width of the balloon in the image otherwise.
+ * @param   camera_distance the distance estimated by the camera, 0 if unknown
+ * @return                  the distance in mm
+**/
+static uint16_t get_balloon_range(uint16_t camera_distance)
+{
+    //far until the first measure
+    tof_snapshot_t tof = {.distance = TOF_MAX_RANGE};
+
+    messagebus_topic_read(tof_topic, &tof, sizeof(tof));
+    if(tof.distance < TOF_MAX_RANGE || camera_distance == 0)
+    {
+        return tof.distance;
+    }
+    return camera_distance;
+}
+
+/**
+ * @brief   Called by the motion module at the end of the maneuver of a state.
+ * @return  none
+**/
+static void signal_motion_done(void)
+{
+    motion_done = true;
+}
+
+/*===========================================================================*/
+/* State actions.                                                            */
+/*===========================================================================*/
+
+static void stopped_entry(void)
+{
+    //no color
+    set_leds(0, 0, 0);
+    motion_stop();
+}
+
+static void moving_to_balloon_exit(void)
+{
+    motion_stop();
+    //the camera may have been stopped close to a balloon
+    set_capture_image(true);
+}
+
 /**
  * @brief   Researches a balloon by turning on itself
  * @return  none
 **/
-static void research_balloon(void)
+static void searching_entry(void)
 {
+    //yellow
+    set_leds(255, 255, 0);
+    set_capture_image(true);
+    //the approach starts from the next balloon seen
+    approach_reset();
     right_motor_set_speed(NORMAL_SPEED);
     left_motor_set_speed(-NORMAL_SPEED);
 }
 
-static bool approach_balloon(uint16_t balloon_position)
+static controller_event_t searching_during(void)
 {
-    uint16_t error = 0;
-    uint16_t speed = 0;
-    int16_t speed_correction = balloon_position - IMAGE_BUFFER_SIZE/2;
-
-    //get the distance to the balloon
-    error = get_TOF_value();
-
-    //P controller implementation
-    speed = KP * error;
+    //turns again if the watchdog stopped the robot while the detections were missing
+    right_motor_set_speed(NORMAL_SPEED);
+    left_motor_set_speed(-NORMAL_SPEED);
+    return balloon.type != NONE ? EVENT_BALLOON_SEEN : EVENT_NONE;
+}
 
-    //if the speed is too low, we set it to the normal speed
-    if(speed < NORMAL_SPEED)
+/**
+ * @brief   Moves toward the balloon, at full speed far away and braking
+ *          to stop at GOAL_DISTANCE.
+ * @return  the event of the balloon reached, EVENT_BALLOON_LOST if it is not seen anymore
+**/
+static controller_event_t approaching_during(void)
+{
+    if(balloon.type == NONE)
     {
-        speed = NORMAL_SPEED;
+        return EVENT_BALLOON_LOST;
     }
-   
-    //threshold to avoid small corrections due to noise of the camera
-    if(abs(speed_correction) < ROTATION_THRESHOLD)
+    if(approach_update(get_balloon_range(balloon.distance), balloon.position))
     {
-        speed_correction = 0;
+        return balloon.type == FLOWER ? EVENT_FLOWER_REACHED : EVENT_ENEMY_REACHED;
     }
-    right_motor_set_speed(speed - ROTATION_COEFF*speed_correction);
-    left_motor_set_speed(speed + ROTATION_COEFF*speed_correction);
+    return EVENT_NONE;
+}
 
-    if (error < GOAL_DISTANCE)
-    {
-        right_motor_set_speed(0);
-        left_motor_set_speed(0);
-        return true;
-    }
-    return false;
+/**
+ * @brief   Makes the robot pollinate with a flower, it moves into the flower, then giggles.
+ * @return  none
+**/
+static void pollinating_entry(void)
+{
+    //blue
+    set_leds(0, 0, 255);
+    giggles = 0;
+}
+
+static void balloon_done_exit(void)
+{
+    motion_stop();
+    //allows the camera to capture image again
+    set_capture_image(true);
+}
+
+static void pushing_flower_entry(void)
+{
+    motion_drive(POLLINATE_DISTANCE, MANEUVER_SPEED, signal_motion_done);
 }
 
 /**
- * @brief   Attacks the enemy by turning on itselfs and moving backward.
- * @return  true if the robot is still attacking, false otherwise
+ * @brief   Swings from one side to the other in front of the flower, starting
+ *          and ending with half swings so the robot faces it again.
+ * @return  none
 **/
-static bool attack_enemy(void)
+static void giggling_entry(void)
 {
-    static uint8_t count_rotation = 0;
-    static uint8_t count_move_backward = 0;
+    int16_t angle = GIGGLE_ANGLE;
 
-    if(reset_variable)
+    if(giggles == 0 || giggles == NB_GIGGLES)
     {
-        count_rotation = 0;
-        count_move_backward = 0;
-        return 0;
+        angle = GIGGLE_ANGLE / 2;
     }
-    ++count_rotation;
-    if(count_rotation <= ROTATE_180_DEGREES) {
-        right_motor_set_speed(3*NORMAL_SPEED);
-        left_motor_set_speed(-3*NORMAL_SPEED);
-    } else {
-        ++count_move_backward;
-        right_motor_set_speed(-10*NORMAL_SPEED);
-        left_motor_set_speed(-10*NORMAL_SPEED);
-        if(count_move_backward >= ATTACK_ENEMY) {
-            count_rotation = 0;
-            count_move_backward = 0;
-            right_motor_set_speed(0);
-            left_motor_set_speed(0);
-            //allows the camera to capture image again
-            set_capture_image(true);
-            return false;
-        }
+    if(giggles % 2)
+    {
+        angle = -angle;
     }
-    return true;
+    giggles++;
+    motion_rotate(angle, MANEUVER_SPEED, signal_motion_done);
+}
+
+static bool giggles_left(void)
+{
+    return giggles <= NB_GIGGLES;
+}
+
+/**
+ * @brief   Attacks the enemy by turning on itselfs and moving backward.
+ * @return  none
+**/
+static void attacking_entry(void)
+{
+    //red
+    set_leds(255, 0, 0);
+}
+
+static void turning_around_entry(void)
+{
+    motion_rotate(ATTACK_ROTATION, MANEUVER_SPEED, signal_motion_done);
+}
+
+static void stinging_entry(void)
+{
+    motion_drive(-ATTACK_DISTANCE, MANEUVER_SPEED, signal_motion_done);
+}
+
+/**
+ * @brief   Communicates with other bees by doing complete turn and playing music.
+ * @return  none
+**/
+static void communicating_entry(void)
+{
+    //magenta
+    set_leds(255, 0, 255);
+    dance_turns = 0;
+    //the music plays by itself until stopped
+    music_play(&miel_pops);
+}
+
+static void communicating_exit(void)
+{
+    music_stop();
+    motion_stop();
+}
+
+static void resume_moving(void)
+{
+    set_mode(MOVING_TO_BALLOON);
+}
+
+/**
+ * @brief   Turns on itself, the other way round at each turn.
+ * @return  none
+**/
+static void dancing_entry(void)
+{
+    motion_rotate(dance_turns % 2 ? -360 : 360, MANEUVER_SPEED, signal_motion_done);
+    dance_turns++;
+}
+
+static bool dance_turns_left(void)
+{
+    return dance_turns < NB_DANCE_TURNS;
 }
 
 /**
- * @brief   Makes the robot pollinate with a flower.
- * @return  true if the robot is still performing the action, false otherwise
+ * @brief   Turns the robot toward the operator who gave a command.
+ * @return  none
 **/
-static bool pollinate_flower(void)
+static void facing_operator_entry(void)
 {
-    static uint8_t count_move_forward = 0;
-    static uint8_t count_rotation = 0;
-    static int16_t speed = NORMAL_SPEED;
+    motion_rotate(operator_bearing, MANEUVER_SPEED, signal_motion_done);
+}
+
+static void facing_operator_exit(void)
+{
+    motion_stop();
+}
+
+//STOP stops the robot where it is, only the other commands turn it toward the operator
+static bool command_starts_behaviour(void)
+{
+    return get_mode() != STOPPED;
+}
+
+/*===========================================================================*/
+/* State machine.                                                            */
+/*===========================================================================*/
 
-    if(reset_variable)
+//the maneuvers are closed on the steps of the motors and updated every MOTION_PERIOD,
+//only the search and the approach turn the wheels on their inputs
+static const state_t states[NB_STATES] = {
+    [STATE_STOPPED]             = {NO_STATE, NO_STATE, stopped_entry, NULL, NULL, 0, 0},
+    [STATE_MOVING_TO_BALLOON]   = {NO_STATE, STATE_SEARCHING, NULL, moving_to_balloon_exit, NULL, 0, 0},
+    [STATE_SEARCHING]           = {STATE_MOVING_TO_BALLOON, NO_STATE, searching_entry, NULL, searching_during, BALLOON_EVENT,
+                                   SEARCH_WATCHDOG},
+    [STATE_APPROACHING]         = {STATE_MOVING_TO_BALLOON, NO_STATE, NULL, NULL, approaching_during, BALLOON_EVENT | TOF_EVENT,
+                                   APPROACH_WATCHDOG},
+    [STATE_POLLINATING]         = {STATE_MOVING_TO_BALLOON, STATE_PUSHING_FLOWER, pollinating_entry, balloon_done_exit, NULL, 0, 0},
+    [STATE_PUSHING_FLOWER]      = {STATE_POLLINATING, NO_STATE, pushing_flower_entry, NULL, NULL, 0, 0},
+    [STATE_GIGGLING]            = {STATE_POLLINATING, NO_STATE, giggling_entry, NULL, NULL, 0, 0},
+    [STATE_ATTACKING]           = {STATE_MOVING_TO_BALLOON, STATE_TURNING_AROUND, attacking_entry, balloon_done_exit, NULL, 0, 0},
+    [STATE_TURNING_AROUND]      = {STATE_ATTACKING, NO_STATE, turning_around_entry, NULL, NULL, 0, 0},
+    [STATE_STINGING]            = {STATE_ATTACKING, NO_STATE, stinging_entry, NULL, NULL, 0, 0},
+    [STATE_COMMUNICATING]       = {NO_STATE, STATE_DANCING, communicating_entry, communicating_exit, NULL, 0, 0},
+    [STATE_DANCING]             = {STATE_COMMUNICATING, NO_STATE, dancing_entry, NULL, NULL, 0, 0},
+    [STATE_FACING_OPERATOR]     = {NO_STATE, NO_STATE, facing_operator_entry, facing_operator_exit, NULL, 0, 0},
+};
+
+//the events a state does not handle go to the state around it
+static const transition_t transitions[NB_STATES][NB_EVENTS] = {
+    [STATE_STOPPED] = {
+        [EVENT_MOVE]            = {STATE_MOVING_TO_BALLOON, NULL, NULL},
+        [EVENT_COMMUNICATE]     = {STATE_COMMUNICATING, NULL, NULL},
+        [EVENT_COMMAND]         = {STATE_FACING_OPERATOR, command_starts_behaviour, NULL},
+    },
+    [STATE_MOVING_TO_BALLOON] = {
+        [EVENT_STOP]            = {STATE_STOPPED, NULL, NULL},
+        [EVENT_COMMUNICATE]     = {STATE_COMMUNICATING, NULL, NULL},
+        [EVENT_COMMAND]         = {STATE_FACING_OPERATOR, command_starts_behaviour, NULL},
+    },
+    [STATE_SEARCHING] = {
+        [EVENT_BALLOON_SEEN]    = {STATE_APPROACHING, NULL, NULL},
+    },
+    [STATE_APPROACHING] = {
+        [EVENT_BALLOON_LOST]    = {STATE_SEARCHING, NULL, NULL},
+        [EVENT_FLOWER_REACHED]  = {STATE_POLLINATING, NULL, NULL},
+        [EVENT_ENEMY_REACHED]   = {STATE_ATTACKING, NULL, NULL},
+    },
+    [STATE_POLLINATING] = {
+        [EVENT_MOTION_DONE]     = {STATE_SEARCHING, NULL, NULL},
+    },
+    [STATE_PUSHING_FLOWER] = {
+        [EVENT_MOTION_DONE]     = {STATE_GIGGLING, NULL, NULL},
+    },
+    [STATE_GIGGLING] = {
+        [EVENT_MOTION_DONE]     = {STATE_GIGGLING, giggles_left, NULL},
+    },
+    [STATE_ATTACKING] = {
+        [EVENT_MOTION_DONE]     = {STATE_SEARCHING, NULL, NULL},
+    },
+    [STATE_TURNING_AROUND] = {
+        [EVENT_MOTION_DONE]     = {STATE_STINGING, NULL, NULL},
+    },
+    [STATE_COMMUNICATING] = {
+        [EVENT_STOP]            = {STATE_STOPPED, NULL, NULL},
+        [EVENT_MOVE]            = {STATE_MOVING_TO_BALLOON, NULL, NULL},
+        [EVENT_COMMAND]         = {STATE_FACING_OPERATOR, command_starts_behaviour, NULL},
+        [EVENT_MOTION_DONE]     = {STATE_MOVING_TO_BALLOON, NULL, resume_moving},
+    },
+    [STATE_DANCING] = {
+        [EVENT_MOTION_DONE]     = {STATE_DANCING, dance_turns_left, NULL},
+    },
+    [STATE_FACING_OPERATOR] = {
+        //a new command restarts the rotation
+        [EVENT_COMMAND]         = {STATE_FACING_OPERATOR, command_starts_behaviour, NULL},
+        //the state of the mode is entered at once from STOPPED
+        [EVENT_MOTION_DONE]     = {STATE_STOPPED, NULL, NULL},
+        [EVENT_STOP]            = {STATE_STOPPED, NULL, NULL},
+    },
+};
+
+//event sent while the robot is not in the state of the mode
+static const controller_event_t mode_events[] = {
+    [STOPPED]                   = EVENT_STOP,
+    [MOVING_TO_BALLOON]         = EVENT_MOVE,
+    [COMMUNICATING_WITH_PEERS]  = EVENT_COMMUNICATE,
+};
+
+/**
+ * @brief               Tells if a state is another one or inside it.
+ * @param   state       the state
+ * @param   ancestor    the other state
+ * @return              true if state is ancestor or inside it
+**/
+static bool is_inside(controller_state_t state, controller_state_t ancestor)
+{
+    for( ; state != NO_STATE ; state = states[state].parent)
     {
-        count_move_forward = 0;
-        count_rotation = 0;
-        return 0;
-    }
-    
-    if(count_move_forward <= MOVE_FORWARD) {
-        ++count_move_forward;
-        right_motor_set_speed(speed);
-        left_motor_set_speed(speed);
-    } else {
-        ++count_rotation;
-        if(count_rotation % GIGGLE_FLOWER == 0) {
-            speed = -speed;
-            right_motor_set_speed(speed);
-            left_motor_set_speed(-speed);
-        }
-        if(count_rotation >= 10 * GIGGLE_FLOWER) {
-            count_rotation = 0;
-            count_move_forward = 0;
-            right_motor_set_speed(0);
-            left_motor_set_speed(0);
-            //allows the camera to capture image again
-            set_capture_image(true);
-            return false;
+        if(state == ancestor)
+        {
+            return true;
         }
     }
-    return true;
+    return false;
 }
 
 /**
- * @brief   Moves the robot to the balloon.
- * @return  none
+ * @brief               Enters a state from the state around it, and the states
+ *                      inside it down to the innermost one.
+ * @param   from        the state around the one to enter, which is already entered
+ * @param   target      the state to enter
+ * @return              none
 **/
-static void move_to_balloon(void)
+static void enter_state(controller_state_t from, controller_state_t target)
 {
-    //initial state
-    static action_type_t action_type = SEARCHING;
-
-    //get the infos from the image processing
-    uint16_t balloon_position = get_balloon_position();
-    balloon_type_t balloon_type = get_balloon_type();
+    controller_state_t path[MAX_STATE_DEPTH];
+    uint8_t depth = 0;
 
-    if(reset_variable)
+    //the states between from and target, entered from the outermost one
+    for(controller_state_t state = target ; state != from ; state = states[state].parent)
     {
-        action_type = SEARCHING;
-        return;
+        path[depth++] = state;
     }
-   
-    if(balloon_type == NONE)
+    while(depth > 0)
     {
-        set_capture_image(true);
-        action_type = SEARCHING;
-    } 
-    switch (action_type)
+        current_state = path[--depth];
+        if(states[current_state].entry != NULL)
+        {
+            states[current_state].entry();
+        }
+    }
+    while(states[current_state].initial != NO_STATE)
     {
-        case SEARCHING:
-            //yellow
-            set_leds(255, 255, 0);
-             //turns on itself
-            research_balloon();
-            action_type = APPROACHING;
-            break;
-        case APPROACHING:
-            //yellow
-            set_leds(255, 255, 0);
-            //if the robot is close enough to the balloon
-            if(approach_balloon(balloon_position)) {
-                
-                if (balloon_type == FLOWER)
-                {
-                    //blue
-                    set_leds(0, 0, 255);
-                    action_type = POLLINATING;
-                } else {
-                    //red
-                    set_leds(255,  0, 0);
-                    action_type = ATTACKING;
-                }
-            }
-            break;
-        case POLLINATING:
-            
-            if (!pollinate_flower())
-            {
-                action_type = SEARCHING;
-            }
-            break;
-        case ATTACKING:
-            if(!attack_enemy())
-            {
-                action_type = SEARCHING;
-            }
-            break;
-        default:
-            //no color
-            set_leds(0, 0, 0);
-            left_motor_set_speed(0);
-            right_motor_set_speed(0);
-            break;
+        current_state = states[current_state].initial;
+        if(states[current_state].entry != NULL)
+        {
+            states[current_state].entry();
+        }
     }
 }
 
 /**
- * @brief   Communicates with other bees by doing complete turn and playing music.
- * @return  none
+ * @brief               Leaves the innermost state and the states around it.
+ * @param   until       the state to stop at, which is not left
+ * @return              none
 **/
-static void communicate_with_peers(void)
+static void exit_state(controller_state_t until)
 {
-    static uint16_t count_rotation = 0;
-    static int16_t speed = 3*NORMAL_SPEED;
-
-    if(reset_variable)
+    while(current_state != until)
     {
-        count_rotation = 0;
-        play_music(true);
-        return;
+        if(states[current_state].exit != NULL)
+        {
+            states[current_state].exit();
+        }
+        current_state = states[current_state].parent;
     }
+}
 
-    if(count_rotation <= 4*ROTATE_360_DEGREES)
+/**
+ * @brief               Changes of state on an event. The innermost state handling it
+ *                      is left along with the states inside it, even for a transition
+ *                      to itself, then the target and its initial states are entered.
+ * @param   event       the event
+ * @return              none
+**/
+static void dispatch(controller_event_t event)
+{
+    const transition_t* transition = NULL;
+    controller_state_t source = current_state, common = NO_STATE;
+#if CONTROLLER_TRACE
+    controller_state_t from = current_state;
+#endif
+
+    //at most MAX_STATE_DEPTH states handle the event
+    for( ; source != NO_STATE ; source = states[source].parent)
     {
-        play_music(false);
-        ++count_rotation;
-        if(count_rotation % ROTATE_360_DEGREES == 0)
+        transition = &transitions[source][event];
+        if(transition->target != NO_STATE && (transition->guard == NULL || transition->guard()))
         {
-            speed = -speed;
+            break;
         }
-        left_motor_set_speed(-speed);
-        right_motor_set_speed(speed);
-        
-    } else {
-        play_music(true);
-        left_motor_set_speed(0);
-        right_motor_set_speed(0);
-        count_rotation = 0;
-        set_mode(MOVING_TO_BALLOON);
     }
+    if(source == NO_STATE)
+    {
+        return;
+    }
+
+    //the innermost state around the source containing the target stays
+    for(common = states[source].parent ; common != NO_STATE && !is_inside(transition->target, common) ;
+        common = states[common].parent);
+    exit_state(common);
+    if(transition->action != NULL)
+    {
+        transition->action();
+    }
+    enter_state(common, transition->target);
+
+#if CONTROLLER_TRACE
+    trace[nb_transitions % TRACE_SIZE] = (controller_transition_t){chVTGetSystemTime(), event, from, current_state};
+    nb_transitions++;
+#endif
 }
 
-static void reset_all(void)
+/**
+ * @brief               Gets the time the controller can sleep for.
+ * @param   last_input  the time the inputs of the current state last came
+ * @param   stalled     true if the watchdog of the current state has already stopped the robot
+ * @return              the timeout of the wait, TIME_INFINITE until an event
+**/
+static systime_t get_timeout(systime_t last_input, bool stalled)
 {
-    reset_variable = true;
+    systime_t timeout = motion_is_running() ? MS2ST(MOTION_PERIOD) : TIME_INFINITE;
+    systime_t watchdog = MS2ST(states[current_state].watchdog);
+    systime_t elapsed = chVTGetSystemTime() - last_input;
 
-    //resets every static variables in every function to default values
-    communicate_with_peers();
-    move_to_balloon();
-    attack_enemy();
-    pollinate_flower();
-    set_capture_image(true);
-    
-    reset_variable = false;
+    if(watchdog == 0 || stalled)
+    {
+        return timeout;
+    }
+    //at least a tick, TIME_IMMEDIATE would not wait at all
+    if(elapsed >= watchdog)
+    {
+        return 1;
+    }
+    return watchdog - elapsed < timeout ? watchdog - elapsed : timeout;
 }
 
 /*===========================================================================*/
 /* File threads.                                                             */
 /*===========================================================================*/
 
-static THD_WORKING_AREA(waController, 512);
+//the dispatch, the entry actions and the approach nest their calls, 512 bytes are too few
+static THD_WORKING_AREA(waController, 1024);
 static THD_FUNCTION(Controller, arg) 
 {
 
      chRegSetThreadName(__FUNCTION__);
     (void)arg;
 
-    systime_t time;
-
-    mode_selected_t last_mode = get_mode();
-    mode_selected_t current_mode = get_mode();
+    event_listener_t command_listener, balloon_listener, tof_listener;
+    eventmask_t wakeup = 0;
+    controller_event_t event = EVENT_NONE;
+    audio_stats_t audio;
+    //state the watchdog runs for, the time of its last inputs and if it stopped the robot
+    controller_state_t watched_state = NO_STATE;
+    systime_t last_input = 0;
+    bool stalled = false;
+
+    //waits for the producers to be started
+    balloon_topic = messagebus_find_topic_blocking(&bus, BALLOON_TOPIC);
+    tof_topic = messagebus_find_topic_blocking(&bus, TOF_TOPIC);
+    chEvtRegisterMask(&command_event, &command_listener, COMMAND_EVENT);
+    chEvtRegisterMask(&balloon_event, &balloon_listener, BALLOON_EVENT);
+    chEvtRegisterMask(&tof_event, &tof_listener, TOF_EVENT);
+
+    enter_state(NO_STATE, STATE_STOPPED);
     
     while(1){
-        time = chVTGetSystemTime();
-        current_mode = get_mode();
-        if(last_mode != current_mode)
+        //a state entered gets the time of its watchdog to receive its inputs
+        if(current_state != watched_state)
         {
-            last_mode = current_mode;
-            reset_all();
+            watched_state = current_state;
+            last_input = chVTGetSystemTime();
+            stalled = false;
         }
-        switch (current_mode)
+        //sleeps until a command, or the data the state uses, and ticks only
+        //while a maneuver runs or until the watchdog, the events of the other data stay pending
+        wakeup = chEvtWaitAnyTimeout(COMMAND_EVENT | states[current_state].inputs,
+                                     get_timeout(last_input, stalled));
+        wakeups++;
+        //stops the robot if its inputs are stale, the state turns the wheels again at the next one
+        if(wakeup & states[current_state].inputs)
         {
-            case MOVING_TO_BALLOON:
-                move_to_balloon();
-                break;
-            case COMMUNICATING_WITH_PEERS:
-                //magenta
-                set_leds(255, 0, 255);
-                communicate_with_peers();
-                break;
-            case STOPPED:
-            default:
-                //no color
-                set_leds(0, 0, 0);
-                right_motor_set_speed(0);
-                left_motor_set_speed(0);
-                break;
+            last_input = chVTGetSystemTime();
+            stalled = false;
+        } else if(!stalled && states[current_state].watchdog != 0
+                    && chVTGetSystemTime() - last_input >= MS2ST(states[current_state].watchdog)) {
+            motion_stop();
+            stalled = true;
+            stalls++;
         }
-        //100Hz precisly
-        chThdSleepUntilWindowed(time, time + MS2ST(10));
+        //get the infos from the image processing, all from the same frame
+        messagebus_topic_read(balloon_topic, &balloon, sizeof(balloon));
+
+        //answers a voice command by turning toward the operator first
+        if(get_command_bearing(&operator_bearing))
+        {
+            dispatch(EVENT_COMMAND);
+        }
+        motion_update();
+        if(motion_done)
+        {
+            motion_done = false;
+            dispatch(EVENT_MOTION_DONE);
+        }
+        //the states of the other modes handle it
+        dispatch(mode_events[get_mode()]);
+        if(states[current_state].during != NULL && !(stalled && current_state == watched_state))
+        {
+            event = states[current_state].during();
+            if(event != EVENT_NONE)
+            {
+                dispatch(event);
+            }
+        }
+        //the motors are set by the states entered on the command
+        if(wakeup & COMMAND_EVENT)
+        {
+            get_audio_stats(&audio);
+            command_latency = ST2MS(chVTGetSystemTime() - audio.mode_change_time);
+            if(command_latency > max_command_latency)
+            {
+                max_command_latency = command_latency;
+            }
+        }
+    }
+}
+
+#if CH_DBG_FILL_THREADS
+/**
+ * @brief               Measures the stack of the controller thread never used, the
+ *                      kernel fills it with CH_DBG_STACK_FILL_VALUE at the creation
+ *                      and it grows down to the thread_t at the start of the working area.
+ * @return              the bytes never written
+**/
+static uint32_t get_free_stack(void)
+{
+    const uint8_t* bottom = (const uint8_t*)waController + sizeof(thread_t);
+    const uint8_t* top = (const uint8_t*)waController + sizeof(waController);
+    const uint8_t* byte = bottom;
+
+    while(byte < top && *byte == CH_DBG_STACK_FILL_VALUE)
+    {
+        byte++;
     }
+    return byte - bottom;
 }
+#endif
 
 /*===========================================================================*/
 /* File exported functions.                                                  */
 /*===========================================================================*/
 
+void get_controller_stats(controller_stats_t* stats)
+{
+    stats->wakeups = wakeups;
+    stats->stalls = stalls;
+    stats->command_latency = command_latency;
+    stats->max_command_latency = max_command_latency;
+#if CH_DBG_FILL_THREADS
+    stats->free_stack = get_free_stack();
+#else
+    stats->free_stack = 0;
+#endif
+}
+
+uint8_t get_controller_trace(controller_transition_t* transitions, uint8_t max)
+{
+    uint8_t nb_written = 0;
+
+#if CONTROLLER_TRACE
+    uint32_t first = nb_transitions > TRACE_SIZE ? nb_transitions - TRACE_SIZE : 0;
+
+    if(nb_transitions - first > max)
+    {
+        first = nb_transitions - max;
+    }
+    for(uint32_t i = first ; i < nb_transitions ; i++)
+    {
+        transitions[nb_written++] = trace[i % TRACE_SIZE];
+    }
+#else
+    (void)transitions;
+    (void)max;
+#endif
+    return nb_written;
+}
+
 void controller_start(void) {
     //initializes the motors
     motors_init();
@@ -0,0 +1,76 @@
+/**
+ * @file	goertzel.c
+ * @brief 	Single bin DFT evaluated sample by sample with the Goertzel
+ * 			algorithm, cheaper than a full FFT when only a few bins are needed.
+**/
+
+//C headers
+#include <math.h>
+
+//ChibiOS headers
+#include <ch.h>
+#include <hal.h>
+
+//E-puck 2 headers
+#include <arm_math.h>
+
+//Project headers
+#include "include/goertzel.h"
+
+/*===========================================================================*/
+/* File exported functions.                                                  */
+/*===========================================================================*/
+
+void goertzel_init(goertzel_t* filter, uint16_t bin, uint16_t size)
+{
+	float w = 2 * PI * bin / size;
+
+	filter->cosine = cosf(w);
+	filter->sine = sinf(w);
+	filter->coeff = 2 * filter->cosine;
+	goertzel_reset(filter);
+}
+
+void goertzel_reset(goertzel_t* filter)
+{
+	filter->s1 = 0;
+	filter->s2 = 0;
+}
+
+void goertzel_process(goertzel_t* filter, const float* data, uint16_t length)
+{
+	//local copies so the resonator stays in registers
+	float coeff = filter->coeff;
+	float s1 = filter->s1;
+	float s2 = filter->s2;
+	float s0;
+
+	for(uint16_t i = 0 ; i < length ; i++){
+		s0 = data[i] + coeff * s1 - s2;
+		s2 = s1;
+		s1 = s0;
+	}
+	filter->s1 = s1;
+	filter->s2 = s2;
+}
+
+float goertzel_magnitude(const goertzel_t* filter)
+{
+	float power = filter->s1 * filter->s1 + filter->s2 * filter->s2
+				- filter->coeff * filter->s1 * filter->s2;
+	float magnitude = 0;
+
+	//rounding can give a slightly negative power for a null bin
+	if(power > 0)
+	{
+		arm_sqrt_f32(power, &magnitude);
+	}
+	return magnitude;
+}
+
+void goertzel_phasor(const goertzel_t* filter, float* phasor)
+{
+	//X[k] = s1*e^(jw) - s2 once exactly size samples went through the filter
+	phasor[0] = filter->s1 * filter->cosine - filter->s2;
+	phasor[1] = filter->s1 * filter->sine;
+}
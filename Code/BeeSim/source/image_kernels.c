@@ -0,0 +1,150 @@
+/**
+ * @file	image_kernels.c
+ * @brief 	Pixel kernels of the line processing, working on four pixels
+ * 			at a time with the SIMD instructions of the Cortex-M4.
+ * @note 	The scalar versions are used on targets without these instructions
+ * 			and give exactly the same results.
+**/
+
+//C headers
+#include <stdlib.h>
+#include <string.h>
+
+//ChibiOS headers
+#include <ch.h>
+#include <hal.h>
+
+//Project headers
+#include "include/image_kernels.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+//set by the compiler when the instructions working on the four bytes of a word exist
+#if defined(__ARM_FEATURE_SIMD32)
+#define USE_SIMD			TRUE
+#else
+#define USE_SIMD			FALSE
+#endif
+
+//green bits of two RGB565 pixels in the first and in the second byte of their halfword
+#define GREEN_HIGH_MASK		0x00070007
+#define GREEN_LOW_MASK		0x001C001C
+
+//turns signed bytes into unsigned ones with 0 in the middle
+#define GRADIENT_BIAS		0x80808080
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+#if USE_SIMD
+/**
+ * @brief               	Reads four bytes at any alignment.
+ * @param[in]	data    	the bytes to read
+ * @return              	the bytes, the first one in the least significant byte
+**/
+static inline uint32_t load_word(const void* data)
+{
+	uint32_t word = 0;
+
+	//compiled to a single load, the Cortex-M4 allows unaligned accesses
+	memcpy(&word, data, sizeof(word));
+	return word;
+}
+
+/**
+ * @brief               	Writes four bytes at any alignment.
+ * @param[out]	data    	the bytes to write
+ * @param[in]	word    	the bytes, the first one in the least significant byte
+ * @return              	none
+**/
+static inline void store_word(void* data, uint32_t word)
+{
+	memcpy(data, &word, sizeof(word));
+}
+#endif
+
+/*===========================================================================*/
+/* File exported functions.                                                  */
+/*===========================================================================*/
+
+void image_extract_green(const uint8_t* rgb565, uint8_t* green, uint16_t nb_pixels)
+{
+	uint16_t i = 0;
+
+#if USE_SIMD
+	uint32_t first = 0, second = 0;
+
+	for( ; i + 4 <= nb_pixels ; i += 4){
+		first = load_word(&rgb565[2 * i]);
+		second = load_word(&rgb565[2 * i + 4]);
+		//the green value of each pixel ends in the first byte of its halfword
+		first = ((first & GREEN_HIGH_MASK) << 5) | ((first >> 11) & GREEN_LOW_MASK);
+		second = ((second & GREEN_HIGH_MASK) << 5) | ((second >> 11) & GREEN_LOW_MASK);
+		//packs the four values in one word
+		store_word(&green[i], __PKHBT(first | (first >> 8), second | (second >> 8), 16));
+	}
+#endif
+	for( ; i < nb_pixels ; i++){
+		//extracts 3 LSbits of the first byte and the 3 MSbits of second byte
+		green[i] = ((rgb565[2 * i] & 0x07) << 5) + ((rgb565[2 * i + 1] & 0xE0) >> 3);
+	}
+}
+
+void image_average(const uint8_t* a, const uint8_t* b, uint8_t* average, uint16_t length)
+{
+	uint16_t i = 0;
+
+#if USE_SIMD
+	for( ; i + 4 <= length ; i += 4){
+		store_word(&average[i], __UHADD8(load_word(&a[i]), load_word(&b[i])));
+	}
+#endif
+	for( ; i < length ; i++){
+		average[i] = (a[i] + b[i]) / 2;
+	}
+}
+
+void image_gradient(const uint8_t* green, int8_t* gradient, uint16_t length, uint16_t offset)
+{
+	uint16_t i = 0;
+
+#if USE_SIMD
+	for( ; i + 4 <= length ; i += 4){
+		store_word(&gradient[i], __UHSUB8(load_word(&green[i]), load_word(&green[i + offset])));
+	}
+#endif
+	for( ; i < length ; i++){
+		gradient[i] = (green[i] - green[i + offset]) / 2;
+	}
+}
+
+uint16_t image_find_edge(const int8_t* gradient, uint16_t start, uint16_t end, uint8_t threshold)
+{
+	uint16_t i = start;
+
+#if USE_SIMD
+	//the sum of the absolute differences of four pixels is below the threshold when none of them
+	//exceeds it, so most of the line is skipped four pixels at a time
+	for( ; i + 4 <= end ; i += 4){
+		if(__USAD8(load_word(&gradient[i]) ^ GRADIENT_BIAS, GRADIENT_BIAS) > threshold)
+		{
+			for(uint16_t j = i ; j < i + 4 ; j++){
+				if(abs(gradient[j]) > threshold)
+				{
+					return j;
+				}
+			}
+		}
+	}
+#endif
+	for( ; i < end ; i++){
+		if(abs(gradient[i]) > threshold)
+		{
+			return i;
+		}
+	}
+	return end;
+}
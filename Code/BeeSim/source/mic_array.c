@@ -0,0 +1,185 @@
+/**
+ * @file	mic_array.c
+ * @brief 	Combines the four microphones to raise the level of the commands
+ * 			over the noise and estimates the direction they come from.
+**/
+
+//C headers
+#include <math.h>
+
+//ChibiOS headers
+#include <ch.h>
+#include <hal.h>
+
+//E-puck 2 headers
+#include <audio/microphone.h>
+#include <arm_math.h>
+
+//Project headers
+#include "include/mic_array.h"
+#include "include/goertzel.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+//approximate distances between the microphones of each pair, in mm
+#define MIC_LEFT_RIGHT_DISTANCE		60.0f
+#define MIC_FRONT_BACK_DISTANCE		45.0f
+
+#define RAD_TO_DEG					(180.0f / PI)
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+//deinterleaved samples of each microphone, indexed by MIC_RIGHT...MIC_FRONT
+static float mic_blocks[NB_MICS][MIC_BLOCK_SIZE];
+
+//the same bins evaluated on each microphone to compare their phases
+static goertzel_t direction_filters[NB_MICS][MAX_DIRECTION_BINS];
+static uint8_t nb_direction_bins = 0;
+static uint16_t direction_frame_size = 0;
+
+//the magnitude of a cross spectrum is the product of the magnitudes of both microphones
+static float min_cross_magnitude = 0;
+
+static int16_t last_bearing = 0;
+static bool bearing_valid = false;
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief   Estimates the direction of the sound from the phase differences
+ * 			between opposite microphones on the strongest bin, then starts a new frame.
+ * @return  none
+**/
+static void estimate_bearing(void)
+{
+	float phasors[NB_MICS][2 * MAX_DIRECTION_BINS];
+	float conjugate[2 * MAX_DIRECTION_BINS];
+	float cross_left_right[2 * MAX_DIRECTION_BINS];
+	float cross_front_back[2 * MAX_DIRECTION_BINS];
+	float magnitudes[MAX_DIRECTION_BINS];
+	float max_magnitude = 0, front_back_magnitude = 0;
+	float phase_left_right = 0, phase_front_back = 0;
+	uint32_t bin = 0;
+
+	for(uint8_t mic = 0 ; mic < NB_MICS ; mic++){
+		for(uint8_t i = 0 ; i < nb_direction_bins ; i++){
+			goertzel_phasor(&direction_filters[mic][i], &phasors[mic][2 * i]);
+			goertzel_reset(&direction_filters[mic][i]);
+		}
+	}
+
+	//cross spectra, their phase is the phase difference between the two microphones
+	arm_cmplx_conj_f32(phasors[MIC_RIGHT], conjugate, nb_direction_bins);
+	arm_cmplx_mult_cmplx_f32(phasors[MIC_LEFT], conjugate, cross_left_right, nb_direction_bins);
+	arm_cmplx_conj_f32(phasors[MIC_BACK], conjugate, nb_direction_bins);
+	arm_cmplx_mult_cmplx_f32(phasors[MIC_FRONT], conjugate, cross_front_back, nb_direction_bins);
+
+	//the strongest bin is the one of the command, if there is one
+	arm_cmplx_mag_f32(cross_left_right, magnitudes, nb_direction_bins);
+	arm_max_f32(magnitudes, nb_direction_bins, &max_magnitude, &bin);
+	arm_cmplx_mag_f32(&cross_front_back[2 * bin], &front_back_magnitude, 1);
+
+	if(max_magnitude < min_cross_magnitude || front_back_magnitude < min_cross_magnitude)
+	{
+		bearing_valid = false;
+		return;
+	}
+
+	//positive when the sound reaches the left or the front microphone first
+	phase_left_right = atan2f(cross_left_right[2 * bin + 1], cross_left_right[2 * bin]);
+	phase_front_back = atan2f(cross_front_back[2 * bin + 1], cross_front_back[2 * bin]);
+
+	//each phase difference is proportional to the distance between the microphones
+	//times the sine (left-right) or the cosine (front-back) of the bearing
+	last_bearing = (int16_t)(RAD_TO_DEG * atan2f(phase_left_right / MIC_LEFT_RIGHT_DISTANCE,
+												 phase_front_back / MIC_FRONT_BACK_DISTANCE));
+	bearing_valid = true;
+}
+
+/*===========================================================================*/
+/* File exported functions.                                                  */
+/*===========================================================================*/
+
+void mic_array_init(const uint16_t* bins, uint8_t nb_bins, uint16_t frame_size, float min_magnitude)
+{
+	if(nb_bins > MAX_DIRECTION_BINS)
+	{
+		nb_bins = MAX_DIRECTION_BINS;
+	}
+	for(uint8_t mic = 0 ; mic < NB_MICS ; mic++){
+		for(uint8_t i = 0 ; i < nb_bins ; i++){
+			goertzel_init(&direction_filters[mic][i], bins[i], frame_size);
+		}
+	}
+	nb_direction_bins = nb_bins;
+	direction_frame_size = frame_size;
+	min_cross_magnitude = min_magnitude * min_magnitude;
+}
+
+uint16_t mic_array_process(const int16_t* data, uint16_t num_samples, float* output)
+{
+	//position in the current direction frame
+	static uint16_t nb_samples = 0;
+	uint16_t length = num_samples / NB_MICS;
+	uint16_t done = 0, chunk = 0;
+
+	if(length > MIC_BLOCK_SIZE)
+	{
+		length = MIC_BLOCK_SIZE;
+	}
+
+	//deinterleaves the microphones
+	for(uint16_t i = 0 ; i < length ; i++){
+		for(uint8_t mic = 0 ; mic < NB_MICS ; mic++){
+			mic_blocks[mic][i] = data[NB_MICS * i + mic];
+		}
+	}
+
+	//sum without steering: the microphones are up to 60 mm apart, 175 us or 2.8 samples,
+	//which is at most 26 degrees of phase at 415 Hz. The average loses about 3% of the
+	//command and still averages out the noise of each microphone
+	arm_add_f32(mic_blocks[0], mic_blocks[1], output, length);
+	arm_add_f32(output, mic_blocks[2], output, length);
+	arm_add_f32(output, mic_blocks[3], output, length);
+	arm_scale_f32(output, 1.0f / NB_MICS, output, length);
+
+	if(nb_direction_bins == 0)
+	{
+		return length;
+	}
+
+	//feeds the direction filters, estimating the bearing at the end of each frame
+	while(done < length){
+		chunk = length - done;
+		if(chunk > direction_frame_size - nb_samples)
+		{
+			chunk = direction_frame_size - nb_samples;
+		}
+		for(uint8_t mic = 0 ; mic < NB_MICS ; mic++){
+			for(uint8_t i = 0 ; i < nb_direction_bins ; i++){
+				goertzel_process(&direction_filters[mic][i], &mic_blocks[mic][done], chunk);
+			}
+		}
+		done += chunk;
+		nb_samples += chunk;
+
+		if(nb_samples >= direction_frame_size)
+		{
+			estimate_bearing();
+			nb_samples = 0;
+		}
+	}
+	return length;
+}
+
+bool mic_array_get_bearing(int16_t* bearing)
+{
+	*bearing = last_bearing;
+	return bearing_valid;
+}
@@ -0,0 +1,209 @@
+/**
+ * @file	motion.c
+ * @brief 	Maneuvers of the robot with targets in steps of the motors, so they
+ * 			end at the same place whatever the speed and the period of the updates.
+ * @note 	The speed ramps up and down with a limited acceleration, the wheels
+ * 			do not slip and the robot stops on the target.
+**/
+
+//C headers
+#include <stdlib.h>
+#include <math.h>
+
+//ChibiOS headers
+#include <ch.h>
+#include <hal.h>
+
+//E-puck 2 headers
+#include <motors.h>
+
+//Project headers
+#include "include/motion.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+//acceleration and deceleration of the leading wheel, in steps/s^2
+#define MAX_ACCELERATION    3000
+//speed the maneuvers start and end at, in steps/s, the motors move at once
+#define MIN_SPEED           100
+
+//longest update period used for the acceleration, in ms, for the first update
+#define MAX_UPDATE_PERIOD   20
+
+#define DEGREES_TO_RADIANS  (M_PI / 180.0f)
+//steps of a wheel moving by a distance in mm
+#define MM_TO_STEPS(mm)     ((mm) * STEPS_PER_TURN / WHEEL_PERIMETER)
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+//maneuver running, the wheel going the furthest leads and the other one follows
+typedef struct motion_t
+{
+    int32_t left_target;        //positions of the motors to reach
+    int32_t right_target;
+    int32_t left_steps;         //steps of each wheel for the whole maneuver
+    int32_t right_steps;
+    uint16_t max_speed;         //of the leading wheel, in steps/s
+    float speed;                //of the leading wheel now, in steps/s
+    systime_t last_update;
+    motion_callback_t done;
+    bool running;
+} motion_t;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static motion_t motion = {0};
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               Starts a maneuver from the current position of the motors.
+ * @param[in]   left_steps the steps of the left wheel
+ * @param[in]   right_steps the steps of the right wheel
+ * @param[in]   speed   the highest speed of the leading wheel in steps/s
+ * @param[in]   done    called once the maneuver is done
+ * @return              none
+**/
+static void start_motion(int32_t left_steps, int32_t right_steps, uint16_t speed, motion_callback_t done)
+{
+    motion.left_target = left_motor_get_pos() + left_steps;
+    motion.right_target = right_motor_get_pos() + right_steps;
+    motion.left_steps = left_steps;
+    motion.right_steps = right_steps;
+    motion.max_speed = speed > MOTOR_SPEED_LIMIT ? MOTOR_SPEED_LIMIT : speed;
+    motion.speed = MIN_SPEED;
+    motion.last_update = chVTGetSystemTime();
+    motion.done = done;
+    //a maneuver without any step ends at the first update
+    motion.running = true;
+}
+
+/**
+ * @brief               Stops the robot at the end of a maneuver and starts the next one.
+ * @return              none
+**/
+static void finish_motion(void)
+{
+    motion_callback_t done = motion.done;
+
+    motion_stop();
+    if(done != NULL)
+    {
+        done();
+    }
+}
+
+/*===========================================================================*/
+/* File exported functions.                                                  */
+/*===========================================================================*/
+
+void motion_rotate(int16_t angle, uint16_t speed, motion_callback_t done)
+{
+    //the wheels move on a circle of diameter WHEEL_DISTANCE
+    int32_t steps = MM_TO_STEPS(angle * DEGREES_TO_RADIANS * WHEEL_DISTANCE / 2);
+
+    start_motion(-steps, steps, speed, done);
+}
+
+void motion_drive(int16_t distance, uint16_t speed, motion_callback_t done)
+{
+    int32_t steps = MM_TO_STEPS((int32_t)distance);
+
+    start_motion(steps, steps, speed, done);
+}
+
+void motion_arc(int16_t radius, int16_t angle, uint16_t speed, motion_callback_t done)
+{
+    float arc = angle * DEGREES_TO_RADIANS;
+    //the inner wheel is on the side of the center of the circle
+    float half_distance = radius < 0 ? -WHEEL_DISTANCE / 2.0f : WHEEL_DISTANCE / 2.0f;
+
+    start_motion(MM_TO_STEPS(arc * (abs(radius) - half_distance)),
+                 MM_TO_STEPS(arc * (abs(radius) + half_distance)), speed, done);
+}
+
+bool motion_update(void)
+{
+    systime_t time = chVTGetSystemTime();
+    float period = ST2MS(time - motion.last_update) / 1000.0f;
+    int32_t lead_steps = 0, follow_steps = 0, remaining = 0;
+    int16_t lead_speed = 0, follow_speed = 0;
+    float braking_speed = 0;
+    bool left_leads = abs(motion.left_steps) >= abs(motion.right_steps);
+
+    if(!motion.running)
+    {
+        return false;
+    }
+    if(period > MAX_UPDATE_PERIOD / 1000.0f)
+    {
+        period = MAX_UPDATE_PERIOD / 1000.0f;
+    }
+    motion.last_update = time;
+
+    lead_steps = left_leads ? motion.left_steps : motion.right_steps;
+    follow_steps = left_leads ? motion.right_steps : motion.left_steps;
+    //steps left to the leading wheel, in the direction of the maneuver
+    remaining = left_leads ? motion.left_target - left_motor_get_pos()
+                            : motion.right_target - right_motor_get_pos();
+    if(lead_steps < 0)
+    {
+        remaining = -remaining;
+    }
+    //the speed of the other wheel is scaled by the steps of the leading one
+    if(lead_steps == 0 || remaining <= 0)
+    {
+        finish_motion();
+        return motion.running;
+    }
+
+    //accelerates up to the highest speed, and brakes to stop on the target
+    motion.speed += MAX_ACCELERATION * period;
+    if(motion.speed > motion.max_speed)
+    {
+        motion.speed = motion.max_speed;
+    }
+    braking_speed = sqrtf(2.0f * MAX_ACCELERATION * remaining);
+    if(braking_speed < MIN_SPEED)
+    {
+        braking_speed = MIN_SPEED;
+    }
+    if(motion.speed > braking_speed)
+    {
+        motion.speed = braking_speed;
+    }
+
+    //the other wheel keeps the ratio of the steps to the speed actually set, rounded so
+    //it does not fall behind on the arcs, the robot stays on its path
+    lead_speed = motion.speed;
+    follow_speed = lroundf((float)lead_speed * follow_steps / abs(lead_steps));
+    if(left_leads)
+    {
+        left_motor_set_speed(lead_steps < 0 ? -lead_speed : lead_speed);
+        right_motor_set_speed(follow_speed);
+    } else {
+        right_motor_set_speed(lead_steps < 0 ? -lead_speed : lead_speed);
+        left_motor_set_speed(follow_speed);
+    }
+    return true;
+}
+
+void motion_stop(void)
+{
+    motion.running = false;
+    left_motor_set_speed(0);
+    right_motor_set_speed(0);
+}
+
+bool motion_is_running(void)
+{
+    return motion.running;
+}
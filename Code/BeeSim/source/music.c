@@ -0,0 +1,195 @@
+/**
+ * @file	music.c
+ * @brief 	Plays tracks of notes on the speaker from its own thread, each note
+ * 			ending at an absolute deadline so the tempo does not drift.
+**/
+
+//C headers
+#include <stdint.h>
+
+//ChibiOS headers
+#include <ch.h>
+#include <hal.h>
+
+//E-puck 2 headers
+#include <audio/audio_thread.h>
+
+//Project headers
+#include "include/music.h"
+#include "include/tone_canceller.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+//notes used for the music playing
+#define NOTE_AS3 233
+#define NOTE_DS4 311
+#define NOTE_F4  349
+#define NOTE_GS4 415
+#define NOTE_AS4 466
+
+//duration of the shortest notes of Miel pops in ms
+#define CHANGE_NOTE 160
+
+//number of tracks waiting to be played
+#define MUSIC_QUEUE_SIZE 4
+
+//longest note a track can contain, in ms
+#define MAX_NOTE_DURATION UINT16_MAX
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+//const so the tracks stay in flash
+static const note_t miel_pops_notes[] = {
+	{NOTE_AS4, 2*CHANGE_NOTE-70},	{0, CHANGE_NOTE-30},	{NOTE_AS4, 2*CHANGE_NOTE},	{0, 2*CHANGE_NOTE},
+	{NOTE_GS4, CHANGE_NOTE-50},		{0, CHANGE_NOTE/2},		{NOTE_AS4, CHANGE_NOTE+50},	{0, CHANGE_NOTE/2},
+	{NOTE_F4, 3*CHANGE_NOTE},		{0, 2*CHANGE_NOTE},		{NOTE_DS4, CHANGE_NOTE-50},	{0, CHANGE_NOTE/2},
+	{NOTE_F4, CHANGE_NOTE+50},		{0, CHANGE_NOTE/2},		{NOTE_AS3, 3*CHANGE_NOTE},	{0, 12*CHANGE_NOTE}
+};
+
+const track_t miel_pops = {miel_pops_notes, sizeof(miel_pops_notes) / sizeof(miel_pops_notes[0]), true};
+
+static msg_t music_queue_buffer[MUSIC_QUEUE_SIZE];
+static MAILBOX_DECL(music_mb, music_queue_buffer, MUSIC_QUEUE_SIZE);
+
+static volatile bool stop_requested = false;
+static volatile bool playing = false;
+
+/*===========================================================================*/
+/* Semaphores.                                                               */
+/*===========================================================================*/
+
+//wakes the music thread up before the end of a note
+static BSEMAPHORE_DECL(music_sem, TRUE);
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               	Plays a note and tells the canceller which one.
+ * @param[in] frequency 	the frequency of the note in Hz, 0 for a rest
+**/
+static void play_note(uint16_t frequency)
+{
+	tone_canceller_set_note(frequency);
+	dac_play(frequency);
+}
+
+/**
+ * @brief               	Waits for the end of a note, or for the music to be stopped.
+ * @param[in] deadline  	the system time the note ends at
+**/
+static void wait_note_end(systime_t deadline)
+{
+	systime_t remaining = 0;
+
+	while(!stop_requested){
+		remaining = deadline - chVTGetSystemTime();
+		//a remaining time longer than any note means the deadline is already over
+		if(remaining == 0 || remaining > MS2ST(MAX_NOTE_DURATION))
+		{
+			return;
+		}
+		if(chBSemWaitTimeout(&music_sem, remaining) == MSG_TIMEOUT)
+		{
+			return;
+		}
+	}
+}
+
+/*===========================================================================*/
+/* File threads.                                                             */
+/*===========================================================================*/
+
+static THD_WORKING_AREA(waMusic, 256);
+static THD_FUNCTION(Music, arg)
+{
+    chRegSetThreadName(__FUNCTION__);
+    (void)arg;
+
+	msg_t msg = 0;
+	const track_t* track = NULL;
+	systime_t deadline = 0;
+
+    while(1){
+		//waits for a track to play, the stop requests before it are cleared in the same
+		//critical section: music_stop either empties the queue before the fetch or
+		//stops the track fetched, it cannot come in between and be lost
+		chSysLock();
+		chMBFetchS(&music_mb, &msg, TIME_INFINITE);
+		stop_requested = false;
+		chSysUnlock();
+		track = (const track_t*)(intptr_t)msg;
+
+		dac_start();
+		playing = true;
+		deadline = chVTGetSystemTime();
+
+		while(track != NULL){
+			for(uint8_t i = 0 ; i < track->length && !stop_requested ; i++){
+				play_note(track->notes[i].frequency);
+				deadline += MS2ST(track->notes[i].duration);
+				wait_note_end(deadline);
+			}
+			//a queued track follows without a gap, otherwise a looped track starts again.
+			//the track of a music_play coming after the stop is fetched at the top
+			chSysLock();
+			if(stop_requested)
+			{
+				track = NULL;
+			} else if(chMBFetchI(&music_mb, &msg) == MSG_OK) {
+				track = (const track_t*)(intptr_t)msg;
+			} else if(!track->loop) {
+				track = NULL;
+			}
+			chSysUnlock();
+		}
+
+		playing = false;
+		tone_canceller_set_note(0);
+		dac_stop();
+	}
+}
+
+/*===========================================================================*/
+/* File exported functions.                                                  */
+/*===========================================================================*/
+
+void music_play(const track_t* track)
+{
+	music_stop();
+	music_queue(track);
+}
+
+bool music_queue(const track_t* track)
+{
+	return chMBPost(&music_mb, (msg_t)(intptr_t)track, TIME_IMMEDIATE) == MSG_OK;
+}
+
+void music_stop(void)
+{
+	msg_t msg = 0;
+
+	//empties the queue and stops the current track atomically for the music thread
+	chSysLock();
+	while(chMBFetchI(&music_mb, &msg) == MSG_OK){
+	}
+	stop_requested = true;
+	chBSemSignalI(&music_sem);
+	chSchRescheduleS();
+	chSysUnlock();
+}
+
+bool music_is_playing(void)
+{
+	return playing;
+}
+
+void music_start(void)
+{
+	chThdCreateStatic(waMusic, sizeof(waMusic), NORMALPRIO+1, Music, NULL);
+}
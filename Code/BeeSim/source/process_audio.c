@@ -4,28 +4,76 @@
  * @note 	Inspired by TP5.
 **/
 
+//C headers
+#include <string.h>
+#include <math.h>
+
 //ChibiOS headers
 #include <ch.h>
 #include <hal.h>
 
 //E-puck 2 headers
 #include <audio/microphone.h>
-#include <audio/audio_thread.h>
 #include <arm_math.h>
-#include <arm_const_structs.h>
 
 //Project headers
 #include "include/process_audio.h"
+#include "include/goertzel.h"
+#include "include/mic_array.h"
+#include "include/tone_canceller.h"
+#include "include/music.h"
 
 
 /*===========================================================================*/
 /* File constants.                                                           */
 /*===========================================================================*/
 
-#define FFT_SIZE 1024
+//samples of each microphone analysed per spectrum, 64 ms which gives 15.625 Hz bins
+#define FRAME_SIZE			1024
+
+//the commands are below 500 Hz, the combined signal is low pass filtered and
+//decimated to 2 kHz before its analysis, which keeps the same bins with 8 times fewer samples
+#define DECIMATION_FACTOR	8
+#define FFT_SIZE			(FRAME_SIZE / DECIMATION_FACTOR)
+
+//windowed sinc low pass filter cut at 1 kHz, attenuating by 38.6 dB at 1.5 kHz. The signals aliased
+//on the bins the tones are found on come from above 1.55 kHz and are attenuated by 50 dB or more,
+//46 dB on the guard bins of the Goertzel filters
+#define DECIMATION_TAPS		48
+#define DECIMATION_CUTOFF	1000
+#define SAMPLING_FREQUENCY	16000
+
+//spectral analysis used to find the commands
+//the Goertzel filters only evaluate the bins around the commands frequencies
+//whereas the real FFTs compute the whole spectrum, in float or in Q15. On the decimated
+//signal the float FFT is the fastest, the filters run on every sample of it (test_decimation)
+#define SPECTRUM_FFT		0
+#define SPECTRUM_GOERTZEL	1
+#define SPECTRUM_FFT_Q15	2
+#ifndef SPECTRUM_METHOD
+#define SPECTRUM_METHOD		SPECTRUM_FFT
+#endif
+
+//the decimated frame has DECIMATION_FACTOR times fewer samples, this brings the magnitudes
+//back to the scale of a FRAME_SIZE frame the thresholds are set for
+#define MAGNITUDE_SCALE		DECIMATION_FACTOR
+
+//the Q15 real FFT scales its output down by FFT_SIZE
+#define Q15_MAGNITUDE_SCALE	(FFT_SIZE * MAGNITUDE_SCALE)
+
+//number of microphone blocks waiting for the audio thread, must be a power of 2
+#define AUDIO_RING_SIZE		4
+#define AUDIO_SLOT_SIZE		(NB_MICS * MIC_BLOCK_SIZE)
+
+//a spectrum of the last FFT_SIZE decimated samples is computed every HOP_SIZE of them (16 ms)
+//FFT_SIZE must be a multiple of HOP_SIZE, HOP_SIZE = FFT_SIZE disables the overlap
+#ifndef HOP_SIZE
+#define HOP_SIZE			32
+#endif
+#define NB_HOPS				(FFT_SIZE / HOP_SIZE)
 
 #define MIN_VALUE_THRESHOLD	10000 
-#define DETECTION_THRESHOLD 5
+#define DETECTION_THRESHOLD 5	//consecutive spectra, one every HOP_SIZE decimated samples
 
 #define MIN_FREQ		    10	//we don't analyze before this index to not use resources for nothing
 #define FREQ_MOVE		    27	//415Hz
@@ -33,25 +81,53 @@
 #define FREQ_STOP	        24	//370HZ
 #define MAX_FREQ		    30	//we don't analyze after this index to not use resources for nothing
 
-#define FREQ_MOVE_L		    	(FREQ_MOVE-1)
-#define FREQ_MOVE_H		   	 	(FREQ_MOVE+1)
-#define FREQ_COMMUNICATE_L		(FREQ_COMMUNICATE-1)
-#define FREQ_COMMUNICATE_H		(FREQ_COMMUNICATE+1)
-#define FREQ_STOP_L		        (FREQ_STOP-1)
-#define FREQ_STOP_H		        (FREQ_STOP+1)
+//tones the commands are made of: name, bin
+//a tone is recognised on its bin and on both neighbours
+#define TONE_LIST(X)						\
+	X(COMMUNICATE,	FREQ_COMMUNICATE)		\
+	X(STOP,			FREQ_STOP)				\
+	X(MOVE,			FREQ_MOVE)
+
+//commands: mode activated, tones to whistle in that order
+//adding a command only takes a new line here
+#ifndef COMMAND_LIST
+#define COMMAND_LIST(X)											\
+	X(MOVING_TO_BALLOON,		TONE_MOVE)						\
+	X(COMMUNICATING_WITH_PEERS,	TONE_COMMUNICATE)				\
+	X(STOPPED,					TONE_STOP)
+#endif
+
+#define MAX_SEQUENCE_LENGTH		3
+//maximum number of spectra between two tones of a sequence
+#define SEQUENCE_TIMEOUT		(4 * DETECTION_THRESHOLD)
+
+//3 bins per tone and a guard bin on each side, shared by close tones
+#define MAX_COMMAND_BINS		(5 * NB_TONES)
 
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
 
-//notes used for the music playing
-#define NOTE_AS3 233
-#define NOTE_DS4 311
-#define NOTE_F4  349
-#define NOTE_DS4 311
-#define NOTE_GS4 415
-#define NOTE_AS4 466
+#define TONE_ENUM(name, bin)		TONE_##name,
+typedef enum tone_t
+{
+	TONE_LIST(TONE_ENUM)
+	NB_TONES,
+	NO_TONE = NB_TONES
+} tone_t;
 
-#define NBR_NOTES 16
+typedef struct command_t
+{
+	mode_selected_t mode;
+	uint8_t length;
+	uint8_t tones[MAX_SEQUENCE_LENGTH];
+} command_t;
 
-#define CHANGE_NOTE 16
+/*===========================================================================*/
+/* Global variables.                                                         */
+/*===========================================================================*/
+
+EVENTSOURCE_DECL(command_event);
 
 /*===========================================================================*/
 /* File local variables.                                                     */
@@ -59,42 +135,134 @@
 
 static mode_selected_t mode_activated = STOPPED;
 
-//2 times FFT_SIZE because it contains complex numbers (real + imaginary)
-static float micFront_cmplx_input[2 * FFT_SIZE];
+#define TONE_BIN(name, bin)			bin,
+static const uint16_t tone_bins[NB_TONES] = {TONE_LIST(TONE_BIN)};
+
+#define COMMAND_ENTRY(mode, ...)	{mode, sizeof((uint8_t[]){__VA_ARGS__}), {__VA_ARGS__}},
+static const command_t commands[] = {COMMAND_LIST(COMMAND_ENTRY)};
+
+#define NB_COMMANDS					(sizeof(commands) / sizeof(commands[0]))
+
+//last tones heard, oldest first
+static uint8_t heard_tones[MAX_SEQUENCE_LENGTH];
+static uint8_t nb_heard_tones = 0;
+
+//single producer (microphone callback), single consumer (audio thread) ring buffer.
+//each side only writes its own index, so no lock is needed
+static int16_t audio_ring[AUDIO_RING_SIZE][AUDIO_SLOT_SIZE];
+static uint16_t audio_ring_length[AUDIO_RING_SIZE];
+static volatile uint32_t audio_ring_head = 0;
+static volatile uint32_t audio_ring_tail = 0;
+
+//blocks received from the microphones and blocks lost because the ring buffer was full
+static volatile uint32_t audio_blocks = 0;
+static volatile uint32_t audio_overruns = 0;
+
+//samples processed per microphone since the start, the timestamp of the audio pipeline
+static uint32_t processed_samples = 0;
+static uint32_t processed_spectra = 0;
+static uint32_t mode_change_sample = 0;
+static systime_t processing_time = 0;
+
+//direction of the operator when the last command was recognised
+static int16_t command_bearing = 0;
+static bool command_bearing_pending = false;
+//system time the last command was recognised at
+static systime_t mode_change_time = 0;
+
+//combined signal of the four microphones for the current block
+static float micArray_block[MIC_BLOCK_SIZE];
+
+//combined signal decimated to 2 kHz
+static float micArray_decimated[MIC_BLOCK_SIZE / DECIMATION_FACTOR];
+
+static float decimation_coeffs[DECIMATION_TAPS];
+static float decimation_state[DECIMATION_TAPS + MIC_BLOCK_SIZE - 1];
+static arm_fir_decimate_instance_f32 decimation_instance;
+
+//magnitudes indexed by bin, only the bins up to MAX_FREQ are computed
+static float micArray_output[MAX_FREQ + 1];
+
+#if SPECTRUM_METHOD == SPECTRUM_FFT
+//ring buffer of the last FFT_SIZE samples of the combined signal
+static float micArray_history[FFT_SIZE];
+
+//samples in chronological order, also used as scratch memory by the FFT
+static float micArray_input[FFT_SIZE];
 
-//array containing the computed magnitude of the complex numbers
-static float micFront_output[FFT_SIZE];
+//packed output of the real FFT, FFT_SIZE/2 complex numbers (real + imaginary)
+static float micArray_spectrum[FFT_SIZE];
 
-static uint16_t notes[NBR_NOTES] =  {NOTE_AS4, 0,  NOTE_AS4, 0, NOTE_GS4, 0, NOTE_AS4, 0, NOTE_F4, 0, NOTE_DS4, 0, NOTE_F4, 0, NOTE_AS3, 0};
-static uint16_t tempos[NBR_NOTES] = {2*CHANGE_NOTE-7, CHANGE_NOTE-3, 2*CHANGE_NOTE, 2*CHANGE_NOTE, CHANGE_NOTE-5, CHANGE_NOTE/2, CHANGE_NOTE+5,
-									 CHANGE_NOTE/2, 3*CHANGE_NOTE, 2*CHANGE_NOTE, CHANGE_NOTE-5, CHANGE_NOTE/2, CHANGE_NOTE+5, CHANGE_NOTE/2,
-									 3*CHANGE_NOTE, 12*CHANGE_NOTE};
+static arm_rfft_fast_instance_f32 rfft_instance;
+#elif SPECTRUM_METHOD == SPECTRUM_FFT_Q15
+//the microphone samples already are Q15 numbers, so is their average
+static q15_t micArray_history[FFT_SIZE];
 
-static uint16_t* note_pointer = &notes[0];
+static q15_t micArray_input[FFT_SIZE];
+
+//the Q15 real FFT writes the whole spectrum, FFT_SIZE complex numbers
+static q15_t micArray_spectrum[2 * FFT_SIZE];
+
+static arm_rfft_instance_q15 rfft_instance;
+#else
+//bins evaluated by the filters, the only ones sound_remote can trigger on and the guard bins
+//around them: the leakage of a louder peak outside the commands is higher on the guard bin
+//than on the bins of the tones, so find_tone rejects it as it does on the whole spectrum
+static uint16_t command_bins[MAX_COMMAND_BINS];
+static uint8_t nb_command_bins = 0;
+
+//one bank of filters per hop, each bank starting its frame HOP_SIZE samples after the previous one
+//so that one of them completes a frame every HOP_SIZE samples
+static goertzel_t command_filters[NB_HOPS][MAX_COMMAND_BINS];
+#endif
 
-static bool playing_music = false;
+
+/*===========================================================================*/
+/* Semaphores.                                                               */
+/*===========================================================================*/
+
+static BSEMAPHORE_DECL(audio_ready_sem, TRUE);
 
 /*===========================================================================*/
 /* File local functions.                                                     */
 /*===========================================================================*/
 
 /**
- * @brief               Processes the audio data to perform actions.
- * @param[in] data      the audio data to process
+ * @brief               Activates the mode of a recognised command and keeps
+ * 						the direction it came from.
+ * @param[in] mode      the mode to activate
 **/
-static void sound_remote(float* data){
-
-	float max_norm = MIN_VALUE_THRESHOLD;
-	int16_t max_norm_index = -1; 
-
-	//we count the number of times we detect the same frequency to avoid detecting noise
-	static uint8_t count_mode = 0;
-	//if the music is playing, we don't want to change the mode until it is finised
-	//to avoid detection errors
-	if(playing_music)
+static void command_recognised(mode_selected_t mode)
+{
+	//the notes are removed from the signal but some of them are close to the commands,
+	//so only STOP is trusted while the music is playing
+	if(music_is_playing() && mode != STOPPED)
 	{
 		return;
 	}
+	int16_t bearing = 0;
+	bool found = mic_array_get_bearing(&bearing);
+
+	mode_activated = mode;
+	mode_change_sample = processed_samples;
+	mode_change_time = chVTGetSystemTime();
+	//the controller reads and clears them together
+	chSysLock();
+	command_bearing = bearing;
+	command_bearing_pending = found;
+	chSysUnlock();
+	chEvtBroadcast(&command_event);
+}
+
+/**
+ * @brief               Finds the tone of the highest peak of the spectrum.
+ * @param[in] data      the magnitudes indexed by bin
+ * @return              the tone, NO_TONE if the peak is too low or on no tone
+**/
+static tone_t find_tone(const float* data)
+{
+	float max_norm = MIN_VALUE_THRESHOLD;
+	int16_t max_norm_index = -1; 
 
 	//search for the highest peak
 	for(uint16_t i = MIN_FREQ ; i <= MAX_FREQ ; i++){
@@ -104,138 +272,407 @@ static void sound_remote(float* data){
 		}
 	}
 
-	//move
-	if(max_norm_index >= FREQ_MOVE_L && max_norm_index <= FREQ_MOVE_H){
-		++count_mode;
-		if(count_mode >= DETECTION_THRESHOLD)
-		{
-			count_mode = 0;
-			mode_activated = MOVING_TO_BALLOON;
-			
+	for(uint8_t tone = 0 ; tone < NB_TONES ; tone++){
+		if(max_norm_index >= tone_bins[tone] - 1 && max_norm_index <= tone_bins[tone] + 1){
+			return tone;
 		}
 	}
-	//communicate
-	else if(max_norm_index >= FREQ_COMMUNICATE_L && max_norm_index <= FREQ_COMMUNICATE_H){
-		++count_mode;
-		if(count_mode >= DETECTION_THRESHOLD)
-		{
-			count_mode = 0;
-			mode_activated = COMMUNICATING_WITH_PEERS;
+	return NO_TONE;
+}
 
+/**
+ * @brief               Removes the oldest tone heard.
+ * @return              none
+**/
+static void drop_oldest_tone(void)
+{
+	--nb_heard_tones;
+	for(uint8_t i = 0 ; i < nb_heard_tones ; i++){
+		heard_tones[i] = heard_tones[i + 1];
+	}
+}
+
+/**
+ * @brief               Compares the last tones heard with the beginning of a command.
+ * @param[in] command   the command to compare with
+ * @return              true if the tones heard start the command
+**/
+static bool sequence_starts(const command_t* command)
+{
+	if(nb_heard_tones > command->length)
+	{
+		return false;
+	}
+	for(uint8_t i = 0 ; i < nb_heard_tones ; i++){
+		if(heard_tones[i] != command->tones[i]){
+			return false;
 		}
 	}
-	//stop
-	else if(max_norm_index >= FREQ_STOP_L && max_norm_index <= FREQ_STOP_H){
-		++count_mode;
-		if(count_mode >= DETECTION_THRESHOLD)
+	return true;
+}
+
+/**
+ * @brief               Activates the command matching the tones heard, waiting
+ * 						for the end of longer commands starting the same way.
+ * @param[in] timeout   true if no tone can follow anymore
+ * @return              none
+**/
+static void match_sequence(bool timeout)
+{
+	const command_t* complete = NULL;
+	bool longer = false;
+
+	//drops the oldest tones until the sequence starts a command
+	while(nb_heard_tones > 0){
+		for(uint8_t i = 0 ; i < NB_COMMANDS ; i++){
+			if(sequence_starts(&commands[i])){
+				if(commands[i].length == nb_heard_tones){
+					complete = &commands[i];
+				} else {
+					longer = true;
+				}
+			}
+		}
+		if(complete || longer)
 		{
-			count_mode = 0;
-			mode_activated = STOPPED;
+			break;
 		}
-	} else {
-		count_mode = 0;
+		drop_oldest_tone();
+	}
+
+	if(complete && (!longer || timeout))
+	{
+		command_recognised(complete->mode);
+		nb_heard_tones = 0;
+	} else if(timeout) {
+		nb_heard_tones = 0;
 	}
 }
 
 /**
- * @brief               Computes the FFT of the audio data.
- * @param[in] size      the size of the FFT
+ * @brief               Processes the audio data to perform actions.
  * @param[in] data      the audio data to process
+**/
+static void sound_remote(float* data){
+
+	tone_t tone = find_tone(data);
+
+	++processed_spectra;
+
+	//we count the number of times we detect the same tone to avoid detecting noise
+	static uint8_t count_tone = 0;
+	static tone_t last_tone = NO_TONE;
+	//spectra since the last tone heard, to end the sequences
+	static uint16_t count_silence = 0;
+	if(tone != last_tone)
+	{
+		last_tone = tone;
+		count_tone = 0;
+	}
+	//a held tone is heard once, it needs to stop before being heard again
+	if(tone != NO_TONE && count_tone < DETECTION_THRESHOLD)
+	{
+		++count_tone;
+		if(count_tone >= DETECTION_THRESHOLD)
+		{
+			if(nb_heard_tones >= MAX_SEQUENCE_LENGTH)
+			{
+				drop_oldest_tone();
+			}
+			heard_tones[nb_heard_tones] = tone;
+			++nb_heard_tones;
+			count_silence = 0;
+			match_sequence(false);
+			return;
+		}
+	}
+
+	//the sequence times out once its last tone stopped
+	if(nb_heard_tones > 0)
+	{
+		if(count_tone >= DETECTION_THRESHOLD)
+		{
+			count_silence = 0;
+		} else if(++count_silence > SEQUENCE_TIMEOUT) {
+			match_sequence(true);
+		}
+	}
+}
+
+#if SPECTRUM_METHOD == SPECTRUM_FFT || SPECTRUM_METHOD == SPECTRUM_FFT_Q15
+/**
+ * @brief               Computes the magnitudes of the bins up to MAX_FREQ
+ * 						with a real FFT of the last FFT_SIZE samples.
+ * @param[in] oldest    the index of the oldest sample in micArray_history
+ * @return              none
  **/
-static void doFFT_optimized(uint16_t size, float* complex_buffer){
-	if(size == 1024)
-		arm_cfft_f32(&arm_cfft_sR_f32_len1024, complex_buffer, 0, 1);
-	
+static void compute_spectrum(uint16_t oldest)
+{
+#if SPECTRUM_METHOD == SPECTRUM_FFT
+	//unrolls the ring buffer, the FFT overwrites its input
+	arm_copy_f32(&micArray_history[oldest], micArray_input, FFT_SIZE - oldest);
+	arm_copy_f32(micArray_history, &micArray_input[FFT_SIZE - oldest], oldest);
+
+	arm_rfft_fast_f32(&rfft_instance, micArray_input, micArray_spectrum, 0);
+	//the first complex number packs the DC and Nyquist bins, both unused
+	arm_cmplx_mag_f32(micArray_spectrum, micArray_output, MAX_FREQ + 1);
+	arm_scale_f32(micArray_output, MAGNITUDE_SCALE, micArray_output, MAX_FREQ + 1);
+#else
+	float re = 0, im = 0;
+
+	arm_copy_q15(&micArray_history[oldest], micArray_input, FFT_SIZE - oldest);
+	arm_copy_q15(micArray_history, &micArray_input[FFT_SIZE - oldest], oldest);
+
+	arm_rfft_q15(&rfft_instance, micArray_input, micArray_spectrum);
+	//arm_cmplx_mag_q15 truncates the squares to 15 bits, which zeroes the magnitudes below
+	//362 LSB when the threshold is 10 LSB, so the few magnitudes needed are computed in float
+	for(uint16_t i = MIN_FREQ ; i <= MAX_FREQ ; i++){
+		re = micArray_spectrum[2 * i];
+		im = micArray_spectrum[2 * i + 1];
+		arm_sqrt_f32(re * re + im * im, &micArray_output[i]);
+		micArray_output[i] *= Q15_MAGNITUDE_SCALE;
+	}
+#endif
 }
 
 /**
- * @brief               	Processes the audio data to perform actions.
- * @param[in] data      	the audio data to process
- * @param[in] num_samples 	the number of samples to process
+ * @brief               	Adds a block of the combined signal to the ring buffer
+ * 							and processes a spectrum every HOP_SIZE samples.
+ * @param[in] block      	the samples to add
+ * @param[in] length    	the number of samples
 **/
-static void process_audio_data(int16_t* data, uint16_t num_samples)
+static void process_block(const float* block, uint16_t length)
 {
+	//position of the next sample in the ring buffer, thus of the oldest one
+	static uint16_t write_index = 0;
 	static uint16_t nb_samples = 0;
 
-	//loop to fill the buffers
-	for(uint16_t i = 0 ; i < num_samples ; i+=4){
-		//construct an array of complex numbers. Put 0 to the imaginary part
-		micFront_cmplx_input[nb_samples] = (float)data[i + MIC_FRONT];
-		nb_samples++;
-
-		micFront_cmplx_input[nb_samples] = 0;
+	for(uint16_t i = 0 ; i < length ; i++){
+#if SPECTRUM_METHOD == SPECTRUM_FFT_Q15
+		//the low pass filter can overshoot the full scale of the microphones
+		micArray_history[write_index] = __SSAT(lroundf(block[i]), 16);
+#else
+		micArray_history[write_index] = block[i];
+#endif
+		write_index++;
+		if(write_index >= FFT_SIZE){
+			write_index = 0;
+		}
 		nb_samples++;
+		processed_samples += DECIMATION_FACTOR;
 
-		//stop when buffer is full
-		if(nb_samples >= (2 * FFT_SIZE)){
-			break;
+		if(nb_samples >= HOP_SIZE){
+			compute_spectrum(write_index);
+			nb_samples = 0;
+			//process the output to perform actions
+			sound_remote(micArray_output);
 		}
 	}
+}
 
-	if(nb_samples >= (2 * FFT_SIZE)){
-        //FFT procession
-        //this FFT function stores the results in the input buffer given.
-		doFFT_optimized(FFT_SIZE, micFront_cmplx_input);
+#else
+/**
+ * @brief               	Lists the bins of the tones and their guard bins in increasing
+ * 							order, without duplicates, and initializes their filters.
+ * @return              	none
+**/
+static void init_command_filters(void)
+{
+	bool evaluated[MAX_FREQ + 1] = {false};
+
+	for(uint8_t tone = 0 ; tone < NB_TONES ; tone++){
+		for(uint16_t bin = tone_bins[tone] - 2 ; bin <= tone_bins[tone] + 2 ; bin++){
+			//find_tone ignores the bins outside MIN_FREQ..MAX_FREQ
+			if(bin >= MIN_FREQ && bin <= MAX_FREQ)
+			{
+				evaluated[bin] = true;
+			}
+		}
+	}
+	nb_command_bins = 0;
+	for(uint16_t bin = MIN_FREQ ; bin <= MAX_FREQ ; bin++){
+		if(evaluated[bin])
+		{
+			command_bins[nb_command_bins] = bin;
+			nb_command_bins++;
+		}
+	}
 
-		//magnitude processing
-        //computes the magnitude of the complex numbers and stores them 
-        //in a buffer of FFT_SIZE because it only contains real numbers.
-		arm_cmplx_mag_f32(micFront_cmplx_input, micFront_output, FFT_SIZE);
+	for(uint8_t bank = 0 ; bank < NB_HOPS ; bank++){
+		for(uint8_t i = 0 ; i < nb_command_bins ; i++){
+			goertzel_init(&command_filters[bank][i], command_bins[i], FFT_SIZE);
+		}
+	}
+}
 
-		nb_samples = 0;
-        //process the output to perform actions
-		sound_remote(micFront_output);
+/**
+ * @brief               	Feeds samples to every command filter.
+ * @param[in] block      	the samples to process
+ * @param[in] length    	the number of samples
+**/
+static void feed_command_filters(const float* block, uint16_t length)
+{
+	for(uint8_t bank = 0 ; bank < NB_HOPS ; bank++){
+		for(uint8_t i = 0 ; i < nb_command_bins ; i++){
+			goertzel_process(&command_filters[bank][i], block, length);
+		}
 	}
 }
 
-/*===========================================================================*/
-/* File exported functions.                                                  */
-/*===========================================================================*/
+/**
+ * @brief               	Feeds a block of the combined signal to the filters
+ * 							and processes a spectrum every HOP_SIZE samples.
+ * @param[in] block      	the samples to process
+ * @param[in] length    	the number of samples
+**/
+static void process_block(const float* block, uint16_t length)
+{
+	static uint16_t nb_samples = 0;
+	//bank completing its frame at the end of the current hop
+	//at start up every bank begins together, so the first frames are shorter
+	static uint8_t bank = 0;
+	uint16_t done = 0, chunk = 0;
+
+	while(done < length){
+		//the filters are fed by chunks to keep their state in registers
+		chunk = length - done;
+		if(chunk > HOP_SIZE - nb_samples)
+		{
+			chunk = HOP_SIZE - nb_samples;
+		}
+		feed_command_filters(&block[done], chunk);
+		done += chunk;
+		nb_samples += chunk;
+		processed_samples += DECIMATION_FACTOR * chunk;
+
+		//the completed frame has the same length as the FFT, so the magnitudes match
+		if(nb_samples >= HOP_SIZE){
+			for(uint8_t j = 0 ; j < nb_command_bins ; j++){
+				micArray_output[command_bins[j]] = MAGNITUDE_SCALE * goertzel_magnitude(&command_filters[bank][j]);
+				//the bank starts its next frame right away
+				goertzel_reset(&command_filters[bank][j]);
+			}
+			bank++;
+			if(bank >= NB_HOPS){
+				bank = 0;
+			}
+			nb_samples = 0;
+			//process the output to perform actions
+			sound_remote(micArray_output);
+		}
+	}
+}
+#endif
 
-void play_music(bool end_music)
+/**
+ * @brief               	Computes the low pass filter of the decimation, a sinc
+ * 							windowed by a Hamming window with a gain of 1.
+ * @return              	none
+**/
+static void init_decimation(void)
 {
-	static bool start_music = true;
-    static uint16_t tempo_notes = 0;
-    static uint8_t count_pointer = 0;
+	float x = 0, sum = 0;
 
-	if(start_music)
-	{
-		//starts DAC once
-		dac_start();
-		playing_music = true;
-		start_music = false;
+	for(uint16_t n = 0 ; n < DECIMATION_TAPS ; n++){
+		x = 2.0f * DECIMATION_CUTOFF / SAMPLING_FREQUENCY * (n - (DECIMATION_TAPS - 1) / 2.0f);
+		decimation_coeffs[n] = (0.54f - 0.46f * cosf(2 * PI * n / (DECIMATION_TAPS - 1)))
+								* (x == 0 ? 1 : sinf(PI * x) / (PI * x));
+		sum += decimation_coeffs[n];
 	}
-	if(!end_music)
-	{
-		++tempo_notes;
-		if(count_pointer == 0)
+	arm_scale_f32(decimation_coeffs, 1 / sum, decimation_coeffs, DECIMATION_TAPS);
+
+	arm_fir_decimate_init_f32(&decimation_instance, DECIMATION_TAPS, DECIMATION_FACTOR,
+								decimation_coeffs, decimation_state, MIC_BLOCK_SIZE);
+}
+
+/**
+ * @brief               	Processes the audio data to perform actions.
+ * @param[in] data      	the audio data to process, the four microphones interleaved
+ * @param[in] num_samples 	the number of samples to process
+**/
+static void process_audio_data(int16_t* data, uint16_t num_samples)
+{
+	uint16_t length = 0;
+
+	//the microphones are combined by blocks of at most MIC_BLOCK_SIZE samples each
+	for(uint16_t offset = 0 ; offset < num_samples ; offset += NB_MICS * MIC_BLOCK_SIZE){
+		length = mic_array_process(&data[offset], num_samples - offset, micArray_block);
+		//removes the music the robot is playing
+		tone_canceller_process(micArray_block, length);
+		//the blocks of the microphones are multiples of DECIMATION_FACTOR samples
+		arm_fir_decimate_f32(&decimation_instance, micArray_block, micArray_decimated, length);
+		process_block(micArray_decimated, length / DECIMATION_FACTOR);
+	}
+}
+
+/**
+ * @brief               	Microphone callback, only copies the samples to the ring buffer
+ * 							to give the microphones back as fast as possible.
+ * @param[in] data      	the audio data, the four microphones interleaved
+ * @param[in] num_samples 	the number of samples
+**/
+static void queue_audio_data(int16_t* data, uint16_t num_samples)
+{
+	uint32_t slot = 0;
+	uint16_t length = 0;
+
+	for(uint16_t offset = 0 ; offset < num_samples ; offset += AUDIO_SLOT_SIZE){
+		audio_blocks++;
+		//the audio thread is late, the block is lost
+		if(audio_ring_head - audio_ring_tail >= AUDIO_RING_SIZE)
 		{
-			dac_play(*note_pointer);
+			audio_overruns++;
+			continue;
 		}
-		//play the notes with the right tempo
-		if(tempo_notes % tempos[count_pointer] == 0)
+		length = num_samples - offset;
+		if(length > AUDIO_SLOT_SIZE)
 		{
-			++note_pointer;
-			dac_play(*note_pointer);
-			++count_pointer;
-			tempo_notes = 0;
+			length = AUDIO_SLOT_SIZE;
 		}
-		if (count_pointer % NBR_NOTES == 0)
-		{
-			count_pointer = 0;
-			note_pointer = &notes[0];
-			
+		slot = audio_ring_head & (AUDIO_RING_SIZE - 1);
+		memcpy(audio_ring[slot], &data[offset], length * sizeof(int16_t));
+		audio_ring_length[slot] = length;
+		//the block must be written before it is published
+		__DMB();
+		audio_ring_head++;
+	}
+	chBSemSignal(&audio_ready_sem);
+}
+
+/*===========================================================================*/
+/* File threads.                                                             */
+/*===========================================================================*/
+
+static THD_WORKING_AREA(waProcessAudio, 1024);
+static THD_FUNCTION(ProcessAudio, arg) 
+{
+    chRegSetThreadName(__FUNCTION__);
+    (void)arg;
+
+	uint32_t slot = 0;
+	systime_t start = 0;
+
+    while(1){
+		//waits until blocks have been queued
+		chBSemWait(&audio_ready_sem);
+
+		//processes every block published since the last wake up
+		while(audio_ring_tail != audio_ring_head){
+			slot = audio_ring_tail & (AUDIO_RING_SIZE - 1);
+			start = chVTGetSystemTime();
+			process_audio_data(audio_ring[slot], audio_ring_length[slot]);
+			processing_time += chVTGetSystemTime() - start;
+			//the slot is given back only once processed
+			__DMB();
+			audio_ring_tail++;
 		}
-	} else {
-		note_pointer = &notes[0];
-		tempo_notes = 0;
-		count_pointer = 0;
-		start_music = true;
-		playing_music = false;
-		dac_stop();
 	}
 }
 
+/*===========================================================================*/
+/* File exported functions.                                                  */
+/*===========================================================================*/
+
 mode_selected_t get_mode(void)
 {
 	return mode_activated;
@@ -246,9 +683,45 @@ void set_mode(mode_selected_t mode)
 	mode_activated = mode;
 }
 
+bool get_command_bearing(int16_t* bearing)
+{
+	bool pending = false;
+
+	//a command recognised meanwhile is kept for the next call
+	chSysLock();
+	pending = command_bearing_pending;
+	*bearing = command_bearing;
+	command_bearing_pending = false;
+	chSysUnlock();
+	return pending;
+}
+
+void get_audio_stats(audio_stats_t* stats)
+{
+	stats->blocks = audio_blocks;
+	stats->overruns = audio_overruns;
+	stats->samples = processed_samples;
+	stats->spectra = processed_spectra;
+	stats->mode_change_sample = mode_change_sample;
+	stats->mode_change_time = mode_change_time;
+	stats->processing_time_ms = ST2MS(processing_time);
+}
+
 void process_audio_start(void)
 {
+	//the direction is estimated on the central bin of each tone
+	mic_array_init(tone_bins, NB_TONES, FRAME_SIZE, MIN_VALUE_THRESHOLD);
+	init_decimation();
+#if SPECTRUM_METHOD == SPECTRUM_FFT
+	arm_rfft_fast_init_f32(&rfft_instance, FFT_SIZE);
+#elif SPECTRUM_METHOD == SPECTRUM_FFT_Q15
+	arm_rfft_init_q15(&rfft_instance, FFT_SIZE, 0, 1);
+#else
+	init_command_filters();
+#endif
+	//starts the thread processing the queued blocks
+	chThdCreateStatic(waProcessAudio, sizeof(waProcessAudio), NORMALPRIO, ProcessAudio, NULL);
     //starts the microphones processing thread.
     //it calls the callback given in parameter when samples are ready
-    mic_start(&process_audio_data);
+    mic_start(&queue_audio_data);
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 
 //C headers
 #include <stdlib.h>
+#include <math.h>
 
 //ChibiOS headers
 #include <ch.h>
@@ -14,10 +15,18 @@
 // E-puck 2 headers
 #include <camera/dcmi_camera.h>
 #include <camera/po8030.h>
+#include <motors.h>
 
 //Project headers
+#include "main.h"
 #include "include/process_image.h"
 #include "include/process_audio.h"
+#include "include/TOF_sensor.h"
+#include "include/image_kernels.h"
+#include "include/color_table.h"
+#include "include/range.h"
+#include "include/camera_exposure.h"
+#include "include/motion.h"
 
 /*===========================================================================*/
 /* File constants.                                                           */
@@ -26,157 +35,792 @@
 //lines used for the detection, inside [0...478]
 #define USED_LINE			    200
 
+//each band is made of two captured lines averaged to remove the noise of the sensor
+//more bands, spread around USED_LINE, give the height of the balloon
+#ifndef NB_BANDS
+#define NB_BANDS                1
+#endif
+#define MAIN_BAND               (NB_BANDS / 2)
+//rows between two captured lines, 1, 2 or 4
+#define LINE_SPACING            1
+#define NB_LINES                (2 * NB_BANDS)
+#define BAND_HEIGHT             (2 * LINE_SPACING)
+#define FIRST_LINE              (USED_LINE - MAIN_BAND * BAND_HEIGHT)
+//bytes of a captured line, 2 per pixel in RGB565
+#define LINE_SIZE               (2 * IMAGE_BUFFER_SIZE)
+
+#if LINE_SPACING == 4
+#define LINE_SUBSAMPLING        SUBSAMPLING_X4
+#elif LINE_SPACING == 2
+#define LINE_SUBSAMPLING        SUBSAMPLING_X2
+#else
+#define LINE_SUBSAMPLING        SUBSAMPLING_X1
+#endif
+
+//the balloons are found from the steps of the green channel, darker balloons being flowers,
+//or from the colors classified by color_table, whose hue ranges were never checked on the balloons
+#define DETECT_GREEN_EDGES      0
+#define DETECT_COLOR_CLASSES    1
+#ifndef DETECTION_METHOD
+#define DETECTION_METHOD        DETECT_GREEN_EDGES
+#endif
+
+//pixels of other classes allowed inside a balloon
+#define MAX_CLASS_GAP           4
+
+//width and center of a balloon from its edges, the green edges are found WIDTH_SLOPE pixels early
+#if DETECTION_METHOD == DETECT_GREEN_EDGES
+#define BALLOON_WIDTH(begin, end)   ((end) - (begin) - WIDTH_SLOPE)
+#define BALLOON_CENTER(begin, end)  (((begin) + WIDTH_SLOPE + (end) - 1) / 2.0f)
+#else
+#define BALLOON_WIDTH(begin, end)   ((end) - (begin) + 1)
+#define BALLOON_CENTER(begin, end)  (((begin) + (end)) / 2.0f)
+#endif
+
+//the table is generated with the classes of balloon_type_t
+_Static_assert(NB_COLOR_CLASSES == NB_BALLOON_TYPES, "color_table.h does not match balloon_type_t, run tools/color_table.py");
+
+//index of a RGB565 pixel in color_table, the 4 MSbits of each channel
+#define COLOR_INDEX(pixel)      ((((pixel)[0] & 0xF0) << 4) | (((pixel)[0] & 0x07) << 5) \
+                                | (((pixel)[1] & 0x80) >> 3) | (((pixel)[1] >> 1) & 0x0F))
+
+//the camera writes the frames alternately in two buffers, the buffer of a frame is
+//written again two periods after its end, minus the time the lines take
+#define NB_DCMI_BUFFERS         2
+//the DMA writes the lines of a frame within this time before the end of the frame
+#define CAPTURE_WINDOW          MS2ST(2)
+//the processing takes the newest frame, a frame still waiting is replaced by the next one
+#define FRAME_QUEUE_SIZE        1
+//descriptors of the queued frame and of the one being processed
+#define FRAME_POOL_SIZE         (FRAME_QUEUE_SIZE + 1)
+
 //image processing constants
 #define DETECTION_THRESHOLD     20
 #define WIDTH_SLOPE		        30
 #define MIN_BALLOON_WIDTH		50
 #define TOO_CLOSE_TO_BALLOON    400
-#define COEFF_RANGE_CAPTURE     1
+
+//balloons kept per line
+#define MAX_CANDIDATES          8
+
+//policies choosing the balloon to move to among the ones of the line
+#define SELECT_FIRST            0   //the leftmost one
+#define SELECT_WIDEST           1   //the closest one
+#define SELECT_CENTERED         2   //the one needing the smallest rotation
+#define SELECT_FLOWERS_FIRST    3   //the closest flower, the closest ennemy if there is none
+#define SELECTION_POLICY        SELECT_WIDEST
+
+//alpha-beta tracker of the target: gains of the position and width corrections,
+//and of their rate of change per frame
+#define TRACK_ALPHA             0.5f
+#define TRACK_BETA              0.1f
+//frames the track is predicted for without the balloon being found
+#define TRACK_MAX_MISSES        5
+//the track is lost if no frame is processed for this long, in ms
+#define TRACK_TIMEOUT           500
+//pixels searched on each side of the predicted balloon, for each frame missed
+#define TRACK_MARGIN            40
+
+//the range model is calibrated with the TOF sensor while the balloon is in front of it,
+//closer than CALIBRATION_RANGE in mm and less than CALIBRATION_CENTERING pixels off center
+#define CALIBRATION_RANGE       600
+#define CALIBRATION_CENTERING   30
+
+//rotation of the robot for one step of difference between the wheels, in radians
+#define RADIANS_PER_STEP        ((float)WHEEL_PERIMETER / (STEPS_PER_TURN * WHEEL_DISTANCE))
+
+//the gradient is halved, the averaged green values are even so no edge is lost
+#define GRADIENT_THRESHOLD      (DETECTION_THRESHOLD / 2)
+#define GRADIENT_SIZE           (IMAGE_BUFFER_SIZE - WIDTH_SLOPE)
 
 /*===========================================================================*/
-/* File local variables.                                                     */
+/* File data structures and types.                                           */
 /*===========================================================================*/
 
-static bool capture_image = true;
-static uint16_t balloon_position = IMAGE_BUFFER_SIZE/2;
-static uint8_t balloon_type = NONE;
+//balloon found on the line, its edges included
+typedef struct candidate_t
+{
+    uint16_t begin;         //first pixel of the opening edge
+    uint16_t end;           //last pixel of the closing edge
+    balloon_type_t type;
+    uint8_t contrast;       //green step of the weakest edge, or share of the pixels
+                            //of the class out of 255 for the colors
+} candidate_t;
+
+//frame captured in the DCMI buffers
+typedef struct frame_t
+{
+    const uint8_t* data;    //the lines in RGB565, in the DCMI buffer
+    uint32_t seq;           //number of the frame since the start
+    systime_t timestamp;    //system time at the end of the capture
+    int32_t left_steps;     //positions of the motors at the end of the capture
+    int32_t right_steps;
+} frame_t;
+
+//target followed from frame to frame, in pixels and pixels per frame
+typedef struct balloon_track_t
+{
+    float position;
+    float velocity;         //besides the motion from the rotation of the robot
+    float width;
+    float growth;           //change of the width per frame
+    balloon_type_t type;
+    uint32_t seq;           //last frame the track was updated with
+    systime_t timestamp;
+    int32_t left_steps;     //positions of the motors at the end of the capture of that frame
+    int32_t right_steps;
+    uint8_t misses;         //frames the balloon was not found in since the last one
+    bool active;
+} balloon_track_t;
 
 /*===========================================================================*/
-/* Semaphores.                                                               */
+/* Global variables.                                                         */
 /*===========================================================================*/
 
-static BSEMAPHORE_DECL(image_ready_sem, TRUE);
+EVENTSOURCE_DECL(balloon_event);
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static bool capture_image = true;
+//detection of the last frame, only written by the processing and then published
+static balloon_snapshot_t balloon = {.position = IMAGE_BUFFER_SIZE/2, .type = NONE};
+
+static messagebus_topic_t balloon_topic;
+static MUTEX_DECL(balloon_topic_lock);
+static CONDVAR_DECL(balloon_topic_condvar);
+static balloon_snapshot_t balloon_topic_value;
+//distances of the TOF sensor the range model is calibrated with
+static messagebus_topic_t* tof_topic = NULL;
+
+#if DETECTION_METHOD == DETECT_GREEN_EDGES
+//green values of a band, of its second line, and their differences over WIDTH_SLOPE pixels
+static uint8_t image[IMAGE_BUFFER_SIZE];
+static uint8_t second_line[IMAGE_BUFFER_SIZE];
+static int8_t gradient[GRADIENT_SIZE];
+#else
+//class of each pixel of a band
+static uint8_t image[IMAGE_BUFFER_SIZE];
+#endif
+
+//balloons of each band of the last image, from left to right
+static candidate_t candidates[NB_BANDS][MAX_CANDIDATES];
+static uint8_t nb_candidates[NB_BANDS] = {0};
+
+//frames captured, also the sequence number of the next one
+static volatile uint32_t frames_captured = 0;
+//end of the last frame captured, and the shortest time between two frames, 0 until measured
+static systime_t last_frame_end = 0;
+static volatile systime_t min_frame_period = 0;
+static uint32_t frames_processed = 0;
+//frames removed from the queue by newer ones, and frames overwritten before the end of their processing
+//or skipped as they would be
+static uint32_t frames_replaced = 0;
+static uint32_t frames_overwritten = 0;
+//time the last frame processed took, from its fetch to its detection
+static systime_t frame_processing_time = 0;
+//pixels searched, per band
+static uint32_t pixels_processed = 0;
+//time between the end of the capture of a frame and the detection, in system ticks
+static systime_t last_latency = 0;
+static systime_t max_latency = 0;
+
+static balloon_track_t track = {0};
+
+//the frames are passed to the processing thread by pointers to their descriptor
+static frame_t frame_pool[FRAME_POOL_SIZE];
+static msg_t frame_queue_buffer[FRAME_QUEUE_SIZE];
+static MAILBOX_DECL(frame_mb, frame_queue_buffer, FRAME_QUEUE_SIZE);
 
 /*===========================================================================*/
 /* File local functions.                                                     */
 /*===========================================================================*/
 
+#if DETECTION_METHOD == DETECT_GREEN_EDGES
 /**
- * @brief               Detects if the beginning of a balloon is in the image.
- * @param[in]   image   the image to process
- * @param[in]   i       the index of the pixel to process
- * @return              i, the index of the beginning of the balloon
+ * @brief               Follows an edge of the line and measures its contrast.
+ * @param[in]   gradient the gradient of the image to process
+ * @param[in]   i       the index of the first pixel of the edge
+ * @param[in]   last    the index to stop at, excluded
+ * @param[out]  contrast the highest green step of the edge
+ * @return              the index of the first pixel after the edge
 **/
-static uint16_t detect_beginning(uint8_t* image, uint16_t i)
+static uint16_t follow_edge(const int8_t* gradient, uint16_t i, uint16_t last, uint8_t* contrast)
 {
-	if(abs(image[i] - image[i+WIDTH_SLOPE]) > DETECTION_THRESHOLD)
-	{
-		//we check if we have detected a flower or an ennemy
-		if(image[i] > image[i+WIDTH_SLOPE])
-		{
-			balloon_type = FLOWER;
-			return i;
-		} else if (image[i] < image[i+WIDTH_SLOPE]){
-			balloon_type = ENNEMY;
-			return i;
-		}
-	}
-	return 0;
+    bool rising = gradient[i] < 0;
+    uint8_t step = 0;
+
+    *contrast = 0;
+    while(i < last && abs(gradient[i]) > GRADIENT_THRESHOLD && (gradient[i] < 0) == rising)
+    {
+        //the gradient is half of the green step
+        step = 2 * abs(gradient[i]);
+        if(step > *contrast)
+        {
+            *contrast = step;
+        }
+        i++;
+    }
+    return i;
 }
 
 /**
- * @brief            	Detects if the ending of a balloon is in the image.
- * @param[in]   image   the image to process
- * @param[in]   i       the index of the pixel to process
- * @return              i, the index of the ending of the balloon
+ * @brief               Finds every balloon of the line in a single pass. A balloon
+ *                      opens on an edge and closes on the next edge of opposite sign.
+ * @param[in]   gradient the gradient of the image to process
+ * @param[in]   first   the first index of the gradient to search
+ * @param[in]   last    the index to stop the search at, excluded
+ * @param[out]  found   the balloons found, from left to right
+ * @return              the number of balloons found, at most MAX_CANDIDATES
 **/
-static uint16_t detect_ending(uint8_t* image, uint16_t i)
+static uint8_t find_candidates(const int8_t* gradient, uint16_t first, uint16_t last, candidate_t* found)
 {
-	//checking if we previously have detected a flower or an ennemy
-	if(balloon_type == FLOWER)
-	{
-		if(abs(image[i] - image[i-WIDTH_SLOPE]) > DETECTION_THRESHOLD && image[i-WIDTH_SLOPE] < image[i])
-		{
-			return i;
-		}
-	} else if (balloon_type == ENNEMY){
-		if(abs(image[i] - image[i-WIDTH_SLOPE]) > DETECTION_THRESHOLD && image[i-WIDTH_SLOPE] > image[i])
-		{
-			return i;
-		}
-	}
-	return 0;
+    uint8_t nb_found = 0, contrast = 0, open_contrast = 0;
+    uint16_t i = first, begin = 0, end = 0;
+    balloon_type_t type = NONE;
+
+    while(nb_found < MAX_CANDIDATES)
+    {
+        //the flat parts of the line are skipped four pixels at a time
+        i = image_find_edge(gradient, i, last, GRADIENT_THRESHOLD);
+        if(i >= last)
+        {
+            break;
+        }
+        //a darker balloon is a flower, a lighter one an ennemy
+        if(type == NONE)
+        {
+            begin = i;
+            type = gradient[i] > 0 ? FLOWER : ENNEMY;
+            i = follow_edge(gradient, i, last, &open_contrast);
+        } else if((gradient[i] > 0) == (type == FLOWER)) {
+            //another edge of the same sign inside the balloon
+            i = follow_edge(gradient, i, last, &contrast);
+        } else {
+            //the edge is WIDTH_SLOPE pixels before the last pixel of the balloon
+            end = i + WIDTH_SLOPE;
+            i = follow_edge(gradient, i, last, &contrast);
+            //the lines too small are noise, the runs narrower than WIDTH_SLOPE
+            //are measured WIDTH_SLOPE wide as their edges overlap
+            if(BALLOON_WIDTH(begin, end) >= MIN_BALLOON_WIDTH)
+            {
+                found[nb_found].begin = begin;
+                found[nb_found].end = end;
+                found[nb_found].type = type;
+                found[nb_found].contrast = contrast < open_contrast ? contrast : open_contrast;
+                nb_found++;
+            }
+            type = NONE;
+        }
+    }
+    return nb_found;
 }
 
+#else
 /**
- * @brief               Detects a balloon in the image, set the line position.
- *                      and the balloon_detected variable
- * @param[in]   image   the image to process
- * @return              none
+ * @brief               Finds every balloon of the line in a single pass, a balloon
+ *                      is a run of pixels of the same class.
+ * @param[in]   classes the class of each pixel of the line
+ * @param[in]   first   the first pixel to search
+ * @param[in]   end     the pixel to stop the search at, excluded
+ * @param[out]  found   the balloons found, from left to right
+ * @return              the number of balloons found, at most MAX_CANDIDATES
 **/
-static void detect_balloon(uint8_t* image)
+static uint8_t find_candidates(const uint8_t* classes, uint16_t first, uint16_t end, candidate_t* found)
 {
-
-	uint16_t i = 0, begin = 0, end = 0;
-	uint8_t stop = 0, wrong_balloon = 0, balloon_not_found = 0;
-
-		do 
-	{
-		wrong_balloon = 0;
-		//search for a begin
-		while(stop == 0 && i < IMAGE_BUFFER_SIZE - COEFF_RANGE_CAPTURE*WIDTH_SLOPE)
-		{
-            begin = detect_beginning(image, i);
-            if(begin > 0)
+    uint8_t nb_found = 0;
+    uint16_t i = first, begin = 0, last = 0, nb_pixels = 0;
+    balloon_type_t type = NONE;
+
+    while(i < end && nb_found < MAX_CANDIDATES)
+    {
+        if(classes[i] == NONE)
+        {
+            i++;
+            continue;
+        }
+        type = classes[i];
+        begin = i;
+        last = i;
+        nb_pixels = 0;
+        //the run goes on over gaps of at most MAX_CLASS_GAP pixels
+        while(i < end && i - last <= MAX_CLASS_GAP)
+        {
+            if(classes[i] == type)
             {
-                stop = 1;
+                last = i;
+                nb_pixels++;
             }
             i++;
-        } 
-		//if a begin was found, search for an end
-		if (i < IMAGE_BUFFER_SIZE - COEFF_RANGE_CAPTURE*WIDTH_SLOPE && begin)
-		{
-		    stop = 0;
-		    while(stop == 0 && i < IMAGE_BUFFER_SIZE -COEFF_RANGE_CAPTURE*WIDTH_SLOPE)
-		    {
-                end = detect_ending(image, i);
-                if(end > 0)
-                {
-                    stop = 1;
-                } 
-				i++;
-		    }
-		    //if an end was not found
-		    if (i > IMAGE_BUFFER_SIZE - COEFF_RANGE_CAPTURE*WIDTH_SLOPE || !end)
-		    {
-		        balloon_not_found = 1;
-		    }
-		//if no begin was found
-		} else {  
-		    balloon_not_found = 1;
-		}
+        }
+        //the pixels of the gap can start another balloon
+        i = last + 1;
+        //the lines too small are noise
+        if(last + 1 - begin >= MIN_BALLOON_WIDTH)
+        {
+            found[nb_found].begin = begin;
+            found[nb_found].end = last;
+            found[nb_found].type = type;
+            found[nb_found].contrast = (nb_pixels * UINT8_MAX) / (last + 1 - begin);
+            nb_found++;
+        }
+    }
+    return nb_found;
+}
+#endif
 
-		//if a line too small has been detected, continues the search
-		if(!balloon_not_found && (end-begin) < MIN_BALLOON_WIDTH)
-		{
-			i = end;
-			begin = 0;
-			end = 0;
-			stop = 0;
-			wrong_balloon = 1;
-		}
-	} while(wrong_balloon);
-
-	if(balloon_not_found)
-	{
-		//reset to default values
-		begin = 0;
-		end = 0;
-		balloon_position = IMAGE_BUFFER_SIZE/2;
-        balloon_type = NONE;
-	} else {
-		//gives the line position
-		balloon_position = (begin + end)/2;
-
-		//if we are close to the ballon, we don't want to capture image to avoid errors
-		//the last few centimeters are handled by the TOF sensor
-		if((end-begin) > TOO_CLOSE_TO_BALLOON)
-		{
-			capture_image = false;
-			balloon_position = IMAGE_BUFFER_SIZE/2;
-		}
+/**
+ * @brief               Compares two balloons with the selection policy.
+ * @param[in]   a       the balloon to compare
+ * @param[in]   b       the best balloon so far
+ * @return              true if a should be targeted rather than b
+**/
+static bool is_better_target(const candidate_t* a, const candidate_t* b)
+{
+#if SELECTION_POLICY == SELECT_FIRST
+    (void)a;
+    (void)b;
+    return false;
+#elif SELECTION_POLICY == SELECT_CENTERED
+    return fabsf(BALLOON_CENTER(a->begin, a->end) - IMAGE_BUFFER_SIZE/2) < fabsf(BALLOON_CENTER(b->begin, b->end) - IMAGE_BUFFER_SIZE/2);
+#else
+#if SELECTION_POLICY == SELECT_FLOWERS_FIRST
+    if(a->type != b->type)
+    {
+        return a->type == FLOWER;
+    }
+#endif
+    return a->end - a->begin > b->end - b->begin;
+#endif
+}
 
-	}
+/**
+ * @brief               Chooses the balloon to move to.
+ * @param[in]   found   the balloons of the line
+ * @param[in]   nb_found the number of balloons
+ * @return              the balloon to move to, NULL if there is none
+**/
+static const candidate_t* select_target(const candidate_t* found, uint8_t nb_found)
+{
+    const candidate_t* target = NULL;
+
+    for(uint8_t i = 0 ; i < nb_found ; i++)
+    {
+        if(target == NULL || is_better_target(&found[i], target))
+        {
+            target = &found[i];
+        }
+    }
+    return target;
+}
+
+/**
+ * @brief               Tells if a band contains a balloon at a given column.
+ * @param[in]   band    the band to search
+ * @param[in]   type    the type of the balloon
+ * @param[in]   column  the column the balloon must cover
+ * @return              true if the band contains the balloon
+**/
+static bool band_contains(uint8_t band, balloon_type_t type, uint16_t column)
+{
+    for(uint8_t i = 0 ; i < nb_candidates[band] ; i++)
+    {
+        if(candidates[band][i].type == type && candidates[band][i].begin <= column
+            && candidates[band][i].end >= column)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief               Measures the height of a balloon of the main band with the
+ *                      bands around it.
+ * @param[in]   target  the balloon found in the main band
+ * @return              the height in rows, a multiple of BAND_HEIGHT
+**/
+static uint16_t measure_extent(const candidate_t* target)
+{
+    uint16_t center = BALLOON_CENTER(target->begin, target->end);
+    uint8_t nb_bands = 1;
+    int8_t band = 0;
+
+    //counts the bands above, then below, until one misses the balloon
+    for(band = MAIN_BAND - 1 ; band >= 0 && band_contains(band, target->type, center) ; band--)
+    {
+        nb_bands++;
+    }
+    for(band = MAIN_BAND + 1 ; band < NB_BANDS && band_contains(band, target->type, center) ; band++)
+    {
+        nb_bands++;
+    }
+    return nb_bands * BAND_HEIGHT;
+}
+
+#if DETECTION_METHOD == DETECT_GREEN_EDGES
+/**
+ * @brief               Averages the two lines of a band and finds its balloons.
+ * @param[in]   lines   the two lines of the band in RGB565
+ * @param[in]   band    the index of the band
+ * @param[in]   first   the first pixel of the search window
+ * @param[in]   end     the pixel ending the search window, excluded
+ * @return              none
+**/
+static void process_band(const uint8_t* lines, uint8_t band, uint16_t first, uint16_t end)
+{
+    uint16_t length = end - first;
+
+    //extracts only the green pixels
+    image_extract_green(&lines[2 * first], &image[first], length);
+    image_extract_green(&lines[LINE_SIZE + 2 * first], &second_line[first], length);
+    image_average(&image[first], &second_line[first], &image[first], length);
+
+    //the window is at least WIDTH_SLOPE pixels long
+    image_gradient(&image[first], &gradient[first], length - WIDTH_SLOPE, WIDTH_SLOPE);
+    nb_candidates[band] = find_candidates(gradient, first, end - WIDTH_SLOPE, candidates[band]);
+}
+#else
+/**
+ * @brief               Classifies the pixels of a band and finds its balloons.
+ * @param[in]   lines   the two lines of the band in RGB565
+ * @param[in]   band    the index of the band
+ * @param[in]   first   the first pixel of the search window
+ * @param[in]   end     the pixel ending the search window, excluded
+ * @return              none
+**/
+static void process_band(const uint8_t* lines, uint8_t band, uint16_t first, uint16_t end)
+{
+    uint8_t upper = 0, lower = 0;
+
+    for(uint16_t i = first ; i < end ; i++)
+    {
+        upper = color_table[COLOR_INDEX(&lines[2 * i])];
+        lower = color_table[COLOR_INDEX(&lines[LINE_SIZE + 2 * i])];
+        //the noise of the sensor rarely gives the same class on both lines
+        image[i] = upper == lower ? upper : NONE;
+    }
+    nb_candidates[band] = find_candidates(image, first, end, candidates[band]);
+}
+#endif
+
+/**
+ * @brief               Predicts the position and the width of the tracked balloon.
+ * @note                The balloon moves by the rotation of the robot since the last
+ *                      frame of the track, faster than the velocity can follow when
+ *                      the robot starts or stops turning.
+ * @param[in]   frame   the frame to predict them for
+ * @param[out]  position the predicted position
+ * @param[out]  width   the predicted width
+ * @return              none
+**/
+static void predict_track(const frame_t* frame, float* position, float* width)
+{
+    float frames = frame->seq - track.seq;
+    //counterclockwise, turning to the left moves the balloon to the right
+    float rotation = ((frame->right_steps - track.right_steps)
+                        - (frame->left_steps - track.left_steps)) * RADIANS_PER_STEP;
+
+    *position = track.position + track.velocity * frames + FOCAL_LENGTH * rotation;
+    *width = track.width + track.growth * frames;
+}
+
+/**
+ * @brief               Computes the part of the line to search, around the predicted
+ *                      balloon while it is tracked, the whole line otherwise.
+ * @param[in]   frame   the frame to search
+ * @param[out]  first   the first pixel of the window
+ * @param[out]  end     the pixel ending the window, excluded
+ * @return              none
+**/
+static void get_search_window(const frame_t* frame, uint16_t* first, uint16_t* end)
+{
+    float position = 0, width = 0, half_window = 0;
+
+    *first = 0;
+    *end = IMAGE_BUFFER_SIZE;
+    if(track.active && frame->timestamp - track.timestamp > MS2ST(TRACK_TIMEOUT))
+    {
+        track.active = false;
+    }
+    if(!track.active)
+    {
+        return;
+    }
+    predict_track(frame, &position, &width);
+    //the edges of the balloon and their slopes must be in the window, which grows while it is missed
+    half_window = width / 2 + WIDTH_SLOPE + TRACK_MARGIN * (1 + track.misses);
+    if(half_window < MIN_BALLOON_WIDTH)
+    {
+        half_window = MIN_BALLOON_WIDTH;
+    }
+    if(position - half_window > 0)
+    {
+        *first = position - half_window;
+    }
+    if(position + half_window < IMAGE_BUFFER_SIZE)
+    {
+        *end = position + half_window;
+    }
+    //the balloon went out of the line
+    if(*end < *first + 2 * MIN_BALLOON_WIDTH)
+    {
+        track.active = false;
+        *first = 0;
+        *end = IMAGE_BUFFER_SIZE;
+    }
+}
+
+/**
+ * @brief               Finds the balloon of the track among the balloons of the window.
+ * @param[in]   found   the balloons of the window
+ * @param[in]   nb_found the number of balloons
+ * @param[in]   frame   the frame the balloons were found in
+ * @return              the balloon closest to the prediction with the type of the track,
+ *                      NULL if there is none within the margin of the window
+**/
+static const candidate_t* find_tracked(const candidate_t* found, uint8_t nb_found, const frame_t* frame)
+{
+    const candidate_t* target = NULL;
+    float position = 0, width = 0, distance = 0, best_distance = 0;
+
+    predict_track(frame, &position, &width);
+    //the window grows by TRACK_MARGIN per miss around the predicted edges, a balloon
+    //narrower than the prediction fits in it further than the tracked one can have moved
+    best_distance = TRACK_MARGIN * (1 + track.misses);
+    for(uint8_t i = 0 ; i < nb_found ; i++)
+    {
+        if(found[i].type != track.type)
+        {
+            continue;
+        }
+        distance = fabsf(BALLOON_CENTER(found[i].begin, found[i].end) - position);
+        if(distance <= best_distance)
+        {
+            best_distance = distance;
+            target = &found[i];
+        }
+    }
+    return target;
+}
+
+/**
+ * @brief               Corrects the track with the balloon found, or starts it.
+ * @param[in]   frame   the frame the balloon was found in
+ * @param[in]   target  the balloon found
+ * @return              none
+**/
+static void update_track(const frame_t* frame, const candidate_t* target)
+{
+    float position = BALLOON_CENTER(target->begin, target->end);
+    float width = target->end - target->begin;
+    float predicted_position = 0, predicted_width = 0, frames = 0;
+
+    if(!track.active)
+    {
+        track.position = position;
+        track.velocity = 0;
+        track.width = width;
+        track.growth = 0;
+        track.type = target->type;
+        track.active = true;
+    } else {
+        frames = frame->seq - track.seq;
+        predict_track(frame, &predicted_position, &predicted_width);
+        track.position = predicted_position + TRACK_ALPHA * (position - predicted_position);
+        track.velocity += TRACK_BETA * (position - predicted_position) / frames;
+        track.width = predicted_width + TRACK_ALPHA * (width - predicted_width);
+        track.growth += TRACK_BETA * (width - predicted_width) / frames;
+    }
+    track.seq = frame->seq;
+    track.timestamp = frame->timestamp;
+    track.left_steps = frame->left_steps;
+    track.right_steps = frame->right_steps;
+    track.misses = 0;
+}
+
+/**
+ * @brief               Follows the prediction when the balloon is not found.
+ * @param[in]   frame   the frame the balloon was missed in
+ * @return              true if the track goes on, false if it is lost
+**/
+static bool coast_track(const frame_t* frame)
+{
+    if(!track.active || track.misses >= TRACK_MAX_MISSES)
+    {
+        track.active = false;
+        return false;
+    }
+    predict_track(frame, &track.position, &track.width);
+    track.seq = frame->seq;
+    track.timestamp = frame->timestamp;
+    track.left_steps = frame->left_steps;
+    track.right_steps = frame->right_steps;
+    track.misses++;
+    return true;
+}
+
+/**
+ * @brief               Calibrates the range model with the TOF sensor when it
+ *                      measures the distance of the balloon.
+ * @param[in]   target  the balloon found in the main band
+ * @return              none
+**/
+static void calibrate_range(const candidate_t* target)
+{
+    tof_snapshot_t tof;
+
+    //the TOF sensor only sees the balloons in front of the robot
+    if(fabsf(BALLOON_CENTER(target->begin, target->end) - IMAGE_BUFFER_SIZE/2) > CALIBRATION_CENTERING)
+    {
+        return;
+    }
+    //the last distance published, none before the first measure
+    if(messagebus_topic_read(tof_topic, &tof, sizeof(tof)) && tof.distance < CALIBRATION_RANGE)
+    {
+        range_add_sample(BALLOON_WIDTH(target->begin, target->end), tof.distance);
+    }
+}
+
+/**
+ * @brief               Detects a balloon in the main band, set the line position,
+ *                      the balloon type, its width, its height and its distance
+ * @param[in]   frame   the frame the balloons were found in
+ * @return              none
+**/
+static void detect_balloon(const frame_t* frame)
+{
+    const candidate_t* target = NULL;
+
+    //the tracked balloon is kept, a new one is chosen only when it is lost
+    if(track.active)
+    {
+        target = find_tracked(candidates[MAIN_BAND], nb_candidates[MAIN_BAND], frame);
+    } else {
+        target = select_target(candidates[MAIN_BAND], nb_candidates[MAIN_BAND]);
+    }
+
+    if(target != NULL)
+    {
+        update_track(frame, target);
+        calibrate_range(target);
+        balloon.extent = measure_extent(target);
+
+        //if we are close to the ballon, we don't want to capture image to avoid errors
+        //the last few centimeters are handled by the TOF sensor
+        if((target->end - target->begin) > TOO_CLOSE_TO_BALLOON)
+        {
+            capture_image = false;
+            track.active = false;
+            balloon.position = IMAGE_BUFFER_SIZE/2;
+            balloon.width = BALLOON_WIDTH(target->begin, target->end);
+            balloon.type = target->type;
+            return;
+        }
+    } else if(!coast_track(frame)) {
+        //reset to default values
+        balloon.position = IMAGE_BUFFER_SIZE/2;
+        balloon.width = 0;
+        balloon.type = NONE;
+        balloon.extent = 0;
+        balloon.distance = 0;
+        return;
+    }
+
+    //gives the line position measured, predicted during short losses, the prediction
+    //lags the balloon and only serves the search window
+    if(target != NULL)
+    {
+        balloon.position = BALLOON_CENTER(target->begin, target->end);
+        balloon.width = BALLOON_WIDTH(target->begin, target->end);
+    } else {
+        if(track.position < 0)
+        {
+            balloon.position = 0;
+        } else if(track.position > IMAGE_BUFFER_SIZE - 1) {
+            balloon.position = IMAGE_BUFFER_SIZE - 1;
+        } else {
+            balloon.position = track.position;
+        }
+        balloon.width = BALLOON_WIDTH(0, track.width);
+    }
+    balloon.type = track.type;
+    //from the filtered width, less noisy than the one of the frame
+    balloon.distance = range_from_width(BALLOON_WIDTH(0, track.width));
+}
+
+/**
+ * @brief               Publishes the detection of a frame on the bus, all its fields at once.
+ * @param[in]   frame   the frame the balloon was found in
+ * @return              none
+**/
+static void publish_balloon(const frame_t* frame)
+{
+    balloon.seq = frame->seq;
+    balloon.timestamp = frame->timestamp;
+    messagebus_topic_publish(&balloon_topic, &balloon, sizeof(balloon));
+    chEvtBroadcast(&balloon_event);
+}
+
+/**
+ * @brief               Passes the last frame captured to the processing, replacing
+ *                      the frame queued if the processing is late.
+ * @param[in]   data    the lines of the frame in the DCMI buffer
+ * @return              none
+**/
+static void queue_frame(const uint8_t* data)
+{
+    frame_t* frame = &frame_pool[frames_captured % FRAME_POOL_SIZE];
+    msg_t msg = 0;
+
+    frame->data = data;
+    frame->seq = frames_captured;
+    frame->timestamp = chVTGetSystemTime();
+    frame->left_steps = left_motor_get_pos();
+    frame->right_steps = right_motor_get_pos();
+    //the pauses of the capture only lengthen the time between two frames
+    if(frames_captured > 0 && (min_frame_period == 0 || frame->timestamp - last_frame_end < min_frame_period))
+    {
+        min_frame_period = frame->timestamp - last_frame_end;
+    }
+    last_frame_end = frame->timestamp;
+    frames_captured++;
+
+    if(chMBPost(&frame_mb, (msg_t)(intptr_t)frame, TIME_IMMEDIATE) != MSG_OK)
+    {
+        chMBFetch(&frame_mb, &msg, TIME_IMMEDIATE);
+        frames_replaced++;
+        chMBPost(&frame_mb, (msg_t)(intptr_t)frame, TIME_IMMEDIATE);
+    }
+}
+
+/**
+ * @brief               Gets the time left before the camera may start writing a newer frame
+ *                      over a frame.
+ * @note                The buffer of frame k is written again by frame k + NB_DCMI_BUFFERS,
+ *                      from CAPTURE_WINDOW before its end, at the earliest NB_DCMI_BUFFERS of
+ *                      the shortest periods after the end of frame k. Until the period is
+ *                      measured, the frame is overwritten as soon as the frame before ends.
+ *                      It relies on CaptureImage counting each frame as soon as it ends, so it
+ *                      must preempt ProcessImage.
+ * @param[in]   frame   the frame to check
+ * @return              the time left in system ticks, 0 if the data of the frame cannot be
+ *                      trusted anymore
+**/
+static systime_t frame_time_left(const frame_t* frame)
+{
+    uint32_t newer = frames_captured - frame->seq - 1;
+    systime_t since_end = chVTGetSystemTime() - frame->timestamp;
+    systime_t rewrite = NB_DCMI_BUFFERS * min_frame_period - CAPTURE_WINDOW;
+
+    if(min_frame_period == 0)
+    {
+        return newer < NB_DCMI_BUFFERS - 1 ? TIME_INFINITE : 0;
+    } else if(newer > NB_DCMI_BUFFERS - 1 || since_end >= rewrite) {
+        return 0;
+    }
+    return rewrite - since_end;
 }
 
 /*===========================================================================*/
@@ -189,26 +833,41 @@ static THD_FUNCTION(CaptureImage, arg)
      chRegSetThreadName(__FUNCTION__);
     (void)arg;
 
-	//takes pixels 0 to IMAGE_BUFFER_SIZE of the lines USED_LINE and USED_LINE + 1 
-	po8030_advanced_config(FORMAT_RGB565, 0, USED_LINE, IMAGE_BUFFER_SIZE, 2, SUBSAMPLING_X1, SUBSAMPLING_X1);
+	//takes pixels 0 to IMAGE_BUFFER_SIZE of NB_LINES lines LINE_SPACING rows apart from FIRST_LINE
+	//with one band, the lines USED_LINE and USED_LINE + 1
+	po8030_advanced_config(FORMAT_RGB565, 0, FIRST_LINE, IMAGE_BUFFER_SIZE, NB_LINES * LINE_SPACING,
+							SUBSAMPLING_X1, LINE_SUBSAMPLING);
+	//the exposure is then controlled from the captured lines
+	exposure_init();
+	//the camera fills one buffer while the other one is processed
 	dcmi_enable_double_buffering();
-	dcmi_set_capture_mode(CAPTURE_ONE_SHOT);
+	dcmi_set_capture_mode(CAPTURE_CONTINUOUS);
 	dcmi_prepare();
 
+	bool capturing = false;
+
     while(1){
 
 		//waits for the mode to be MOVING_TO_BALLOON to starts the capture
 		//avoid capturing images when not needed
 		if(get_mode() == MOVING_TO_BALLOON && capture_image)
 		{
-			//starts a capture
-			dcmi_capture_start();
-			//waits for the capture to be done
+			if(!capturing)
+			{
+				dcmi_capture_start();
+				capturing = true;
+			}
+			//waits for the end of a frame, the next one is captured meanwhile
 			wait_image_ready();
-			//signals an image has been captured
-			chBSemSignal(&image_ready_sem);
+			queue_frame(dcmi_get_last_image_ptr());
+			//the new settings reach the frames after the next one
+			exposure_apply();
 		} else {
-			balloon_position = IMAGE_BUFFER_SIZE/2;
+			if(capturing)
+			{
+				dcmi_capture_stop();
+				capturing = false;
+			}
 			chThdSleepMilliseconds(200);
 		}
     }
@@ -220,24 +879,51 @@ static THD_FUNCTION(ProcessImage, arg)
     chRegSetThreadName(__FUNCTION__);
     (void)arg;
 
-	uint8_t *img_buff_ptr;
-	uint8_t image[IMAGE_BUFFER_SIZE] = {0};
+	msg_t msg = 0;
+	frame_t frame;
+	uint16_t first = 0, end = 0;
+	systime_t fetched = 0;
+
+	//waits for the TOF sensor to be started
+	tof_topic = messagebus_find_topic_blocking(&bus, TOF_TOPIC);
 
     while(1){
-    	//waits until an image has been captured
-        chBSemWait(&image_ready_sem);
-
-		//gets the pointer to the array filled with the last image in RGB565    
-		img_buff_ptr = dcmi_get_last_image_ptr();
-
-		//extracts only the green pixels
-		for(uint16_t i = 0 ; i < (2 * IMAGE_BUFFER_SIZE) ; i+=2){
-			//extracts 3 LSbits of the first byte and the 3 MSbits of second byte
-			image[i/2] = (((uint8_t)img_buff_ptr[i] & 0x07) << 5 )
-						+ (((uint8_t)img_buff_ptr[i+1] & 0xE0) >> 3);
-				
+    	//waits until a frame has been captured
+        chMBFetch(&frame_mb, &msg, TIME_INFINITE);
+		//the descriptor can be reused by the capture once fetched
+		frame = *(const frame_t*)(intptr_t)msg;
+		fetched = chVTGetSystemTime();
+
+		//the lines are processed straight from the DCMI buffer, in RGB565, a frame the camera
+		//would come back to before the end of its processing leaves the time to the next one
+		if(frame_time_left(&frame) <= frame_processing_time)
+		{
+			frames_overwritten++;
+			continue;
+		}
+		//only the pixels around the tracked balloon are searched
+		get_search_window(&frame, &first, &end);
+		for(uint8_t band = 0 ; band < NB_BANDS ; band++){
+			process_band(&frame.data[2 * band * LINE_SIZE], band, first, end);
+		}
+		pixels_processed += end - first;
+		//the whole first line of the main band, the light also changes outside of the window
+		exposure_update(&frame.data[2 * MAIN_BAND * LINE_SIZE], IMAGE_BUFFER_SIZE);
+		//the camera may have started the frame after next in the buffer during the processing
+		if(frame_time_left(&frame) == 0)
+		{
+			frames_overwritten++;
+			continue;
+		}
+		detect_balloon(&frame);
+		publish_balloon(&frame);
+		frames_processed++;
+		frame_processing_time = chVTGetSystemTime() - fetched;
+		last_latency = chVTGetSystemTime() - frame.timestamp;
+		if(last_latency > max_latency)
+		{
+			max_latency = last_latency;
 		}
-		detect_balloon(image);
 	}
 }
 
@@ -245,13 +931,14 @@ static THD_FUNCTION(ProcessImage, arg)
 /* File exported functions.                                                  */
 /*===========================================================================*/
 
-uint16_t get_balloon_position(void){
-	return balloon_position;
-}
-
-balloon_type_t get_balloon_type(void)
+void get_image_stats(image_stats_t* stats)
 {
-	return balloon_type;
+	stats->captured = frames_captured;
+	stats->processed = frames_processed;
+	stats->dropped = frames_replaced + frames_overwritten;
+	stats->pixels = pixels_processed;
+	stats->latency = ST2MS(last_latency);
+	stats->max_latency = ST2MS(max_latency);
 }
 
 void set_capture_image(bool capture)
@@ -261,11 +948,17 @@ void set_capture_image(bool capture)
 
 void process_image_start(void)
 {
+    //the detections are published once the bus is ready
+    messagebus_topic_init(&balloon_topic, &balloon_topic_lock, &balloon_topic_condvar,
+                            &balloon_topic_value, sizeof(balloon_topic_value));
+    messagebus_advertise_topic(&bus, &balloon_topic, BALLOON_TOPIC);
+
     //starts the camera
     dcmi_start();
 	po8030_start();
-    //starts the threads for the capture and processing of the image
-	chThdCreateStatic(waCaptureImage, sizeof(waCaptureImage), NORMALPRIO+1, CaptureImage, NULL);
+    //starts the threads for the capture and processing of the image, the capture preempts
+    //the processing to count the frames on time, frame_time_left depends on it
+	chThdCreateStatic(waCaptureImage, sizeof(waCaptureImage), NORMALPRIO+2, CaptureImage, NULL);
 	chThdCreateStatic(waProcessImage, sizeof(waProcessImage), NORMALPRIO+1, ProcessImage, NULL);
 
 }
\ No newline at end of file
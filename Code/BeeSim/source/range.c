@@ -0,0 +1,155 @@
+/**
+ * @file	range.c
+ * @brief 	Estimates the distance of a balloon from its width in the image,
+ * 			before it is in the range of the TOF sensor.
+ * @note 	With a pinhole camera the width is inversely proportional to the
+ * 			distance. The offset absorbs the bias of the measure of the edges.
+**/
+
+//ChibiOS headers
+#include <ch.h>
+#include <hal.h>
+
+//Project headers
+#include "include/range.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+//the model is fitted on width = coeff * (RANGE_UNIT / distance) + offset,
+//a straight line in the inverse of the distance, in m^-1 to keep the sums small
+#define RANGE_UNIT          1000.0f
+
+//focal length of the camera, about 770 pixels for its 45 degrees over 640 pixels,
+//times the diameter of a balloon, about 250 mm
+#define DEFAULT_COEFF       193.0f
+#define DEFAULT_OFFSET      0.0f
+
+//closest and farthest distances given, in mm
+#define MIN_RANGE           30
+#define MAX_RANGE           5000
+
+//samples needed before the fitted model replaces the default one
+#define MIN_SAMPLES         20
+//the sums are halved when reached, so the older samples fade out
+#define MAX_SAMPLES         200
+//lowest variance of the inverse of the distance of the samples, in m^-2
+//the samples must be spread over enough distances to fit the slope
+#define MIN_SPREAD          1.0f
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+//sums of the least squares fit, x being the inverse of the distance and y the width
+typedef struct range_samples_t
+{
+    float n;
+    float x;
+    float y;
+    float xx;
+    float xy;
+} range_samples_t;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static float coeff = DEFAULT_COEFF;
+static float offset = DEFAULT_OFFSET;
+
+static range_samples_t samples = {0};
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               Fits the model on the samples, keeps the previous one
+ *                      if there are not enough of them, fits only the coefficient
+ *                      if they are too close.
+ * @return              none
+**/
+static void fit_model(void)
+{
+    float det = samples.n * samples.xx - samples.x * samples.x;
+    float fitted_coeff = 0;
+
+    if(samples.n < MIN_SAMPLES)
+    {
+        return;
+    }
+    //the TOF sensor only measures the balloons over a few distances, which only
+    //give the size of the balloon, the offset is kept
+    if(det < MIN_SPREAD * samples.n * samples.n)
+    {
+        fitted_coeff = (samples.xy - offset * samples.x) / samples.xx;
+        if(fitted_coeff > 0)
+        {
+            coeff = fitted_coeff;
+        }
+        return;
+    }
+    fitted_coeff = (samples.n * samples.xy - samples.x * samples.y) / det;
+    //a width growing with the distance means the samples are wrong
+    if(fitted_coeff <= 0)
+    {
+        return;
+    }
+    coeff = fitted_coeff;
+    offset = (samples.y - coeff * samples.x) / samples.n;
+}
+
+/*===========================================================================*/
+/* File exported functions.                                                  */
+/*===========================================================================*/
+
+uint16_t range_from_width(float width)
+{
+    float distance = 0;
+
+    if(width <= offset)
+    {
+        return 0;
+    }
+    distance = RANGE_UNIT * coeff / (width - offset);
+    if(distance < MIN_RANGE || distance > MAX_RANGE)
+    {
+        return 0;
+    }
+    return distance;
+}
+
+void range_add_sample(float width, uint16_t distance)
+{
+    float x = 0;
+
+    if(distance < MIN_RANGE || distance > MAX_RANGE)
+    {
+        return;
+    }
+    x = RANGE_UNIT / distance;
+
+    if(samples.n >= MAX_SAMPLES)
+    {
+        samples.n /= 2;
+        samples.x /= 2;
+        samples.y /= 2;
+        samples.xx /= 2;
+        samples.xy /= 2;
+    }
+    samples.n++;
+    samples.x += x;
+    samples.y += width;
+    samples.xx += x * x;
+    samples.xy += x * width;
+    fit_model();
+}
+
+void range_reset_calibration(void)
+{
+    samples = (range_samples_t){0};
+    coeff = DEFAULT_COEFF;
+    offset = DEFAULT_OFFSET;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file	tone_canceller.c
+ * @brief 	Adaptive notch removing the note played by the speaker, and its
+ * 			harmonics, from the microphones signal so commands can still be heard.
+ * @note 	LMS canceller with sine and cosine references at the known frequency
+ * 			of the note, the weights follow the amplitude and phase of the echo.
+**/
+
+//C headers
+#include <math.h>
+
+//ChibiOS headers
+#include <ch.h>
+#include <hal.h>
+
+//E-puck 2 headers
+#include <arm_math.h>
+
+//Project headers
+#include "include/tone_canceller.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define SAMPLING_FREQUENCY	16000
+
+//the fundamental and the first harmonics of the note are removed
+#define NB_HARMONICS		3
+
+//adaptation step, the notch is about STEP_SIZE*SAMPLING_FREQUENCY/(2*PI) Hz wide
+//(13 Hz) and converges in about 1/STEP_SIZE samples (13 ms)
+#define STEP_SIZE			0.005f
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+//written by the music player, read by the audio thread
+static volatile uint16_t requested_frequency = 0;
+static uint16_t current_frequency = 0;
+
+//references generated by rotating a unit phasor by the phase step of each harmonic
+static float reference_cos[NB_HARMONICS];
+static float reference_sin[NB_HARMONICS];
+static float step_cos[NB_HARMONICS];
+static float step_sin[NB_HARMONICS];
+
+//amplitude of the echo on each reference
+static float weight_cos[NB_HARMONICS];
+static float weight_sin[NB_HARMONICS];
+
+//harmonics below the Nyquist frequency
+static uint8_t nb_harmonics = 0;
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               	Restarts the references and the weights for a new note.
+ * @param[in]	frequency	the frequency of the note in Hz, 0 if nothing is played
+ * @return              	none
+**/
+static void set_references(uint16_t frequency)
+{
+	float step = 0;
+
+	nb_harmonics = 0;
+	for(uint8_t i = 0 ; i < NB_HARMONICS && frequency > 0 ; i++){
+		if((i + 1) * frequency >= SAMPLING_FREQUENCY / 2)
+		{
+			break;
+		}
+		step = 2 * PI * (i + 1) * frequency / SAMPLING_FREQUENCY;
+		step_cos[i] = cosf(step);
+		step_sin[i] = sinf(step);
+		reference_cos[i] = 1;
+		reference_sin[i] = 0;
+		weight_cos[i] = 0;
+		weight_sin[i] = 0;
+		nb_harmonics++;
+	}
+	current_frequency = frequency;
+}
+
+/*===========================================================================*/
+/* File exported functions.                                                  */
+/*===========================================================================*/
+
+void tone_canceller_set_note(uint16_t frequency)
+{
+	requested_frequency = frequency;
+}
+
+void tone_canceller_process(float* data, uint16_t length)
+{
+	float error = 0, estimate = 0, next_cos = 0, norm = 0;
+
+	if(requested_frequency != current_frequency)
+	{
+		set_references(requested_frequency);
+	}
+
+	for(uint16_t n = 0 ; n < length ; n++){
+		estimate = 0;
+		for(uint8_t i = 0 ; i < nb_harmonics ; i++){
+			estimate += weight_cos[i] * reference_cos[i] + weight_sin[i] * reference_sin[i];
+		}
+		error = data[n] - estimate;
+		data[n] = error;
+
+		for(uint8_t i = 0 ; i < nb_harmonics ; i++){
+			weight_cos[i] += 2 * STEP_SIZE * error * reference_cos[i];
+			weight_sin[i] += 2 * STEP_SIZE * error * reference_sin[i];
+
+			next_cos = reference_cos[i] * step_cos[i] - reference_sin[i] * step_sin[i];
+			reference_sin[i] = reference_sin[i] * step_cos[i] + reference_cos[i] * step_sin[i];
+			reference_cos[i] = next_cos;
+		}
+	}
+
+	//keeps the references on the unit circle despite the rounding errors
+	for(uint8_t i = 0 ; i < nb_harmonics ; i++){
+		norm = 1 / sqrtf(reference_cos[i] * reference_cos[i] + reference_sin[i] * reference_sin[i]);
+		reference_cos[i] *= norm;
+		reference_sin[i] *= norm;
+	}
+}
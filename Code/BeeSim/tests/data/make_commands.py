@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""
+Generates data/commands.wav, a synthetic recording of the four microphones
+of the e-puck2 replayed by the host tests: the three commands whistled from
+different directions, a tone outside the commands and a MOVE tone too quiet
+to be recognised, over independent noise on each microphone.
+
+The sound reaches each microphone with the delay given by its position,
+computed exactly on each sample, so the bearings of the commands are known.
+The random generator is seeded: the file is the same at each run.
+
+    python3 tests/data/make_commands.py
+"""
+
+import math
+import os
+import random
+import struct
+import wave
+
+SAMPLING_FREQUENCY = 16000
+DURATION = 4.6
+BIN_WIDTH = SAMPLING_FREQUENCY / 1024
+
+AMPLITUDE = 3000
+NOISE = 300
+# fade in and out of the tones, in seconds
+RAMP = 0.005
+
+SPEED_OF_SOUND = 343000.0   # mm/s
+# positions of the microphones in the order of the channels (R, L, B, F),
+# x to the front and y to the left, in mm
+MICS = [(0, -30), (0, 30), (-22.5, 0), (22.5, 0)]
+
+# start, duration in seconds, bin, bearing in degrees (0 in front, positive to the left), amplitude
+TONES = [
+    (0.4, 0.5, 27, 30, AMPLITUDE),      # MOVE
+    (1.3, 0.5, 16, -90, AMPLITUDE),     # 250 Hz, no command
+    (2.0, 0.3, 27, 0, 10),              # MOVE, too quiet
+    (2.5, 0.5, 21, -60, AMPLITUDE),     # COMMUNICATE
+    (3.5, 0.5, 24, 150, AMPLITUDE),     # STOP
+]
+
+OUTPUT = os.path.join(os.path.dirname(__file__), "commands.wav")
+
+
+def tone_value(tone, time):
+    start, duration, bin_index, _, amplitude = tone
+    elapsed = time - start
+    if elapsed < 0 or elapsed > duration:
+        return 0.0
+    envelope = min(1.0, elapsed / RAMP, (duration - elapsed) / RAMP)
+    return amplitude * envelope * math.sin(2 * math.pi * bin_index * BIN_WIDTH * elapsed)
+
+
+def main():
+    random.seed(1)
+    frames = bytearray()
+    for n in range(int(DURATION * SAMPLING_FREQUENCY)):
+        time = n / SAMPLING_FREQUENCY
+        for x, y in MICS:
+            value = random.gauss(0, NOISE)
+            for tone in TONES:
+                bearing = math.radians(tone[3])
+                # the microphones closer to the source hear it earlier
+                advance = (x * math.cos(bearing) + y * math.sin(bearing)) / SPEED_OF_SOUND
+                value += tone_value(tone, time + advance)
+            frames += struct.pack("<h", max(-32768, min(32767, round(value))))
+    with wave.open(OUTPUT, "wb") as output:
+        output.setnchannels(len(MICS))
+        output.setsampwidth(2)
+        output.setframerate(SAMPLING_FREQUENCY)
+        output.writeframes(bytes(frames))
+
+
+if __name__ == "__main__":
+    main()
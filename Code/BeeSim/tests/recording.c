@@ -0,0 +1,96 @@
+/**
+ * @file	recording.c
+ * @brief	Loads the recordings of the four microphones replayed by the tests.
+**/
+
+//C headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//ChibiOS headers
+#include <ch.h>
+
+//Project headers
+#include "include/mic_array.h"
+#include "recording.h"
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+static uint32_t read_u32(const uint8_t* data)
+{
+	return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static uint16_t read_u16(const uint8_t* data)
+{
+	return data[0] | data[1] << 8;
+}
+
+/*===========================================================================*/
+/* Exported functions.                                                       */
+/*===========================================================================*/
+
+int16_t* recording_load(const char* path, uint32_t* length)
+{
+	FILE* file = fopen(path, "rb");
+	uint8_t* content = NULL;
+	int16_t* samples = NULL;
+	long size = 0;
+	uint32_t offset = 0, data_size = 0, chunk_size = 0;
+
+	if(file == NULL)
+	{
+		perror(path);
+		return NULL;
+	}
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	content = malloc(size);
+	if(fread(content, 1, size, file) != (size_t)size)
+	{
+		fprintf(stderr, "%s: cannot be read\n", path);
+		fclose(file);
+		free(content);
+		return NULL;
+	}
+	fclose(file);
+
+	data_size = size;
+	if(size >= 12 && memcmp(content, "RIFF", 4) == 0 && memcmp(&content[8], "WAVE", 4) == 0)
+	{
+		//walks the chunks until the data, checking the format on the way
+		data_size = 0;
+		for(offset = 12 ; offset + 8 <= (uint32_t)size ; offset += 8 + chunk_size + (chunk_size & 1)){
+			chunk_size = read_u32(&content[offset + 4]);
+			if(memcmp(&content[offset], "fmt ", 4) == 0)
+			{
+				if(read_u16(&content[offset + 8]) != 1 || read_u16(&content[offset + 10]) != NB_MICS
+					|| read_u32(&content[offset + 12]) != RECORDING_FREQUENCY || read_u16(&content[offset + 22]) != 16)
+				{
+					fprintf(stderr, "%s: not a 16 bits, 16 kHz, 4 channels PCM recording\n", path);
+					free(content);
+					return NULL;
+				}
+			} else if(memcmp(&content[offset], "data", 4) == 0) {
+				offset += 8;
+				data_size = chunk_size;
+				if(offset + data_size > (uint32_t)size)
+				{
+					data_size = size - offset;
+				}
+				break;
+			}
+		}
+	}
+	*length = data_size / (NB_MICS * sizeof(int16_t));
+	samples = malloc(*length * NB_MICS * sizeof(int16_t));
+	for(uint32_t i = 0 ; i < *length * NB_MICS ; i++){
+		samples[i] = (int16_t)read_u16(&content[offset + 2 * i]);
+	}
+	free(content);
+	return samples;
+}
@@ -0,0 +1,23 @@
+/**
+ * @file	recording.h
+ * @brief	Loads the recordings of the four microphones replayed by the tests.
+ * @note	A recording is a WAV file or raw PCM, 16 bits, 16 kHz, four channels
+ * 			in the order of the microphones (right, left, back, front).
+**/
+
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <stdint.h>
+
+#define RECORDING_FREQUENCY	16000		//Hz
+
+/**
+ * @brief               	Loads a recording of the four microphones.
+ * @param[in]	path    	a WAV file, any other file is read as raw PCM
+ * @param[out]	length  	the number of samples per microphone
+ * @return              	the interleaved samples, to free, NULL if the file cannot be used
+**/
+int16_t* recording_load(const char* path, uint32_t* length);
+
+#endif /* RECORDING_H */
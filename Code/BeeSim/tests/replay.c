@@ -0,0 +1,131 @@
+/**
+ * @file	replay.c
+ * @brief	Replays a recording of the four microphones through the audio pipeline
+ * 			of process_audio.c and prints the modes it activates.
+ * @note	The recording is a WAV file or raw PCM, 16 bits, 16 kHz, four channels
+ * 			in the order of the microphones (right, left, back, front). It is given to
+ * 			the pipeline by blocks, like the driver of the microphones, one block per
+ * 			block duration of virtual time. Each mode change is printed with the sample
+ * 			it was recognised at. The lines starting with # give the throughput,
+ * 			measured on the host, and are left out of the comparisons.
+ *
+ * 			replay [-b samples per block] recording.wav|recording.pcm
+**/
+
+//C headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//ChibiOS headers
+#include <ch.h>
+#include <hal.h>
+
+//E-puck 2 headers
+#include <audio/microphone.h>
+
+//Project headers
+#include "include/process_audio.h"
+#include "include/mic_array.h"
+#include "sim.h"
+#include "recording.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+//the blocks are split for the decimation by 8 of process_audio.c
+#define BLOCK_MULTIPLE		8
+#define MAX_BLOCK_SIZE		(UINT16_MAX / NB_MICS / BLOCK_MULTIPLE * BLOCK_MULTIPLE)
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+static const char* mode_name(mode_selected_t mode)
+{
+	switch(mode){
+		case STOPPED:					return "STOPPED";
+		case MOVING_TO_BALLOON:			return "MOVING_TO_BALLOON";
+		case COMMUNICATING_WITH_PEERS:	return "COMMUNICATING_WITH_PEERS";
+	}
+	return "?";
+}
+
+static double cpu_time(void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+	return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(int argc, char** argv)
+{
+	uint32_t block_size = MIC_BUFFER_LEN / NB_MICS;
+	uint32_t length = 0, block = 0, last_change = 0;
+	const char* path = NULL;
+	int16_t* samples = NULL;
+	audio_stats_t stats;
+	int16_t bearing = 0;
+	double start = 0, elapsed = 0;
+
+	for(int i = 1 ; i < argc ; i++){
+		if(strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+		{
+			block_size = strtoul(argv[++i], NULL, 10);
+		} else {
+			path = argv[i];
+		}
+	}
+	if(path == NULL || block_size == 0 || block_size % BLOCK_MULTIPLE != 0 || block_size > MAX_BLOCK_SIZE)
+	{
+		fprintf(stderr, "usage: %s [-b samples per block, multiple of %d] recording.wav|recording.pcm\n",
+				argv[0], BLOCK_MULTIPLE);
+		return 2;
+	}
+	samples = recording_load(path, &length);
+	if(samples == NULL)
+	{
+		return 2;
+	}
+
+	process_audio_start();
+
+	start = cpu_time();
+	for(uint32_t offset = 0 ; offset + block_size <= length ; offset += block_size){
+		sim_mic_feed(&samples[NB_MICS * offset], NB_MICS * block_size);
+		block++;
+		//the audio thread processes the block while the next one is recorded
+		chThdSleep(US2ST(1000000ULL * block_size / RECORDING_FREQUENCY));
+
+		get_audio_stats(&stats);
+		if(stats.mode_change_sample != last_change)
+		{
+			last_change = stats.mode_change_sample;
+			printf("%8u %9.3f ms  %-24s", (unsigned)stats.mode_change_sample,
+					1000.0 * stats.mode_change_sample / RECORDING_FREQUENCY, mode_name(get_mode()));
+			if(get_command_bearing(&bearing))
+			{
+				printf(" bearing %4d\n", bearing);
+			} else {
+				printf(" no bearing\n");
+			}
+		}
+	}
+	elapsed = cpu_time() - start;
+
+	get_audio_stats(&stats);
+	printf("# %u blocks of %u samples, %u samples and %u spectra processed, %u blocks lost\n",
+			(unsigned)stats.blocks, (unsigned)block_size, (unsigned)stats.samples,
+			(unsigned)stats.spectra, (unsigned)stats.overruns);
+	printf("# %.0f blocks/s, %.0f spectra/s, %.1f times real time on the host\n",
+			block / elapsed, stats.spectra / elapsed, (double)length / RECORDING_FREQUENCY / elapsed);
+	free(samples);
+	return 0;
+}
@@ -0,0 +1,445 @@
+/**
+ * @file	arm_math.c
+ * @brief	Host version of the part of CMSIS-DSP used by the project.
+ * @note	The float FFTs are radix 2 decimations in frequency, the real one runs a
+ * 			complex FFT of half its length like CMSIS. The Q15 real FFT is computed
+ * 			in fixed point, halving the values at each stage, which gives the
+ * 			scaling and about the rounding errors of CMSIS.
+**/
+
+//C headers
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+//CMSIS headers
+#include <arm_math.h>
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define MAX_FFT_SIZE		4096
+
+/*===========================================================================*/
+/* Global variables.                                                         */
+/*===========================================================================*/
+
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len16 = {16};
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len32 = {32};
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len64 = {64};
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len128 = {128};
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len256 = {256};
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len512 = {512};
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len1024 = {1024};
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len2048 = {2048};
+const arm_cfft_instance_f32 arm_cfft_sR_f32_len4096 = {4096};
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+//cos and sin of 2*pi*k/MAX_FFT_SIZE, in float and in Q15
+static float twiddles_f32[2 * MAX_FFT_SIZE];
+static q15_t twiddles_q15[2 * MAX_FFT_SIZE];
+static bool twiddles_ready = false;
+
+//scratch memory of the real FFTs
+static float rfft_buffer[2 * MAX_FFT_SIZE];
+static q15_t rfft_buffer_q15[2 * MAX_FFT_SIZE];
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+static void init_twiddles(void)
+{
+	double angle = 0;
+
+	if(twiddles_ready)
+	{
+		return;
+	}
+	for(uint16_t k = 0 ; k < MAX_FFT_SIZE ; k++){
+		angle = 2 * M_PI * k / MAX_FFT_SIZE;
+		twiddles_f32[2 * k] = cos(angle);
+		twiddles_f32[2 * k + 1] = sin(angle);
+		//1.0 saturates to the largest Q15 number
+		twiddles_q15[2 * k] = fmin(round(cos(angle) * 32768), 32767);
+		twiddles_q15[2 * k + 1] = fmin(round(sin(angle) * 32768), 32767);
+	}
+	twiddles_ready = true;
+}
+
+static uint16_t bit_reverse(uint16_t index, uint16_t length)
+{
+	uint16_t reversed = 0;
+
+	for(uint16_t bit = 1 ; bit < length ; bit <<= 1){
+		reversed = (reversed << 1) | ((index & bit) ? 1 : 0);
+	}
+	return reversed;
+}
+
+static void bit_reverse_f32(float* data, uint16_t length)
+{
+	float swap = 0;
+	uint16_t j = 0;
+
+	for(uint16_t i = 0 ; i < length ; i++){
+		j = bit_reverse(i, length);
+		if(j > i)
+		{
+			for(uint8_t part = 0 ; part < 2 ; part++){
+				swap = data[2 * i + part];
+				data[2 * i + part] = data[2 * j + part];
+				data[2 * j + part] = swap;
+			}
+		}
+	}
+}
+
+/**
+ * @brief               Complex FFT in place, output in bit reversed order.
+ * @param[in] sign      -1 for the forward transform, 1 for the inverse one
+**/
+static void fft_f32(float* data, uint16_t length, int8_t sign)
+{
+	uint16_t step = 0;
+	float wr = 0, wi = 0, ar = 0, ai = 0, br = 0, bi = 0;
+
+	init_twiddles();
+	for(uint16_t half = length / 2 ; half >= 1 ; half /= 2){
+		step = MAX_FFT_SIZE / (2 * half);
+		for(uint16_t start = 0 ; start < length ; start += 2 * half){
+			for(uint16_t k = 0 ; k < half ; k++){
+				wr = twiddles_f32[2 * k * step];
+				wi = sign * twiddles_f32[2 * k * step + 1];
+				ar = data[2 * (start + k)];
+				ai = data[2 * (start + k) + 1];
+				br = data[2 * (start + k + half)];
+				bi = data[2 * (start + k + half) + 1];
+				data[2 * (start + k)] = ar + br;
+				data[2 * (start + k) + 1] = ai + bi;
+				data[2 * (start + k + half)] = (ar - br) * wr - (ai - bi) * wi;
+				data[2 * (start + k + half) + 1] = (ar - br) * wi + (ai - bi) * wr;
+			}
+		}
+	}
+}
+
+/**
+ * @brief               Complex FFT in place in Q15, each stage halves the values.
+ * 						Output in bit reversed order.
+**/
+static void fft_q15(q15_t* data, uint16_t length)
+{
+	uint16_t step = 0;
+	int32_t wr = 0, wi = 0, ar = 0, ai = 0, dr = 0, di = 0;
+
+	init_twiddles();
+	for(uint16_t half = length / 2 ; half >= 1 ; half /= 2){
+		step = MAX_FFT_SIZE / (2 * half);
+		for(uint16_t start = 0 ; start < length ; start += 2 * half){
+			for(uint16_t k = 0 ; k < half ; k++){
+				wr = twiddles_q15[2 * k * step];
+				wi = -twiddles_q15[2 * k * step + 1];
+				ar = data[2 * (start + k)];
+				ai = data[2 * (start + k) + 1];
+				dr = (ar - data[2 * (start + k + half)]) >> 1;
+				di = (ai - data[2 * (start + k + half) + 1]) >> 1;
+				data[2 * (start + k)] = (ar + data[2 * (start + k + half)]) >> 1;
+				data[2 * (start + k) + 1] = (ai + data[2 * (start + k + half) + 1]) >> 1;
+				data[2 * (start + k + half)] = (dr * wr - di * wi) >> 15;
+				data[2 * (start + k + half) + 1] = (dr * wi + di * wr) >> 15;
+			}
+		}
+	}
+}
+
+/*===========================================================================*/
+/* Basic and statistics functions.                                           */
+/*===========================================================================*/
+
+void arm_add_f32(float32_t* pSrcA, float32_t* pSrcB, float32_t* pDst, uint32_t blockSize)
+{
+	for(uint32_t i = 0 ; i < blockSize ; i++){
+		pDst[i] = pSrcA[i] + pSrcB[i];
+	}
+}
+
+void arm_sub_f32(float32_t* pSrcA, float32_t* pSrcB, float32_t* pDst, uint32_t blockSize)
+{
+	for(uint32_t i = 0 ; i < blockSize ; i++){
+		pDst[i] = pSrcA[i] - pSrcB[i];
+	}
+}
+
+void arm_scale_f32(float32_t* pSrc, float32_t scale, float32_t* pDst, uint32_t blockSize)
+{
+	for(uint32_t i = 0 ; i < blockSize ; i++){
+		pDst[i] = pSrc[i] * scale;
+	}
+}
+
+void arm_dot_prod_f32(float32_t* pSrcA, float32_t* pSrcB, uint32_t blockSize, float32_t* result)
+{
+	float32_t sum = 0;
+
+	for(uint32_t i = 0 ; i < blockSize ; i++){
+		sum += pSrcA[i] * pSrcB[i];
+	}
+	*result = sum;
+}
+
+void arm_copy_f32(float32_t* pSrc, float32_t* pDst, uint32_t blockSize)
+{
+	memmove(pDst, pSrc, blockSize * sizeof(float32_t));
+}
+
+void arm_copy_q15(q15_t* pSrc, q15_t* pDst, uint32_t blockSize)
+{
+	memmove(pDst, pSrc, blockSize * sizeof(q15_t));
+}
+
+void arm_fill_f32(float32_t value, float32_t* pDst, uint32_t blockSize)
+{
+	for(uint32_t i = 0 ; i < blockSize ; i++){
+		pDst[i] = value;
+	}
+}
+
+void arm_max_f32(float32_t* pSrc, uint32_t blockSize, float32_t* pResult, uint32_t* pIndex)
+{
+	uint32_t index = 0;
+
+	for(uint32_t i = 1 ; i < blockSize ; i++){
+		if(pSrc[i] > pSrc[index])
+		{
+			index = i;
+		}
+	}
+	*pResult = pSrc[index];
+	*pIndex = index;
+}
+
+void arm_power_f32(float32_t* pSrc, uint32_t blockSize, float32_t* pResult)
+{
+	arm_dot_prod_f32(pSrc, pSrc, blockSize, pResult);
+}
+
+arm_status arm_sqrt_f32(float32_t in, float32_t* pOut)
+{
+	if(in < 0)
+	{
+		*pOut = 0;
+		return ARM_MATH_ARGUMENT_ERROR;
+	}
+	*pOut = sqrtf(in);
+	return ARM_MATH_SUCCESS;
+}
+
+/*===========================================================================*/
+/* Complex math functions.                                                   */
+/*===========================================================================*/
+
+void arm_cmplx_conj_f32(float32_t* pSrc, float32_t* pDst, uint32_t numSamples)
+{
+	for(uint32_t i = 0 ; i < numSamples ; i++){
+		pDst[2 * i] = pSrc[2 * i];
+		pDst[2 * i + 1] = -pSrc[2 * i + 1];
+	}
+}
+
+void arm_cmplx_mult_cmplx_f32(float32_t* pSrcA, float32_t* pSrcB, float32_t* pDst, uint32_t numSamples)
+{
+	float32_t ar = 0, ai = 0, br = 0, bi = 0;
+
+	for(uint32_t i = 0 ; i < numSamples ; i++){
+		ar = pSrcA[2 * i];
+		ai = pSrcA[2 * i + 1];
+		br = pSrcB[2 * i];
+		bi = pSrcB[2 * i + 1];
+		pDst[2 * i] = ar * br - ai * bi;
+		pDst[2 * i + 1] = ar * bi + ai * br;
+	}
+}
+
+void arm_cmplx_mag_f32(float32_t* pSrc, float32_t* pDst, uint32_t numSamples)
+{
+	for(uint32_t i = 0 ; i < numSamples ; i++){
+		pDst[i] = sqrtf(pSrc[2 * i] * pSrc[2 * i] + pSrc[2 * i + 1] * pSrc[2 * i + 1]);
+	}
+}
+
+void arm_cmplx_mag_squared_f32(float32_t* pSrc, float32_t* pDst, uint32_t numSamples)
+{
+	for(uint32_t i = 0 ; i < numSamples ; i++){
+		pDst[i] = pSrc[2 * i] * pSrc[2 * i] + pSrc[2 * i + 1] * pSrc[2 * i + 1];
+	}
+}
+
+void arm_cmplx_mag_q15(q15_t* pSrc, q15_t* pDst, uint32_t numSamples)
+{
+	int64_t power = 0;
+
+	for(uint32_t i = 0 ; i < numSamples ; i++){
+		//1.15 inputs, 2.14 output: the square root of the Q15 number (re^2 + im^2) >> 17
+		power = (int64_t)pSrc[2 * i] * pSrc[2 * i] + (int64_t)pSrc[2 * i + 1] * pSrc[2 * i + 1];
+		pDst[i] = (q15_t)fmin(sqrt((double)(power >> 17) * 32768), 32767);
+	}
+}
+
+/*===========================================================================*/
+/* Transforms.                                                               */
+/*===========================================================================*/
+
+void arm_cfft_f32(const arm_cfft_instance_f32* S, float32_t* p1, uint8_t ifftFlag, uint8_t bitReverseFlag)
+{
+	uint16_t length = S->fftLen;
+
+	fft_f32(p1, length, ifftFlag ? 1 : -1);
+	if(bitReverseFlag)
+	{
+		bit_reverse_f32(p1, length);
+	}
+	if(ifftFlag)
+	{
+		arm_scale_f32(p1, 1.0f / length, p1, 2 * length);
+	}
+}
+
+arm_status arm_rfft_fast_init_f32(arm_rfft_fast_instance_f32* S, uint16_t fftLen)
+{
+	if(fftLen < 32 || fftLen > MAX_FFT_SIZE || (fftLen & (fftLen - 1)) != 0)
+	{
+		return ARM_MATH_ARGUMENT_ERROR;
+	}
+	S->fftLenRFFT = fftLen;
+	init_twiddles();
+	return ARM_MATH_SUCCESS;
+}
+
+void arm_rfft_fast_f32(arm_rfft_fast_instance_f32* S, float32_t* p, float32_t* pOut, uint8_t ifftFlag)
+{
+	uint16_t length = S->fftLenRFFT;
+	uint16_t half = length / 2;
+	float zr = 0, zi = 0, cr = 0, ci = 0, er = 0, ei = 0, or = 0, oi = 0, wr = 0, wi = 0;
+
+	if(ifftFlag)
+	{
+		//rebuilds the whole spectrum from the packed one and runs the inverse complex FFT
+		rfft_buffer[0] = p[0];
+		rfft_buffer[1] = 0;
+		rfft_buffer[length] = p[1];
+		rfft_buffer[length + 1] = 0;
+		for(uint16_t k = 1 ; k < half ; k++){
+			rfft_buffer[2 * k] = p[2 * k];
+			rfft_buffer[2 * k + 1] = p[2 * k + 1];
+			rfft_buffer[2 * (length - k)] = p[2 * k];
+			rfft_buffer[2 * (length - k) + 1] = -p[2 * k + 1];
+		}
+		fft_f32(rfft_buffer, length, 1);
+		bit_reverse_f32(rfft_buffer, length);
+		for(uint16_t n = 0 ; n < length ; n++){
+			pOut[n] = rfft_buffer[2 * n] / length;
+		}
+		return;
+	}
+
+	//the even and odd samples are the real and imaginary parts of a half length signal
+	memcpy(rfft_buffer, p, length * sizeof(float));
+	fft_f32(rfft_buffer, half, -1);
+	bit_reverse_f32(rfft_buffer, half);
+
+	//X[0] and X[N/2] are real, packed in the first complex number
+	pOut[0] = rfft_buffer[0] + rfft_buffer[1];
+	pOut[1] = rfft_buffer[0] - rfft_buffer[1];
+	for(uint16_t k = 1 ; k < half ; k++){
+		zr = rfft_buffer[2 * k];
+		zi = rfft_buffer[2 * k + 1];
+		cr = rfft_buffer[2 * (half - k)];
+		ci = -rfft_buffer[2 * (half - k) + 1];
+		//spectra of the even and of the odd samples
+		er = (zr + cr) / 2;
+		ei = (zi + ci) / 2;
+		or = (zi - ci) / 2;
+		oi = -(zr - cr) / 2;
+		wr = twiddles_f32[2 * k * (MAX_FFT_SIZE / length)];
+		wi = -twiddles_f32[2 * k * (MAX_FFT_SIZE / length) + 1];
+		pOut[2 * k] = er + or * wr - oi * wi;
+		pOut[2 * k + 1] = ei + or * wi + oi * wr;
+	}
+}
+
+arm_status arm_rfft_init_q15(arm_rfft_instance_q15* S, uint32_t fftLenReal, uint32_t ifftFlagR,
+								uint32_t bitReverseFlag)
+{
+	if(fftLenReal < 32 || fftLenReal > MAX_FFT_SIZE || (fftLenReal & (fftLenReal - 1)) != 0)
+	{
+		return ARM_MATH_ARGUMENT_ERROR;
+	}
+	S->fftLenReal = fftLenReal;
+	S->ifftFlagR = ifftFlagR;
+	S->bitReverseFlagR = bitReverseFlag;
+	init_twiddles();
+	return ARM_MATH_SUCCESS;
+}
+
+void arm_rfft_q15(arm_rfft_instance_q15* S, q15_t* pSrc, q15_t* pDst)
+{
+	uint16_t length = S->fftLenReal;
+	uint16_t j = 0;
+
+	//the forward transform only, the project does not use the inverse one
+	for(uint16_t n = 0 ; n < length ; n++){
+		rfft_buffer_q15[2 * n] = pSrc[n];
+		rfft_buffer_q15[2 * n + 1] = 0;
+	}
+	fft_q15(rfft_buffer_q15, length);
+	//the whole spectrum, X[k] / N in 1.15
+	for(uint16_t k = 0 ; k < length ; k++){
+		j = bit_reverse(k, length);
+		pDst[2 * k] = rfft_buffer_q15[2 * j];
+		pDst[2 * k + 1] = rfft_buffer_q15[2 * j + 1];
+	}
+}
+
+/*===========================================================================*/
+/* Filters.                                                                  */
+/*===========================================================================*/
+
+arm_status arm_fir_decimate_init_f32(arm_fir_decimate_instance_f32* S, uint16_t numTaps, uint8_t M,
+										float32_t* pCoeffs, float32_t* pState, uint32_t blockSize)
+{
+	if(M == 0 || blockSize % M != 0)
+	{
+		return ARM_MATH_LENGTH_ERROR;
+	}
+	S->numTaps = numTaps;
+	S->M = M;
+	S->pCoeffs = pCoeffs;
+	S->pState = pState;
+	memset(pState, 0, (numTaps + blockSize - 1) * sizeof(float32_t));
+	return ARM_MATH_SUCCESS;
+}
+
+void arm_fir_decimate_f32(const arm_fir_decimate_instance_f32* S, float32_t* pSrc, float32_t* pDst,
+							uint32_t blockSize)
+{
+	float32_t* state = S->pState;
+	uint16_t history = S->numTaps - 1;
+	float32_t sum = 0;
+
+	//the state holds the last numTaps - 1 samples followed by the block
+	memcpy(&state[history], pSrc, blockSize * sizeof(float32_t));
+	for(uint32_t m = 0 ; m < blockSize / S->M ; m++){
+		sum = 0;
+		//the coefficients are stored in time reversed order
+		for(uint16_t k = 0 ; k < S->numTaps ; k++){
+			sum += S->pCoeffs[k] * state[S->M * m + k];
+		}
+		pDst[m] = sum;
+	}
+	memmove(state, &state[blockSize], history * sizeof(float32_t));
+}
@@ -0,0 +1,127 @@
+/**
+ * @file	arm_math.h
+ * @brief	Host version of the part of CMSIS-DSP used by the project, with the
+ * 			prototypes of the CMSIS version of the e-puck2 library.
+ * @note	The results follow CMSIS, including the packing and the scaling of the
+ * 			FFTs and the fixed point arithmetic of the Q15 real FFT, but not its speed:
+ * 			the host times only compare the algorithms with each other.
+**/
+
+#ifndef ARM_MATH_H
+#define ARM_MATH_H
+
+#include <stdint.h>
+
+/*===========================================================================*/
+/* Constants and types.                                                      */
+/*===========================================================================*/
+
+#define PI					3.14159265358979f
+
+typedef float float32_t;
+typedef int16_t q15_t;
+typedef int32_t q31_t;
+typedef int64_t q63_t;
+
+typedef enum
+{
+	ARM_MATH_SUCCESS = 0,
+	ARM_MATH_ARGUMENT_ERROR = -1,
+	ARM_MATH_LENGTH_ERROR = -2
+} arm_status;
+
+typedef struct
+{
+	uint16_t fftLen;
+} arm_cfft_instance_f32;
+
+typedef struct
+{
+	uint16_t fftLenRFFT;
+} arm_rfft_fast_instance_f32;
+
+typedef struct
+{
+	uint32_t fftLenReal;
+	uint8_t ifftFlagR;
+	uint8_t bitReverseFlagR;
+} arm_rfft_instance_q15;
+
+typedef struct
+{
+	uint8_t M;
+	uint16_t numTaps;
+	float32_t* pCoeffs;
+	float32_t* pState;
+} arm_fir_decimate_instance_f32;
+
+extern const arm_cfft_instance_f32 arm_cfft_sR_f32_len16;
+extern const arm_cfft_instance_f32 arm_cfft_sR_f32_len32;
+extern const arm_cfft_instance_f32 arm_cfft_sR_f32_len64;
+extern const arm_cfft_instance_f32 arm_cfft_sR_f32_len128;
+extern const arm_cfft_instance_f32 arm_cfft_sR_f32_len256;
+extern const arm_cfft_instance_f32 arm_cfft_sR_f32_len512;
+extern const arm_cfft_instance_f32 arm_cfft_sR_f32_len1024;
+extern const arm_cfft_instance_f32 arm_cfft_sR_f32_len2048;
+extern const arm_cfft_instance_f32 arm_cfft_sR_f32_len4096;
+
+/*===========================================================================*/
+/* Core intrinsics.                                                          */
+/*===========================================================================*/
+
+//saturation to a signed number of bits, an instruction of the Cortex-M4 on the robot
+static inline int32_t __SSAT(int32_t value, uint32_t bits)
+{
+	int32_t max = (1 << (bits - 1)) - 1;
+
+	return value > max ? max : (value < -max - 1 ? -max - 1 : value);
+}
+
+/*===========================================================================*/
+/* Basic and statistics functions.                                           */
+/*===========================================================================*/
+
+void arm_add_f32(float32_t* pSrcA, float32_t* pSrcB, float32_t* pDst, uint32_t blockSize);
+void arm_sub_f32(float32_t* pSrcA, float32_t* pSrcB, float32_t* pDst, uint32_t blockSize);
+void arm_scale_f32(float32_t* pSrc, float32_t scale, float32_t* pDst, uint32_t blockSize);
+void arm_dot_prod_f32(float32_t* pSrcA, float32_t* pSrcB, uint32_t blockSize, float32_t* result);
+void arm_copy_f32(float32_t* pSrc, float32_t* pDst, uint32_t blockSize);
+void arm_copy_q15(q15_t* pSrc, q15_t* pDst, uint32_t blockSize);
+void arm_fill_f32(float32_t value, float32_t* pDst, uint32_t blockSize);
+void arm_max_f32(float32_t* pSrc, uint32_t blockSize, float32_t* pResult, uint32_t* pIndex);
+void arm_power_f32(float32_t* pSrc, uint32_t blockSize, float32_t* pResult);
+arm_status arm_sqrt_f32(float32_t in, float32_t* pOut);
+
+/*===========================================================================*/
+/* Complex math functions.                                                   */
+/*===========================================================================*/
+
+void arm_cmplx_conj_f32(float32_t* pSrc, float32_t* pDst, uint32_t numSamples);
+void arm_cmplx_mult_cmplx_f32(float32_t* pSrcA, float32_t* pSrcB, float32_t* pDst, uint32_t numSamples);
+void arm_cmplx_mag_f32(float32_t* pSrc, float32_t* pDst, uint32_t numSamples);
+void arm_cmplx_mag_squared_f32(float32_t* pSrc, float32_t* pDst, uint32_t numSamples);
+void arm_cmplx_mag_q15(q15_t* pSrc, q15_t* pDst, uint32_t numSamples);
+
+/*===========================================================================*/
+/* Transforms.                                                               */
+/*===========================================================================*/
+
+void arm_cfft_f32(const arm_cfft_instance_f32* S, float32_t* p1, uint8_t ifftFlag, uint8_t bitReverseFlag);
+
+arm_status arm_rfft_fast_init_f32(arm_rfft_fast_instance_f32* S, uint16_t fftLen);
+void arm_rfft_fast_f32(arm_rfft_fast_instance_f32* S, float32_t* p, float32_t* pOut, uint8_t ifftFlag);
+
+arm_status arm_rfft_init_q15(arm_rfft_instance_q15* S, uint32_t fftLenReal, uint32_t ifftFlagR,
+								uint32_t bitReverseFlag);
+void arm_rfft_q15(arm_rfft_instance_q15* S, q15_t* pSrc, q15_t* pDst);
+
+/*===========================================================================*/
+/* Filters.                                                                  */
+/*===========================================================================*/
+
+arm_status arm_fir_decimate_init_f32(arm_fir_decimate_instance_f32* S, uint16_t numTaps, uint8_t M,
+										float32_t* pCoeffs, float32_t* pState, uint32_t blockSize);
+void arm_fir_decimate_f32(const arm_fir_decimate_instance_f32* S, float32_t* pSrc, float32_t* pDst,
+							uint32_t blockSize);
+
+#endif /* ARM_MATH_H */
@@ -0,0 +1,16 @@
+/**
+ * @file	audio_thread.h
+ * @brief	Host version of the speaker driver of the e-puck2, the notes are
+ * 			read by the tests with sim_dac_get_note.
+**/
+
+#ifndef AUDIO_THREAD_H
+#define AUDIO_THREAD_H
+
+#include <stdint.h>
+
+void dac_start(void);
+void dac_stop(void);
+void dac_play(uint16_t freq);
+
+#endif /* AUDIO_THREAD_H */
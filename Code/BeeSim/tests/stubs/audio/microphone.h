@@ -0,0 +1,23 @@
+/**
+ * @file	microphone.h
+ * @brief	Host version of the microphones driver of the e-puck2, the samples
+ * 			are given by the tests with sim_mic_feed.
+**/
+
+#ifndef MICROPHONE_H
+#define MICROPHONE_H
+
+#include <stdint.h>
+
+//order of the microphones in the interleaved samples
+#define MIC_RIGHT		0
+#define MIC_LEFT		1
+#define MIC_BACK		2
+#define MIC_FRONT		3
+
+//samples given to the callback, 10 ms of the four microphones at 16 kHz
+#define MIC_BUFFER_LEN	640
+
+void mic_start(void (*customFullbufferCb)(int16_t* data, uint16_t num_samples));
+
+#endif /* MICROPHONE_H */
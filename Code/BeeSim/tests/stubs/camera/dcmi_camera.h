@@ -0,0 +1,33 @@
+/**
+ * @file	dcmi_camera.h
+ * @brief	Host version of the DCMI driver of the e-puck2, the frames are
+ * 			filled by the source given to sim_camera_set_source.
+**/
+
+#ifndef DCMI_CAMERA_H
+#define DCMI_CAMERA_H
+
+#include <stdint.h>
+#include <ch.h>
+
+typedef enum
+{
+	CAPTURE_ONE_SHOT,
+	CAPTURE_CONTINUOUS
+} capture_mode_t;
+
+void dcmi_start(void);
+int8_t dcmi_prepare(void);
+void dcmi_unprepare(void);
+void dcmi_enable_double_buffering(void);
+void dcmi_disable_double_buffering(void);
+void dcmi_set_capture_mode(capture_mode_t mode);
+void dcmi_capture_start(void);
+msg_t dcmi_capture_stop(void);
+msg_t wait_image_ready(void);
+uint8_t image_is_ready(void);
+uint8_t* dcmi_get_last_image_ptr(void);
+uint8_t* dcmi_get_first_buffer_ptr(void);
+uint8_t* dcmi_get_second_buffer_ptr(void);
+
+#endif /* DCMI_CAMERA_H */
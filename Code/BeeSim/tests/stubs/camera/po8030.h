@@ -0,0 +1,33 @@
+/**
+ * @file	po8030.h
+ * @brief	Host version of the po8030 camera driver of the e-puck2.
+**/
+
+#ifndef PO8030_H
+#define PO8030_H
+
+#include <stdint.h>
+
+typedef enum
+{
+	FORMAT_CBYYCRYY,
+	FORMAT_RGB565,
+	FORMAT_YYYY
+} format_t;
+
+typedef enum
+{
+	SUBSAMPLING_X1 = 1,
+	SUBSAMPLING_X2 = 2,
+	SUBSAMPLING_X4 = 4
+} subsampling_t;
+
+void po8030_start(void);
+int8_t po8030_advanced_config(format_t fmt, unsigned int x1, unsigned int y1, unsigned int width,
+								unsigned int height, subsampling_t subsampling_x, subsampling_t subsampling_y);
+int8_t po8030_set_ae(uint8_t ae);
+int8_t po8030_set_awb(uint8_t awb);
+int8_t po8030_set_exposure(uint16_t integral, uint8_t fractional);
+int8_t po8030_set_rgb_gain(uint8_t r, uint8_t g, uint8_t b);
+
+#endif /* PO8030_H */
@@ -0,0 +1,187 @@
+/**
+ * @file	ch.h
+ * @brief	Host version of the part of the ChibiOS kernel used by the project.
+ * @note	The threads run one at a time on a virtual clock, like on a single core:
+ * 			the running thread keeps the CPU until it waits or wakes up a thread of
+ * 			higher priority, and the clock jumps to the next timeout once every thread
+ * 			waits. The code between two calls to the kernel takes no time, unless
+ * 			sim_consume is called (see sim.h).
+**/
+
+#ifndef CH_H
+#define CH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*===========================================================================*/
+/* Kernel constants.                                                         */
+/*===========================================================================*/
+
+#define TRUE					1
+#define FALSE					0
+
+//frequency of the system tick of the e-puck2
+#define CH_CFG_ST_FREQUENCY		10000
+
+#define MSG_OK					((msg_t)0)
+#define MSG_TIMEOUT				((msg_t)-1)
+#define MSG_RESET				((msg_t)-2)
+
+#define TIME_IMMEDIATE			((systime_t)0)
+#define TIME_INFINITE			((systime_t)-1)
+
+#define IDLEPRIO				((tprio_t)1)
+#define LOWPRIO					((tprio_t)2)
+#define NORMALPRIO				((tprio_t)128)
+#define HIGHPRIO				((tprio_t)255)
+
+#define ALL_EVENTS				((eventmask_t)-1)
+#define EVENT_MASK(eid)			((eventmask_t)1 << (eventmask_t)(eid))
+
+//conversions rounded up, as in ChibiOS 16
+#define S2ST(sec)				((systime_t)((uint32_t)(sec) * (uint32_t)CH_CFG_ST_FREQUENCY))
+#define MS2ST(msec)				((systime_t)(((uint64_t)(msec) * CH_CFG_ST_FREQUENCY + 999) / 1000))
+#define US2ST(usec)				((systime_t)(((uint64_t)(usec) * CH_CFG_ST_FREQUENCY + 999999) / 1000000))
+#define ST2S(n)					((uint32_t)(((uint64_t)(n) + CH_CFG_ST_FREQUENCY - 1) / CH_CFG_ST_FREQUENCY))
+#define ST2MS(n)				((uint32_t)(((uint64_t)(n) * 1000 + CH_CFG_ST_FREQUENCY - 1) / CH_CFG_ST_FREQUENCY))
+#define ST2US(n)				((uint32_t)(((uint64_t)(n) * 1000000 + CH_CFG_ST_FREQUENCY - 1) / CH_CFG_ST_FREQUENCY))
+
+/*===========================================================================*/
+/* Kernel data structures and types.                                         */
+/*===========================================================================*/
+
+typedef uint32_t systime_t;
+//wide enough for the pointers passed through the mailboxes
+typedef intptr_t msg_t;
+typedef int32_t cnt_t;
+typedef uint8_t tprio_t;
+typedef uint32_t eventmask_t;
+typedef uint32_t eventflags_t;
+typedef int32_t eventid_t;
+typedef uint64_t stkalign_t;
+
+typedef struct thread thread_t;
+typedef void (*tfunc_t)(void* arg);
+
+//threads waiting on an object, in the order they started to wait
+typedef struct threads_queue_t
+{
+	thread_t* head;
+} threads_queue_t;
+
+typedef struct binary_semaphore_t
+{
+	threads_queue_t queue;
+	bool available;
+} binary_semaphore_t;
+
+typedef struct mailbox_t
+{
+	msg_t* buffer;
+	cnt_t size;
+	cnt_t count;
+	cnt_t read;
+	cnt_t write;
+	threads_queue_t fetchers;
+	threads_queue_t posters;
+} mailbox_t;
+
+typedef struct event_listener_t
+{
+	struct event_listener_t* next;
+	thread_t* listener;
+	eventmask_t events;
+	eventflags_t flags;
+	eventflags_t wflags;
+} event_listener_t;
+
+typedef struct event_source_t
+{
+	event_listener_t* next;
+} event_source_t;
+
+//the threads cannot be preempted between two calls to the kernel, the locks are not needed
+typedef struct mutex_t
+{
+	bool unused;
+} mutex_t;
+
+typedef struct condition_variable_t
+{
+	bool unused;
+} condition_variable_t;
+
+#define THD_WORKING_AREA_SIZE(n)		((size_t)(n))
+#define THD_WORKING_AREA(s, n)			stkalign_t s[(THD_WORKING_AREA_SIZE(n) + sizeof(stkalign_t) - 1) / sizeof(stkalign_t)]
+#define THD_FUNCTION(tname, arg)		void tname(void* arg)
+
+#define BSEMAPHORE_DECL(name, taken)	binary_semaphore_t name = {{NULL}, !(taken)}
+#define MAILBOX_DECL(name, buffer, size) \
+										mailbox_t name = {(msg_t*)(buffer), (size), 0, 0, 0, {NULL}, {NULL}}
+#define EVENTSOURCE_DECL(name)			event_source_t name = {NULL}
+#define MUTEX_DECL(name)				mutex_t name = {false}
+#define CONDVAR_DECL(name)				condition_variable_t name = {false}
+
+/*===========================================================================*/
+/* Kernel API.                                                               */
+/*===========================================================================*/
+
+void chSysInit(void);
+void chSysHalt(const char* reason);
+void chSysLock(void);
+void chSysUnlock(void);
+void chSysLockFromISR(void);
+void chSysUnlockFromISR(void);
+void chSchRescheduleS(void);
+
+systime_t chVTGetSystemTime(void);
+systime_t chVTGetSystemTimeX(void);
+
+thread_t* chThdCreateStatic(void* wsp, size_t size, tprio_t prio, tfunc_t pf, void* arg);
+thread_t* chThdGetSelfX(void);
+void chRegSetThreadName(const char* name);
+void chThdSleep(systime_t time);
+void chThdSleepMilliseconds(uint32_t msec);
+void chThdSleepMicroseconds(uint32_t usec);
+systime_t chThdSleepUntilWindowed(systime_t prev, systime_t next);
+void chThdYield(void);
+
+void chBSemObjectInit(binary_semaphore_t* bsp, bool taken);
+msg_t chBSemWait(binary_semaphore_t* bsp);
+msg_t chBSemWaitTimeout(binary_semaphore_t* bsp, systime_t time);
+void chBSemSignal(binary_semaphore_t* bsp);
+void chBSemSignalI(binary_semaphore_t* bsp);
+void chBSemReset(binary_semaphore_t* bsp, bool taken);
+
+void chMBObjectInit(mailbox_t* mbp, msg_t* buf, cnt_t n);
+msg_t chMBPost(mailbox_t* mbp, msg_t msg, systime_t timeout);
+msg_t chMBPostI(mailbox_t* mbp, msg_t msg);
+msg_t chMBFetch(mailbox_t* mbp, msg_t* msgp, systime_t timeout);
+msg_t chMBFetchS(mailbox_t* mbp, msg_t* msgp, systime_t timeout);
+msg_t chMBFetchI(mailbox_t* mbp, msg_t* msgp);
+cnt_t chMBGetUsedCountI(mailbox_t* mbp);
+void chMBReset(mailbox_t* mbp);
+
+void chEvtObjectInit(event_source_t* esp);
+void chEvtRegisterMaskWithFlags(event_source_t* esp, event_listener_t* elp, eventmask_t events, eventflags_t wflags);
+void chEvtRegisterMask(event_source_t* esp, event_listener_t* elp, eventmask_t events);
+void chEvtRegister(event_source_t* esp, event_listener_t* elp, eventid_t event);
+void chEvtUnregister(event_source_t* esp, event_listener_t* elp);
+void chEvtBroadcastFlags(event_source_t* esp, eventflags_t flags);
+void chEvtBroadcastFlagsI(event_source_t* esp, eventflags_t flags);
+void chEvtBroadcast(event_source_t* esp);
+void chEvtBroadcastI(event_source_t* esp);
+void chEvtSignal(thread_t* tp, eventmask_t events);
+eventflags_t chEvtGetAndClearFlags(event_listener_t* elp);
+eventmask_t chEvtGetAndClearEvents(eventmask_t events);
+eventmask_t chEvtWaitAny(eventmask_t events);
+eventmask_t chEvtWaitAnyTimeout(eventmask_t events, systime_t time);
+
+void chMtxLock(mutex_t* mp);
+void chMtxUnlock(mutex_t* mp);
+
+#define chDbgAssert(c, r)				do { if(!(c)) chSysHalt(r); } while(0)
+
+#endif /* CH_H */
@@ -0,0 +1,807 @@
+/**
+ * @file	chibios.c
+ * @brief	Host version of the ChibiOS kernel: threads, virtual time, semaphores,
+ * 			mailboxes and events, enough to run the threads of the project.
+ * @note	Each thread runs on a pthread but only the current one executes, the
+ * 			others wait for their turn on their condition variable. The scheduling
+ * 			follows ChibiOS without round robin: the ready thread of highest priority
+ * 			runs, the first one made ready among threads of equal priority.
+**/
+
+//C headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+//ChibiOS headers
+#include <ch.h>
+#include <hal.h>
+
+//Project headers
+#include "sim.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+//host stack of each thread, far larger than its working area on the robot
+#define HOST_STACK_SIZE		(1024 * 1024)
+//value the host stacks are filled with, to measure how much of them is used
+#define STACK_FILL_VALUE	0x55
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+typedef enum thread_state_t
+{
+	THREAD_CURRENT,
+	THREAD_READY,
+	THREAD_WAITING,
+	THREAD_FINISHED
+} thread_state_t;
+
+struct thread
+{
+	pthread_t handle;
+	pthread_cond_t turn;		//signaled when the thread becomes the current one
+	const char* name;
+	tprio_t prio;
+	thread_state_t state;
+	uint64_t ready_order;		//order the ready threads of a priority run in
+	uint64_t wakeup;			//time the wait times out at, if timed
+	bool timed;
+	msg_t wakeup_msg;			//result of the wait
+	threads_queue_t* queue;		//object the thread waits on, NULL if none
+	thread_t* queue_next;
+	eventmask_t pending_events;
+	eventmask_t waited_events;
+	bool waits_events;
+	tfunc_t function;
+	void* arg;
+	void* working_area;
+	uint8_t* stack;
+	thread_t* next;				//in the list of every thread
+};
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static pthread_mutex_t kernel_lock = PTHREAD_MUTEX_INITIALIZER;
+static thread_t main_thread;
+static thread_t* current = NULL;
+static thread_t* threads = NULL;
+static uint64_t now = 0;
+static uint64_t ready_counter = 0;
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               Registers the thread running main before the tests start.
+**/
+__attribute__((constructor)) static void sim_init(void)
+{
+	pthread_cond_init(&main_thread.turn, NULL);
+	main_thread.handle = pthread_self();
+	main_thread.name = "main";
+	main_thread.prio = NORMALPRIO;
+	main_thread.state = THREAD_CURRENT;
+	current = &main_thread;
+	threads = &main_thread;
+}
+
+static void queue_append(threads_queue_t* queue, thread_t* thread)
+{
+	thread_t** last = &queue->head;
+
+	while(*last != NULL){
+		last = &(*last)->queue_next;
+	}
+	thread->queue_next = NULL;
+	*last = thread;
+}
+
+static void queue_remove(threads_queue_t* queue, thread_t* thread)
+{
+	for(thread_t** link = &queue->head ; *link != NULL ; link = &(*link)->queue_next){
+		if(*link == thread)
+		{
+			*link = thread->queue_next;
+			return;
+		}
+	}
+}
+
+/**
+ * @brief               Makes a waiting thread ready, removing it from the queue it waits on.
+**/
+static void make_ready(thread_t* thread, msg_t msg)
+{
+	if(thread->queue != NULL)
+	{
+		queue_remove(thread->queue, thread);
+		thread->queue = NULL;
+	}
+	thread->wakeup_msg = msg;
+	thread->waits_events = false;
+	thread->state = THREAD_READY;
+	thread->ready_order = ++ready_counter;
+}
+
+static thread_t* highest_ready(void)
+{
+	thread_t* best = NULL;
+
+	for(thread_t* thread = threads ; thread != NULL ; thread = thread->next){
+		if(thread->state == THREAD_READY && (best == NULL || thread->prio > best->prio
+			|| (thread->prio == best->prio && thread->ready_order < best->ready_order)))
+		{
+			best = thread;
+		}
+	}
+	return best;
+}
+
+/**
+ * @brief               Times out the waits ending at the current time or before.
+**/
+static void wake_timed_out(void)
+{
+	for(thread_t* thread = threads ; thread != NULL ; thread = thread->next){
+		if(thread->state == THREAD_WAITING && thread->timed && thread->wakeup <= now)
+		{
+			make_ready(thread, MSG_TIMEOUT);
+		}
+	}
+}
+
+/**
+ * @brief               Gets the time of the next timeout.
+ * @return              false if no thread waits with a timeout
+**/
+static bool next_timeout(uint64_t* time)
+{
+	bool found = false;
+
+	for(thread_t* thread = threads ; thread != NULL ; thread = thread->next){
+		if(thread->state == THREAD_WAITING && thread->timed && (!found || thread->wakeup < *time))
+		{
+			*time = thread->wakeup;
+			found = true;
+		}
+	}
+	return found;
+}
+
+/**
+ * @brief               Gives the CPU to another thread and waits until the calling
+ * 						thread is the current one again. Called with the lock taken.
+**/
+static void switch_to(thread_t* next)
+{
+	thread_t* self = current;
+
+	current = next;
+	next->state = THREAD_CURRENT;
+	if(next == self)
+	{
+		return;
+	}
+	pthread_cond_signal(&next->turn);
+	while(current != self){
+		pthread_cond_wait(&self->turn, &kernel_lock);
+	}
+}
+
+/**
+ * @brief               Runs the next thread once the current one stopped running,
+ * 						moving the clock to the next timeout while every thread waits.
+ * @param[in] returns   false if the current thread finished
+**/
+static void reschedule(bool returns)
+{
+	thread_t* next = NULL;
+	uint64_t time = 0;
+
+	while((next = highest_ready()) == NULL){
+		if(!next_timeout(&time))
+		{
+			fprintf(stderr, "sim: deadlock, every thread waits forever (%s last)\n", current->name);
+			exit(3);
+		}
+		now = time;
+		wake_timed_out();
+	}
+	if(returns)
+	{
+		switch_to(next);
+	} else {
+		current = next;
+		next->state = THREAD_CURRENT;
+		pthread_cond_signal(&next->turn);
+	}
+}
+
+/**
+ * @brief               Lets a thread of higher priority made ready run at once.
+**/
+static void preempt(void)
+{
+	thread_t* next = highest_ready();
+
+	if(next != NULL && next->prio > current->prio)
+	{
+		//the preempted thread runs first among the threads of its priority
+		current->state = THREAD_READY;
+		current->ready_order = 0;
+		switch_to(next);
+	}
+}
+
+/**
+ * @brief               Makes the current thread wait on an object.
+ * @param[in] queue     the queue of the object, NULL if the thread waits for events or time
+ * @param[in] timeout   the longest wait, TIME_INFINITE to wait forever
+ * @return              the message of the wakeup, MSG_TIMEOUT if it timed out
+**/
+static msg_t wait_on(threads_queue_t* queue, systime_t timeout)
+{
+	thread_t* self = current;
+
+	if(timeout == TIME_IMMEDIATE)
+	{
+		return MSG_TIMEOUT;
+	}
+	self->state = THREAD_WAITING;
+	self->queue = queue;
+	if(queue != NULL)
+	{
+		queue_append(queue, self);
+	}
+	self->timed = timeout != TIME_INFINITE;
+	self->wakeup = now + timeout;
+	reschedule(true);
+	return self->wakeup_msg;
+}
+
+static void signal_events(thread_t* thread, eventmask_t events)
+{
+	thread->pending_events |= events;
+	if(thread->state == THREAD_WAITING && thread->waits_events
+		&& (thread->pending_events & thread->waited_events))
+	{
+		make_ready(thread, MSG_OK);
+	}
+}
+
+static void* thread_start(void* arg)
+{
+	thread_t* self = arg;
+
+	pthread_mutex_lock(&kernel_lock);
+	while(current != self){
+		pthread_cond_wait(&self->turn, &kernel_lock);
+	}
+	pthread_mutex_unlock(&kernel_lock);
+
+	self->function(self->arg);
+
+	pthread_mutex_lock(&kernel_lock);
+	self->state = THREAD_FINISHED;
+	reschedule(false);
+	pthread_mutex_unlock(&kernel_lock);
+	return NULL;
+}
+
+/*===========================================================================*/
+/* Simulation functions.                                                     */
+/*===========================================================================*/
+
+void sim_consume(systime_t time)
+{
+	uint64_t end = 0, next = 0;
+
+	pthread_mutex_lock(&kernel_lock);
+	end = now + time;
+	while(1){
+		wake_timed_out();
+		if(highest_ready() != NULL && highest_ready()->prio > current->prio)
+		{
+			//the time spent by the other threads does not count
+			time = end - now;
+			preempt();
+			end = now + time;
+		}
+		if(!next_timeout(&next) || next > end)
+		{
+			break;
+		}
+		now = next;
+	}
+	now = end;
+	wake_timed_out();
+	preempt();
+	pthread_mutex_unlock(&kernel_lock);
+}
+
+size_t sim_stack_used(const void* working_area)
+{
+	size_t unused = 0;
+
+	for(thread_t* thread = threads ; thread != NULL ; thread = thread->next){
+		if(thread->working_area == working_area && thread->stack != NULL)
+		{
+			//the stack grows down, from the end of the allocation
+			while(unused < HOST_STACK_SIZE && thread->stack[unused] == STACK_FILL_VALUE){
+				unused++;
+			}
+			return HOST_STACK_SIZE - unused;
+		}
+	}
+	return 0;
+}
+
+/*===========================================================================*/
+/* System.                                                                   */
+/*===========================================================================*/
+
+void chSysInit(void)
+{
+}
+
+void chSysHalt(const char* reason)
+{
+	fprintf(stderr, "sim: system halted: %s\n", reason);
+	abort();
+}
+
+void chSysLock(void)
+{
+}
+
+void chSysUnlock(void)
+{
+}
+
+void chSysLockFromISR(void)
+{
+}
+
+void chSysUnlockFromISR(void)
+{
+}
+
+void chSchRescheduleS(void)
+{
+	pthread_mutex_lock(&kernel_lock);
+	preempt();
+	pthread_mutex_unlock(&kernel_lock);
+}
+
+systime_t chVTGetSystemTime(void)
+{
+	return (systime_t)now;
+}
+
+systime_t chVTGetSystemTimeX(void)
+{
+	return (systime_t)now;
+}
+
+/*===========================================================================*/
+/* Threads.                                                                  */
+/*===========================================================================*/
+
+thread_t* chThdCreateStatic(void* wsp, size_t size, tprio_t prio, tfunc_t pf, void* arg)
+{
+	thread_t* thread = calloc(1, sizeof(thread_t));
+	pthread_attr_t attributes;
+
+	(void)size;
+	pthread_cond_init(&thread->turn, NULL);
+	thread->name = "unnamed";
+	thread->prio = prio;
+	thread->function = pf;
+	thread->arg = arg;
+	thread->working_area = wsp;
+	thread->stack = aligned_alloc(4096, HOST_STACK_SIZE);
+	memset(thread->stack, STACK_FILL_VALUE, HOST_STACK_SIZE);
+
+	pthread_mutex_lock(&kernel_lock);
+	thread->next = threads;
+	threads = thread;
+	make_ready(thread, MSG_OK);
+	pthread_attr_init(&attributes);
+	pthread_attr_setstack(&attributes, thread->stack, HOST_STACK_SIZE);
+	pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+	if(pthread_create(&thread->handle, &attributes, thread_start, thread) != 0)
+	{
+		chSysHalt("cannot create a thread");
+	}
+	pthread_attr_destroy(&attributes);
+	preempt();
+	pthread_mutex_unlock(&kernel_lock);
+	return thread;
+}
+
+thread_t* chThdGetSelfX(void)
+{
+	return current;
+}
+
+void chRegSetThreadName(const char* name)
+{
+	current->name = name;
+}
+
+void chThdSleep(systime_t time)
+{
+	pthread_mutex_lock(&kernel_lock);
+	if(time == TIME_IMMEDIATE)
+	{
+		time = 1;
+	}
+	wait_on(NULL, time);
+	pthread_mutex_unlock(&kernel_lock);
+}
+
+void chThdSleepMilliseconds(uint32_t msec)
+{
+	chThdSleep(MS2ST(msec));
+}
+
+void chThdSleepMicroseconds(uint32_t usec)
+{
+	chThdSleep(US2ST(usec));
+}
+
+systime_t chThdSleepUntilWindowed(systime_t prev, systime_t next)
+{
+	systime_t time = chVTGetSystemTime();
+
+	//sleeps only if the current time is in the window [prev, next)
+	if((systime_t)(time - prev) < (systime_t)(next - prev))
+	{
+		chThdSleep(next - time);
+	}
+	return next;
+}
+
+void chThdYield(void)
+{
+	pthread_mutex_lock(&kernel_lock);
+	current->state = THREAD_READY;
+	current->ready_order = ++ready_counter;
+	reschedule(true);
+	pthread_mutex_unlock(&kernel_lock);
+}
+
+/*===========================================================================*/
+/* Binary semaphores.                                                        */
+/*===========================================================================*/
+
+void chBSemObjectInit(binary_semaphore_t* bsp, bool taken)
+{
+	bsp->queue.head = NULL;
+	bsp->available = !taken;
+}
+
+msg_t chBSemWaitTimeout(binary_semaphore_t* bsp, systime_t time)
+{
+	msg_t msg = MSG_OK;
+
+	pthread_mutex_lock(&kernel_lock);
+	if(bsp->available)
+	{
+		bsp->available = false;
+	} else {
+		msg = wait_on(&bsp->queue, time);
+	}
+	pthread_mutex_unlock(&kernel_lock);
+	return msg;
+}
+
+msg_t chBSemWait(binary_semaphore_t* bsp)
+{
+	return chBSemWaitTimeout(bsp, TIME_INFINITE);
+}
+
+void chBSemSignalI(binary_semaphore_t* bsp)
+{
+	pthread_mutex_lock(&kernel_lock);
+	if(bsp->queue.head != NULL)
+	{
+		make_ready(bsp->queue.head, MSG_OK);
+	} else {
+		bsp->available = true;
+	}
+	pthread_mutex_unlock(&kernel_lock);
+}
+
+void chBSemSignal(binary_semaphore_t* bsp)
+{
+	chBSemSignalI(bsp);
+	pthread_mutex_lock(&kernel_lock);
+	preempt();
+	pthread_mutex_unlock(&kernel_lock);
+}
+
+void chBSemReset(binary_semaphore_t* bsp, bool taken)
+{
+	pthread_mutex_lock(&kernel_lock);
+	while(bsp->queue.head != NULL){
+		make_ready(bsp->queue.head, MSG_RESET);
+	}
+	bsp->available = !taken;
+	preempt();
+	pthread_mutex_unlock(&kernel_lock);
+}
+
+/*===========================================================================*/
+/* Mailboxes.                                                                */
+/*===========================================================================*/
+
+void chMBObjectInit(mailbox_t* mbp, msg_t* buf, cnt_t n)
+{
+	*mbp = (mailbox_t){buf, n, 0, 0, 0, {NULL}, {NULL}};
+}
+
+static void mailbox_write(mailbox_t* mbp, msg_t msg)
+{
+	mbp->buffer[mbp->write] = msg;
+	mbp->write = (mbp->write + 1) % mbp->size;
+	mbp->count++;
+	if(mbp->fetchers.head != NULL)
+	{
+		make_ready(mbp->fetchers.head, MSG_OK);
+	}
+}
+
+static void mailbox_read(mailbox_t* mbp, msg_t* msgp)
+{
+	*msgp = mbp->buffer[mbp->read];
+	mbp->read = (mbp->read + 1) % mbp->size;
+	mbp->count--;
+	if(mbp->posters.head != NULL)
+	{
+		make_ready(mbp->posters.head, MSG_OK);
+	}
+}
+
+msg_t chMBPost(mailbox_t* mbp, msg_t msg, systime_t timeout)
+{
+	msg_t result = MSG_OK;
+
+	pthread_mutex_lock(&kernel_lock);
+	while(mbp->count >= mbp->size && result == MSG_OK){
+		result = wait_on(&mbp->posters, timeout);
+	}
+	if(result == MSG_OK)
+	{
+		mailbox_write(mbp, msg);
+		preempt();
+	}
+	pthread_mutex_unlock(&kernel_lock);
+	return result;
+}
+
+msg_t chMBPostI(mailbox_t* mbp, msg_t msg)
+{
+	msg_t result = MSG_TIMEOUT;
+
+	pthread_mutex_lock(&kernel_lock);
+	if(mbp->count < mbp->size)
+	{
+		mailbox_write(mbp, msg);
+		result = MSG_OK;
+	}
+	pthread_mutex_unlock(&kernel_lock);
+	return result;
+}
+
+msg_t chMBFetch(mailbox_t* mbp, msg_t* msgp, systime_t timeout)
+{
+	msg_t result = MSG_OK;
+
+	pthread_mutex_lock(&kernel_lock);
+	while(mbp->count == 0 && result == MSG_OK){
+		result = wait_on(&mbp->fetchers, timeout);
+	}
+	if(result == MSG_OK)
+	{
+		mailbox_read(mbp, msgp);
+		preempt();
+	}
+	pthread_mutex_unlock(&kernel_lock);
+	return result;
+}
+
+//the threads are only switched in the calls to the kernel, the lock of the system is not needed
+msg_t chMBFetchS(mailbox_t* mbp, msg_t* msgp, systime_t timeout)
+{
+	return chMBFetch(mbp, msgp, timeout);
+}
+
+msg_t chMBFetchI(mailbox_t* mbp, msg_t* msgp)
+{
+	msg_t result = MSG_TIMEOUT;
+
+	pthread_mutex_lock(&kernel_lock);
+	if(mbp->count > 0)
+	{
+		mailbox_read(mbp, msgp);
+		result = MSG_OK;
+	}
+	pthread_mutex_unlock(&kernel_lock);
+	return result;
+}
+
+cnt_t chMBGetUsedCountI(mailbox_t* mbp)
+{
+	return mbp->count;
+}
+
+void chMBReset(mailbox_t* mbp)
+{
+	pthread_mutex_lock(&kernel_lock);
+	mbp->count = 0;
+	mbp->read = 0;
+	mbp->write = 0;
+	while(mbp->fetchers.head != NULL){
+		make_ready(mbp->fetchers.head, MSG_RESET);
+	}
+	while(mbp->posters.head != NULL){
+		make_ready(mbp->posters.head, MSG_RESET);
+	}
+	preempt();
+	pthread_mutex_unlock(&kernel_lock);
+}
+
+/*===========================================================================*/
+/* Events.                                                                   */
+/*===========================================================================*/
+
+void chEvtObjectInit(event_source_t* esp)
+{
+	esp->next = NULL;
+}
+
+void chEvtRegisterMaskWithFlags(event_source_t* esp, event_listener_t* elp, eventmask_t events, eventflags_t wflags)
+{
+	pthread_mutex_lock(&kernel_lock);
+	elp->next = esp->next;
+	elp->listener = current;
+	elp->events = events;
+	elp->flags = 0;
+	elp->wflags = wflags;
+	esp->next = elp;
+	pthread_mutex_unlock(&kernel_lock);
+}
+
+void chEvtRegisterMask(event_source_t* esp, event_listener_t* elp, eventmask_t events)
+{
+	chEvtRegisterMaskWithFlags(esp, elp, events, (eventflags_t)-1);
+}
+
+void chEvtRegister(event_source_t* esp, event_listener_t* elp, eventid_t event)
+{
+	chEvtRegisterMask(esp, elp, EVENT_MASK(event));
+}
+
+void chEvtUnregister(event_source_t* esp, event_listener_t* elp)
+{
+	pthread_mutex_lock(&kernel_lock);
+	for(event_listener_t** link = &esp->next ; *link != NULL ; link = &(*link)->next){
+		if(*link == elp)
+		{
+			*link = elp->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&kernel_lock);
+}
+
+void chEvtBroadcastFlagsI(event_source_t* esp, eventflags_t flags)
+{
+	pthread_mutex_lock(&kernel_lock);
+	for(event_listener_t* elp = esp->next ; elp != NULL ; elp = elp->next){
+		elp->flags |= flags;
+		if(flags == 0 || (elp->flags & elp->wflags) != 0)
+		{
+			signal_events(elp->listener, elp->events);
+		}
+	}
+	pthread_mutex_unlock(&kernel_lock);
+}
+
+void chEvtBroadcastFlags(event_source_t* esp, eventflags_t flags)
+{
+	chEvtBroadcastFlagsI(esp, flags);
+	pthread_mutex_lock(&kernel_lock);
+	preempt();
+	pthread_mutex_unlock(&kernel_lock);
+}
+
+void chEvtBroadcast(event_source_t* esp)
+{
+	chEvtBroadcastFlags(esp, 0);
+}
+
+void chEvtBroadcastI(event_source_t* esp)
+{
+	chEvtBroadcastFlagsI(esp, 0);
+}
+
+void chEvtSignal(thread_t* tp, eventmask_t events)
+{
+	pthread_mutex_lock(&kernel_lock);
+	signal_events(tp, events);
+	preempt();
+	pthread_mutex_unlock(&kernel_lock);
+}
+
+eventflags_t chEvtGetAndClearFlags(event_listener_t* elp)
+{
+	eventflags_t flags = elp->flags;
+
+	elp->flags = 0;
+	return flags;
+}
+
+eventmask_t chEvtGetAndClearEvents(eventmask_t events)
+{
+	eventmask_t pending = current->pending_events & events;
+
+	current->pending_events &= ~pending;
+	return pending;
+}
+
+eventmask_t chEvtWaitAnyTimeout(eventmask_t events, systime_t time)
+{
+	thread_t* self = NULL;
+	eventmask_t pending = 0;
+
+	pthread_mutex_lock(&kernel_lock);
+	self = current;
+	pending = self->pending_events & events;
+	if(pending == 0 && time != TIME_IMMEDIATE)
+	{
+		self->waited_events = events;
+		self->waits_events = true;
+		if(wait_on(NULL, time) == MSG_OK)
+		{
+			pending = self->pending_events & events;
+		}
+		self->waits_events = false;
+	}
+	self->pending_events &= ~pending;
+	pthread_mutex_unlock(&kernel_lock);
+	return pending;
+}
+
+eventmask_t chEvtWaitAny(eventmask_t events)
+{
+	return chEvtWaitAnyTimeout(events, TIME_INFINITE);
+}
+
+/*===========================================================================*/
+/* Mutexes.                                                                  */
+/*===========================================================================*/
+
+void chMtxLock(mutex_t* mp)
+{
+	(void)mp;
+}
+
+void chMtxUnlock(mutex_t* mp)
+{
+	(void)mp;
+}
+
+void halInit(void)
+{
+}
@@ -0,0 +1,508 @@
+/**
+ * @file	epuck2.c
+ * @brief	Host versions of the drivers of the e-puck2 library used by the project:
+ * 			motors, LEDs, microphones, speaker, camera and TOF sensor.
+ * @note	The motors move on the virtual clock and the camera writes its frames
+ * 			from a thread of the highest priority, like the DMA and its interrupt.
+**/
+
+//C headers
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+//ChibiOS headers
+#include <ch.h>
+#include <hal.h>
+
+//E-puck 2 headers
+#include <motors.h>
+#include <leds.h>
+#include <memory_protection.h>
+#include <spi_comm.h>
+#include <audio/microphone.h>
+#include <audio/audio_thread.h>
+#include <camera/dcmi_camera.h>
+#include <camera/po8030.h>
+#include <sensors/VL53L0X/VL53L0X.h>
+
+//Project headers
+#include "include/motion.h"
+#include "sim.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+//size of the image of the po8030 until it is configured
+#define CAMERA_WIDTH			640
+#define CAMERA_HEIGHT			480
+
+//default timing of the capture: 15 frames/s, the lines around row 200 of 480
+#define CAMERA_PERIOD			MS2ST(66)
+#define CAMERA_WINDOW_START		MS2ST(27)
+#define CAMERA_WINDOW_LENGTH	MS2ST(1)
+
+//distance given by the VL53L0X without target
+#define TOF_OUT_OF_RANGE		8190
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static double left_position = 0, right_position = 0;
+static int16_t left_speed = 0, right_speed = 0;
+static systime_t motors_time = 0;
+
+static uint8_t rgb_leds[NUM_RGB_LED][3];
+
+static void (*mic_callback)(int16_t* data, uint16_t num_samples) = NULL;
+
+static uint16_t dac_note = 0;
+static void (*dac_listener)(systime_t time, uint16_t frequency) = NULL;
+
+static uint16_t camera_width = CAMERA_WIDTH, camera_height = CAMERA_HEIGHT;
+static uint16_t camera_exposure = 0;
+static uint8_t camera_rgb_gain[3] = {0};
+static uint32_t camera_settings_writes = 0;
+static sim_frame_source_t camera_source = NULL;
+static systime_t camera_period = CAMERA_PERIOD;
+static systime_t camera_window_start = CAMERA_WINDOW_START;
+static systime_t camera_window_length = CAMERA_WINDOW_LENGTH;
+static uint8_t* camera_buffers[2] = {NULL, NULL};
+static size_t camera_buffer_size = 0;
+static bool double_buffering = false;
+static volatile bool capturing = false;
+//buffer the DMA writes next, and the last complete one
+static uint8_t write_buffer = 0;
+static uint8_t last_buffer = 0;
+//frame written last in each buffer and the time its writing started at
+static uint32_t buffer_frames[2] = {0};
+static systime_t buffer_write_starts[2] = {0};
+static uint32_t camera_frames = 0;
+
+static uint16_t tof_distance = TOF_OUT_OF_RANGE;
+
+static BSEMAPHORE_DECL(image_ready_sem, TRUE);
+static BSEMAPHORE_DECL(capture_start_sem, TRUE);
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief   Moves the motors by their speed since the last update.
+**/
+static void update_motors(void)
+{
+	systime_t time = chVTGetSystemTime();
+	double period = (systime_t)(time - motors_time) / (double)CH_CFG_ST_FREQUENCY;
+
+	left_position += left_speed * period;
+	right_position += right_speed * period;
+	motors_time = time;
+}
+
+static int16_t limit_speed(int speed)
+{
+	if(speed > MOTOR_SPEED_LIMIT)
+	{
+		return MOTOR_SPEED_LIMIT;
+	} else if(speed < -MOTOR_SPEED_LIMIT) {
+		return -MOTOR_SPEED_LIMIT;
+	}
+	return speed;
+}
+
+/*===========================================================================*/
+/* File threads.                                                             */
+/*===========================================================================*/
+
+//writes the frames in the buffers and signals their end, like the DMA and its interrupt
+static THD_WORKING_AREA(waCamera, 256);
+static THD_FUNCTION(Camera, arg)
+{
+	chRegSetThreadName(__FUNCTION__);
+	(void)arg;
+
+	systime_t frame_start = 0;
+
+	while(1){
+		while(!capturing){
+			chBSemWait(&capture_start_sem);
+			frame_start = chVTGetSystemTime();
+		}
+		chThdSleepUntilWindowed(frame_start, frame_start + camera_window_start);
+		if(!capturing)
+		{
+			continue;
+		}
+		buffer_frames[write_buffer] = camera_frames;
+		buffer_write_starts[write_buffer] = chVTGetSystemTime();
+		if(camera_source != NULL)
+		{
+			camera_source(camera_frames, camera_buffers[write_buffer], camera_width, camera_height);
+		}
+		chThdSleep(camera_window_length);
+
+		last_buffer = write_buffer;
+		if(double_buffering)
+		{
+			write_buffer ^= 1;
+		}
+		camera_frames++;
+		chBSemSignal(&image_ready_sem);
+
+		frame_start += camera_period;
+		chThdSleepUntilWindowed(chVTGetSystemTime(), frame_start);
+	}
+}
+
+/*===========================================================================*/
+/* Simulation functions.                                                     */
+/*===========================================================================*/
+
+void sim_motors_get_position(double* left, double* right)
+{
+	update_motors();
+	*left = left_position;
+	*right = right_position;
+}
+
+void sim_motors_get_speed(int16_t* left, int16_t* right)
+{
+	*left = left_speed;
+	*right = right_speed;
+}
+
+void sim_pose_update(sim_pose_t* pose)
+{
+	double left = 0, right = 0, forward = 0, rotation = 0;
+
+	sim_motors_get_position(&left, &right);
+	left = (left - pose->left) * WHEEL_PERIMETER / STEPS_PER_TURN;
+	right = (right - pose->right) * WHEEL_PERIMETER / STEPS_PER_TURN;
+	forward = (left + right) / 2;
+	rotation = (right - left) / WHEEL_DISTANCE;
+	pose->x += forward * cos(pose->heading + rotation / 2);
+	pose->y += forward * sin(pose->heading + rotation / 2);
+	pose->heading += rotation;
+	sim_motors_get_position(&pose->left, &pose->right);
+}
+
+void sim_pose_reset(sim_pose_t* pose)
+{
+	memset(pose, 0, sizeof(*pose));
+	sim_motors_get_position(&pose->left, &pose->right);
+}
+
+double sim_pose_get_bearing(const sim_pose_t* pose, double x, double y, double* distance)
+{
+	double dx = x - pose->x, dy = y - pose->y;
+
+	*distance = sqrt(dx * dx + dy * dy);
+	return remainder(pose->heading - atan2(dy, dx), 2 * M_PI);
+}
+
+void sim_get_rgb_led(rgb_led_name_t led, uint8_t* rgb)
+{
+	memcpy(rgb, rgb_leds[led], 3);
+}
+
+bool sim_mic_feed(int16_t* data, uint16_t num_samples)
+{
+	if(mic_callback == NULL)
+	{
+		return false;
+	}
+	mic_callback(data, num_samples);
+	return true;
+}
+
+uint16_t sim_dac_get_note(void)
+{
+	return dac_note;
+}
+
+void sim_dac_set_listener(void (*listener)(systime_t time, uint16_t frequency))
+{
+	dac_listener = listener;
+}
+
+void sim_camera_set_source(sim_frame_source_t source, systime_t period, systime_t window_start,
+							systime_t window_length)
+{
+	camera_source = source;
+	camera_period = period;
+	camera_window_start = window_start;
+	camera_window_length = window_length;
+}
+
+bool sim_camera_get_write(const uint8_t* buffer, uint32_t* frame, systime_t* start)
+{
+	for(uint8_t i = 0 ; i < 2 ; i++){
+		if(camera_buffers[i] != NULL && buffer >= camera_buffers[i] && buffer < camera_buffers[i] + camera_buffer_size)
+		{
+			*frame = buffer_frames[i];
+			*start = buffer_write_starts[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+void sim_write_pixel(uint8_t* pixel, int green)
+{
+	uint8_t g = (green < 0 ? 0 : (green > 255 ? 255 : green)) >> 2;
+
+	pixel[0] = (0x10 << 3) | (g >> 3);
+	pixel[1] = ((g & 0x07) << 5) | 0x10;
+}
+
+void sim_camera_get_settings(uint16_t* exposure, uint8_t* rgb_gain, uint32_t* writes)
+{
+	*exposure = camera_exposure;
+	memcpy(rgb_gain, camera_rgb_gain, 3);
+	*writes = camera_settings_writes;
+}
+
+void sim_tof_set_distance(uint16_t distance)
+{
+	tof_distance = distance;
+}
+
+/*===========================================================================*/
+/* Motors.                                                                   */
+/*===========================================================================*/
+
+void motors_init(void)
+{
+	update_motors();
+	left_speed = 0;
+	right_speed = 0;
+}
+
+void left_motor_set_speed(int speed)
+{
+	update_motors();
+	left_speed = limit_speed(speed);
+}
+
+void right_motor_set_speed(int speed)
+{
+	update_motors();
+	right_speed = limit_speed(speed);
+}
+
+int32_t left_motor_get_pos(void)
+{
+	update_motors();
+	return (int32_t)floor(left_position);
+}
+
+int32_t right_motor_get_pos(void)
+{
+	update_motors();
+	return (int32_t)floor(right_position);
+}
+
+void left_motor_set_pos(int32_t counter_value)
+{
+	update_motors();
+	left_position = counter_value;
+}
+
+void right_motor_set_pos(int32_t counter_value)
+{
+	update_motors();
+	right_position = counter_value;
+}
+
+/*===========================================================================*/
+/* LEDs, memory protection and SPI.                                          */
+/*===========================================================================*/
+
+void set_led(led_name_t led_number, unsigned int value)
+{
+	(void)led_number;
+	(void)value;
+}
+
+void set_rgb_led(rgb_led_name_t led_number, uint8_t red_val, uint8_t green_val, uint8_t blue_val)
+{
+	rgb_leds[led_number][0] = red_val;
+	rgb_leds[led_number][1] = green_val;
+	rgb_leds[led_number][2] = blue_val;
+}
+
+void mpu_init(void)
+{
+}
+
+void spi_comm_start(void)
+{
+}
+
+/*===========================================================================*/
+/* Microphones and speaker.                                                  */
+/*===========================================================================*/
+
+void mic_start(void (*customFullbufferCb)(int16_t* data, uint16_t num_samples))
+{
+	mic_callback = customFullbufferCb;
+}
+
+void dac_start(void)
+{
+}
+
+void dac_stop(void)
+{
+	dac_play(0);
+}
+
+void dac_play(uint16_t freq)
+{
+	if(freq == dac_note)
+	{
+		return;
+	}
+	dac_note = freq;
+	if(dac_listener != NULL)
+	{
+		dac_listener(chVTGetSystemTime(), freq);
+	}
+}
+
+/*===========================================================================*/
+/* Camera.                                                                   */
+/*===========================================================================*/
+
+void po8030_start(void)
+{
+}
+
+int8_t po8030_advanced_config(format_t fmt, unsigned int x1, unsigned int y1, unsigned int width,
+								unsigned int height, subsampling_t subsampling_x, subsampling_t subsampling_y)
+{
+	(void)fmt;
+	(void)x1;
+	(void)y1;
+	camera_width = width / subsampling_x;
+	camera_height = height / subsampling_y;
+	return 0;
+}
+
+int8_t po8030_set_ae(uint8_t ae)
+{
+	(void)ae;
+	return 0;
+}
+
+int8_t po8030_set_awb(uint8_t awb)
+{
+	(void)awb;
+	return 0;
+}
+
+int8_t po8030_set_exposure(uint16_t integral, uint8_t fractional)
+{
+	(void)fractional;
+	camera_exposure = integral;
+	camera_settings_writes++;
+	return 0;
+}
+
+int8_t po8030_set_rgb_gain(uint8_t r, uint8_t g, uint8_t b)
+{
+	camera_rgb_gain[0] = r;
+	camera_rgb_gain[1] = g;
+	camera_rgb_gain[2] = b;
+	camera_settings_writes++;
+	return 0;
+}
+
+void dcmi_start(void)
+{
+	chThdCreateStatic(waCamera, sizeof(waCamera), HIGHPRIO, Camera, NULL);
+}
+
+int8_t dcmi_prepare(void)
+{
+	//RGB565, two bytes per pixel
+	camera_buffer_size = 2 * camera_width * camera_height;
+	for(uint8_t i = 0 ; i < 2 ; i++){
+		free(camera_buffers[i]);
+		camera_buffers[i] = calloc(1, camera_buffer_size);
+	}
+	return 0;
+}
+
+void dcmi_unprepare(void)
+{
+}
+
+void dcmi_enable_double_buffering(void)
+{
+	double_buffering = true;
+}
+
+void dcmi_disable_double_buffering(void)
+{
+	double_buffering = false;
+}
+
+void dcmi_set_capture_mode(capture_mode_t mode)
+{
+	(void)mode;
+}
+
+void dcmi_capture_start(void)
+{
+	capturing = true;
+	chBSemSignal(&capture_start_sem);
+}
+
+msg_t dcmi_capture_stop(void)
+{
+	capturing = false;
+	return MSG_OK;
+}
+
+msg_t wait_image_ready(void)
+{
+	return chBSemWait(&image_ready_sem);
+}
+
+uint8_t image_is_ready(void)
+{
+	return 0;
+}
+
+uint8_t* dcmi_get_last_image_ptr(void)
+{
+	return camera_buffers[last_buffer];
+}
+
+uint8_t* dcmi_get_first_buffer_ptr(void)
+{
+	return camera_buffers[0];
+}
+
+uint8_t* dcmi_get_second_buffer_ptr(void)
+{
+	return camera_buffers[1];
+}
+
+/*===========================================================================*/
+/* TOF sensor.                                                               */
+/*===========================================================================*/
+
+void VL53L0X_start(void)
+{
+}
+
+uint16_t VL53L0X_get_dist_mm(void)
+{
+	return tof_distance;
+}
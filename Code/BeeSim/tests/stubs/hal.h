@@ -0,0 +1,70 @@
+/**
+ * @file	hal.h
+ * @brief	Host version of the HAL header, with the Cortex-M4 intrinsics used by the project.
+ * @note	The SIMD intrinsics compute the same results as the instructions, so the
+ * 			kernels written with them can be compared with their scalar versions
+ * 			on the host by defining __ARM_FEATURE_SIMD32.
+**/
+
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+
+void halInit(void);
+
+//the threads run one at a time on the host
+#define __DMB()							__sync_synchronize()
+#define __DSB()							__sync_synchronize()
+
+/**
+ * @brief   Halved additions of the four unsigned bytes of two words.
+**/
+static inline uint32_t __UHADD8(uint32_t a, uint32_t b)
+{
+	uint32_t result = 0;
+
+	for(uint8_t i = 0 ; i < 32 ; i += 8){
+		result |= ((((a >> i) & 0xFF) + ((b >> i) & 0xFF)) >> 1) << i;
+	}
+	return result;
+}
+
+/**
+ * @brief   Halved subtractions of the four unsigned bytes of two words.
+**/
+static inline uint32_t __UHSUB8(uint32_t a, uint32_t b)
+{
+	uint32_t result = 0;
+
+	for(uint8_t i = 0 ; i < 32 ; i += 8){
+		//arithmetic shift of the 9 bits difference
+		result |= (uint32_t)(((int32_t)((a >> i) & 0xFF) - (int32_t)((b >> i) & 0xFF)) >> 1 & 0xFF) << i;
+	}
+	return result;
+}
+
+/**
+ * @brief   Sum of the absolute differences of the four unsigned bytes of two words.
+**/
+static inline uint32_t __USAD8(uint32_t a, uint32_t b)
+{
+	uint32_t sum = 0;
+	int32_t difference = 0;
+
+	for(uint8_t i = 0 ; i < 32 ; i += 8){
+		difference = (int32_t)((a >> i) & 0xFF) - (int32_t)((b >> i) & 0xFF);
+		sum += difference < 0 ? -difference : difference;
+	}
+	return sum;
+}
+
+/**
+ * @brief   Packs the bottom halfword of a and the top halfword of b shifted left.
+**/
+static inline uint32_t __PKHBT(uint32_t a, uint32_t b, uint32_t shift)
+{
+	return (a & 0x0000FFFF) | ((b << shift) & 0xFFFF0000);
+}
+
+#endif /* HAL_H */
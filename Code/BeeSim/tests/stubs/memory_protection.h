@@ -0,0 +1,11 @@
+/**
+ * @file	memory_protection.h
+ * @brief	Host version of the memory protection of the e-puck2.
+**/
+
+#ifndef MEMORY_PROTECTION_H
+#define MEMORY_PROTECTION_H
+
+void mpu_init(void);
+
+#endif /* MEMORY_PROTECTION_H */
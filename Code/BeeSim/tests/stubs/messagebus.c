@@ -0,0 +1,109 @@
+/**
+ * @file	messagebus.c
+ * @brief	Host version of the message bus of the e-puck2, on the kernel events.
+ * @note	The threads cannot be preempted between two calls to the kernel,
+ * 			so the copies of the topic values need no lock.
+**/
+
+//C headers
+#include <string.h>
+
+//ChibiOS headers
+#include <ch.h>
+
+//E-puck 2 headers
+#include <msgbus/messagebus.h>
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+//event the waits of the bus use, above the events of the project
+#define BUS_EVENT		EVENT_MASK(31)
+
+/*===========================================================================*/
+/* Exported functions.                                                       */
+/*===========================================================================*/
+
+void messagebus_init(messagebus_t* bus, void* lock, void* condvar)
+{
+	(void)lock;
+	(void)condvar;
+	bus->head = NULL;
+	chEvtObjectInit(&bus->advertised_event);
+}
+
+void messagebus_topic_init(messagebus_topic_t* topic, void* topic_lock, void* topic_condvar,
+							void* buffer, size_t buffer_len)
+{
+	(void)topic_lock;
+	(void)topic_condvar;
+	memset(topic, 0, sizeof(messagebus_topic_t));
+	topic->buffer = buffer;
+	topic->buffer_len = buffer_len;
+	chEvtObjectInit(&topic->published_event);
+}
+
+void messagebus_advertise_topic(messagebus_t* bus, messagebus_topic_t* topic, const char* name)
+{
+	strncpy(topic->name, name, TOPIC_NAME_MAX_LENGTH);
+	topic->next = bus->head;
+	bus->head = topic;
+	chEvtBroadcast(&bus->advertised_event);
+}
+
+messagebus_topic_t* messagebus_find_topic(messagebus_t* bus, const char* name)
+{
+	for(messagebus_topic_t* topic = bus->head ; topic != NULL ; topic = topic->next){
+		if(strcmp(topic->name, name) == 0)
+		{
+			return topic;
+		}
+	}
+	return NULL;
+}
+
+messagebus_topic_t* messagebus_find_topic_blocking(messagebus_t* bus, const char* name)
+{
+	event_listener_t listener;
+	messagebus_topic_t* topic = NULL;
+
+	chEvtRegisterMask(&bus->advertised_event, &listener, BUS_EVENT);
+	while((topic = messagebus_find_topic(bus, name)) == NULL){
+		chEvtWaitAny(BUS_EVENT);
+	}
+	chEvtUnregister(&bus->advertised_event, &listener);
+	chEvtGetAndClearEvents(BUS_EVENT);
+	return topic;
+}
+
+bool messagebus_topic_publish(messagebus_topic_t* topic, const void* buf, size_t buf_len)
+{
+	if(buf_len > topic->buffer_len)
+	{
+		return false;
+	}
+	memcpy(topic->buffer, buf, buf_len);
+	topic->published = true;
+	chEvtBroadcast(&topic->published_event);
+	return true;
+}
+
+bool messagebus_topic_read(messagebus_topic_t* topic, void* buf, size_t buf_len)
+{
+	if(topic->published)
+	{
+		memcpy(buf, topic->buffer, buf_len);
+	}
+	return topic->published;
+}
+
+void messagebus_topic_wait(messagebus_topic_t* topic, void* buf, size_t buf_len)
+{
+	event_listener_t listener;
+
+	chEvtRegisterMask(&topic->published_event, &listener, BUS_EVENT);
+	chEvtWaitAny(BUS_EVENT);
+	chEvtUnregister(&topic->published_event, &listener);
+	memcpy(buf, topic->buffer, buf_len);
+}
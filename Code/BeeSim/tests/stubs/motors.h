@@ -0,0 +1,23 @@
+/**
+ * @file	motors.h
+ * @brief	Host version of the motors library of the e-puck2, the positions
+ * 			follow the speeds on the virtual clock.
+**/
+
+#ifndef MOTORS_H
+#define MOTORS_H
+
+#include <stdint.h>
+
+//highest speed of the motors, in steps/s
+#define MOTOR_SPEED_LIMIT		1100
+
+void motors_init(void);
+void left_motor_set_speed(int speed);
+void right_motor_set_speed(int speed);
+int32_t left_motor_get_pos(void);
+int32_t right_motor_get_pos(void);
+void left_motor_set_pos(int32_t counter_value);
+void right_motor_set_pos(int32_t counter_value);
+
+#endif /* MOTORS_H */
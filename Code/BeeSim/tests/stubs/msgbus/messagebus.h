@@ -0,0 +1,42 @@
+/**
+ * @file	messagebus.h
+ * @brief	Host version of the message bus of the e-puck2, on the kernel events.
+**/
+
+#ifndef MESSAGEBUS_H
+#define MESSAGEBUS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <ch.h>
+
+#define TOPIC_NAME_MAX_LENGTH	64
+
+typedef struct topic_s
+{
+	void* buffer;
+	size_t buffer_len;
+	char name[TOPIC_NAME_MAX_LENGTH + 1];
+	bool published;
+	event_source_t published_event;
+	struct topic_s* next;
+} messagebus_topic_t;
+
+typedef struct
+{
+	messagebus_topic_t* head;
+	event_source_t advertised_event;
+} messagebus_t;
+
+void messagebus_init(messagebus_t* bus, void* lock, void* condvar);
+void messagebus_topic_init(messagebus_topic_t* topic, void* topic_lock, void* topic_condvar,
+							void* buffer, size_t buffer_len);
+void messagebus_advertise_topic(messagebus_t* bus, messagebus_topic_t* topic, const char* name);
+messagebus_topic_t* messagebus_find_topic(messagebus_t* bus, const char* name);
+messagebus_topic_t* messagebus_find_topic_blocking(messagebus_t* bus, const char* name);
+bool messagebus_topic_publish(messagebus_topic_t* topic, const void* buf, size_t buf_len);
+bool messagebus_topic_read(messagebus_topic_t* topic, void* buf, size_t buf_len);
+void messagebus_topic_wait(messagebus_topic_t* topic, void* buf, size_t buf_len);
+
+#endif /* MESSAGEBUS_H */
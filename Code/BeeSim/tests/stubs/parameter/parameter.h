@@ -0,0 +1,14 @@
+/**
+ * @file	parameter.h
+ * @brief	Host version of the parameter library of the e-puck2, only its types.
+**/
+
+#ifndef PARAMETER_H
+#define PARAMETER_H
+
+typedef struct parameter_namespace_s
+{
+	const char* id;
+} parameter_namespace_t;
+
+#endif /* PARAMETER_H */
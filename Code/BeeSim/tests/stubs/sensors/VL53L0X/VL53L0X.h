@@ -0,0 +1,15 @@
+/**
+ * @file	VL53L0X.h
+ * @brief	Host version of the TOF sensor driver of the e-puck2, the distance
+ * 			is set by the tests with sim_tof_set_distance.
+**/
+
+#ifndef VL53L0X_H
+#define VL53L0X_H
+
+#include <stdint.h>
+
+void VL53L0X_start(void);
+uint16_t VL53L0X_get_dist_mm(void);
+
+#endif /* VL53L0X_H */
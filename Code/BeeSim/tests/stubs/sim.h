@@ -0,0 +1,188 @@
+/**
+ * @file	sim.h
+ * @brief	Functions of the host simulation which do not exist on the robot,
+ * 			used by the tests to drive the stubs and to read their state.
+**/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <ch.h>
+#include <leds.h>
+
+/*===========================================================================*/
+/* Kernel.                                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief               	Keeps the CPU busy for a time, the threads of higher
+ * 							priority woken meanwhile preempt the calling thread.
+ * @param[in]	time    	the time in system ticks
+ * @return              	none
+**/
+void sim_consume(systime_t time);
+
+/**
+ * @brief               	Measures the host stack used by a thread since its start.
+ * @param[in]	working_area the working area the thread was created with
+ * @return              	the bytes used on the host, 0 if no thread has this working area
+**/
+size_t sim_stack_used(const void* working_area);
+
+/*===========================================================================*/
+/* Motors.                                                                   */
+/*===========================================================================*/
+
+//pose of a differential drive integrated from the motors, in mm and radians counterclockwise
+typedef struct sim_pose_t
+{
+	double x;
+	double y;
+	double heading;
+	double left;			//positions of the motors it was integrated to, in steps
+	double right;
+} sim_pose_t;
+
+/**
+ * @brief               	Gets the positions of the motors between two steps.
+ * @param[out]	left    	the position of the left motor in steps
+ * @param[out]	right   	the position of the right motor in steps
+ * @return              	none
+**/
+void sim_motors_get_position(double* left, double* right);
+
+/**
+ * @brief               	Gets the speeds set to the motors.
+ * @param[out]	left    	the speed of the left motor in steps/s
+ * @param[out]	right   	the speed of the right motor in steps/s
+ * @return              	none
+**/
+void sim_motors_get_speed(int16_t* left, int16_t* right);
+
+/**
+ * @brief               	Integrates a pose with the motion of the motors since its last update,
+ * 							the wheels rolling without slipping.
+ * @param[in,out] pose   	the pose
+ * @return              	none
+**/
+void sim_pose_update(sim_pose_t* pose);
+
+/**
+ * @brief               	Places a pose at the origin, facing the x axis, from the
+ * 							current positions of the motors.
+ * @param[out]	pose    	the pose
+ * @return              	none
+**/
+void sim_pose_reset(sim_pose_t* pose);
+
+/**
+ * @brief               	Gets the bearing of a point from a pose.
+ * @param[in]	pose    	the pose
+ * @param[in]	x       	the abscissa of the point in mm
+ * @param[in]	y       	the ordinate of the point in mm
+ * @param[out]	distance	the distance to the point in mm
+ * @return              	the bearing in radians, positive to the right like in the image
+**/
+double sim_pose_get_bearing(const sim_pose_t* pose, double x, double y, double* distance);
+
+/*===========================================================================*/
+/* LEDs.                                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               	Gets the color of a RGB LED.
+ * @param[in]	led     	the LED
+ * @param[out]	rgb     	its red, green and blue values
+ * @return              	none
+**/
+void sim_get_rgb_led(rgb_led_name_t led, uint8_t* rgb);
+
+/*===========================================================================*/
+/* Microphones and speaker.                                                  */
+/*===========================================================================*/
+
+/**
+ * @brief               	Calls the callback given to mic_start, as the driver of the
+ * 							microphones does every 10 ms with 160 samples per microphone.
+ * @param[in]	data    	the samples, the four microphones interleaved
+ * @param[in]	num_samples	the number of samples
+ * @return              	false if mic_start was not called
+**/
+bool sim_mic_feed(int16_t* data, uint16_t num_samples);
+
+/**
+ * @brief               	Gets the note played by the speaker.
+ * @return              	the frequency in Hz, 0 if the speaker is silent
+**/
+uint16_t sim_dac_get_note(void);
+
+/**
+ * @brief               	Sets a function called at each change of the note played.
+ * @param[in]	listener	the function, given the time of the change and the new note
+ * @return              	none
+**/
+void sim_dac_set_listener(void (*listener)(systime_t time, uint16_t frequency));
+
+/*===========================================================================*/
+/* Camera.                                                                   */
+/*===========================================================================*/
+
+//fills a buffer with the lines of a frame, in RGB565
+typedef void (*sim_frame_source_t)(uint32_t frame, uint8_t* buffer, uint16_t width, uint16_t height);
+
+/**
+ * @brief               	Sets the function filling the frames and the timing of the
+ * 							capture: the DMA writes the lines window_start ticks after
+ * 							the start of each frame, for window_length ticks.
+ * @param[in]	source  	the function filling the frames
+ * @param[in]	period  	the time between two frames, in system ticks
+ * @param[in]	window_start the time the lines start to be written at in each frame
+ * @param[in]	window_length the time taken to write the lines
+ * @return              	none
+**/
+void sim_camera_set_source(sim_frame_source_t source, systime_t period, systime_t window_start,
+							systime_t window_length);
+
+/**
+ * @brief               	Tells which frame the DMA wrote last in a buffer.
+ * @param[in]	buffer  	a pointer in the buffer
+ * @param[out]	frame   	the frame written last, or being written
+ * @param[out]	start   	the time its writing started at
+ * @return              	false if the pointer is not in a DCMI buffer
+**/
+bool sim_camera_get_write(const uint8_t* buffer, uint32_t* frame, systime_t* start);
+
+/**
+ * @brief               	Writes a pixel in RGB565 for a frame source, its red and blue
+ * 							channels at half scale.
+ * @param[out]	pixel   	the two bytes of the pixel
+ * @param[in]	green   	the green value, clipped to 0 to 255
+ * @return              	none
+**/
+void sim_write_pixel(uint8_t* pixel, int green);
+
+/**
+ * @brief               	Gets the exposure and the gains set to the po8030.
+ * @param[out]	exposure	the integration time in lines
+ * @param[out]	rgb_gain	the red, green and blue gains
+ * @param[out]	writes  	the number of times they were set
+ * @return              	none
+**/
+void sim_camera_get_settings(uint16_t* exposure, uint8_t* rgb_gain, uint32_t* writes);
+
+/*===========================================================================*/
+/* TOF sensor.                                                               */
+/*===========================================================================*/
+
+/**
+ * @brief               	Sets the distance the TOF sensor measures.
+ * @param[in]	distance	the distance in mm
+ * @return              	none
+**/
+void sim_tof_set_distance(uint16_t distance);
+
+#endif /* SIM_H */
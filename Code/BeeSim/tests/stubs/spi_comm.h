@@ -0,0 +1,11 @@
+/**
+ * @file	spi_comm.h
+ * @brief	Host version of the SPI link to the ESP32 driving the RGB LEDs.
+**/
+
+#ifndef SPI_COMM_H
+#define SPI_COMM_H
+
+void spi_comm_start(void);
+
+#endif /* SPI_COMM_H */
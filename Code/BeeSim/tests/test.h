@@ -0,0 +1,66 @@
+/**
+ * @file	test.h
+ * @brief	Checks and measures shared by the host tests.
+ * @note	A test prints each failed check and returns test_result() from main,
+ * 			1 if a check failed. The measures are printed on lines starting with #.
+**/
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+
+static unsigned test_checks = 0;
+static unsigned test_failures = 0;
+
+//counts the check and prints the message if the condition is false
+#define CHECK(condition, ...)											\
+	do {																\
+		test_checks++;													\
+		if(!(condition))												\
+		{																\
+			test_failures++;											\
+			printf("FAIL %s:%d: ", __FILE__, __LINE__);					\
+			printf(__VA_ARGS__);										\
+			printf("\n");												\
+		}																\
+	} while(0)
+
+/**
+ * @brief               	Prints the number of checks passed.
+ * @return              	the exit status of the test, 1 if a check failed
+**/
+static inline int test_result(void)
+{
+	printf("%u/%u checks passed\n", test_checks - test_failures, test_checks);
+	return test_failures == 0 ? 0 : 1;
+}
+
+/**
+ * @brief               	Gets the CPU time used by the test, for the throughputs.
+ * @return              	the time in seconds
+**/
+static inline double test_cpu_time(void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+	return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief               	Gets a random number of a normal distribution, Box-Muller.
+ * @return              	the number, mean 0 and standard deviation 1
+**/
+static inline double test_gaussian(void)
+{
+	double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+#endif /* TEST_H */
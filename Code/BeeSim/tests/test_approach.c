@@ -0,0 +1,254 @@
+/**
+ * @file	test_approach.c
+ * @brief	Simulates the approach of a balloon in closed loop, from the robot turning
+ * 			at the speed of the search, and measures the response of the bearing and
+ * 			of the distance.
+ * @note	The wheels follow the speeds set without slipping, the pose of the
+ * 			robot is integrated from the positions of the motors. approach_update
+ * 			is called like in approaching_during: at each frame of the camera, with
+ * 			the distance estimated from the width of the balloon, and at each
+ * 			distance of the TOF sensor once the balloon is in its range. The
+ * 			distances are given from the front of the robot to the surface of the
+ * 			balloon, with their noise. The robot must stop its rotation at the first
+ * 			update, then face the balloon without overshooting much and stop on
+ * 			GOAL_DISTANCE without touching it, its wheels within their acceleration.
+ * 			One approach loses the balloon for longer than MAX_UPDATE_PERIOD, the
+ * 			approach must then start again from a standstill.
+**/
+
+//C headers
+#include <string.h>
+
+//the static functions and variables of the approach are tested directly
+#include "../source/approach.c"
+
+#include "sim.h"
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+//speed of the search, like NORMAL_SPEED of the controller, in steps/s
+#define SEARCH_SPEED			150
+
+#define FRAME_PERIOD			MS2ST(66)
+#define TOF_PERIOD				MS2ST(30)
+//the TOF sensor gives the distance below it, like TOF_MAX_RANGE of the controller
+#define TOF_RANGE				500
+#define TOF_NOISE				3.0
+//relative noise of the distance estimated by the camera
+#define CAMERA_NOISE			0.02
+
+#define DEGREES_TO_RADIANS		(M_PI / 180.0)
+#define ROBOT_RADIUS			37.0
+#define BALLOON_RADIUS			125.0
+
+//time the balloon is lost for in the pause, longer than MAX_UPDATE_PERIOD
+#define PAUSE_TIME				MS2ST(200)
+#define MAX_TIME				MS2ST(30000)
+
+//bearing the robot settles within, and the one it can overshoot by, in degrees
+#define BEARING_TOLERANCE		2.0
+#define MAX_BEARING_OVERSHOOT	3.0
+#define MAX_SETTLING_TIME		1500
+//distance the robot can stop off GOAL_DISTANCE by, in mm
+#define MAX_GOAL_ERROR			10.0
+//acceleration measured allowed over MAX_ACCELERATION, the speeds being rounded to a step/s
+#define ACCELERATION_MARGIN		1.05
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+//start of an approach
+typedef struct scenario_t
+{
+	const char* name;
+	double distance;		//from the front of the robot to the balloon, in mm
+	double bearing;			//in degrees, positive to the right
+	double camera_bias;		//of the distance estimated by the camera, relative
+	double pause_distance;	//distance the balloon is lost at, 0 for none
+} scenario_t;
+
+//results of an approach
+typedef struct run_t
+{
+	bool reached;
+	bool stopped;				//at the first update, and at the first one after the pause
+	uint32_t time;				//to reach the goal, in ms
+	double settling_time;		//from the start to the bearing within BEARING_TOLERANCE, in ms
+	double overshoot;			//of the bearing past the center, in degrees
+	double final_distance;		//in mm
+	double min_distance;
+	double final_bearing;		//in degrees
+	double max_acceleration;	//of a wheel, in steps/s^2
+	uint32_t updates;
+} run_t;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static const scenario_t scenarios[] = {
+	{"ahead at 1 m",			1000,	0,		1.0,	0},
+	{"20 deg right at 1 m",		1000,	20,		1.0,	0},
+	{"15 deg left at 400 mm",	400,	-15,	1.0,	0},
+	{"camera 15% long at 2 m",	2000,	10,		1.15,	0},
+	{"lost at 600 mm",			1200,	-10,	1.0,	600},
+};
+#define NB_SCENARIOS			(sizeof(scenarios) / sizeof(scenarios[0]))
+
+static sim_pose_t pose = {0};
+static double balloon_x = 0, balloon_y = 0;
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               	Gets the balloon seen from the robot.
+ * @param[out]	distance	the distance from the front of the robot to its surface, in mm
+ * @return              	the bearing in radians, positive to the right like in the image
+**/
+static double get_bearing(double* distance)
+{
+	double bearing = sim_pose_get_bearing(&pose, balloon_x, balloon_y, distance);
+
+	*distance -= BALLOON_RADIUS + ROBOT_RADIUS;
+	return bearing;
+}
+
+/**
+ * @brief               	Approaches a balloon from the robot turning at the speed of the search.
+ * @param[in]	scenario	the start of the approach
+ * @param[out]	run     	the results
+ * @return              	none
+**/
+static void run_approach(const scenario_t* scenario, run_t* run)
+{
+	systime_t begin = 0, next_frame = 0, next_tof = 0, now = 0, last_update = 0;
+	double distance = 0, bearing = 0, measure = 0, start_side = 0, degrees = 0;
+	uint16_t position = IMAGE_BUFFER_SIZE/2, camera_distance = 0;
+	int16_t left = 0, right = 0, last_left = 0, last_right = 0;
+	bool paused = scenario->pause_distance == 0, first = true, frame = false;
+
+	memset(run, 0, sizeof(*run));
+	run->stopped = true;
+	run->min_distance = scenario->distance;
+	run->settling_time = -1;
+
+	//the robot turns at the speed of the search when it sees the balloon
+	sim_pose_reset(&pose);
+	balloon_x = (scenario->distance + BALLOON_RADIUS + ROBOT_RADIUS) * cos(scenario->bearing * DEGREES_TO_RADIANS);
+	balloon_y = -(scenario->distance + BALLOON_RADIUS + ROBOT_RADIUS) * sin(scenario->bearing * DEGREES_TO_RADIANS);
+	start_side = scenario->bearing > 0 ? 1 : -1;
+	right_motor_set_speed(SEARCH_SPEED);
+	left_motor_set_speed(-SEARCH_SPEED);
+	approach_reset();
+
+	begin = chVTGetSystemTime();
+	next_frame = begin;
+	next_tof = begin;
+	while(!run->reached && chVTGetSystemTime() - begin < MAX_TIME){
+		//the next frame of the camera or distance of the TOF sensor
+		now = next_frame < next_tof ? next_frame : next_tof;
+		if(now != chVTGetSystemTime())
+		{
+			chThdSleep(now - chVTGetSystemTime());
+		}
+		frame = now == next_frame;
+		if(frame)
+		{
+			next_frame += FRAME_PERIOD;
+		} else {
+			next_tof += TOF_PERIOD;
+		}
+
+		sim_pose_update(&pose);
+		bearing = get_bearing(&distance);
+		degrees = bearing / DEGREES_TO_RADIANS;
+		run->min_distance = fmin(run->min_distance, distance);
+		if(run->updates > 0)
+		{
+			run->overshoot = fmax(run->overshoot, -start_side * degrees);
+			if(fabs(degrees) > BEARING_TOLERANCE)
+			{
+				run->settling_time = -1;
+			} else if(run->settling_time < 0) {
+				run->settling_time = ST2MS(now - begin);
+			}
+		}
+		//the balloon is lost, the robot goes on at the speeds set
+		if(!paused && distance < scenario->pause_distance)
+		{
+			paused = true;
+			first = true;
+			next_frame = now + PAUSE_TIME;
+			next_tof = next_frame;
+			continue;
+		}
+
+		if(frame)
+		{
+			position = IMAGE_BUFFER_SIZE/2 + lround(FOCAL_LENGTH * tan(bearing));
+			camera_distance = fmax(0, distance * scenario->camera_bias * (1 + CAMERA_NOISE * test_gaussian()));
+		} else if(distance >= TOF_RANGE) {
+			continue;
+		}
+		//the TOF sensor gives the distance in its range, like get_balloon_range
+		measure = distance < TOF_RANGE ? distance + TOF_NOISE * test_gaussian() : camera_distance;
+		run->reached = approach_update(measure < 0 ? 0 : lround(measure), position);
+		run->updates++;
+
+		sim_motors_get_speed(&left, &right);
+		if(first)
+		{
+			run->stopped = run->stopped && left == 0 && right == 0;
+			first = false;
+		} else if(!run->reached) {
+			run->max_acceleration = fmax(run->max_acceleration, fmax(abs(left - last_left), abs(right - last_right))
+										* CH_CFG_ST_FREQUENCY / (double)(now - last_update));
+		}
+		last_left = left;
+		last_right = right;
+		last_update = now;
+	}
+	run->time = ST2MS(chVTGetSystemTime() - begin);
+	sim_pose_update(&pose);
+	run->final_bearing = get_bearing(&run->final_distance) / DEGREES_TO_RADIANS;
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	run_t run;
+
+	srand(1);
+	motors_init();
+
+	for(uint8_t i = 0 ; i < NB_SCENARIOS ; i++){
+		run_approach(&scenarios[i], &run);
+		printf("# %-24s reached in %5u ms and %3u updates, %.1f mm off the goal and %.1f deg off the center,"
+				" bearing settled in %4.0f ms with %.1f deg of overshoot, %.1f mm at the closest, acceleration up"
+				" to %.0f steps/s^2\n", scenarios[i].name, (unsigned)run.time, (unsigned)run.updates,
+				run.final_distance - GOAL_DISTANCE, run.final_bearing, run.settling_time, run.overshoot,
+				run.min_distance, run.max_acceleration);
+		CHECK(run.stopped, "%s: search rotation not stopped at the first update", scenarios[i].name);
+		CHECK(run.reached, "%s: goal not reached in %u ms", scenarios[i].name, (unsigned)ST2MS(MAX_TIME));
+		CHECK(fabs(run.final_distance - GOAL_DISTANCE) <= MAX_GOAL_ERROR && run.min_distance >= GOAL_DISTANCE
+				- MAX_GOAL_ERROR, "%s: stopped at %.1f mm, %.1f mm at the closest", scenarios[i].name,
+				run.final_distance, run.min_distance);
+		CHECK(run.settling_time >= 0 && run.settling_time <= MAX_SETTLING_TIME && fabs(run.final_bearing)
+				<= BEARING_TOLERANCE, "%s: bearing settled in %.0f ms, %.1f deg at the end", scenarios[i].name,
+				run.settling_time, run.final_bearing);
+		CHECK(run.overshoot <= MAX_BEARING_OVERSHOOT, "%s: bearing overshoot of %.1f deg", scenarios[i].name,
+				run.overshoot);
+		CHECK(run.max_acceleration <= ACCELERATION_MARGIN * MAX_ACCELERATION, "%s: acceleration of %.0f steps/s^2",
+				scenarios[i].name, run.max_acceleration);
+	}
+	return test_result();
+}
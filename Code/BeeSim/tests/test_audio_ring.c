@@ -0,0 +1,176 @@
+/**
+ * @file	test_audio_ring.c
+ * @brief	Stresses the ring buffer between the microphone callback and the audio thread.
+ * @note	A thread of the priority of the driver calls the callback every 10 ms
+ * 			with a block numbered in its samples. The combination of the microphones
+ * 			is replaced by a function checking that the blocks reach the audio thread
+ * 			whole and in order, and keeping the CPU busy for a random time to make the
+ * 			audio thread late. Within the real time the ring buffer must lose no block,
+ * 			overloaded it must lose blocks without reordering or mixing the others.
+**/
+
+//the static functions and constants of the pipeline are tested directly
+#include "../source/process_audio.c"
+
+#include "sim.h"
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define BLOCK_PERIOD		MS2ST(10)
+#define BLOCKS_PER_RUN		6000
+
+//random processing times of a block, in us: below the period on average but
+//late by up to two blocks at times, which the ring buffer absorbs
+#define REAL_TIME_DELAY		9000
+#define REAL_TIME_SPIKE		25000
+#define SPIKE_PERIOD		20
+//always above the period, the blocks have to be lost
+#define OVERLOAD_DELAY		15000
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static int16_t block[NB_MICS * MIC_BLOCK_SIZE];
+
+//number of the next block sent and of the last block received
+static uint32_t sent_blocks = 0;
+static uint32_t blocks_to_send = 0;
+static int32_t last_received = -1;
+static uint32_t received_blocks = 0;
+static uint32_t reordered_blocks = 0;
+static uint32_t corrupted_blocks = 0;
+static uint32_t max_pending = 0;
+
+static bool overload = false;
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+//the first two samples hold the number of the block, the others depend on it
+static int16_t sample_value(uint32_t number, uint16_t index)
+{
+	if(index < 2)
+	{
+		return (int16_t)((number >> (15 * index)) & INT16_MAX);
+	}
+	return (int16_t)((number * 7 + index) & INT16_MAX);
+}
+
+//the microphones are not combined, the blocks are checked instead
+void mic_array_init(const uint16_t* bins, uint8_t nb_bins, uint16_t frame_size, float min_magnitude)
+{
+}
+
+uint16_t mic_array_process(const int16_t* data, uint16_t num_samples, float* output)
+{
+	uint32_t number = (uint32_t)data[0] | (uint32_t)data[1] << 15;
+	uint32_t pending = audio_ring_head - audio_ring_tail;
+	bool whole = true;
+
+	for(uint16_t i = 0 ; i < num_samples ; i++){
+		whole = whole && data[i] == sample_value(number, i);
+	}
+	corrupted_blocks += !whole || num_samples != NB_MICS * MIC_BLOCK_SIZE;
+	reordered_blocks += (int32_t)number <= last_received;
+	last_received = number;
+	received_blocks++;
+	max_pending = pending > max_pending ? pending : max_pending;
+
+	memset(output, 0, MIC_BLOCK_SIZE * sizeof(float));
+	//the time the audio thread takes on the block
+	if(overload)
+	{
+		sim_consume(US2ST(OVERLOAD_DELAY));
+	} else if(rand() % SPIKE_PERIOD == 0) {
+		sim_consume(US2ST(rand() % REAL_TIME_SPIKE));
+	} else {
+		sim_consume(US2ST(rand() % REAL_TIME_DELAY));
+	}
+	return MIC_BLOCK_SIZE;
+}
+
+bool mic_array_get_bearing(int16_t* bearing)
+{
+	*bearing = 0;
+	return false;
+}
+
+/*===========================================================================*/
+/* File threads.                                                             */
+/*===========================================================================*/
+
+//the DMA of the microphones, above every thread of the project
+static THD_WORKING_AREA(waMicrophones, 256);
+static THD_FUNCTION(Microphones, arg)
+{
+	(void)arg;
+	systime_t time = chVTGetSystemTime();
+
+	while(1){
+		time = chThdSleepUntilWindowed(time, time + BLOCK_PERIOD);
+		if(sent_blocks >= blocks_to_send)
+		{
+			continue;
+		}
+		for(uint16_t i = 0 ; i < NB_MICS * MIC_BLOCK_SIZE ; i++){
+			block[i] = sample_value(sent_blocks, i);
+		}
+		sent_blocks++;
+		queue_audio_data(block, NB_MICS * MIC_BLOCK_SIZE);
+	}
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+/**
+ * @brief               	Sends BLOCKS_PER_RUN blocks and waits for the audio thread.
+ * @note                	The audio thread of the same priority keeps the CPU while it
+ * 							is late, the main thread only runs once it caught up.
+ * @param[in]	overloaded	true to process the blocks slower than they come
+ * @return              	the number of blocks lost during the run
+**/
+static uint32_t run(bool overloaded)
+{
+	uint32_t overruns = audio_overruns;
+
+	overload = overloaded;
+	blocks_to_send += BLOCKS_PER_RUN;
+	while(sent_blocks < blocks_to_send || audio_ring_tail != audio_ring_head){
+		chThdSleep(BLOCK_PERIOD);
+	}
+	return audio_overruns - overruns;
+}
+
+int main(void)
+{
+	uint32_t lost = 0;
+
+	srand(1);
+	process_audio_start();
+	chThdCreateStatic(waMicrophones, sizeof(waMicrophones), HIGHPRIO, Microphones, NULL);
+
+	lost = run(false);
+	CHECK(lost == 0, "%u blocks lost in real time", (unsigned)lost);
+	CHECK(received_blocks == sent_blocks, "%u blocks sent, %u received", (unsigned)sent_blocks,
+			(unsigned)received_blocks);
+	printf("# real time: %u blocks, %u lost, up to %u blocks pending out of %d\n", (unsigned)sent_blocks,
+			(unsigned)lost, (unsigned)max_pending, AUDIO_RING_SIZE);
+
+	lost = run(true);
+	CHECK(lost > 0, "no block lost while overloaded");
+	CHECK(received_blocks + audio_overruns == sent_blocks, "%u blocks sent, %u received and %u lost",
+			(unsigned)sent_blocks, (unsigned)received_blocks, (unsigned)audio_overruns);
+	CHECK(audio_blocks == sent_blocks, "%u blocks counted, %u sent", (unsigned)audio_blocks, (unsigned)sent_blocks);
+	printf("# overloaded: %u blocks, %u lost\n", BLOCKS_PER_RUN, (unsigned)lost);
+
+	CHECK(reordered_blocks == 0, "%u blocks out of order", (unsigned)reordered_blocks);
+	CHECK(corrupted_blocks == 0, "%u blocks corrupted", (unsigned)corrupted_blocks);
+	return test_result();
+}
@@ -0,0 +1,190 @@
+/**
+ * @file	test_bands.c
+ * @brief	Measures the false detections and the time of a frame with the two lines
+ * 			of each band averaged, against a single line.
+ * @note	Built with several bands. The frames are made of a flower crossing some
+ * 			of the bands, with the noise of the sensor drawn independently on each
+ * 			line. A single line is processed as a band whose two lines are the same,
+ * 			through the same code. The flower must be found at its place, and a
+ * 			false detection is a balloon found anywhere else. The time of a frame
+ * 			covers every band, the time of a single line the kernels and the search
+ * 			of one line, as the processing did before the lines were averaged.
+**/
+
+//C headers
+#include <string.h>
+
+//the static functions and variables of the processing are tested directly
+#include "../source/process_image.c"
+
+#include "sim.h"
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define BACKGROUND				128
+#define FLOWER_GREEN			60
+#define BALLOON_FIRST			250
+#define BALLOON_LAST			349
+
+#define NB_FRAMES				2000
+#define TIMED_FRAMES			20000
+//standard deviations of the noise of a line, in green values, up to where the edges
+//of the noise are so dense that they rarely pair into balloons
+static const double noises[] = {3, 4, 5, 6, 7};
+#define NB_NOISES				(sizeof(noises) / sizeof(noises[0]))
+//noise of the sensor in normal light
+#define NOMINAL_NOISE			4
+
+//false balloons per frame allowed at the nominal noise
+#define MAX_FALSE_RATE			0.001
+//pixels the edges of the flower can be found off by in the noise
+#define EDGE_TOLERANCE			2
+
+/*===========================================================================*/
+/* Global variables.                                                         */
+/*===========================================================================*/
+
+messagebus_t bus;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static uint8_t frame[NB_LINES * LINE_SIZE];
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               	Draws a frame, with a flower in some of its bands.
+ * @param[in]	bands   	the bands the flower is in, a bit per band
+ * @param[in]	noise   	the standard deviation of the noise of each line
+ * @param[in]	fused   	false to copy the first line of each band over the second one
+ * @return              	none
+**/
+static void draw_frame(uint8_t bands, double noise, bool fused)
+{
+	uint8_t* line = NULL;
+	int green = 0;
+
+	for(uint8_t i = 0 ; i < NB_LINES ; i++){
+		line = &frame[i * LINE_SIZE];
+		if(!fused && i % 2)
+		{
+			memcpy(line, line - LINE_SIZE, LINE_SIZE);
+			continue;
+		}
+		for(uint16_t j = 0 ; j < IMAGE_BUFFER_SIZE ; j++){
+			green = (bands & (1 << (i / 2))) && j >= BALLOON_FIRST && j <= BALLOON_LAST ? FLOWER_GREEN : BACKGROUND;
+			sim_write_pixel(&line[2 * j], green + noise * test_gaussian());
+		}
+	}
+}
+
+/**
+ * @brief               	Processes every band of the frame, like ProcessImage.
+ * @return              	none
+**/
+static void process_frame(void)
+{
+	for(uint8_t band = 0 ; band < NB_BANDS ; band++){
+		process_band(&frame[2 * band * LINE_SIZE], band, 0, IMAGE_BUFFER_SIZE);
+	}
+}
+
+/**
+ * @brief               	Processes a single line, the kernels and the search of one line.
+ * @return              	none
+**/
+static void process_line(void)
+{
+	image_extract_green(&frame[2 * MAIN_BAND * LINE_SIZE], image, IMAGE_BUFFER_SIZE);
+	image_gradient(image, gradient, GRADIENT_SIZE, WIDTH_SLOPE);
+	nb_candidates[MAIN_BAND] = find_candidates(gradient, 0, GRADIENT_SIZE, candidates[MAIN_BAND]);
+}
+
+/**
+ * @brief               	Counts the balloons of the main band in frames with a flower.
+ * @param[in]	noise   	the standard deviation of the noise of each line
+ * @param[in]	fused   	true to average the two lines of the band
+ * @param[out]	false_rate	the false balloons per frame
+ * @return              	the share of the frames the flower is found in
+**/
+static double detection_rate(double noise, bool fused, double* false_rate)
+{
+	const candidate_t* found = NULL;
+	uint32_t nb_false = 0, nb_found = 0;
+
+	for(uint32_t i = 0 ; i < NB_FRAMES ; i++){
+		draw_frame(1 << MAIN_BAND, noise, fused);
+		process_band(&frame[2 * MAIN_BAND * LINE_SIZE], MAIN_BAND, 0, IMAGE_BUFFER_SIZE);
+		for(uint8_t j = 0 ; j < nb_candidates[MAIN_BAND] ; j++){
+			found = &candidates[MAIN_BAND][j];
+			//the opening edge is found WIDTH_SLOPE pixels before the balloon
+			if(found->type == FLOWER && abs(found->begin + WIDTH_SLOPE - BALLOON_FIRST) <= EDGE_TOLERANCE
+				&& abs(found->end - 1 - BALLOON_LAST) <= EDGE_TOLERANCE)
+			{
+				nb_found++;
+			} else {
+				nb_false++;
+			}
+		}
+	}
+	*false_rate = (double)nb_false / NB_FRAMES;
+	return (double)nb_found / NB_FRAMES;
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	double single = 0, fused = 0, single_false = 0, fused_false = 0;
+	double begin = 0, frame_time = 0, line_time = 0;
+
+	srand(1);
+
+	//the flower in every band, then only in the main one
+	draw_frame((1 << NB_BANDS) - 1, NOMINAL_NOISE, true);
+	process_frame();
+	CHECK(nb_candidates[MAIN_BAND] == 1 && measure_extent(&candidates[MAIN_BAND][0]) == NB_BANDS * BAND_HEIGHT,
+			"extent of a balloon in every band: %u rows", nb_candidates[MAIN_BAND] ? measure_extent(&candidates[MAIN_BAND][0]) : 0);
+	draw_frame(1 << MAIN_BAND, NOMINAL_NOISE, true);
+	process_frame();
+	CHECK(nb_candidates[MAIN_BAND] == 1 && measure_extent(&candidates[MAIN_BAND][0]) == BAND_HEIGHT,
+			"extent of a balloon in the main band: %u rows", nb_candidates[MAIN_BAND] ? measure_extent(&candidates[MAIN_BAND][0]) : 0);
+
+	//the noise of each line, from the one of the sensor in normal light
+	for(uint8_t i = 0 ; i < NB_NOISES ; i++){
+		single = detection_rate(noises[i], false, &single_false);
+		fused = detection_rate(noises[i], true, &fused_false);
+		CHECK(fused >= single && fused_false <= single_false, "averaging the lines is worse at a noise of %.0f", noises[i]);
+		if(noises[i] == NOMINAL_NOISE)
+		{
+			CHECK(fused == 1 && fused_false <= MAX_FALSE_RATE, "at the nominal noise, flower found in %.1f%% of the frames"
+					" and %.4f false balloons per frame", 100 * fused, fused_false);
+		}
+		printf("# noise %3.1f: found in %5.1f%% of the frames with %.4f false balloons per frame on a single line,"
+				" %5.1f%% with %.4f on the averaged lines\n", noises[i], 100 * single, single_false, 100 * fused, fused_false);
+	}
+
+	draw_frame(1 << MAIN_BAND, NOMINAL_NOISE, true);
+	begin = test_cpu_time();
+	for(uint32_t i = 0 ; i < TIMED_FRAMES ; i++){
+		process_frame();
+	}
+	frame_time = (test_cpu_time() - begin) / TIMED_FRAMES;
+	begin = test_cpu_time();
+	for(uint32_t i = 0 ; i < TIMED_FRAMES ; i++){
+		process_line();
+	}
+	line_time = (test_cpu_time() - begin) / TIMED_FRAMES;
+	printf("# %d bands of %d averaged lines: %.2f us per frame, %.2f us for a single line, on the host\n",
+			NB_BANDS, BAND_HEIGHT / LINE_SPACING, 1e6 * frame_time, 1e6 * line_time);
+	return test_result();
+}
@@ -0,0 +1,200 @@
+/**
+ * @file	test_color_classes.c
+ * @brief	Checks the classification of the pixels by color_table and benchmarks
+ * 			the processing of a line with it, against the green edges.
+ * @note	Built with the color classes. The index of every RGB565 color must be
+ * 			made of the 4 MSbits of its channels, and balloons of the hues of
+ * 			tools/color_table.py must be segmented with their class under several
+ * 			levels of light. The time of a band covers both of its lines, the green
+ * 			edges are timed with the kernels of image_kernels.c and their search
+ * 			for the edges. The times are the ones of the host.
+**/
+
+//the static functions and variables of the processing are tested directly
+#include "../source/process_image.c"
+
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+//colors in 8 bits components at full light: grey background, red flower, yellow-green ennemy
+static const uint8_t background_color[3] = {120, 120, 120};
+static const uint8_t flower_color[3] = {200, 40, 60};
+static const uint8_t ennemy_color[3] = {110, 200, 40};
+
+//levels of light, the share of the full light reaching the sensor
+static const float lights[] = {0.4f, 0.6f, 0.8f, 1.0f};
+#define NB_LIGHTS				(sizeof(lights) / sizeof(lights[0]))
+
+#define NOISE					4.0
+#define NB_NOISY_LINES			1000
+#define TIMED_LINES				20000
+
+#define FLOWER_FIRST			100
+#define FLOWER_LAST				219
+#define ENNEMY_FIRST			350
+#define ENNEMY_LAST				479
+
+/*===========================================================================*/
+/* Global variables.                                                         */
+/*===========================================================================*/
+
+messagebus_t bus;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static uint8_t lines[2 * LINE_SIZE];
+static uint8_t green[IMAGE_BUFFER_SIZE], other_green[IMAGE_BUFFER_SIZE];
+static int8_t green_gradient[GRADIENT_SIZE];
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+static uint8_t clip(double value)
+{
+	return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+/**
+ * @brief               	Writes a pixel in RGB565.
+ * @param[out]	pixel   	the two bytes of the pixel
+ * @param[in]	red     	the channels, 0 to 255
+ * @param[in]	green
+ * @param[in]	blue
+ * @return              	none
+**/
+static void write_pixel(uint8_t* pixel, uint8_t red, uint8_t green, uint8_t blue)
+{
+	uint16_t value = ((red >> 3) << 11) | ((green >> 2) << 5) | (blue >> 3);
+
+	//the camera sends the MSbyte first
+	pixel[0] = value >> 8;
+	pixel[1] = value & 0xFF;
+}
+
+/**
+ * @brief               	Draws a flower and an ennemy on both lines of a band.
+ * @param[in]	light   	the share of the full light
+ * @param[in]	noise   	the standard deviation of the noise of each channel
+ * @return              	none
+**/
+static void draw_band(float light, double noise)
+{
+	const uint8_t* color = NULL;
+
+	for(uint8_t line = 0 ; line < 2 ; line++){
+		for(uint16_t i = 0 ; i < IMAGE_BUFFER_SIZE ; i++){
+			if(i >= FLOWER_FIRST && i <= FLOWER_LAST)
+			{
+				color = flower_color;
+			} else if(i >= ENNEMY_FIRST && i <= ENNEMY_LAST) {
+				color = ennemy_color;
+			} else {
+				color = background_color;
+			}
+			write_pixel(&lines[line * LINE_SIZE + 2 * i], clip(light * color[0] + noise * test_gaussian()),
+						clip(light * color[1] + noise * test_gaussian()), clip(light * color[2] + noise * test_gaussian()));
+		}
+	}
+}
+
+/**
+ * @brief               	Tells if the band was segmented into the flower and the ennemy.
+ * @return              	true if both balloons were found with their class and their edges
+**/
+static bool segmented(void)
+{
+	const candidate_t* found = candidates[MAIN_BAND];
+
+	return nb_candidates[MAIN_BAND] == 2
+			&& found[0].type == FLOWER && found[0].begin == FLOWER_FIRST && found[0].end == FLOWER_LAST
+			&& found[1].type == ENNEMY && found[1].begin == ENNEMY_FIRST && found[1].end == ENNEMY_LAST;
+}
+
+/**
+ * @brief               	Processes a line with the green edges, like the other method.
+ * @return              	the number of edges found
+**/
+static uint16_t process_green_edges(void)
+{
+	uint16_t i = 0, nb_edges = 0;
+
+	image_extract_green(lines, green, IMAGE_BUFFER_SIZE);
+	image_extract_green(&lines[LINE_SIZE], other_green, IMAGE_BUFFER_SIZE);
+	image_average(green, other_green, green, IMAGE_BUFFER_SIZE);
+	image_gradient(green, green_gradient, GRADIENT_SIZE, WIDTH_SLOPE);
+	while((i = image_find_edge(green_gradient, i, GRADIENT_SIZE, GRADIENT_THRESHOLD)) < GRADIENT_SIZE){
+		while(i < GRADIENT_SIZE && abs(green_gradient[i]) > GRADIENT_THRESHOLD)
+		{
+			i++;
+		}
+		nb_edges++;
+	}
+	return nb_edges;
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	uint8_t pixel[2] = {0};
+	uint16_t expected = 0;
+	uint32_t wrong_indexes = 0, nb_segmented = 0, edges = 0;
+	double begin = 0, class_time = 0, edge_time = 0;
+
+	srand(1);
+
+	//the 4 MSbits of each channel, red first
+	for(uint32_t value = 0 ; value <= UINT16_MAX ; value++){
+		pixel[0] = value >> 8;
+		pixel[1] = value & 0xFF;
+		expected = (((value >> 12) & 0x0F) << 8) | (((value >> 7) & 0x0F) << 4) | ((value >> 1) & 0x0F);
+		wrong_indexes += COLOR_INDEX(pixel) != expected;
+	}
+	CHECK(wrong_indexes == 0, "%u RGB565 colors with a wrong index", (unsigned)wrong_indexes);
+
+	write_pixel(pixel, flower_color[0], flower_color[1], flower_color[2]);
+	CHECK(color_table[COLOR_INDEX(pixel)] == FLOWER, "flower color of class %u", color_table[COLOR_INDEX(pixel)]);
+	write_pixel(pixel, ennemy_color[0], ennemy_color[1], ennemy_color[2]);
+	CHECK(color_table[COLOR_INDEX(pixel)] == ENNEMY, "ennemy color of class %u", color_table[COLOR_INDEX(pixel)]);
+	write_pixel(pixel, background_color[0], background_color[1], background_color[2]);
+	CHECK(color_table[COLOR_INDEX(pixel)] == NONE, "background color of class %u", color_table[COLOR_INDEX(pixel)]);
+
+	//the classes do not depend on the light, as long as the colors stay saturated enough
+	for(uint8_t i = 0 ; i < NB_LIGHTS ; i++){
+		draw_band(lights[i], 0);
+		process_band(lines, MAIN_BAND, 0, IMAGE_BUFFER_SIZE);
+		CHECK(segmented(), "balloons not segmented by their colors at %.0f%% of the light", 100 * lights[i]);
+		nb_segmented = 0;
+		for(uint32_t line = 0 ; line < NB_NOISY_LINES ; line++){
+			draw_band(lights[i], NOISE);
+			process_band(lines, MAIN_BAND, 0, IMAGE_BUFFER_SIZE);
+			nb_segmented += segmented();
+		}
+		printf("# %3.0f%% of the light: %.1f%% of the noisy lines segmented exactly\n",
+				100 * lights[i], 100.0 * nb_segmented / NB_NOISY_LINES);
+	}
+
+	draw_band(1, NOISE);
+	begin = test_cpu_time();
+	for(uint32_t i = 0 ; i < TIMED_LINES ; i++){
+		process_band(lines, MAIN_BAND, 0, IMAGE_BUFFER_SIZE);
+	}
+	class_time = (test_cpu_time() - begin) / TIMED_LINES;
+	begin = test_cpu_time();
+	for(uint32_t i = 0 ; i < TIMED_LINES ; i++){
+		edges += process_green_edges();
+	}
+	edge_time = (test_cpu_time() - begin) / TIMED_LINES;
+	printf("# per band of %d pixels on the host: %.2f us with the color classes (%.1f ns per pixel),"
+			" %.2f us with the green edges (%u edges)\n", IMAGE_BUFFER_SIZE, 1e6 * class_time,
+			1e9 * class_time / IMAGE_BUFFER_SIZE, 1e6 * edge_time, (unsigned)(edges / TIMED_LINES));
+	return test_result();
+}
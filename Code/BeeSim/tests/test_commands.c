@@ -0,0 +1,175 @@
+/**
+ * @file	test_commands.c
+ * @brief	Runs whistled sequences of tones through the pipeline and the command table.
+ * @note	The table of the test has commands of one, two and three tones, some of
+ * 			them starting like others, in place of the single tones of the robot. Each
+ * 			sequence is whistled over noise, a tone every TONE_LENGTH with short gaps,
+ * 			followed by a long silence ending the sequences still waiting. The command
+ * 			recognised and the time it is recognised at are checked: at once for a
+ * 			command no other one continues, after the timeout of the sequence otherwise.
+**/
+
+//the commands of the test, defined before the pipeline uses them
+#define COMMAND_LIST(X)																\
+	X(STOPPED,					TONE_STOP)											\
+	X(MOVING_TO_BALLOON,		TONE_MOVE, TONE_COMMUNICATE)						\
+	X(COMMUNICATING_WITH_PEERS,	TONE_MOVE, TONE_COMMUNICATE, TONE_STOP)				\
+	X(COMMUNICATING_WITH_PEERS,	TONE_COMMUNICATE, TONE_COMMUNICATE)
+
+//the static functions and constants of the pipeline are tested directly
+#include "../source/process_audio.c"
+
+#include "sim.h"
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define AMPLITUDE			3000
+#define NOISE				300
+#define TONE_LENGTH			(SAMPLING_FREQUENCY * 3 / 10)
+#define TONE_GAP			(SAMPLING_FREQUENCY * 15 / 100)
+#define SEQUENCE_GAP		SAMPLING_FREQUENCY
+
+//samples of silence after which the sequences waiting for a longer command end
+#define TIMEOUT_LENGTH		(SEQUENCE_TIMEOUT * HOP_SIZE * DECIMATION_FACTOR)
+
+#define NO_COMMAND			((mode_selected_t)-1)
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+typedef struct sequence_t
+{
+	const char* name;
+	uint8_t length;
+	tone_t tones[2 * MAX_SEQUENCE_LENGTH];
+	mode_selected_t expected;	//NO_COMMAND if no command is recognised
+	bool waits;					//true if it is recognised only after the timeout
+} sequence_t;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static const sequence_t sequences[] = {
+	{"STOP",					1, {TONE_STOP},			STOPPED,					false},
+	{"MOVE COMMUNICATE",		2, {TONE_MOVE, TONE_COMMUNICATE},
+								MOVING_TO_BALLOON,										true},
+	{"MOVE COMMUNICATE STOP",	3, {TONE_MOVE, TONE_COMMUNICATE, TONE_STOP},
+								COMMUNICATING_WITH_PEERS,								false},
+	{"COMMUNICATE COMMUNICATE",	2, {TONE_COMMUNICATE, TONE_COMMUNICATE},
+								COMMUNICATING_WITH_PEERS,								false},
+	{"MOVE",					1, {TONE_MOVE},			NO_COMMAND,					false},
+	{"COMMUNICATE",				1, {TONE_COMMUNICATE},	NO_COMMAND,					false},
+	//the first tone starts no command with the next ones and is dropped
+	{"COMMUNICATE MOVE COMMUNICATE STOP", 4, {TONE_COMMUNICATE, TONE_MOVE, TONE_COMMUNICATE, TONE_STOP},
+								COMMUNICATING_WITH_PEERS,								false},
+	{"STOP MOVE COMMUNICATE",	3, {TONE_STOP, TONE_MOVE, TONE_COMMUNICATE},
+								MOVING_TO_BALLOON,										true},
+};
+
+#define NB_SEQUENCES		(sizeof(sequences) / sizeof(sequences[0]))
+
+static int16_t block[NB_MICS * MIC_BLOCK_SIZE];
+static uint32_t generated_samples = 0;
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+static const char* mode_name(mode_selected_t mode)
+{
+	switch(mode){
+		case STOPPED:					return "STOPPED";
+		case MOVING_TO_BALLOON:			return "MOVING_TO_BALLOON";
+		case COMMUNICATING_WITH_PEERS:	return "COMMUNICATING_WITH_PEERS";
+	}
+	return "none";
+}
+
+/**
+ * @brief               	Feeds noise and optionally a tone to the pipeline, block by block.
+ * @param[in]	length  	the number of samples per microphone
+ * @param[in]	bin     	the bin of the tone, 0 for noise only
+ * @return              	none
+**/
+static void feed(uint32_t length, uint16_t bin)
+{
+	static uint16_t fill = 0;
+
+	for(uint32_t n = 0 ; n < length ; n++){
+		float tone = bin ? AMPLITUDE * sinf(2 * PI * bin * n / FRAME_SIZE) : 0;
+
+		for(uint8_t mic = 0 ; mic < NB_MICS ; mic++){
+			block[NB_MICS * fill + mic] = (int16_t)lrintf(tone + NOISE * test_gaussian());
+		}
+		generated_samples++;
+		if(++fill == MIC_BLOCK_SIZE)
+		{
+			fill = 0;
+			sim_mic_feed(block, NB_MICS * MIC_BLOCK_SIZE);
+			//the audio thread processes the block while the next one is recorded
+			chThdSleep(US2ST(1000000ULL * MIC_BLOCK_SIZE / SAMPLING_FREQUENCY));
+		}
+	}
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	audio_stats_t stats;
+	uint32_t last_change = 0, changes = 0, end = 0;
+	const sequence_t* sequence = NULL;
+
+	srand(1);
+	process_audio_start();
+	feed(SEQUENCE_GAP, 0);
+	get_audio_stats(&stats);
+	last_change = stats.mode_change_sample;
+
+	for(uint8_t i = 0 ; i < NB_SEQUENCES ; i++){
+		sequence = &sequences[i];
+		changes = 0;
+		for(uint8_t j = 0 ; j < sequence->length ; j++){
+			feed(TONE_GAP, 0);
+			feed(TONE_LENGTH, tone_bins[sequence->tones[j]]);
+		}
+		end = generated_samples;
+		feed(SEQUENCE_GAP, 0);
+
+		get_audio_stats(&stats);
+		if(stats.mode_change_sample != last_change)
+		{
+			changes++;
+			last_change = stats.mode_change_sample;
+		}
+		if(sequence->expected == NO_COMMAND)
+		{
+			CHECK(changes == 0, "%s: %s activated", sequence->name, mode_name(get_mode()));
+			printf("# %-34s none\n", sequence->name);
+			continue;
+		}
+		CHECK(changes == 1 && get_mode() == sequence->expected, "%s: %s instead of %s", sequence->name,
+				changes ? mode_name(get_mode()) : "none", mode_name(sequence->expected));
+		//a command waiting for a longer one is recognised after the timeout, the others during their last tone
+		if(sequence->waits)
+		{
+			CHECK(last_change >= end + TIMEOUT_LENGTH - TONE_GAP, "%s: recognised %d samples after its end",
+					sequence->name, (int)(last_change - end));
+		} else {
+			CHECK(last_change <= end, "%s: recognised %d samples after its end", sequence->name,
+					(int)(last_change - end));
+		}
+		printf("# %-34s %-24s %+7.1f ms from the end of the last tone\n", sequence->name,
+				changes ? mode_name(get_mode()) : "none", 1000.0 * ((double)last_change - end) / SAMPLING_FREQUENCY);
+	}
+	printf("# %d commands, %d sequences, timeout of %.0f ms\n", (int)NB_COMMANDS, (int)NB_SEQUENCES,
+			1000.0 * TIMEOUT_LENGTH / SAMPLING_FREQUENCY);
+	return test_result();
+}
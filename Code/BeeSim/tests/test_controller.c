@@ -0,0 +1,348 @@
+/**
+ * @file	test_controller.c
+ * @brief	Takes every transition of the state machine of the controller, then runs
+ * 			the controller thread through the behaviours and measures its stack.
+ * @note	Each transition starts from an innermost state entered from the top,
+ * 			with the mode and the maneuvers done its guard depends on. The event
+ * 			must lead to the innermost state expected and be traced, and the events
+ * 			no state around the innermost one handles must change nothing. The
+ * 			thread is then woken by the commands, the detections and the distances
+ * 			like on the robot, pollinates a flower, attacks an enemy, dances and
+ * 			stops. The host stack it used is measured against a thread which only
+ * 			waits for events, to remove the thread descriptor of the host and the
+ * 			wait in the kernel: the rest must fit in the working area.
+**/
+
+//the static functions and variables of the controller are tested directly
+#include "../source/controller.c"
+
+#include "sim.h"
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define STATE_TIMEOUT			MS2ST(10000)
+#define POLL_PERIOD				MS2ST(10)
+//distance the TOF sensor gives without any obstacle, in mm
+#define FAR_DISTANCE			8190
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+//transition from an innermost state
+typedef struct transition_case_t
+{
+	controller_state_t source;
+	controller_event_t event;
+	mode_selected_t mode;			//for the guard of the commands
+	uint8_t repeats;				//giggles or dance turns done, for their guards
+	controller_state_t target;		//innermost state entered, NO_STATE if the event is not handled
+} transition_case_t;
+
+/*===========================================================================*/
+/* Global variables.                                                         */
+/*===========================================================================*/
+
+messagebus_t bus;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static const controller_state_t innermost_states[] = {
+	STATE_STOPPED, STATE_SEARCHING, STATE_APPROACHING, STATE_PUSHING_FLOWER, STATE_GIGGLING,
+	STATE_TURNING_AROUND, STATE_STINGING, STATE_DANCING, STATE_FACING_OPERATOR,
+};
+#define NB_INNERMOST_STATES		(sizeof(innermost_states) / sizeof(innermost_states[0]))
+
+//the states inside MOVING_TO_BALLOON handle its events
+#define MOVING_CASES(state)																\
+	{state,						EVENT_STOP,				MOVING_TO_BALLOON,	0,	STATE_STOPPED},			\
+	{state,						EVENT_COMMUNICATE,		MOVING_TO_BALLOON,	0,	STATE_DANCING},			\
+	{state,						EVENT_COMMAND,			MOVING_TO_BALLOON,	0,	STATE_FACING_OPERATOR},	\
+	{state,						EVENT_COMMAND,			STOPPED,			0,	NO_STATE},
+
+//every event handled by an innermost state or a state around it
+static const transition_case_t cases[] = {
+	{STATE_STOPPED,				EVENT_MOVE,				MOVING_TO_BALLOON,	0,	STATE_SEARCHING},
+	{STATE_STOPPED,				EVENT_COMMUNICATE,		MOVING_TO_BALLOON,	0,	STATE_DANCING},
+	{STATE_STOPPED,				EVENT_COMMAND,			MOVING_TO_BALLOON,	0,	STATE_FACING_OPERATOR},
+	{STATE_STOPPED,				EVENT_COMMAND,			STOPPED,			0,	NO_STATE},
+	MOVING_CASES(STATE_SEARCHING)
+	MOVING_CASES(STATE_APPROACHING)
+	MOVING_CASES(STATE_PUSHING_FLOWER)
+	MOVING_CASES(STATE_GIGGLING)
+	MOVING_CASES(STATE_TURNING_AROUND)
+	MOVING_CASES(STATE_STINGING)
+	{STATE_SEARCHING,			EVENT_BALLOON_SEEN,		MOVING_TO_BALLOON,	0,	STATE_APPROACHING},
+	{STATE_APPROACHING,			EVENT_BALLOON_LOST,		MOVING_TO_BALLOON,	0,	STATE_SEARCHING},
+	{STATE_APPROACHING,			EVENT_FLOWER_REACHED,	MOVING_TO_BALLOON,	0,	STATE_PUSHING_FLOWER},
+	{STATE_APPROACHING,			EVENT_ENEMY_REACHED,	MOVING_TO_BALLOON,	0,	STATE_TURNING_AROUND},
+	{STATE_PUSHING_FLOWER,		EVENT_MOTION_DONE,		MOVING_TO_BALLOON,	0,	STATE_GIGGLING},
+	{STATE_GIGGLING,			EVENT_MOTION_DONE,		MOVING_TO_BALLOON,	1,	STATE_GIGGLING},
+	{STATE_GIGGLING,			EVENT_MOTION_DONE,		MOVING_TO_BALLOON,	NB_GIGGLES,	STATE_GIGGLING},
+	{STATE_GIGGLING,			EVENT_MOTION_DONE,		MOVING_TO_BALLOON,	NB_GIGGLES + 1,	STATE_SEARCHING},
+	{STATE_TURNING_AROUND,		EVENT_MOTION_DONE,		MOVING_TO_BALLOON,	0,	STATE_STINGING},
+	{STATE_STINGING,			EVENT_MOTION_DONE,		MOVING_TO_BALLOON,	0,	STATE_SEARCHING},
+	{STATE_DANCING,				EVENT_STOP,				COMMUNICATING_WITH_PEERS,	0,	STATE_STOPPED},
+	{STATE_DANCING,				EVENT_MOVE,				COMMUNICATING_WITH_PEERS,	0,	STATE_SEARCHING},
+	{STATE_DANCING,				EVENT_COMMAND,			COMMUNICATING_WITH_PEERS,	0,	STATE_FACING_OPERATOR},
+	{STATE_DANCING,				EVENT_COMMAND,			STOPPED,			0,	NO_STATE},
+	{STATE_DANCING,				EVENT_MOTION_DONE,		COMMUNICATING_WITH_PEERS,	1,	STATE_DANCING},
+	{STATE_DANCING,				EVENT_MOTION_DONE,		COMMUNICATING_WITH_PEERS,	NB_DANCE_TURNS,	STATE_SEARCHING},
+	{STATE_FACING_OPERATOR,		EVENT_COMMAND,			MOVING_TO_BALLOON,	0,	STATE_FACING_OPERATOR},
+	{STATE_FACING_OPERATOR,		EVENT_COMMAND,			STOPPED,			0,	NO_STATE},
+	{STATE_FACING_OPERATOR,		EVENT_MOTION_DONE,		MOVING_TO_BALLOON,	0,	STATE_STOPPED},
+	{STATE_FACING_OPERATOR,		EVENT_STOP,				STOPPED,			0,	STATE_STOPPED},
+};
+#define NB_CASES				(sizeof(cases) / sizeof(cases[0]))
+
+//detections published by the test in place of the image processing
+static messagebus_topic_t test_balloon_topic;
+static MUTEX_DECL(test_balloon_topic_lock);
+static CONDVAR_DECL(test_balloon_topic_condvar);
+static balloon_snapshot_t test_balloon_topic_value;
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               	Leaves the states and enters an innermost state from the top.
+ * @param[in]	state   	the innermost state
+ * @param[in]	repeats 	the giggles or dance turns done
+ * @return              	none
+**/
+static void place(controller_state_t state, uint8_t repeats)
+{
+	exit_state(NO_STATE);
+	enter_state(NO_STATE, state);
+	//the entry actions count the maneuvers started
+	giggles = repeats;
+	dance_turns = repeats;
+}
+
+/**
+ * @brief               	Takes a transition and checks where it leads.
+ * @param[in]	test_case	the transition
+ * @return              	none
+**/
+static void take_transition(const transition_case_t* test_case)
+{
+	controller_transition_t last;
+	uint32_t transitions = 0;
+
+	set_mode(test_case->mode);
+	place(test_case->source, test_case->repeats);
+	transitions = nb_transitions;
+	dispatch(test_case->event);
+	get_controller_trace(&last, 1);
+
+	if(test_case->target == NO_STATE)
+	{
+		CHECK(current_state == test_case->source && nb_transitions == transitions, "state %u left on event %u to %u",
+				test_case->source, test_case->event, current_state);
+		return;
+	}
+	CHECK(current_state == test_case->target, "state %u on event %u, with %u done: %u entered instead of %u",
+			test_case->source, test_case->event, test_case->repeats, current_state, test_case->target);
+	CHECK(nb_transitions == transitions + 1 && last.event == test_case->event && last.from == test_case->source
+			&& last.to == current_state, "state %u on event %u traced as %u from %u to %u", test_case->source,
+			test_case->event, last.event, last.from, last.to);
+}
+
+/**
+ * @brief               	Tells if a transition of an innermost state is in the cases.
+ * @param[in]	state   	the innermost state
+ * @param[in]	event   	the event
+ * @return              	true if it is
+**/
+static bool is_listed(controller_state_t state, controller_event_t event)
+{
+	for(uint8_t i = 0 ; i < NB_CASES ; i++){
+		if(cases[i].source == state && cases[i].event == event)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief               	Checks the actions of the states on the motors, the LEDs and the mode.
+ * @return              	none
+**/
+static void check_actions(void)
+{
+	int16_t left = 0, right = 0;
+	uint8_t rgb[3] = {0};
+
+	set_mode(MOVING_TO_BALLOON);
+	place(STATE_SEARCHING, 0);
+	sim_motors_get_speed(&left, &right);
+	sim_get_rgb_led(LED2, rgb);
+	CHECK(left == -NORMAL_SPEED && right == NORMAL_SPEED && rgb[0] && rgb[1] && !rgb[2], "searching at %d and %d"
+			" steps/s with the LEDs at %u %u %u", left, right, rgb[0], rgb[1], rgb[2]);
+
+	place(STATE_APPROACHING, 0);
+	dispatch(EVENT_FLOWER_REACHED);
+	sim_get_rgb_led(LED8, rgb);
+	CHECK(!rgb[0] && !rgb[1] && rgb[2] && motion_is_running(), "flower pushed with the LEDs at %u %u %u",
+			rgb[0], rgb[1], rgb[2]);
+
+	place(STATE_APPROACHING, 0);
+	dispatch(EVENT_ENEMY_REACHED);
+	sim_get_rgb_led(LED2, rgb);
+	CHECK(rgb[0] && !rgb[1] && !rgb[2] && motion_is_running(), "enemy attacked with the LEDs at %u %u %u",
+			rgb[0], rgb[1], rgb[2]);
+	//leaving MOVING_TO_BALLOON stops the maneuver
+	dispatch(EVENT_STOP);
+	sim_motors_get_speed(&left, &right);
+	sim_get_rgb_led(LED2, rgb);
+	CHECK(left == 0 && right == 0 && !motion_is_running() && !rgb[0] && !rgb[1] && !rgb[2], "stopped at %d and %d"
+			" steps/s with the LEDs at %u %u %u", left, right, rgb[0], rgb[1], rgb[2]);
+
+	//the end of the dance moves the robot again
+	set_mode(COMMUNICATING_WITH_PEERS);
+	place(STATE_DANCING, NB_DANCE_TURNS);
+	dispatch(EVENT_MOTION_DONE);
+	CHECK(get_mode() == MOVING_TO_BALLOON, "mode %u at the end of the dance", get_mode());
+	exit_state(NO_STATE);
+}
+
+/**
+ * @brief               	Publishes a detection like ProcessImage.
+ * @param[in]	type    	the type of the balloon, NONE if there is none
+ * @return              	none
+**/
+static void publish_balloon(balloon_type_t type)
+{
+	balloon_snapshot_t detection = {.position = IMAGE_BUFFER_SIZE/2, .type = type};
+
+	messagebus_topic_publish(&test_balloon_topic, &detection, sizeof(detection));
+	chEvtBroadcast(&balloon_event);
+}
+
+/**
+ * @brief               	Gives a command like the audio processing.
+ * @param[in]	mode    	the mode of the command
+ * @return              	none
+**/
+static void give_command(mode_selected_t mode)
+{
+	set_mode(mode);
+	chEvtBroadcast(&command_event);
+}
+
+/**
+ * @brief               	Waits for the controller thread to enter a state.
+ * @param[in]	state   	the innermost state
+ * @return              	true if it entered it before STATE_TIMEOUT
+**/
+static bool wait_state(controller_state_t state)
+{
+	systime_t start = chVTGetSystemTime();
+
+	while(current_state != state){
+		if(chVTGetSystemTime() - start > STATE_TIMEOUT)
+		{
+			return false;
+		}
+		chThdSleep(POLL_PERIOD);
+	}
+	return true;
+}
+
+/*===========================================================================*/
+/* File threads.                                                             */
+/*===========================================================================*/
+
+//the stack of the host used by a thread only waiting
+static THD_WORKING_AREA(waIdle, 1024);
+static THD_FUNCTION(Idle, arg)
+{
+	chRegSetThreadName(__FUNCTION__);
+	(void)arg;
+
+	chEvtWaitAny(ALL_EVENTS);
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	controller_stats_t stats;
+	size_t used = 0, idle = 0;
+	uint32_t unlisted = 0;
+
+	messagebus_init(&bus, NULL, NULL);
+	motors_init();
+
+	for(uint8_t i = 0 ; i < NB_CASES ; i++){
+		take_transition(&cases[i]);
+	}
+	//the other events change nothing
+	for(uint8_t i = 0 ; i < NB_INNERMOST_STATES ; i++){
+		for(controller_event_t event = EVENT_NONE + 1 ; event < NB_EVENTS ; event++){
+			if(!is_listed(innermost_states[i], event))
+			{
+				take_transition(&(transition_case_t){innermost_states[i], event, MOVING_TO_BALLOON, 0, NO_STATE});
+				unlisted++;
+			}
+		}
+	}
+	printf("# %u transitions taken, %u events without any\n", (unsigned)NB_CASES, (unsigned)unlisted);
+	check_actions();
+
+	//the controller thread, woken like on the robot
+	current_state = NO_STATE;
+	set_mode(STOPPED);
+	messagebus_topic_init(&test_balloon_topic, &test_balloon_topic_lock, &test_balloon_topic_condvar,
+							&test_balloon_topic_value, sizeof(test_balloon_topic_value));
+	messagebus_advertise_topic(&bus, &test_balloon_topic, BALLOON_TOPIC);
+	sensor_start();
+	chThdCreateStatic(waIdle, sizeof(waIdle), NORMALPRIO, Idle, NULL);
+	controller_start();
+	CHECK(wait_state(STATE_STOPPED), "controller not started");
+
+	//the TOF sensor measures nothing until the balloon is at the goal, its readings
+	//update the approach like the detections
+	sim_tof_set_distance(FAR_DISTANCE);
+	give_command(MOVING_TO_BALLOON);
+	CHECK(wait_state(STATE_SEARCHING), "search not started");
+	publish_balloon(FLOWER);
+	CHECK(wait_state(STATE_APPROACHING), "flower not approached");
+	sim_tof_set_distance(GOAL_DISTANCE - 10);
+	CHECK(wait_state(STATE_PUSHING_FLOWER), "flower not reached");
+	publish_balloon(NONE);
+	CHECK(wait_state(STATE_SEARCHING), "flower not pollinated");
+
+	sim_tof_set_distance(FAR_DISTANCE);
+	publish_balloon(ENNEMY);
+	CHECK(wait_state(STATE_APPROACHING), "enemy not approached");
+	sim_tof_set_distance(GOAL_DISTANCE - 10);
+	CHECK(wait_state(STATE_TURNING_AROUND), "enemy not reached");
+	publish_balloon(NONE);
+	CHECK(wait_state(STATE_SEARCHING), "enemy not attacked");
+
+	give_command(COMMUNICATING_WITH_PEERS);
+	CHECK(wait_state(STATE_DANCING), "dance not started");
+	CHECK(wait_state(STATE_SEARCHING), "dance not ended");
+	give_command(STOPPED);
+	CHECK(wait_state(STATE_STOPPED), "robot not stopped");
+
+	get_controller_stats(&stats);
+	used = sim_stack_used(waController);
+	idle = sim_stack_used(waIdle);
+	printf("# controller thread: %u bytes of host stack used besides the %u of a waiting thread, out of %u,"
+			" %u wakeups\n", (unsigned)(used - idle), (unsigned)idle, (unsigned)sizeof(waController),
+			(unsigned)stats.wakeups);
+	CHECK(used > idle && used - idle < sizeof(waController), "%u bytes of stack used out of %u",
+			(unsigned)(used - idle), (unsigned)sizeof(waController));
+	return test_result();
+}
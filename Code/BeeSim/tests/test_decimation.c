@@ -0,0 +1,242 @@
+/**
+ * @file	test_decimation.c
+ * @brief	Checks the decimation filter of the pipeline and compares the analysis of the
+ * 			decimated signal with the analysis at the 16 kHz of the microphones it replaces:
+ * 			frequency response, resolution and time per second of audio.
+ * @note	The response of the filter is computed from its coefficients. The frequencies
+ * 			aliased on the bins the tones are found on must be attenuated by
+ * 			MIN_ALIAS_ATTENUATION. The resolution is compared on two tones two bins apart,
+ * 			with a 1024 points FFT of the full rate signal and a FFT_SIZE points FFT of
+ * 			the decimated one. The times are the ones of the host, only their ratios
+ * 			carry over to the e-puck2.
+**/
+
+//C headers
+#include <string.h>
+
+//the static functions and constants of the pipeline are tested directly
+#include "../source/process_audio.c"
+
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define DECIMATED_FREQUENCY		(SAMPLING_FREQUENCY / DECIMATION_FACTOR)
+#define BIN_WIDTH				((float)SAMPLING_FREQUENCY / FRAME_SIZE)
+
+#define MAX_PASSBAND_LOSS		0.05f	//dB
+#define MIN_ALIAS_ATTENUATION	50.0f	//dB
+
+#define AMPLITUDE				3000
+#define NOISE					100
+#define RESOLUTION_TOLERANCE	0.02f
+
+//the full rate analysis before the decimation, a spectrum every 16 ms
+#define FULL_HOP_SIZE			(HOP_SIZE * DECIMATION_FACTOR)
+#define FULL_NB_HOPS			(FRAME_SIZE / FULL_HOP_SIZE)
+#define TIMED_SECONDS			20
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static float signal[SAMPLING_FREQUENCY];
+static float decimated[DECIMATED_FREQUENCY];
+static float fft_input[FRAME_SIZE];
+static float fft_spectrum[FRAME_SIZE];
+static float full_magnitudes[FRAME_SIZE / 2];
+static float decimated_magnitudes[FFT_SIZE / 2];
+static goertzel_t full_filters[FULL_NB_HOPS][MAX_COMMAND_BINS];
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               	Computes the gain of the decimation filter.
+ * @param[in]	frequency	the frequency in Hz
+ * @return              	the gain in dB
+**/
+static float response(float frequency)
+{
+	double re = 0, im = 0;
+
+	for(uint16_t n = 0 ; n < DECIMATION_TAPS ; n++){
+		re += decimation_coeffs[n] * cos(2 * M_PI * frequency * n / SAMPLING_FREQUENCY);
+		im -= decimation_coeffs[n] * sin(2 * M_PI * frequency * n / SAMPLING_FREQUENCY);
+	}
+	return 10 * log10(re * re + im * im);
+}
+
+/**
+ * @brief               	Gives the frequency a frequency of the microphones aliases on.
+ * @param[in]	frequency	the frequency in Hz
+ * @return              	the frequency after the decimation, 0 to DECIMATED_FREQUENCY / 2
+**/
+static float alias(float frequency)
+{
+	float folded = fmodf(frequency, DECIMATED_FREQUENCY);
+
+	return folded > DECIMATED_FREQUENCY / 2 ? DECIMATED_FREQUENCY - folded : folded;
+}
+
+/**
+ * @brief               	Decimates a signal block by block, like process_audio_data.
+ * @param[in]	input   	the signal at SAMPLING_FREQUENCY
+ * @param[out]	output  	the decimated signal
+ * @param[in]	length  	the number of samples of the input
+ * @return              	none
+**/
+static void decimate(float* input, float* output, uint32_t length)
+{
+	for(uint32_t n = 0 ; n < length ; n += MIC_BLOCK_SIZE){
+		arm_fir_decimate_f32(&decimation_instance, &input[n], &output[n / DECIMATION_FACTOR], MIC_BLOCK_SIZE);
+	}
+}
+
+/**
+ * @brief               	Computes the magnitudes of the last samples of a signal.
+ * @param[in]	instance	the real FFT of size points
+ * @param[in]	input   	the last size samples
+ * @param[in]	size    	the number of points of the FFT
+ * @param[out]	magnitudes	the size / 2 magnitudes
+ * @return              	none
+**/
+static void spectrum(arm_rfft_fast_instance_f32* instance, const float* input, uint16_t size, float* magnitudes)
+{
+	arm_copy_f32((float*)input, fft_input, size);
+	arm_rfft_fast_f32(instance, fft_input, fft_spectrum, 0);
+	arm_cmplx_mag_f32(fft_spectrum, magnitudes, size / 2);
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	arm_rfft_fast_instance_f32 full_instance, decimated_instance;
+	float loss = 0, attenuation = 0, guard_attenuation = 0, worst_alias = 0, low = 0, high = 0;
+	float full_peak = 0, decimated_peak = 0, difference = 0, max_difference = 0;
+	uint32_t index = 0;
+	double start = 0, full_goertzel = 0, full_fft = 0, decimated_goertzel = 0, decimated_fft = 0;
+
+	srand(1);
+	init_decimation();
+	init_command_filters();
+	arm_rfft_fast_init_f32(&full_instance, FRAME_SIZE);
+	arm_rfft_fast_init_f32(&decimated_instance, FFT_SIZE);
+
+	//the passband on the bins of the tones, the stopband on everything aliased on the evaluated bins
+	for(uint8_t tone = 0 ; tone < NB_TONES ; tone++){
+		loss = fmaxf(loss, -response(tone_bins[tone] * BIN_WIDTH));
+	}
+	//the tones are found on their bins and on the next ones, the guard bins are only evaluated
+	low = (tone_bins[0] - 1.5f) * BIN_WIDTH;
+	high = (tone_bins[NB_TONES - 1] + 1.5f) * BIN_WIDTH;
+	attenuation = INFINITY;
+	guard_attenuation = INFINITY;
+	for(float frequency = DECIMATED_FREQUENCY / 2 ; frequency <= SAMPLING_FREQUENCY / 2 ; frequency += 1){
+		if(alias(frequency) >= low && alias(frequency) <= high && -response(frequency) < attenuation)
+		{
+			attenuation = -response(frequency);
+			worst_alias = frequency;
+		}
+		if(alias(frequency) >= (command_bins[0] - 0.5f) * BIN_WIDTH
+			&& alias(frequency) <= (command_bins[nb_command_bins - 1] + 0.5f) * BIN_WIDTH)
+		{
+			guard_attenuation = fminf(guard_attenuation, -response(frequency));
+		}
+	}
+	CHECK(loss <= MAX_PASSBAND_LOSS, "%.3f dB lost on the tones", loss);
+	CHECK(attenuation >= MIN_ALIAS_ATTENUATION, "%.1f dB at %.0f Hz aliased on %.0f Hz", attenuation,
+			worst_alias, alias(worst_alias));
+	printf("# filter: %.3f dB lost on the tones, %.1f dB at 1.5 kHz, %.1f dB from %.0f Hz the lowest frequency "
+			"aliased on the bins of the tones, %.1f dB on the guard bins\n", loss, -response(1500), attenuation,
+			worst_alias, guard_attenuation);
+
+	//two tones two bins apart, separated the same way by both analyses
+	for(uint32_t n = 0 ; n < SAMPLING_FREQUENCY ; n++){
+		signal[n] = AMPLITUDE * (sinf(2 * PI * tone_bins[TONE_STOP] * n / FRAME_SIZE)
+								+ sinf(2 * PI * (tone_bins[TONE_STOP] + 2) * n / FRAME_SIZE))
+					+ NOISE * test_gaussian();
+	}
+	decimate(signal, decimated, SAMPLING_FREQUENCY);
+	spectrum(&full_instance, &signal[SAMPLING_FREQUENCY - FRAME_SIZE], FRAME_SIZE, full_magnitudes);
+	spectrum(&decimated_instance, &decimated[DECIMATED_FREQUENCY - FFT_SIZE], FFT_SIZE, decimated_magnitudes);
+	arm_max_f32(&full_magnitudes[MIN_FREQ], MAX_FREQ - MIN_FREQ + 1, &full_peak, &index);
+	arm_max_f32(&decimated_magnitudes[MIN_FREQ], MAX_FREQ - MIN_FREQ + 1, &decimated_peak, &index);
+	for(uint16_t bin = MIN_FREQ ; bin <= MAX_FREQ ; bin++){
+		difference = fabsf(full_magnitudes[bin] / full_peak - decimated_magnitudes[bin] / decimated_peak);
+		max_difference = fmaxf(max_difference, difference);
+	}
+	CHECK(max_difference <= RESOLUTION_TOLERANCE, "the spectra differ by %.3f of their peak", max_difference);
+	CHECK(decimated_magnitudes[tone_bins[TONE_STOP] + 1] < 0.5f * decimated_peak,
+			"the tones two bins apart are not separated after the decimation");
+	printf("# resolution: %.3f Hz bins at 16 kHz, %.3f Hz after the decimation, the spectra of two tones "
+			"%.0f Hz apart differ by %.2f%% of their peak\n", BIN_WIDTH, (float)DECIMATED_FREQUENCY / FFT_SIZE,
+			2 * BIN_WIDTH, 100 * max_difference);
+
+	//time per second of audio, a spectrum every 16 ms in each case
+	for(uint8_t bank = 0 ; bank < FULL_NB_HOPS ; bank++){
+		for(uint8_t i = 0 ; i < nb_command_bins ; i++){
+			goertzel_init(&full_filters[bank][i], command_bins[i], FRAME_SIZE);
+		}
+	}
+	start = test_cpu_time();
+	for(uint16_t second = 0 ; second < TIMED_SECONDS ; second++){
+		for(uint32_t n = 0 ; n < SAMPLING_FREQUENCY ; n += FULL_HOP_SIZE){
+			for(uint8_t bank = 0 ; bank < FULL_NB_HOPS ; bank++){
+				for(uint8_t i = 0 ; i < nb_command_bins ; i++){
+					goertzel_process(&full_filters[bank][i], &signal[n], FULL_HOP_SIZE);
+				}
+			}
+			for(uint8_t i = 0 ; i < nb_command_bins ; i++){
+				micArray_output[command_bins[i]] = goertzel_magnitude(&full_filters[n / FULL_HOP_SIZE % FULL_NB_HOPS][i]);
+				goertzel_reset(&full_filters[n / FULL_HOP_SIZE % FULL_NB_HOPS][i]);
+			}
+		}
+	}
+	full_goertzel = (test_cpu_time() - start) / TIMED_SECONDS;
+
+	start = test_cpu_time();
+	for(uint16_t second = 0 ; second < TIMED_SECONDS ; second++){
+		for(uint32_t n = FRAME_SIZE ; n <= SAMPLING_FREQUENCY ; n += FULL_HOP_SIZE){
+			spectrum(&full_instance, &signal[n - FRAME_SIZE], FRAME_SIZE, full_magnitudes);
+		}
+	}
+	full_fft = (test_cpu_time() - start) / TIMED_SECONDS;
+
+	//the decimation and the filters of the pipeline, without the sequences of tones
+	start = test_cpu_time();
+	for(uint16_t second = 0 ; second < TIMED_SECONDS ; second++){
+		for(uint32_t n = 0 ; n < SAMPLING_FREQUENCY ; n += MIC_BLOCK_SIZE){
+			arm_fir_decimate_f32(&decimation_instance, &signal[n], micArray_decimated, MIC_BLOCK_SIZE);
+			feed_command_filters(micArray_decimated, MIC_BLOCK_SIZE / DECIMATION_FACTOR);
+		}
+	}
+	decimated_goertzel = (test_cpu_time() - start) / TIMED_SECONDS;
+
+	start = test_cpu_time();
+	for(uint16_t second = 0 ; second < TIMED_SECONDS ; second++){
+		decimate(signal, decimated, SAMPLING_FREQUENCY);
+		for(uint32_t n = FFT_SIZE ; n <= DECIMATED_FREQUENCY ; n += HOP_SIZE){
+			spectrum(&decimated_instance, &decimated[n - FFT_SIZE], FFT_SIZE, decimated_magnitudes);
+		}
+	}
+	decimated_fft = (test_cpu_time() - start) / TIMED_SECONDS;
+
+	CHECK(decimated_goertzel < full_goertzel, "the decimated Goertzel filters take %.0f us, %.0f us at 16 kHz",
+			1e6 * decimated_goertzel, 1e6 * full_goertzel);
+	CHECK(decimated_fft < full_fft, "the decimated FFT takes %.0f us, %.0f us at 16 kHz", 1e6 * decimated_fft,
+			1e6 * full_fft);
+	printf("# per second of audio on the host: Goertzel %.0f us at 16 kHz, %.0f us decimated (x%.1f), "
+			"FFT %.0f us at 16 kHz, %.0f us decimated (x%.1f)\n", 1e6 * full_goertzel, 1e6 * decimated_goertzel,
+			full_goertzel / decimated_goertzel, 1e6 * full_fft, 1e6 * decimated_fft, full_fft / decimated_fft);
+	printf("# per second of audio: %d multiply-accumulates for the %d taps of the decimation, "
+			"%d Goertzel updates at 16 kHz and %d decimated\n", DECIMATION_TAPS * DECIMATED_FREQUENCY, DECIMATION_TAPS,
+			SAMPLING_FREQUENCY * FULL_NB_HOPS * nb_command_bins, DECIMATED_FREQUENCY * NB_HOPS * nb_command_bins);
+	return test_result();
+}
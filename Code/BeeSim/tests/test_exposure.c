@@ -0,0 +1,225 @@
+/**
+ * @file	test_exposure.c
+ * @brief	Runs the control of the exposure and of the gain on sequences of the
+ * 			brightness of the scene.
+ * @note	The camera is modelled linear up to the saturation: the green level of
+ * 			a pixel is the light of the scene times its reflectance, the exposure and
+ * 			the gain read back from the po8030, quantized to the 6 bits of RGB565.
+ * 			The settings written after a frame reach the frame after the next one,
+ * 			like in CaptureImage. The line is a grey gradient with a dark balloon
+ * 			and a few lamps brighter than the rest, with the noise of the sensor.
+ * 			After each change of the light, the 95th percentile of the line must come
+ * 			back within the deadband around the target without oscillating, and stay
+ * 			there without any change of the settings while the light is steady. In
+ * 			sunlight and in the dark room the settings reach their limits, they must
+ * 			stay there without cycling.
+**/
+
+//the static functions and variables of the control are tested directly
+#include "../source/camera_exposure.c"
+
+#include "sim.h"
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define NB_PIXELS				640
+#define NOISE					0.5
+//level of a white pixel for a light of 1 at the initial settings
+#define SENSITIVITY				(TARGET_LEVEL / 0.9 / INITIAL_EXPOSURE)
+//the lamps, brighter than the scene and saturated whatever the settings
+#define LAMP_PIXELS				8
+#define LAMP_REFLECTANCE		20.0
+//the balloon
+#define BALLOON_FIRST			250
+#define BALLOON_LAST			349
+#define BALLOON_REFLECTANCE		0.3
+
+//frames the settings take to reach the frames
+#define SETTINGS_DELAY			2
+//frames allowed to come back within the deadband after a change of the light
+#define MAX_SETTLING			30
+//frames the light is steady at the end of each phase, the settings must not change
+#define STEADY_FRAMES			60
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+//change of the light over a phase, from the light of the end of the last one
+typedef struct phase_t
+{
+	const char* name;
+	double light;			//at the end of the phase
+	uint16_t ramp;			//frames the light takes to get there, 0 for a step
+	uint16_t length;		//frames of the phase
+} phase_t;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static const phase_t phases[] = {
+	{"start",				1.0,	0,		120},
+	{"4 times brighter",	4.0,	0,		120},
+	{"back to normal",		1.0,	0,		120},
+	{"8 times darker",		0.125,	0,		150},
+	{"doubling in 3 s",		0.25,	45,		150},
+	{"32 times brighter",	8.0,	0,		150},
+	{"sunlight",			64.0,	0,		150},
+	{"dark room",			0.02,	0,		200},
+};
+#define NB_PHASES				(sizeof(phases) / sizeof(phases[0]))
+
+static uint8_t line[2 * NB_PIXELS];
+static double reflectance[NB_PIXELS];
+//settings of the frames to come, the first one being the next frame
+static uint16_t pipeline_exposure[SETTINGS_DELAY];
+static double pipeline_gain[SETTINGS_DELAY];
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               	Captures the line with the settings of the frame.
+ * @param[in]	light   	the light of the scene
+ * @param[in]	exposure	the integration time in lines
+ * @param[in]	gain    	the gain of the green channel
+ * @return              	none
+**/
+static void capture_line(double light, uint16_t exposure, double gain)
+{
+	double level = 0;
+	uint8_t green = 0;
+
+	for(uint16_t i = 0 ; i < NB_PIXELS ; i++){
+		level = light * reflectance[i] * exposure * gain * SENSITIVITY + NOISE * test_gaussian();
+		green = level < 0 ? 0 : (level > NB_LEVELS - 1 ? NB_LEVELS - 1 : lround(level));
+		line[2 * i] = (0x10 << 3) | (green >> 3);
+		line[2 * i + 1] = ((green & 0x07) << 5) | 0x10;
+	}
+}
+
+/**
+ * @brief               	Captures a frame, processes it like ProcessImage and applies
+ * 							the settings like CaptureImage.
+ * @param[in]	light   	the light of the scene
+ * @return              	the 95th percentile of the line of the frame
+**/
+static uint8_t run_frame(double light)
+{
+	uint16_t exposure = 0;
+	uint8_t rgb_gain[3] = {0};
+	uint32_t writes = 0;
+	uint8_t level = 0;
+
+	capture_line(light, pipeline_exposure[0], pipeline_gain[0]);
+	compute_histogram(line, NB_PIXELS);
+	level = find_percentile(NB_PIXELS, HIGH_PERCENTILE);
+	exposure_update(line, NB_PIXELS);
+	exposure_apply();
+
+	//the settings read back from the camera reach the frame after the next one
+	sim_camera_get_settings(&exposure, rgb_gain, &writes);
+	for(uint8_t i = 0 ; i < SETTINGS_DELAY - 1 ; i++){
+		pipeline_exposure[i] = pipeline_exposure[i + 1];
+		pipeline_gain[i] = pipeline_gain[i + 1];
+	}
+	pipeline_exposure[SETTINGS_DELAY - 1] = exposure;
+	pipeline_gain[SETTINGS_DELAY - 1] = (double)rgb_gain[1] / GREEN_BALANCE;
+	return level;
+}
+
+static bool in_deadband(uint8_t level)
+{
+	return level + LEVEL_DEADBAND >= TARGET_LEVEL && level <= TARGET_LEVEL + LEVEL_DEADBAND;
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	double light = 0, start_light = 0;
+	uint16_t settling = 0, exposure = 0;
+	uint32_t changes = 0, writes = 0, last_writes = 0, blurred = 0;
+	uint8_t level = 0, rgb_gain[3] = {0}, gain = 0, min_level = 0, max_level = 0;
+	bool settled = false;
+
+	srand(1);
+	for(uint16_t i = 0 ; i < NB_PIXELS ; i++){
+		reflectance[i] = 0.3 + 0.6 * i / NB_PIXELS;
+		if(i >= BALLOON_FIRST && i <= BALLOON_LAST)
+		{
+			reflectance[i] = BALLOON_REFLECTANCE;
+		} else if(i % (NB_PIXELS / LAMP_PIXELS) == 0) {
+			reflectance[i] = LAMP_REFLECTANCE;
+		}
+	}
+
+	//the settings of exposure_init reach the first frames
+	exposure_init();
+	sim_camera_get_settings(&exposure, rgb_gain, &writes);
+	for(uint8_t i = 0 ; i < SETTINGS_DELAY ; i++){
+		pipeline_exposure[i] = exposure;
+		pipeline_gain[i] = (double)rgb_gain[1] / GREEN_BALANCE;
+	}
+
+	for(uint8_t i = 0 ; i < NB_PHASES ; i++){
+		start_light = light ? light : phases[i].light;
+		settling = 0;
+		settled = false;
+		changes = 0;
+		min_level = NB_LEVELS;
+		max_level = 0;
+		for(uint16_t frame = 0 ; frame < phases[i].length ; frame++){
+			light = frame < phases[i].ramp ? start_light * pow(phases[i].light / start_light, (frame + 1.0) / phases[i].ramp)
+											: phases[i].light;
+			level = run_frame(light);
+			get_exposure(&exposure, &gain);
+			blurred += exposure > BLUR_EXPOSURE && gain < MAX_GAIN;
+			sim_camera_get_settings(&exposure, rgb_gain, &writes);
+			if(!settled && in_deadband(level) && frame >= phases[i].ramp)
+			{
+				settled = true;
+				settling = frame + 1 - phases[i].ramp;
+			}
+			//the light is steady
+			if(frame >= phases[i].length - STEADY_FRAMES)
+			{
+				changes += writes != last_writes;
+				min_level = level < min_level ? level : min_level;
+				max_level = level > max_level ? level : max_level;
+			}
+			last_writes = writes;
+		}
+		get_exposure(&exposure, &gain);
+		printf("# %-18s light %6.2f: settled in %3u frames, level %2u to %2u, exposure %3u lines and gain %.2f\n",
+				phases[i].name, light, settled ? settling : 0, min_level, max_level, exposure, (double)gain / UNITY_GAIN);
+		CHECK(changes == 0, "%s: settings changed %u times in the last %d frames", phases[i].name,
+				(unsigned)changes, STEADY_FRAMES);
+		//the settings cannot go further, the level stays on the side of the light
+		if(exposure == MIN_EXPOSURE && gain == UNITY_GAIN)
+		{
+			CHECK(min_level + LEVEL_DEADBAND >= TARGET_LEVEL, "%s: level down to %u at the lowest settings",
+					phases[i].name, min_level);
+			continue;
+		}
+		if(exposure == MAX_EXPOSURE && gain == MAX_GAIN)
+		{
+			CHECK(max_level <= TARGET_LEVEL + LEVEL_DEADBAND, "%s: level up to %u at the highest settings",
+					phases[i].name, max_level);
+			continue;
+		}
+		CHECK(settled && settling <= MAX_SETTLING, "%s: level in the deadband after %u frames", phases[i].name,
+				settled ? settling : phases[i].length);
+		CHECK(in_deadband(min_level) && in_deadband(max_level), "%s: level from %u to %u once steady", phases[i].name,
+				min_level, max_level);
+	}
+	CHECK(blurred == 0, "exposure past BLUR_EXPOSURE below the highest gain in %u frames", (unsigned)blurred);
+	return test_result();
+}
@@ -0,0 +1,224 @@
+/**
+ * @file	test_fft.c
+ * @brief	Compares the complex FFT, the real FFT and the Q15 real FFT on the frames
+ * 			of the reference recording: magnitudes of bins 10 to 30, tones found and
+ * 			time per frame.
+ * @note	The frames are the ones the pipeline analyses: the four microphones combined,
+ * 			decimated to 2 kHz, FFT_SIZE samples every HOP_SIZE. The complex FFT of the
+ * 			frame with null imaginary parts is the reference. The Q15 FFT scales its
+ * 			output down by FFT_SIZE, which leaves a few LSBs at the detection threshold,
+ * 			so its tones are only checked on the frames well above it.
+**/
+
+//C headers
+#include <string.h>
+
+//the static functions and constants of the pipeline are tested directly
+#include "../source/process_audio.c"
+
+#include "recording.h"
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define RECORDING				"data/commands.wav"
+
+//largest errors on bins 10 to 30, relative to the highest of them
+#define REAL_TOLERANCE			1e-5f
+#define Q15_TOLERANCE			0.05f
+//plus the rounding of the last stages, in LSB of the Q15 FFT
+#define Q15_LSB_TOLERANCE		3
+//peaks the Q15 tones are checked above, relative to the detection threshold
+#define Q15_MIN_PEAK			2
+
+#define TIMED_RUNS				20
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+//the frames analysed by the pipeline
+static float (*frames)[FFT_SIZE] = NULL;
+static uint32_t nb_frames = 0;
+
+static float complex_buffer[2 * FFT_SIZE];
+static float real_input[FFT_SIZE];
+static float real_spectrum[FFT_SIZE];
+static q15_t q15_input[FFT_SIZE];
+static q15_t q15_spectrum[2 * FFT_SIZE];
+static arm_rfft_fast_instance_f32 real_instance;
+static arm_rfft_instance_q15 q15_instance;
+
+//magnitudes of each path on the scale of the float FFTs
+static float complex_output[MAX_FREQ + 1];
+static float real_output[MAX_FREQ + 1];
+static float q15_output[MAX_FREQ + 1];
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               	Cuts the combined and decimated recording into overlapping frames.
+ * @return              	false if the recording cannot be loaded
+**/
+static bool load_frames(void)
+{
+	uint32_t length = 0, nb_decimated = 0;
+	int16_t* samples = recording_load(RECORDING, &length);
+	float* decimated = NULL;
+	uint16_t block = 0;
+
+	if(samples == NULL)
+	{
+		return false;
+	}
+	decimated = malloc(length / DECIMATION_FACTOR * sizeof(float));
+	init_decimation();
+	for(uint32_t offset = 0 ; offset + MIC_BLOCK_SIZE <= length ; offset += MIC_BLOCK_SIZE){
+		block = mic_array_process(&samples[NB_MICS * offset], NB_MICS * MIC_BLOCK_SIZE, micArray_block);
+		arm_fir_decimate_f32(&decimation_instance, micArray_block, &decimated[nb_decimated], block);
+		nb_decimated += block / DECIMATION_FACTOR;
+	}
+	frames = malloc((nb_decimated / HOP_SIZE) * sizeof(frames[0]));
+	for(uint32_t end = FFT_SIZE ; end <= nb_decimated ; end += HOP_SIZE){
+		memcpy(frames[nb_frames], &decimated[end - FFT_SIZE], sizeof(frames[0]));
+		nb_frames++;
+	}
+	free(decimated);
+	free(samples);
+	return true;
+}
+
+static void run_complex(const float* frame)
+{
+	for(uint16_t i = 0 ; i < FFT_SIZE ; i++){
+		complex_buffer[2 * i] = frame[i];
+		complex_buffer[2 * i + 1] = 0;
+	}
+	arm_cfft_f32(&arm_cfft_sR_f32_len128, complex_buffer, 0, 1);
+	arm_cmplx_mag_f32(complex_buffer, complex_output, MAX_FREQ + 1);
+}
+
+static void run_real(const float* frame)
+{
+	//the FFT overwrites its input
+	memcpy(real_input, frame, sizeof(real_input));
+	arm_rfft_fast_f32(&real_instance, real_input, real_spectrum, 0);
+	arm_cmplx_mag_f32(real_spectrum, real_output, MAX_FREQ + 1);
+}
+
+static void run_q15(const float* frame)
+{
+	//the pipeline converts the decimated samples the same way
+	for(uint16_t i = 0 ; i < FFT_SIZE ; i++){
+		q15_input[i] = frame[i];
+	}
+	arm_rfft_q15(&q15_instance, q15_input, q15_spectrum);
+	//the magnitudes computed as in compute_spectrum
+	for(uint16_t i = MIN_FREQ ; i <= MAX_FREQ ; i++){
+		q15_output[i] = sqrtf((float)q15_spectrum[2 * i] * q15_spectrum[2 * i]
+						+ (float)q15_spectrum[2 * i + 1] * q15_spectrum[2 * i + 1]) * FFT_SIZE;
+	}
+}
+
+/**
+ * @brief               	Gets the largest error of bins MIN_FREQ to MAX_FREQ.
+ * @return              	the error relative to the highest reference magnitude
+**/
+static float bins_error(const float* output, float* peak)
+{
+	float error = 0;
+
+	*peak = 0;
+	for(uint16_t i = MIN_FREQ ; i <= MAX_FREQ ; i++){
+		*peak = fmaxf(*peak, complex_output[i]);
+		error = fmaxf(error, fabsf(output[i] - complex_output[i]));
+	}
+	return *peak > 0 ? error / *peak : 0;
+}
+
+//the magnitudes scaled as in the pipeline, for find_tone
+static tone_t tone_of(const float* output)
+{
+	float scaled[MAX_FREQ + 1] = {0};
+
+	for(uint16_t i = MIN_FREQ ; i <= MAX_FREQ ; i++){
+		scaled[i] = MAGNITUDE_SCALE * output[i];
+	}
+	return find_tone(scaled);
+}
+
+static double time_path(void (*path)(const float* frame))
+{
+	double start = test_cpu_time();
+
+	for(uint16_t run = 0 ; run < TIMED_RUNS ; run++){
+		for(uint32_t i = 0 ; i < nb_frames ; i++){
+			path(frames[i]);
+		}
+	}
+	return (test_cpu_time() - start) / (TIMED_RUNS * nb_frames);
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	float real_error = 0, q15_error = 0, max_real_error = 0, max_q15_error = 0, peak = 0;
+	uint32_t tone_frames = 0, q15_frames = 0, near_frames = 0, near_same = 0;
+	tone_t tone = NO_TONE;
+
+	if(!load_frames())
+	{
+		return 2;
+	}
+	arm_rfft_fast_init_f32(&real_instance, FFT_SIZE);
+	arm_rfft_init_q15(&q15_instance, FFT_SIZE, 0, 1);
+
+	for(uint32_t i = 0 ; i < nb_frames ; i++){
+		run_complex(frames[i]);
+		run_real(frames[i]);
+		run_q15(frames[i]);
+
+		real_error = bins_error(real_output, &peak);
+		q15_error = bins_error(q15_output, &peak);
+		max_real_error = fmaxf(max_real_error, real_error);
+		CHECK(real_error <= REAL_TOLERANCE, "frame %u: real FFT error %.2g of the peak", (unsigned)i, real_error);
+
+		tone = tone_of(complex_output);
+		tone_frames += tone != NO_TONE;
+		CHECK(tone_of(real_output) == tone, "frame %u: the real FFT finds another tone", (unsigned)i);
+
+		if(MAGNITUDE_SCALE * peak >= Q15_MIN_PEAK * MIN_VALUE_THRESHOLD)
+		{
+			q15_frames++;
+			max_q15_error = fmaxf(max_q15_error, q15_error);
+			CHECK(q15_error * peak <= Q15_TOLERANCE * peak + Q15_LSB_TOLERANCE * FFT_SIZE,
+					"frame %u: Q15 FFT error %.2g of the peak", (unsigned)i, q15_error);
+			CHECK(tone_of(q15_output) == tone, "frame %u: the Q15 FFT finds another tone", (unsigned)i);
+		} else {
+			near_frames++;
+			near_same += tone_of(q15_output) == tone;
+		}
+	}
+
+	printf("# %u frames of %u samples, a tone in %u\n", (unsigned)nb_frames, FFT_SIZE, (unsigned)tone_frames);
+	printf("# largest error on bins %u to %u: real %.2g of the peak, Q15 %.2g on the %u frames above %u times the threshold\n",
+			MIN_FREQ, MAX_FREQ, max_real_error, max_q15_error, (unsigned)q15_frames, Q15_MIN_PEAK);
+	printf("# the threshold is %.1f LSB of the Q15 FFT, which finds the same tone on %u/%u frames below\n",
+			(float)MIN_VALUE_THRESHOLD / Q15_MAGNITUDE_SCALE, (unsigned)near_same, (unsigned)near_frames);
+	printf("# complex float: %.2f us/frame on the host, %u bytes of buffers\n",
+			1e6 * time_path(run_complex), (unsigned)(sizeof(complex_buffer) + sizeof(complex_output)));
+	printf("# real float:    %.2f us/frame on the host, %u bytes of buffers\n",
+			1e6 * time_path(run_real), (unsigned)(sizeof(real_input) + sizeof(real_spectrum) + sizeof(real_output)));
+	printf("# real Q15:      %.2f us/frame on the host, %u bytes of buffers\n",
+			1e6 * time_path(run_q15), (unsigned)(sizeof(q15_input) + sizeof(q15_spectrum)));
+
+	free(frames);
+	return test_result();
+}
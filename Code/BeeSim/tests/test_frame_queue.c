@@ -0,0 +1,210 @@
+/**
+ * @file	test_frame_queue.c
+ * @brief	Runs the capture and the processing of the frames against the camera of
+ * 			the simulation, with processing times shorter and longer than the period.
+ * @note	The processing of a frame takes the time set by the test, consumed after
+ * 			its lines are searched. The camera writes the number of each frame at the
+ * 			start of its buffer, so the test knows which frame the lines of a
+ * 			detection really come from. Every frame must be counted, the frames are
+ * 			processed, replaced in the queue or overwritten, and a detection is never
+ * 			published from lines overwritten during its processing. Processed for
+ * 			longer than the period, a frame fetched too late to be processed before
+ * 			the camera comes back to its buffer is skipped for the next one, and
+ * 			every other frame is processed, until the processing outlasts the time
+ * 			the camera takes to come back to the buffer, where the frames can only
+ * 			be dropped.
+ *
+ * 			Built with SAME_PRIORITY, CaptureImage runs at the priority of
+ * 			ProcessImage as it used to. It is then blocked while a frame is
+ * 			processed, the frames are counted late or lost, and detections are
+ * 			published from overwritten lines, which the test checks happens.
+**/
+
+//C headers
+#include <string.h>
+
+//ChibiOS headers
+#include <ch.h>
+#include <hal.h>
+
+//E-puck 2 headers
+#include <msgbus/messagebus.h>
+
+//Project headers
+#include "include/camera_exposure.h"
+#include "include/process_image.h"
+#include "sim.h"
+#include "test.h"
+
+//the time of the processing is consumed once the lines of the frame are searched
+static systime_t processing_time = 0;
+#define exposure_update(line, nb_pixels)	(exposure_update(line, nb_pixels), check_lines(line))
+
+//the detections are checked against the lines they come from
+#define messagebus_topic_publish(topic, buf, buf_len)	(check_detection(buf), messagebus_topic_publish(topic, buf, buf_len))
+
+static void check_lines(const uint8_t* line);
+static void check_detection(const void* detection);
+
+#if SAME_PRIORITY
+#define chThdCreateStatic(wsp, size, prio, pf, arg)	\
+	chThdCreateStatic(wsp, size, (pf) == CaptureImage ? NORMALPRIO+1 : (prio), pf, arg)
+#endif
+
+//the static functions and variables of the processing are used directly
+#include "../source/process_image.c"
+
+#include "include/process_audio.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define FRAME_PERIOD			MS2ST(66)
+#define WINDOW_START			MS2ST(27)
+#define WINDOW_LENGTH			MS2ST(1)
+#define PHASE_LENGTH			3000
+//time from the end of a frame to the camera writing its buffer again
+#define REWRITE_TIME			(2 * FRAME_PERIOD - WINDOW_LENGTH)
+
+//processing times of the frame in ms, below the period, above it, and above
+//the time the camera takes to come back to the buffer of the frame
+static const uint16_t processing_times[] = {20, 60, 100, 150};
+#define NB_PHASES				(sizeof(processing_times) / sizeof(processing_times[0]))
+
+/*===========================================================================*/
+/* Global variables.                                                         */
+/*===========================================================================*/
+
+messagebus_t bus;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static uint32_t camera_frames = 0;
+//lines of the frame being processed and the frame they held at the end of the search
+static const uint8_t* processed_lines = NULL;
+static uint32_t processed_frame = 0;
+//detections published from lines overwritten meanwhile, or from another frame than their own
+static uint32_t corrupted = 0;
+static uint32_t mislabelled = 0;
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+//writes the number of the frame at the start of the buffer, the background elsewhere
+static void frame_source(uint32_t frame, uint8_t* buffer, uint16_t width, uint16_t height)
+{
+	memset(buffer, 0x84, 2 * width * height);
+	memcpy(buffer, &frame, sizeof(frame));
+	camera_frames = frame + 1;
+}
+
+/**
+ * @brief               	Notes the frame the lines hold and processes them.
+ * @param[in]	line    	the first line of the main band
+ * @return              	none
+**/
+static void check_lines(const uint8_t* line)
+{
+	processed_lines = line;
+	memcpy(&processed_frame, line, sizeof(processed_frame));
+	sim_consume(processing_time);
+}
+
+/**
+ * @brief               	Compares the frame of a detection with its lines.
+ * @param[in]	detection	the snapshot published
+ * @return              	none
+**/
+static void check_detection(const void* detection)
+{
+	const balloon_snapshot_t* snapshot = detection;
+	uint32_t frame = 0;
+
+	memcpy(&frame, processed_lines, sizeof(frame));
+	corrupted += frame != processed_frame;
+	mislabelled += processed_frame != snapshot->seq;
+}
+
+/*===========================================================================*/
+/* File threads.                                                             */
+/*===========================================================================*/
+
+//runs the test above the capture, ProcessImage takes every cycle left once the
+//frames come faster than it processes them
+static THD_WORKING_AREA(waMonitor, 1024);
+static THD_FUNCTION(Monitor, arg)
+{
+	chRegSetThreadName(__FUNCTION__);
+	(void)arg;
+
+	image_stats_t stats, last = {0};
+	uint32_t captured = 0, processed = 0, dropped = 0, replaced = 0, last_replaced = 0;
+	uint32_t missed = 0, all_corrupted = 0;
+
+	for(uint8_t i = 0 ; i < NB_PHASES ; i++){
+		processing_time = MS2ST(processing_times[i]);
+		max_latency = 0;
+		corrupted = 0;
+		mislabelled = 0;
+		chThdSleepMilliseconds(PHASE_LENGTH);
+
+		get_image_stats(&stats);
+		captured = stats.captured - last.captured;
+		processed = stats.processed - last.processed;
+		dropped = stats.dropped - last.dropped;
+		replaced = frames_replaced - last_replaced;
+		missed = camera_frames - stats.captured;
+		all_corrupted += corrupted + mislabelled;
+		printf("# processing in %3u ms: %3u frames captured, %3u processed, %3u replaced and %3u overwritten,"
+				" %u missed, %u detections from overwritten lines, latency up to %u ms\n", processing_times[i],
+				(unsigned)captured, (unsigned)processed, (unsigned)replaced, (unsigned)(dropped - replaced),
+				(unsigned)missed, (unsigned)(corrupted + mislabelled), (unsigned)stats.max_latency);
+#if !SAME_PRIORITY
+		CHECK(missed <= 1, "%u frames of the camera not counted", (unsigned)missed);
+		CHECK(corrupted == 0 && mislabelled == 0, "%u detections from overwritten lines, %u from another frame",
+				(unsigned)corrupted, (unsigned)mislabelled);
+		//the frames still queued or in processing
+		CHECK(stats.captured - stats.processed - stats.dropped <= FRAME_POOL_SIZE, "%u frames lost by the queue",
+				(unsigned)(stats.captured - stats.processed - stats.dropped - FRAME_POOL_SIZE));
+		if(processing_times[i] < ST2MS(FRAME_PERIOD))
+		{
+			CHECK(dropped == 0, "%u frames dropped while processed in %u ms", (unsigned)dropped, processing_times[i]);
+			CHECK(stats.max_latency <= processing_times[i] + 1u, "latency up to %u ms", (unsigned)stats.max_latency);
+		} else if(processing_times[i] < ST2MS(REWRITE_TIME)) {
+			//the frames fetched too late to be processed are skipped for the next ones, every other one
+			CHECK(2 * processed + 2 >= captured, "%u of %u frames processed in %u ms", (unsigned)processed,
+					(unsigned)captured, processing_times[i]);
+		} else {
+			//the buffer is written again before the processing ends, but for the frame processed
+			//when the time of the processing changes
+			CHECK(processed <= 1 && dropped > 0, "%u frames processed and %u dropped", (unsigned)processed, (unsigned)dropped);
+		}
+#endif
+		last_replaced = frames_replaced;
+		last = stats;
+	}
+#if SAME_PRIORITY
+	CHECK(missed > 1 || all_corrupted > 0, "no frame missed and no detection from overwritten lines");
+#endif
+	exit(test_result());
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	messagebus_init(&bus, NULL, NULL);
+	sim_camera_set_source(frame_source, FRAME_PERIOD, WINDOW_START, WINDOW_LENGTH);
+	set_mode(MOVING_TO_BALLOON);
+	process_image_start();
+	sensor_start();
+	chThdCreateStatic(waMonitor, sizeof(waMonitor), NORMALPRIO+3, Monitor, NULL);
+	chThdSleep(TIME_INFINITE);
+	return 0;
+}
@@ -0,0 +1,173 @@
+/**
+ * @file	test_goertzel.c
+ * @brief	Compares the Goertzel filters of the command bins with the 1024 points
+ * 			complex FFT they replace: magnitudes, tones found and time per frame.
+ * @note	The frames are synthetic tones over noise, at the 16 kHz of the microphones.
+ * 			The tones are found by find_tone of process_audio.c, on the whole FFT
+ * 			spectrum or on the bins evaluated by the filters, which must find the same
+ * 			tone for the commands and for the louder tones outside the commands. The
+ * 			filters do not see the peaks of the noise outside their bins, so the frames
+ * 			of noise are only counted, their debounce is left to the replays.
+**/
+
+//C headers
+#include <string.h>
+
+//the static functions and constants of the pipeline are tested directly
+#include "../source/process_audio.c"
+
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define NOISE				100
+#define MAGNITUDE_TOLERANCE	1e-3f
+#define TIMED_FRAMES		2000
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static float frame[FRAME_SIZE];
+static float fft_buffer[2 * FRAME_SIZE];
+static float fft_output[FRAME_SIZE];
+static float goertzel_output[FRAME_SIZE];
+static goertzel_t filters[MAX_COMMAND_BINS];
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+static void make_frame(float bin, float amplitude)
+{
+	float phase = 2 * PI * rand() / RAND_MAX;
+
+	for(uint16_t i = 0 ; i < FRAME_SIZE ; i++){
+		frame[i] = amplitude * sinf(2 * PI * bin * i / FRAME_SIZE + phase) + NOISE * test_gaussian();
+	}
+}
+
+//the path before the Goertzel filters: complex FFT of the whole frame and every magnitude
+static void run_fft(void)
+{
+	for(uint16_t i = 0 ; i < FRAME_SIZE ; i++){
+		fft_buffer[2 * i] = frame[i];
+		fft_buffer[2 * i + 1] = 0;
+	}
+	arm_cfft_f32(&arm_cfft_sR_f32_len1024, fft_buffer, 0, 1);
+	arm_cmplx_mag_f32(fft_buffer, fft_output, FRAME_SIZE);
+}
+
+static void run_goertzel(void)
+{
+	for(uint8_t i = 0 ; i < nb_command_bins ; i++){
+		goertzel_reset(&filters[i]);
+		goertzel_process(&filters[i], frame, FRAME_SIZE);
+		goertzel_output[command_bins[i]] = goertzel_magnitude(&filters[i]);
+	}
+}
+
+/**
+ * @brief               	Runs both paths on a frame and compares their magnitudes.
+ * @param[in]	bin     	the frequency of the tone in bins, 0 for noise only
+ * @param[in]	amplitude	the amplitude of the tone
+ * @return              	true if they find the same tone
+**/
+static bool compare(float bin, float amplitude)
+{
+	float error = 0, max_magnitude = 0;
+	uint32_t max_bin = 0;
+
+	make_frame(bin, amplitude);
+	run_fft();
+	run_goertzel();
+	//the rounding errors grow with the whole signal, not only with the evaluated bins
+	arm_max_f32(fft_output, FRAME_SIZE / 2, &max_magnitude, &max_bin);
+	for(uint8_t i = 0 ; i < nb_command_bins ; i++){
+		error = fabsf(goertzel_output[command_bins[i]] - fft_output[command_bins[i]]);
+		CHECK(error <= MAGNITUDE_TOLERANCE * max_magnitude,
+				"tone on bin %.1f: bin %u Goertzel %.0f FFT %.0f", bin, command_bins[i],
+				goertzel_output[command_bins[i]], fft_output[command_bins[i]]);
+	}
+	return find_tone(fft_output) == find_tone(goertzel_output);
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	const float offsets[] = {-0.45f, -0.25f, 0, 0.25f, 0.45f};
+	//loud, close to the threshold and below the noise
+	const float amplitudes[] = {3000, 600, 30};
+	const float others[] = {11, 14.5f, 16, 18, 19, 29.5f, 33, 40};
+	unsigned same = 0, total = 0;
+	double start = 0, fft_time = 0, goertzel_time = 0;
+
+	srand(1);
+	memset(goertzel_output, 0, sizeof(goertzel_output));
+	//the bins of the pipeline, evaluated on frames of FRAME_SIZE samples
+	init_command_filters();
+	for(uint8_t i = 0 ; i < nb_command_bins ; i++){
+		goertzel_init(&filters[i], command_bins[i], FRAME_SIZE);
+	}
+
+	//tones of the commands heard above the noise
+	for(uint8_t tone = 0 ; tone < NB_TONES ; tone++){
+		for(uint8_t i = 0 ; i < sizeof(offsets) / sizeof(offsets[0]) ; i++){
+			for(uint8_t j = 0 ; j < 2 ; j++){
+				CHECK(compare(tone_bins[tone] + offsets[i], amplitudes[j]),
+						"tone on bin %.2f amplitude %.0f: FFT and Goertzel find different tones",
+						tone_bins[tone] + offsets[i], amplitudes[j]);
+			}
+		}
+	}
+
+	//tones outside the commands heard above the noise, the guard bins reject their leakage
+	for(uint8_t i = 0 ; i < sizeof(others) / sizeof(others[0]) ; i++){
+		for(uint8_t j = 0 ; j < 2 ; j++){
+			CHECK(compare(others[i], amplitudes[j]),
+					"tone on bin %.2f amplitude %.0f: FFT finds tone %d, Goertzel tone %d",
+					others[i], amplitudes[j], find_tone(fft_output), find_tone(goertzel_output));
+		}
+	}
+
+	//tones below the noise, and noise only
+	for(uint8_t tone = 0 ; tone < NB_TONES ; tone++){
+		for(uint8_t i = 0 ; i < sizeof(offsets) / sizeof(offsets[0]) ; i++){
+			same += compare(tone_bins[tone] + offsets[i], amplitudes[2]);
+			total++;
+		}
+	}
+	for(uint8_t i = 0 ; i < sizeof(others) / sizeof(others[0]) ; i++){
+		same += compare(others[i], amplitudes[2]);
+		total++;
+	}
+	for(uint8_t i = 0 ; i < 20 ; i++){
+		same += compare(0, 0);
+		total++;
+	}
+	printf("# noise: same tone found on %u/%u frames\n", same, total);
+
+	make_frame(tone_bins[0], 3000);
+	start = test_cpu_time();
+	for(uint16_t i = 0 ; i < TIMED_FRAMES ; i++){
+		run_fft();
+	}
+	fft_time = (test_cpu_time() - start) / TIMED_FRAMES;
+	start = test_cpu_time();
+	for(uint16_t i = 0 ; i < TIMED_FRAMES ; i++){
+		run_goertzel();
+	}
+	goertzel_time = (test_cpu_time() - start) / TIMED_FRAMES;
+	//the FFT needs 5 N log2(N) flops and the magnitudes 3 N, the filters 2 per sample and per bin
+	printf("# complex FFT %u points + magnitudes: %.1f us/frame on the host, %u flops\n",
+			FRAME_SIZE, 1e6 * fft_time, 5 * FRAME_SIZE * 10 + 3 * FRAME_SIZE);
+	printf("# %u Goertzel filters: %.1f us/frame on the host, %u flops\n",
+			nb_command_bins, 1e6 * goertzel_time, 2 * FRAME_SIZE * nb_command_bins);
+
+	return test_result();
+}
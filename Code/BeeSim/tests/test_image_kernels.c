@@ -0,0 +1,164 @@
+/**
+ * @file	test_image_kernels.c
+ * @brief	Compares the SIMD kernels of the line processing with their scalar versions
+ * 			and counts their work per line.
+ * @note	image_kernels.c is linked as on the targets without SIMD instructions, and
+ * 			included here again with __ARM_FEATURE_SIMD32 and the intrinsics of the hal.h
+ * 			stub, its functions renamed. Both must give the same bytes on random lines,
+ * 			at every alignment and for lengths which are not multiples of 4. The host
+ * 			cannot time the Cortex-M4 instructions, so the loops count the SIMD
+ * 			instructions and the iterations of each version per line, and the scalar
+ * 			version is timed on the host.
+**/
+
+//C headers
+#include <string.h>
+
+//ChibiOS headers
+#include <ch.h>
+#include <hal.h>
+
+//Project headers
+#include "include/image_kernels.h"
+#include "include/process_image.h"
+#include "test.h"
+
+//the SIMD instructions of the kernels are counted, they take one cycle each on the Cortex-M4
+static uint32_t simd_instructions = 0;
+#define __UHADD8(a, b)				(simd_instructions++, __UHADD8(a, b))
+#define __UHSUB8(a, b)				(simd_instructions++, __UHSUB8(a, b))
+#define __USAD8(a, b)				(simd_instructions++, __USAD8(a, b))
+#define __PKHBT(a, b, shift)		(simd_instructions++, __PKHBT(a, b, shift))
+
+//the SIMD kernels next to the scalar ones, declared by their own copy of image_kernels.c
+#define __ARM_FEATURE_SIMD32		1
+#define image_extract_green			simd_extract_green
+#define image_average				simd_average
+#define image_gradient				simd_gradient
+#define image_find_edge				simd_find_edge
+#include "../source/image_kernels.c"
+#undef image_extract_green
+#undef image_average
+#undef image_gradient
+#undef image_find_edge
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define NB_LINES				2000
+#define GRADIENT_OFFSET			30
+#define THRESHOLD				10
+//fraction of the gradients above the threshold, the edges are rare on a line
+#define EDGE_PROBABILITY		50
+#define TIMED_LINES				20000
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+//a few bytes more to start the lines at every alignment
+static uint8_t rgb565[2 * IMAGE_BUFFER_SIZE + 4];
+static uint8_t scalar_green[IMAGE_BUFFER_SIZE + 4], simd_green[IMAGE_BUFFER_SIZE + 4];
+static uint8_t other_green[IMAGE_BUFFER_SIZE + 4];
+static uint8_t scalar_average[IMAGE_BUFFER_SIZE + 4], simd_average_line[IMAGE_BUFFER_SIZE + 4];
+static int8_t scalar_gradient[IMAGE_BUFFER_SIZE + 4], simd_gradient_line[IMAGE_BUFFER_SIZE + 4];
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               	Runs the kernels of a line of ProcessImage.
+ * @param[in]	simd    	true for the SIMD versions
+ * @return              	the index of the first edge
+**/
+static uint16_t process_line(bool simd)
+{
+	if(simd)
+	{
+		simd_extract_green(rgb565, simd_green, IMAGE_BUFFER_SIZE);
+		simd_extract_green(rgb565, other_green, IMAGE_BUFFER_SIZE);
+		simd_average(simd_green, other_green, simd_green, IMAGE_BUFFER_SIZE);
+		simd_gradient(simd_green, simd_gradient_line, IMAGE_BUFFER_SIZE - GRADIENT_OFFSET, GRADIENT_OFFSET);
+		return simd_find_edge(simd_gradient_line, 0, IMAGE_BUFFER_SIZE - GRADIENT_OFFSET, THRESHOLD);
+	}
+	image_extract_green(rgb565, scalar_green, IMAGE_BUFFER_SIZE);
+	image_extract_green(rgb565, other_green, IMAGE_BUFFER_SIZE);
+	image_average(scalar_green, other_green, scalar_green, IMAGE_BUFFER_SIZE);
+	image_gradient(scalar_green, scalar_gradient, IMAGE_BUFFER_SIZE - GRADIENT_OFFSET, GRADIENT_OFFSET);
+	return image_find_edge(scalar_gradient, 0, IMAGE_BUFFER_SIZE - GRADIENT_OFFSET, THRESHOLD);
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	uint16_t length = 0, offset = 0, start = 0, scalar_edge = 0, simd_edge = 0;
+	uint32_t mismatches[4] = {0};
+	uint32_t instructions = 0;
+	double begin = 0, elapsed = 0;
+
+	srand(1);
+	for(uint32_t line = 0 ; line < NB_LINES ; line++){
+		//every alignment of the source and every length modulo 4
+		length = 1 + rand() % IMAGE_BUFFER_SIZE;
+		offset = rand() % 4;
+		for(uint16_t i = 0 ; i < sizeof(rgb565) ; i++){
+			rgb565[i] = rand();
+		}
+
+		image_extract_green(&rgb565[offset], &scalar_green[offset], length);
+		simd_extract_green(&rgb565[offset], &simd_green[offset], length);
+		mismatches[0] += memcmp(&scalar_green[offset], &simd_green[offset], length) != 0;
+
+		simd_extract_green(&rgb565[(offset + 1) % 4], &other_green[offset], length);
+		image_average(&scalar_green[offset], &other_green[offset], &scalar_average[offset], length);
+		simd_average(&simd_green[offset], &other_green[offset], &simd_average_line[offset], length);
+		mismatches[1] += memcmp(&scalar_average[offset], &simd_average_line[offset], length) != 0;
+
+		if(length > GRADIENT_OFFSET)
+		{
+			image_gradient(&scalar_average[offset], &scalar_gradient[offset], length - GRADIENT_OFFSET, GRADIENT_OFFSET);
+			simd_gradient(&simd_average_line[offset], &simd_gradient_line[offset], length - GRADIENT_OFFSET,
+							GRADIENT_OFFSET);
+			mismatches[2] += memcmp(&scalar_gradient[offset], &simd_gradient_line[offset], length - GRADIENT_OFFSET) != 0;
+		}
+
+		//sparse edges of both signs, searched from anywhere
+		for(uint16_t i = 0 ; i < length ; i++){
+			scalar_gradient[i] = rand() % EDGE_PROBABILITY == 0 ? (int8_t)rand() : rand() % (2 * THRESHOLD + 1) - THRESHOLD;
+		}
+		start = rand() % length;
+		scalar_edge = image_find_edge(scalar_gradient, start, length, THRESHOLD);
+		simd_edge = simd_find_edge(scalar_gradient, start, length, THRESHOLD);
+		mismatches[3] += scalar_edge != simd_edge;
+	}
+	CHECK(mismatches[0] == 0, "image_extract_green differs on %u lines", (unsigned)mismatches[0]);
+	CHECK(mismatches[1] == 0, "image_average differs on %u lines", (unsigned)mismatches[1]);
+	CHECK(mismatches[2] == 0, "image_gradient differs on %u lines", (unsigned)mismatches[2]);
+	CHECK(mismatches[3] == 0, "image_find_edge differs on %u lines", (unsigned)mismatches[3]);
+	printf("# %d random lines, SIMD and scalar kernels bit-exact at every alignment\n", NB_LINES);
+
+	//a flat line with a single edge at the end, the worst case of the search
+	memset(rgb565, 0, sizeof(rgb565));
+	rgb565[2 * (IMAGE_BUFFER_SIZE - 1)] = 0x07;
+	simd_instructions = 0;
+	simd_edge = process_line(true);
+	instructions = simd_instructions;
+	scalar_edge = process_line(false);
+	CHECK(simd_edge == scalar_edge, "edge at %u with SIMD, %u without", simd_edge, scalar_edge);
+
+	begin = test_cpu_time();
+	for(uint32_t i = 0 ; i < TIMED_LINES ; i++){
+		scalar_edge += process_line(false);
+	}
+	elapsed = test_cpu_time() - begin;
+	//the scalar loops take one iteration per pixel of each kernel
+	printf("# per line of %d pixels: %d scalar iterations, %u SIMD instructions of four pixels each\n",
+			IMAGE_BUFFER_SIZE, 3 * IMAGE_BUFFER_SIZE + 2 * (IMAGE_BUFFER_SIZE - GRADIENT_OFFSET), (unsigned)instructions);
+	printf("# scalar kernels: %.2f us per line on the host\n", 1e6 * elapsed / TIMED_LINES);
+	return test_result();
+}
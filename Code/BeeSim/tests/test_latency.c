@@ -0,0 +1,119 @@
+/**
+ * @file	test_latency.c
+ * @brief	Measures the time from the onset of a command tone to the mode change,
+ * 			through the whole audio pipeline.
+ * @note	Each command is whistled several times over noise, starting at random
+ * 			samples so that the onsets fall anywhere in a hop. The test is built with
+ * 			the overlapped spectra (HOP_SIZE of process_audio.c) and, for the old
+ * 			analysis, with HOP_SIZE = FFT_SIZE. The latency must stay below the frame
+ * 			and the DETECTION_THRESHOLD hops the debounce needs. The mode change is
+ * 			timestamped by the block that completes it, so the latencies are rounded
+ * 			up to a block.
+**/
+
+//the static functions and constants of the pipeline are tested directly
+#include "../source/process_audio.c"
+
+#include "sim.h"
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define AMPLITUDE			3000
+#define NOISE				300
+#define TONE_LENGTH			(SAMPLING_FREQUENCY / 2)
+#define GAP_LENGTH			(SAMPLING_FREQUENCY / 2)
+#define TRIALS_PER_COMMAND	10
+
+//the full frame, the debounce and the alignment on a hop, plus the block and the decimation filter
+#define MAX_LATENCY			(DECIMATION_FACTOR * (FFT_SIZE + DETECTION_THRESHOLD * HOP_SIZE) \
+							+ MIC_BLOCK_SIZE + DECIMATION_TAPS)
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static int16_t block[NB_MICS * MIC_BLOCK_SIZE];
+//samples per microphone generated since the start, on the timestamps of the pipeline
+static uint32_t generated_samples = 0;
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               	Feeds noise and optionally a tone to the pipeline, block by block.
+ * @param[in]	length  	the number of samples per microphone
+ * @param[in]	bin     	the bin of the tone, 0 for noise only
+ * @return              	none
+**/
+static void feed(uint32_t length, uint16_t bin)
+{
+	static uint16_t fill = 0;
+
+	for(uint32_t n = 0 ; n < length ; n++){
+		float tone = bin ? AMPLITUDE * sinf(2 * PI * bin * n / FRAME_SIZE) : 0;
+
+		for(uint8_t mic = 0 ; mic < NB_MICS ; mic++){
+			block[NB_MICS * fill + mic] = (int16_t)lrintf(tone + NOISE * test_gaussian());
+		}
+		generated_samples++;
+		if(++fill == MIC_BLOCK_SIZE)
+		{
+			fill = 0;
+			sim_mic_feed(block, NB_MICS * MIC_BLOCK_SIZE);
+			//the audio thread processes the block while the next one is recorded
+			chThdSleep(US2ST(1000000ULL * MIC_BLOCK_SIZE / SAMPLING_FREQUENCY));
+		}
+	}
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	audio_stats_t stats;
+	uint32_t onset = 0, latency = 0, last_change = 0;
+	uint32_t min_latency = UINT32_MAX, max_latency = 0, sum_latency = 0, trials = 0;
+
+	srand(1);
+	process_audio_start();
+
+	for(uint8_t trial = 0 ; trial < TRIALS_PER_COMMAND ; trial++){
+		for(uint8_t i = 0 ; i < NB_COMMANDS ; i++){
+			//the random part of the gap moves the onset in the hop and in the block
+			feed(GAP_LENGTH + rand() % (DECIMATION_FACTOR * HOP_SIZE + MIC_BLOCK_SIZE), 0);
+			onset = generated_samples;
+			feed(TONE_LENGTH, tone_bins[commands[i].tones[0]]);
+
+			get_audio_stats(&stats);
+			CHECK(stats.mode_change_sample != last_change && get_mode() == commands[i].mode,
+					"command %u at sample %u not recognised", (unsigned)i, (unsigned)onset);
+			if(stats.mode_change_sample == last_change)
+			{
+				continue;
+			}
+			last_change = stats.mode_change_sample;
+			latency = stats.mode_change_sample - onset;
+			CHECK(stats.mode_change_sample > onset && latency <= MAX_LATENCY,
+					"command %u at sample %u recognised after %d samples, at most %u expected",
+					(unsigned)i, (unsigned)onset, (int)(stats.mode_change_sample - onset), MAX_LATENCY);
+			min_latency = latency < min_latency ? latency : min_latency;
+			max_latency = latency > max_latency ? latency : max_latency;
+			sum_latency += latency;
+			trials++;
+		}
+	}
+
+	printf("# hop of %d samples at 2 kHz (%.0f ms), spectra of %d samples\n", HOP_SIZE,
+			1000.0 * DECIMATION_FACTOR * HOP_SIZE / SAMPLING_FREQUENCY, FFT_SIZE);
+	printf("# tone onset to mode change over %u commands: mean %.1f ms, min %.1f ms, max %.1f ms, bound %.1f ms\n",
+			(unsigned)trials, trials ? 1000.0 * sum_latency / trials / SAMPLING_FREQUENCY : 0,
+			1000.0 * min_latency / SAMPLING_FREQUENCY, 1000.0 * max_latency / SAMPLING_FREQUENCY,
+			1000.0 * MAX_LATENCY / SAMPLING_FREQUENCY);
+	return test_result();
+}
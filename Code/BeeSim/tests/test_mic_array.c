@@ -0,0 +1,120 @@
+/**
+ * @file	test_mic_array.c
+ * @brief	Estimates the direction of tones coming from known bearings.
+ * @note	The tone reaches each microphone with the delay given by its position,
+ * 			as in data/make_commands.py, over independent noise on each microphone.
+ * 			Every command tone is played from every 30 degrees around the robot for
+ * 			two frames, the bearing of the second one must be within BEARING_TOLERANCE.
+ * 			A tone too quiet for the direction filters must give no bearing.
+**/
+
+//C headers
+#include <math.h>
+
+//ChibiOS headers
+#include <ch.h>
+
+//E-puck 2 headers
+#include <arm_math.h>
+
+//Project headers
+#include "include/mic_array.h"
+
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define SAMPLING_FREQUENCY	16000
+#define FRAME_SIZE			1024
+#define MIN_MAGNITUDE		10000
+
+#define AMPLITUDE			3000
+#define QUIET_AMPLITUDE		10
+#define NOISE				300
+
+#define SPEED_OF_SOUND		343000.0	//mm/s
+#define BEARING_STEP		30
+#define BEARING_TOLERANCE	5
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+//positions of the microphones in the order of the channels (R, L, B, F),
+//x to the front and y to the left, in mm
+static const double mic_positions[NB_MICS][2] = {{0, -30}, {0, 30}, {-22.5, 0}, {22.5, 0}};
+
+static const uint16_t tone_bins[] = {21, 24, 27};
+#define NB_TONES			(sizeof(tone_bins) / sizeof(tone_bins[0]))
+
+static int16_t block[NB_MICS * MIC_BLOCK_SIZE];
+static float combined[MIC_BLOCK_SIZE];
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               	Plays a tone from a direction for two frames.
+ * @param[in]	bin     	the bin of the tone
+ * @param[in]	bearing 	the direction in degrees, 0 in front, positive to the left
+ * @param[in]	amplitude	the amplitude of the tone
+ * @return              	none
+**/
+static void play(uint16_t bin, double bearing, double amplitude)
+{
+	double frequency = (double)bin * SAMPLING_FREQUENCY / FRAME_SIZE;
+	double advance[NB_MICS];
+	uint16_t fill = 0;
+
+	//the microphones closer to the source hear it earlier
+	for(uint8_t mic = 0 ; mic < NB_MICS ; mic++){
+		advance[mic] = (mic_positions[mic][0] * cos(bearing * M_PI / 180)
+						+ mic_positions[mic][1] * sin(bearing * M_PI / 180)) / SPEED_OF_SOUND;
+	}
+	for(uint32_t n = 0 ; n < 2 * FRAME_SIZE ; n++){
+		for(uint8_t mic = 0 ; mic < NB_MICS ; mic++){
+			double time = (double)n / SAMPLING_FREQUENCY + advance[mic];
+			block[NB_MICS * fill + mic] = (int16_t)lrint(amplitude * sin(2 * M_PI * frequency * time)
+														+ NOISE * test_gaussian());
+		}
+		if(++fill == MIC_BLOCK_SIZE || n == 2 * FRAME_SIZE - 1)
+		{
+			mic_array_process(block, NB_MICS * fill, combined);
+			fill = 0;
+		}
+	}
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	int16_t bearing = 0;
+	int error = 0, max_error = 0;
+	bool valid = false;
+
+	srand(1);
+	mic_array_init(tone_bins, NB_TONES, FRAME_SIZE, MIN_MAGNITUDE);
+
+	for(uint8_t tone = 0 ; tone < NB_TONES ; tone++){
+		for(int expected = -180 + BEARING_STEP ; expected <= 180 ; expected += BEARING_STEP){
+			play(tone_bins[tone], expected, AMPLITUDE);
+			valid = mic_array_get_bearing(&bearing);
+			//the error wrapped to -180..180 degrees
+			error = abs(((bearing - expected) % 360 + 540) % 360 - 180);
+			CHECK(valid && error <= BEARING_TOLERANCE, "bin %u from %d degrees: bearing %d%s",
+					tone_bins[tone], expected, bearing, valid ? "" : " not valid");
+			max_error = error > max_error ? error : max_error;
+		}
+		play(tone_bins[tone], 0, QUIET_AMPLITUDE);
+		CHECK(!mic_array_get_bearing(&bearing), "bin %u too quiet but bearing %d", tone_bins[tone], bearing);
+	}
+
+	printf("# largest bearing error %d degrees, amplitude %d over a noise of %d\n", max_error, AMPLITUDE, NOISE);
+	return test_result();
+}
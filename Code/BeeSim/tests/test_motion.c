@@ -0,0 +1,277 @@
+/**
+ * @file	test_motion.c
+ * @brief	Runs the maneuvers on a differential drive and measures where they end,
+ * 			for several periods of the updates.
+ * @note	The wheels follow the speeds set without slipping, the pose of the
+ * 			robot is integrated from the positions of the motors. A sequence of
+ * 			rotations, straight drives and arcs is chained by the callbacks, like the
+ * 			states of the controller, with motion_update called every period. Each
+ * 			maneuver must end on its target whatever the period, the leading wheel
+ * 			within the acceleration, the other one keeping the robot on its path,
+ * 			and call its callback once. The arcs must keep the robot on their circle
+ * 			and end on its point at their angle. A maneuver without any step ends
+ * 			at the first update.
+**/
+
+//the static functions and variables of the maneuvers are tested directly
+#include "../source/motion.c"
+
+#include "sim.h"
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+//periods of the updates, in ms, the controller updates every 10 ms
+static const uint16_t periods[] = {5, 10, 20, 50};
+#define NB_PERIODS				(sizeof(periods) / sizeof(periods[0]))
+
+//longest time a maneuver of the sequence takes
+#define MAX_DURATION			MS2ST(3000)
+
+//steps a wheel may end off its target by, the target being rounded to a step and the
+//wheel going on at MIN_SPEED until the update following its arrival
+#define MAX_STEP_ERROR(period)	(1 + MIN_SPEED * (period) / 1000.0)
+#define STEPS_TO_MM(steps)		((steps) * (double)WHEEL_PERIMETER / STEPS_PER_TURN)
+#define STEPS_TO_DEGREES(steps)	(STEPS_TO_MM(steps) / (WHEEL_DISTANCE / 2.0) / DEGREES_TO_RADIANS)
+//distance the robot may leave its straight path by, in mm
+#define MAX_DRIFT				0.5
+//the acceleration is measured over a window, the braking speed following the steps
+//remaining changes by up to MAX_ACCELERATION / MIN_SPEED at each step
+#define ACCELERATION_WINDOW		50
+#define ACCELERATION_MARGIN		1.25
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+typedef enum {
+	ROTATE,
+	DRIVE,
+	ARC,
+} maneuver_type_t;
+
+//maneuver of the sequence
+typedef struct maneuver_t
+{
+	maneuver_type_t type;
+	int16_t amount;			//angle in degrees or distance in mm
+	uint16_t speed;			//in steps/s
+	int16_t radius;			//of the arcs in mm, positive to turn left
+} maneuver_t;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+//the fastest rotation is above the speed limit of the motors, the last arc
+//turns right backward
+static const maneuver_t maneuvers[] = {
+	{ROTATE,	90,		600,	0},
+	{DRIVE,		200,	800,	0},
+	{ROTATE,	-180,	1500,	0},
+	{DRIVE,		-100,	400,	0},
+	{ARC,		90,		800,	150},
+	{ROTATE,	5,		600,	0},
+	{DRIVE,		3,		600,	0},
+	{ARC,		-60,	600,	-40},
+};
+#define NB_MANEUVERS			(sizeof(maneuvers) / sizeof(maneuvers[0]))
+
+static sim_pose_t pose = {0};
+//pose at the start of the maneuver running
+static sim_pose_t start = {0};
+//center of the circle of the arc running
+static double center_x = 0, center_y = 0;
+static uint8_t current = 0;
+static uint32_t done_calls = 0;
+static double max_heading_error = 0, max_distance_error = 0, max_drift = 0;
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               	Starts a maneuver of the sequence.
+ * @param[in]	maneuver	the maneuver
+ * @param[in]	done    	called once it is done
+ * @return              	none
+**/
+static void start_maneuver(const maneuver_t* maneuver, motion_callback_t done)
+{
+	start = pose;
+	if(maneuver->type == ROTATE)
+	{
+		motion_rotate(maneuver->amount, maneuver->speed, done);
+	} else if(maneuver->type == DRIVE) {
+		motion_drive(maneuver->amount, maneuver->speed, done);
+	} else {
+		//the center is on the left of the robot for a positive radius
+		center_x = start.x - maneuver->radius * sin(start.heading);
+		center_y = start.y + maneuver->radius * cos(start.heading);
+		motion_arc(maneuver->radius, maneuver->amount, maneuver->speed, done);
+	}
+}
+
+/**
+ * @brief               	Measures where the maneuver running ended and starts the next one.
+ * @return              	none
+**/
+static void next_maneuver(void)
+{
+	const maneuver_t* maneuver = &maneuvers[current];
+	double dx = 0, dy = 0, error = 0, turn = 0;
+
+	done_calls++;
+	sim_pose_update(&pose);
+	dx = pose.x - start.x;
+	dy = pose.y - start.y;
+	if(maneuver->type == ROTATE)
+	{
+		error = fabs(remainder((pose.heading - start.heading) / DEGREES_TO_RADIANS - maneuver->amount, 360));
+		max_heading_error = fmax(max_heading_error, error);
+		//the robot turns on the spot
+		max_drift = fmax(max_drift, sqrt(dx * dx + dy * dy));
+	} else if(maneuver->type == ARC) {
+		//the robot turns by the angle to the side of the center, and ends on the circle there
+		turn = maneuver->radius < 0 ? -maneuver->amount : maneuver->amount;
+		error = fabs(remainder((pose.heading - start.heading) / DEGREES_TO_RADIANS - turn, 360));
+		max_heading_error = fmax(max_heading_error, error);
+		dx = pose.x - center_x - maneuver->radius * sin(start.heading + turn * DEGREES_TO_RADIANS);
+		dy = pose.y - center_y + maneuver->radius * cos(start.heading + turn * DEGREES_TO_RADIANS);
+		max_distance_error = fmax(max_distance_error, sqrt(dx * dx + dy * dy));
+	} else {
+		//the distance along the heading and away from it
+		error = fabs(dx * cos(start.heading) + dy * sin(start.heading) - maneuver->amount);
+		max_distance_error = fmax(max_distance_error, error);
+		max_drift = fmax(max_drift, fabs(dy * cos(start.heading) - dx * sin(start.heading)));
+		max_heading_error = fmax(max_heading_error, fabs(pose.heading - start.heading) / DEGREES_TO_RADIANS);
+	}
+
+	if(++current < NB_MANEUVERS)
+	{
+		start_maneuver(&maneuvers[current], next_maneuver);
+	}
+}
+
+static void count_done(void)
+{
+	done_calls++;
+}
+
+/**
+ * @brief               	Runs the sequence with updates every period.
+ * @param[in]	period  	the period of the updates in ms
+ * @param[out]	max_acceleration the highest acceleration of a wheel over ACCELERATION_WINDOW,
+ * 							in steps/s^2
+ * @param[out]	mismatched	the updates the wheels of a rotation ran at different speeds
+ * @return              	the time the sequence took, in ms
+**/
+static uint32_t run_sequence(uint16_t period, double* max_acceleration, uint32_t* mismatched)
+{
+	systime_t begin = chVTGetSystemTime();
+	//speeds of the updates of the last window
+	uint8_t window = period < ACCELERATION_WINDOW ? ACCELERATION_WINDOW / period : 1;
+	int16_t left[ACCELERATION_WINDOW + 1] = {0}, right[ACCELERATION_WINDOW + 1] = {0};
+	bool moving = false;
+	uint32_t updates = 0;
+
+	*max_acceleration = 0;
+	*mismatched = 0;
+	current = 0;
+	sim_pose_update(&pose);
+	start_maneuver(&maneuvers[current], next_maneuver);
+	while(motion_update()){
+		chThdSleepMilliseconds(period);
+		if(chVTGetSystemTime() - begin > NB_MANEUVERS * MAX_DURATION)
+		{
+			motion_stop();
+			break;
+		}
+		for(uint8_t i = window ; i > 0 ; i--){
+			left[i] = left[i - 1];
+			right[i] = right[i - 1];
+		}
+		sim_motors_get_speed(&left[0], &right[0]);
+		*mismatched += maneuvers[current].type == ROTATE && left[0] != -right[0];
+		//the arcs stay on their circle
+		if(maneuvers[current].type == ARC)
+		{
+			sim_pose_update(&pose);
+			max_drift = fmax(max_drift, fabs(hypot(pose.x - center_x, pose.y - center_y)
+										- abs(maneuvers[current].radius)));
+		}
+		//the wheels start and stop at once, at MIN_SPEED
+		moving = ++updates > window;
+		for(uint8_t i = 0 ; i <= window ; i++){
+			moving = moving && left[i] != 0 && right[i] != 0;
+		}
+		if(moving)
+		{
+			*max_acceleration = fmax(*max_acceleration, abs(left[0] - left[window]) * 1000.0 / (window * period));
+			*max_acceleration = fmax(*max_acceleration, abs(right[0] - right[window]) * 1000.0 / (window * period));
+		}
+	}
+	sim_pose_update(&pose);
+	return ST2MS(chVTGetSystemTime() - begin);
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	double max_acceleration = 0;
+	uint32_t duration = 0, mismatched = 0;
+	int16_t left = 0, right = 0;
+
+	motors_init();
+
+	for(uint8_t i = 0 ; i < NB_PERIODS ; i++){
+		done_calls = 0;
+		max_heading_error = 0;
+		max_distance_error = 0;
+		max_drift = 0;
+		duration = run_sequence(periods[i], &max_acceleration, &mismatched);
+		printf("# updates every %2u ms: sequence in %4u ms, headings off by %.2f deg, distances off by %.2f mm,"
+				" drift %.2f mm, acceleration up to %.0f steps/s^2\n", periods[i], (unsigned)duration,
+				max_heading_error, max_distance_error, max_drift, max_acceleration);
+		CHECK(current == NB_MANEUVERS && done_calls == NB_MANEUVERS, "%u maneuvers done, %u callbacks",
+				current, (unsigned)done_calls);
+		CHECK(max_heading_error <= STEPS_TO_DEGREES(MAX_STEP_ERROR(periods[i])), "heading off by %.2f deg",
+				max_heading_error);
+		CHECK(max_distance_error <= STEPS_TO_MM(MAX_STEP_ERROR(periods[i])), "distance off by %.2f mm",
+				max_distance_error);
+		CHECK(max_drift <= MAX_DRIFT, "robot off its path by %.2f mm", max_drift);
+		//the first update of a maneuver is not limited, the period before it is unknown
+		if(periods[i] <= MAX_UPDATE_PERIOD)
+		{
+			CHECK(max_acceleration <= ACCELERATION_MARGIN * MAX_ACCELERATION, "acceleration of %.0f steps/s^2",
+					max_acceleration);
+		}
+		CHECK(mismatched == 0, "wheels at different speeds in %u updates of a rotation", (unsigned)mismatched);
+	}
+
+	//without any step, the maneuver ends at once
+	done_calls = 0;
+	motion_rotate(0, 600, count_done);
+	CHECK(!motion_update() && done_calls == 1, "rotation of 0 deg running after its first update");
+	motion_drive(0, 600, count_done);
+	CHECK(!motion_update() && done_calls == 2, "drive of 0 mm running after its first update");
+	//even pushed away from its target before the update
+	motion_drive(0, 600, count_done);
+	left_motor_set_pos(left_motor_get_pos() - 10);
+	right_motor_set_pos(right_motor_get_pos() - 10);
+	CHECK(!motion_update() && done_calls == 3, "drive of 0 mm pushed away running after its first update");
+	sim_motors_get_speed(&left, &right);
+	CHECK(left == 0 && right == 0, "motors at %d and %d steps/s once stopped", left, right);
+
+	//a stopped maneuver does not call its callback
+	motion_drive(100, 600, count_done);
+	motion_update();
+	motion_stop();
+	CHECK(!motion_update() && done_calls == 3, "callback of a stopped maneuver called");
+	return test_result();
+}
@@ -0,0 +1,249 @@
+/**
+ * @file	test_music.c
+ * @brief	Renders the notes the music thread plays into samples and checks their
+ * 			timing, along with the stops and the queue of tracks.
+ * @note	The speaker stub reports each change of note with its time. The changes are
+ * 			rendered as a square wave at 16 kHz and the notes are found back in the
+ * 			samples, between the rests of Miel pops. A thread of higher priority keeps
+ * 			the CPU busy at random times, the notes may start late by as much but the
+ * 			deadlines are absolute, the delays must not add up over the loops.
+ *
+ * 			test_music [output.pcm]	also writes the rendered samples, 16 bits mono
+**/
+
+//C headers
+#include <string.h>
+
+//ChibiOS headers
+#include <ch.h>
+
+//Project headers
+#include "include/music.h"
+#include "sim.h"
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define RENDER_FREQUENCY	16000
+#define RENDER_AMPLITUDE	8000
+#define MAX_CHANGES			256
+#define NB_LOOPS			3
+
+//the load preempts the music thread for up to LOAD_MAX every LOAD_PERIOD on average
+#define LOAD_MAX			US2ST(2000)
+#define LOAD_PERIOD			MS2ST(5)
+//a note starts late by the load at most, and by a tick of the system timer
+#define MAX_LATENESS		(LOAD_MAX + 1)
+
+#define TICKS_TO_SAMPLES(t)	((uint64_t)(t) * RENDER_FREQUENCY / CH_CFG_ST_FREQUENCY)
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+typedef struct change_t
+{
+	systime_t time;
+	uint16_t frequency;
+} change_t;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static change_t changes[MAX_CHANGES];
+static uint16_t nb_changes = 0;
+
+static const note_t short_notes[] = {{440, 100}, {0, 50}, {523, 100}};
+static const track_t short_track = {short_notes, sizeof(short_notes) / sizeof(short_notes[0]), false};
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+static void record_change(systime_t time, uint16_t frequency)
+{
+	if(nb_changes < MAX_CHANGES)
+	{
+		changes[nb_changes++] = (change_t){time, frequency};
+	}
+}
+
+/**
+ * @brief               	Renders the notes played between two times as a square wave.
+ * @param[in]	start   	the time the rendering starts at
+ * @param[in]	end     	the time the rendering ends at
+ * @param[out]	length  	the number of samples
+ * @return              	the samples, to free
+**/
+static int16_t* render(systime_t start, systime_t end, uint32_t* length)
+{
+	uint16_t change = 0;
+	uint16_t frequency = 0;
+	double phase = 0;
+	int16_t* samples = NULL;
+
+	*length = TICKS_TO_SAMPLES(end - start);
+	samples = malloc(*length * sizeof(int16_t));
+	for(uint32_t n = 0 ; n < *length ; n++){
+		while(change < nb_changes && changes[change].time <= start + n * CH_CFG_ST_FREQUENCY / RENDER_FREQUENCY){
+			frequency = changes[change++].frequency;
+		}
+		if(frequency == 0)
+		{
+			samples[n] = 0;
+			phase = 0;
+		} else {
+			samples[n] = phase < 0.5 ? RENDER_AMPLITUDE : -RENDER_AMPLITUDE;
+			phase += (double)frequency / RENDER_FREQUENCY;
+			phase -= (int)phase;
+		}
+	}
+	return samples;
+}
+
+/**
+ * @brief               	Finds the next note in the samples.
+ * @param[in]	samples 	the samples
+ * @param[in]	length  	the number of samples
+ * @param[in,out] position	where to search from, the end of the note found
+ * @param[out]	onset   	the first sample of the note
+ * @param[out]	frequency	the frequency measured on the note, in Hz
+ * @return              	false if there is no note anymore
+**/
+static bool find_note(const int16_t* samples, uint32_t length, uint32_t* position, uint32_t* onset,
+						float* frequency)
+{
+	uint32_t n = *position, rises = 0, first_rise = 0, last_rise = 0;
+
+	while(n < length && samples[n] == 0){
+		n++;
+	}
+	if(n >= length)
+	{
+		return false;
+	}
+	*onset = n;
+	//the frequency is measured between the first and the last rising edges
+	for(n++ ; n < length && samples[n] != 0 ; n++){
+		if(samples[n] > samples[n - 1])
+		{
+			first_rise = rises == 0 ? n : first_rise;
+			last_rise = n;
+			rises++;
+		}
+	}
+	*frequency = rises > 1 ? (float)(rises - 1) * RENDER_FREQUENCY / (last_rise - first_rise) : 0;
+	*position = n;
+	return n < length;
+}
+
+/*===========================================================================*/
+/* File threads.                                                             */
+/*===========================================================================*/
+
+//a thread above the music, like the capture of the camera
+static THD_WORKING_AREA(waLoad, 256);
+static THD_FUNCTION(Load, arg)
+{
+	(void)arg;
+
+	while(1){
+		chThdSleep(1 + rand() % (2 * LOAD_PERIOD));
+		sim_consume(rand() % (LOAD_MAX + 1));
+	}
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(int argc, char** argv)
+{
+	const track_t* track = &miel_pops;
+	systime_t loop_length = 0, start_time = 0, stop_time = 0;
+	uint32_t length = 0, position = 0, onset = 0, expected = 0, note = 0, nb_notes = 0;
+	int32_t error = 0, max_error = 0, last_error = 0;
+	float frequency = 0, max_frequency_error = 0;
+	uint16_t first = 0;
+	int16_t* samples = NULL;
+	FILE* output = NULL;
+
+	srand(1);
+	sim_dac_set_listener(record_change);
+	music_start();
+	chThdCreateStatic(waLoad, sizeof(waLoad), NORMALPRIO + 2, Load, NULL);
+
+	for(uint8_t i = 0 ; i < track->length ; i++){
+		loop_length += MS2ST(track->notes[i].duration);
+	}
+
+	//the looped tune, stopped during a note of the last loop
+	start_time = chVTGetSystemTime();
+	music_play(&miel_pops);
+	chThdSleep(NB_LOOPS * loop_length + MS2ST(track->notes[0].duration / 2));
+	stop_time = chVTGetSystemTime();
+	music_stop();
+	chThdSleep(1);
+	CHECK(sim_dac_get_note() == 0 && !music_is_playing(), "note %u still played after the stop",
+			sim_dac_get_note());
+	CHECK(nb_changes > 0 && changes[nb_changes - 1].frequency == 0
+			&& changes[nb_changes - 1].time - stop_time <= MAX_LATENESS,
+			"the stop took %d ticks", nb_changes ? (int)(changes[nb_changes - 1].time - stop_time) : -1);
+
+	//the notes are found back in the samples and compared with the durations of the track
+	samples = render(start_time, stop_time, &length);
+	while(find_note(samples, length, &position, &onset, &frequency)){
+		while(track->notes[note % track->length].frequency == 0){
+			expected += TICKS_TO_SAMPLES(MS2ST(track->notes[note % track->length].duration));
+			note++;
+		}
+		error = (int32_t)onset - (int32_t)expected;
+		CHECK(error >= 0 && error <= (int32_t)TICKS_TO_SAMPLES(MAX_LATENESS),
+				"note %u starts %.2f ms late", (unsigned)nb_notes, 1000.0 * error / RENDER_FREQUENCY);
+		CHECK(fabsf(frequency - track->notes[note % track->length].frequency) < 1,
+				"note %u at %.1f Hz instead of %u Hz", (unsigned)nb_notes, frequency,
+				track->notes[note % track->length].frequency);
+		max_error = error > max_error ? error : max_error;
+		max_frequency_error = fmaxf(max_frequency_error, fabsf(frequency - track->notes[note % track->length].frequency));
+		last_error = error;
+		expected += TICKS_TO_SAMPLES(MS2ST(track->notes[note % track->length].duration));
+		note++;
+		nb_notes++;
+	}
+	CHECK(nb_notes == NB_LOOPS * 8, "%u notes found in %d loops", (unsigned)nb_notes, NB_LOOPS);
+	printf("# %u notes over %d loops of %.2f s, up to %.2f ms late, the last one %.2f ms late, up to %.1f Hz off\n",
+			(unsigned)nb_notes, NB_LOOPS, ST2MS(loop_length) / 1000.0, 1000.0 * max_error / RENDER_FREQUENCY,
+			1000.0 * last_error / RENDER_FREQUENCY, max_frequency_error);
+	if(argc > 1 && (output = fopen(argv[1], "wb")) != NULL)
+	{
+		fwrite(samples, sizeof(int16_t), length, output);
+		fclose(output);
+	}
+	free(samples);
+
+	//a stop while nothing plays must not stop the next track
+	music_stop();
+	first = nb_changes;
+	music_play(&short_track);
+	chThdSleep(MS2ST(300));
+	CHECK(nb_changes - first == 4 && changes[first].frequency == 440 && changes[first + 2].frequency == 523
+			&& changes[first + 3].frequency == 0, "the track after a stop made %d changes", nb_changes - first);
+	CHECK(!music_is_playing(), "the track does not end");
+
+	//a track queued during the looped tune follows its current loop without a gap
+	first = nb_changes;
+	start_time = chVTGetSystemTime();
+	music_play(&miel_pops);
+	chThdSleep(loop_length / 2);
+	CHECK(music_queue(&short_track), "the queue is full");
+	chThdSleep(loop_length);
+	for(note = first ; note < nb_changes && changes[note].frequency != short_notes[0].frequency ; note++);
+	CHECK(note < nb_changes && changes[note].time - start_time - loop_length <= MAX_LATENESS,
+			"the queued track starts %d ticks after the end of the loop",
+			note < nb_changes ? (int)(changes[note].time - start_time - loop_length) : -1);
+	CHECK(!music_is_playing(), "the tune goes on after the queued track");
+	return test_result();
+}
@@ -0,0 +1,187 @@
+/**
+ * @file	test_publication.c
+ * @brief	Reads the detections and the distances published on the bus like the
+ * 			controller does, from the events broadcast with them.
+ * @note	The camera shows a flower still in the middle of the line. ProcessImage
+ * 			must publish one snapshot per frame processed, numbered in sequence and
+ * 			stamped with the end of the capture of its frame, the events telling
+ * 			the reader about each of them. The TOF sensor is then given a sequence
+ * 			of distances, some repeated: PublishTOF must publish every reading,
+ * 			numbered in sequence and stamped a period of the sensor after the last
+ * 			one, each distance from the first reading after it is given.
+**/
+
+//C headers
+#include <stdlib.h>
+
+//ChibiOS headers
+#include <ch.h>
+#include <hal.h>
+
+//E-puck 2 headers
+#include <msgbus/messagebus.h>
+
+//Project headers
+#include "main.h"
+#include "include/process_image.h"
+#include "include/process_audio.h"
+#include "include/TOF_sensor.h"
+#include "sim.h"
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define FRAME_PERIOD			MS2ST(66)
+#define WINDOW_START			MS2ST(27)
+#define WINDOW_LENGTH			MS2ST(1)
+
+#define BACKGROUND				128
+#define FLOWER_GREEN			60
+#define NOISE					4.0
+#define FLOWER_FIRST			270
+#define FLOWER_LAST				369
+#define MAX_POSITION_ERROR		3
+
+#define NB_DETECTIONS			100
+//period PublishTOF reads the sensor at
+#define TOF_PERIOD				MS2ST(30)
+//time each distance is given for
+#define HOLD_TIME				MS2ST(300)
+
+#define BALLOON_EVENT			EVENT_MASK(0)
+#define TOF_EVENT				EVENT_MASK(1)
+
+//distances given to the sensor in mm, a distance repeated is published as often as a new one
+static const uint16_t distances[] = {600, 600, 550, 420, 420, 420, 300, 8190, 8190, 500};
+#define NB_DISTANCES			(sizeof(distances) / sizeof(distances[0]))
+
+/*===========================================================================*/
+/* Global variables.                                                         */
+/*===========================================================================*/
+
+messagebus_t bus;
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+//draws the flower in the middle of the line
+static void frame_source(uint32_t frame, uint8_t* buffer, uint16_t width, uint16_t height)
+{
+	(void)frame;
+
+	for(uint16_t line = 0 ; line < height ; line++){
+		for(uint16_t i = 0 ; i < width ; i++){
+			sim_write_pixel(&buffer[2 * (line * width + i)],
+						(i >= FLOWER_FIRST && i <= FLOWER_LAST ? FLOWER_GREEN : BACKGROUND) + NOISE * test_gaussian());
+		}
+	}
+}
+
+/**
+ * @brief               	Reads the detections published, one per event.
+ * @return              	none
+**/
+static void read_detections(void)
+{
+	event_listener_t listener;
+	messagebus_topic_t* topic = messagebus_find_topic_blocking(&bus, BALLOON_TOPIC);
+	balloon_snapshot_t detection, last = {0};
+	image_stats_t start, end;
+	uint32_t events = 0, misnumbered = 0, mistimed = 0, misplaced = 0;
+	systime_t age = 0, max_age = 0;
+
+	chEvtRegisterMask(&balloon_event, &listener, BALLOON_EVENT);
+	chEvtWaitAny(BALLOON_EVENT);
+	messagebus_topic_read(topic, &last, sizeof(last));
+	get_image_stats(&start);
+	while(events < NB_DETECTIONS){
+		if(!chEvtWaitAnyTimeout(BALLOON_EVENT, 2 * FRAME_PERIOD))
+		{
+			break;
+		}
+		CHECK(messagebus_topic_read(topic, &detection, sizeof(detection)), "event without a detection published");
+		events++;
+		misnumbered += detection.seq != last.seq + 1;
+		//the frames end one period apart, the tick they end in may be rounded
+		mistimed += detection.timestamp - last.timestamp < FRAME_PERIOD - 1
+					|| detection.timestamp - last.timestamp > FRAME_PERIOD + 1;
+		misplaced += detection.type != FLOWER
+					|| abs((int)detection.position - (FLOWER_FIRST + FLOWER_LAST) / 2) > MAX_POSITION_ERROR;
+		age = chVTGetSystemTime() - detection.timestamp;
+		max_age = age > max_age ? age : max_age;
+		last = detection;
+	}
+	get_image_stats(&end);
+	chEvtUnregister(&balloon_event, &listener);
+
+	printf("# %u detections read, %u frames processed meanwhile, read up to %u ms after the capture\n",
+			(unsigned)events, (unsigned)(end.processed - start.processed), (unsigned)ST2MS(max_age));
+	CHECK(events == NB_DETECTIONS && end.processed - start.processed == events, "%u events for %u frames processed",
+			(unsigned)events, (unsigned)(end.processed - start.processed));
+	CHECK(misnumbered == 0, "%u detections out of sequence", (unsigned)misnumbered);
+	CHECK(mistimed == 0, "%u detections not a frame period after the last one", (unsigned)mistimed);
+	CHECK(misplaced == 0, "%u detections not of the flower", (unsigned)misplaced);
+	CHECK(max_age < FRAME_PERIOD, "detection read %u ms after the capture", (unsigned)ST2MS(max_age));
+}
+
+/**
+ * @brief               	Gives distances to the TOF sensor and reads the ones published.
+ * @return              	none
+**/
+static void read_distances(void)
+{
+	event_listener_t listener;
+	messagebus_topic_t* topic = messagebus_find_topic_blocking(&bus, TOF_TOPIC);
+	tof_snapshot_t tof, last = {0};
+	systime_t given = 0;
+	uint32_t published = 0, first_seq = 0;
+
+	chEvtRegisterMask(&tof_event, &listener, TOF_EVENT);
+	chEvtGetAndClearEvents(TOF_EVENT);
+	messagebus_topic_read(topic, &last, sizeof(last));
+	first_seq = last.seq;
+	for(uint8_t i = 0 ; i < NB_DISTANCES ; i++){
+		sim_tof_set_distance(distances[i]);
+		given = chVTGetSystemTime();
+		published = 0;
+		while(chEvtWaitAnyTimeout(TOF_EVENT, HOLD_TIME - (chVTGetSystemTime() - given))){
+			messagebus_topic_read(topic, &tof, sizeof(tof));
+			published++;
+			CHECK(tof.seq == last.seq + 1, "reading %u published after %u", (unsigned)tof.seq,
+					(unsigned)last.seq);
+			CHECK(tof.timestamp - last.timestamp == TOF_PERIOD, "reading %u published %u ms after the last one",
+					(unsigned)tof.seq, (unsigned)ST2MS(tof.timestamp - last.timestamp));
+			CHECK(tof.distance == distances[i], "%u mm published %u ms after %u mm was given", tof.distance,
+					(unsigned)ST2MS(tof.timestamp - given), distances[i]);
+			last = tof;
+		}
+		//the readings go on at their period whatever the distance
+		CHECK(published >= HOLD_TIME / TOF_PERIOD - 1, "%u mm published %u times in %u ms", distances[i],
+				(unsigned)published, (unsigned)ST2MS(HOLD_TIME));
+	}
+	chEvtUnregister(&tof_event, &listener);
+
+	printf("# %u distances given for %u ms each, %u readings published\n", (unsigned)NB_DISTANCES,
+			(unsigned)ST2MS(HOLD_TIME), (unsigned)(last.seq - first_seq));
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	srand(1);
+	messagebus_init(&bus, NULL, NULL);
+	sim_camera_set_source(frame_source, FRAME_PERIOD, WINDOW_START, WINDOW_LENGTH);
+	set_mode(MOVING_TO_BALLOON);
+	process_image_start();
+	sensor_start();
+
+	read_detections();
+	read_distances();
+	return test_result();
+}
@@ -0,0 +1,205 @@
+/**
+ * @file	test_range.c
+ * @brief	Estimates the distance of balloons at known distances from their width
+ * 			in the image, with the default model and once calibrated with the TOF
+ * 			sensor.
+ * @note	The balloons are drawn centered on the line with the width of the
+ * 			pinhole model and the noise of the sensor, and measured by the
+ * 			segmentation. The default model assumes balloons of BALLOON_DIAMETER,
+ * 			the balloons of another diameter are calibrated by coming closer to them
+ * 			with the TOF sensor measuring their distance with its noise, through
+ * 			PublishTOF and calibrate_range like in ProcessImage.
+**/
+
+//the static functions and variables of the processing are tested directly
+#include "../source/process_image.c"
+
+#include "sim.h"
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define BACKGROUND				128
+#define FLOWER_GREEN			60
+#define NOISE					4.0
+
+//focal length of the camera in pixels and diameter of the balloons of the default model in mm
+#define FOCAL_PIXELS			772.0
+#define BALLOON_DIAMETER		250.0
+//diameter of the balloons the model is calibrated on
+#define SMALL_DIAMETER			200.0
+
+//known distances in mm, from the end of the approach to the narrowest balloon found
+static const uint16_t distances[] = {500, 750, 1000, 1500, 2000, 2500, 3000, 3500};
+#define NB_DISTANCES			(sizeof(distances) / sizeof(distances[0]))
+#define FRAMES_PER_DISTANCE		100
+
+//approach to the calibrated balloon, in mm per frame, and noise of the TOF sensor in mm
+#define APPROACH_START			1000
+#define APPROACH_END			450
+#define APPROACH_STEP			2
+#define TOF_NOISE				5.0
+//period PublishTOF reads the sensor at
+#define TOF_PERIOD				MS2ST(30)
+//pixels the edges of a balloon can be found off by in the noise
+#define EDGE_TOLERANCE			2
+
+//errors of the mean and of a single estimation allowed, relative to the distance,
+//and share of the frames estimated within it, the others holding false edges
+#define MAX_BIAS				0.03
+#define MAX_ERROR				0.06
+#define MIN_ACCURATE			0.98
+
+/*===========================================================================*/
+/* Global variables.                                                         */
+/*===========================================================================*/
+
+messagebus_t bus;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static uint8_t lines[2 * LINE_SIZE];
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               	Draws a balloon at a distance, centered on both lines of the band.
+ * @param[in]	diameter	the diameter of the balloon in mm
+ * @param[in]	distance	the distance of the balloon in mm
+ * @return              	none
+**/
+static void draw_balloon(double diameter, double distance)
+{
+	double half_width = FOCAL_PIXELS * diameter / distance / 2;
+	double first = IMAGE_BUFFER_SIZE / 2 - half_width, last = IMAGE_BUFFER_SIZE / 2 + half_width;
+	double covered = 0;
+
+	for(uint8_t line = 0 ; line < 2 ; line++){
+		for(uint16_t i = 0 ; i < IMAGE_BUFFER_SIZE ; i++){
+			//share of the pixel covered by the balloon
+			covered = fmin(i + 1, last) - fmax(i, first);
+			covered = covered < 0 ? 0 : (covered > 1 ? 1 : covered);
+			sim_write_pixel(&lines[line * LINE_SIZE + 2 * i],
+						BACKGROUND + covered * (FLOWER_GREEN - BACKGROUND) + NOISE * test_gaussian());
+		}
+	}
+}
+
+/**
+ * @brief               	Finds the balloon of the band.
+ * @return              	the balloon, NULL if the line does not hold exactly one
+**/
+static const candidate_t* find_balloon(void)
+{
+	process_band(lines, MAIN_BAND, 0, IMAGE_BUFFER_SIZE);
+	return nb_candidates[MAIN_BAND] == 1 ? &candidates[MAIN_BAND][0] : NULL;
+}
+
+/**
+ * @brief               	Estimates the distances of balloons at the known distances.
+ * @param[in]	diameter	the diameter of the balloons in mm
+ * @param[in]	name    	the model, for the report
+ * @param[in]	check   	true to check the errors against MAX_BIAS and MAX_ERROR
+ * @return              	none
+**/
+static void estimate_distances(double diameter, const char* name, bool check)
+{
+	const candidate_t* found = NULL;
+	double sum = 0, error = 0;
+	uint32_t estimated = 0, accurate = 0;
+	uint16_t distance = 0;
+
+	printf("# %s, balloons of %.0f mm:", name, diameter);
+	for(uint8_t i = 0 ; i < NB_DISTANCES ; i++){
+		//the balloons narrower than MIN_BALLOON_WIDTH are not seen
+		if(FOCAL_PIXELS * diameter / distances[i] < MIN_BALLOON_WIDTH + EDGE_TOLERANCE)
+		{
+			continue;
+		}
+		sum = 0;
+		estimated = 0;
+		accurate = 0;
+		for(uint32_t frame = 0 ; frame < FRAMES_PER_DISTANCE ; frame++){
+			draw_balloon(diameter, distances[i]);
+			if((found = find_balloon()) == NULL)
+			{
+				continue;
+			}
+			distance = range_from_width(BALLOON_WIDTH(found->begin, found->end));
+			accurate += fabs((double)distance / distances[i] - 1) <= MAX_ERROR;
+			sum += distance;
+			estimated++;
+		}
+		error = estimated ? sum / estimated / distances[i] - 1 : -1;
+		printf(" %u mm %+.1f%%", distances[i], 100 * error);
+		if(check)
+		{
+			CHECK(estimated == FRAMES_PER_DISTANCE, "balloon at %u mm found in %u frames", distances[i], (unsigned)estimated);
+			CHECK(fabs(error) <= MAX_BIAS && accurate >= MIN_ACCURATE * FRAMES_PER_DISTANCE, "distance of %u mm off by"
+					" %+.1f%% on average, within %.0f%% in %u frames", distances[i], 100 * error, 100 * MAX_ERROR,
+					(unsigned)accurate);
+		}
+	}
+	printf("\n");
+}
+
+/**
+ * @brief               	Comes closer to a balloon, calibrating the model with the TOF sensor.
+ * @param[in]	diameter	the diameter of the balloon in mm
+ * @return              	the number of frames the sensor measured the balloon in
+**/
+static uint32_t approach_balloon(double diameter)
+{
+	const candidate_t* found = NULL;
+	uint32_t measured = 0;
+
+	for(uint16_t distance = APPROACH_START ; distance >= APPROACH_END ; distance -= APPROACH_STEP){
+		draw_balloon(diameter, distance);
+		//the distance is published by PublishTOF within a period
+		sim_tof_set_distance(distance + TOF_NOISE * test_gaussian());
+		chThdSleep(TOF_PERIOD + 1);
+		if((found = find_balloon()) != NULL)
+		{
+			calibrate_range(found);
+			measured += distance < CALIBRATION_RANGE;
+		}
+	}
+	return measured;
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	uint32_t measured = 0;
+
+	srand(1);
+	messagebus_init(&bus, NULL, NULL);
+	sensor_start();
+	tof_topic = messagebus_find_topic(&bus, TOF_TOPIC);
+
+	//the samples out of the range of the model do not change it
+	range_add_sample(FOCAL_PIXELS * SMALL_DIAMETER / 20, 20);
+	CHECK(range_from_width(FOCAL_PIXELS * BALLOON_DIAMETER / 1000) == 1000, "sample out of range used");
+	CHECK(range_from_width(MIN_BALLOON_WIDTH / 4) == 0 && range_from_width(0) == 0, "distance of too narrow a balloon");
+
+	estimate_distances(BALLOON_DIAMETER, "default model", true);
+	estimate_distances(SMALL_DIAMETER, "default model", false);
+
+	measured = approach_balloon(SMALL_DIAMETER);
+	CHECK(measured > 0, "balloon never measured by the TOF sensor");
+	printf("# calibrated on %u frames from %d to %d mm\n", (unsigned)measured, CALIBRATION_RANGE, APPROACH_END);
+	estimate_distances(SMALL_DIAMETER, "calibrated model", true);
+
+	range_reset_calibration();
+	CHECK(range_from_width(FOCAL_PIXELS * BALLOON_DIAMETER / 1000) == 1000, "default model not restored");
+	return test_result();
+}
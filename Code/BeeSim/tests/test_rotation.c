@@ -0,0 +1,249 @@
+/**
+ * @file	test_rotation.c
+ * @brief	Simulates the robot turning on itself to search a balloon then turning
+ * 			toward it, and measures the latency of the detections and the overshoot
+ * 			of the rotation.
+ * @note	The robot turns at the speed of the search like in searching_entry,
+ * 			and approaches the balloon with approach_update from the first frame it
+ * 			is seen in, at every detection like in approaching_during. The camera
+ * 			draws the balloon from the pose of the robot, integrated from the motors,
+ * 			at the time the lines are written. The processing of a frame takes
+ * 			PROCESSING_TIME. The bearing of the balloon is sampled every
+ * 			SAMPLE_PERIOD, the overshoot is the furthest it goes past the center once
+ * 			the robot faces the balloon. The first update stops the search, and the
+ * 			bearing changes too slowly afterwards for the latency to matter: moving
+ * 			the positions by the rotation since the capture did not reduce the
+ * 			overshoot at any speed of the search or time of processing tried.
+**/
+
+//C headers
+#include <string.h>
+
+//ChibiOS headers
+#include <ch.h>
+#include <hal.h>
+
+//Project headers
+#include "include/camera_exposure.h"
+#include "sim.h"
+#include "test.h"
+
+//the processing of a frame takes PROCESSING_TIME once its lines are searched
+#define PROCESSING_TIME			MS2ST(20)
+#define exposure_update(line, nb_pixels)	(exposure_update(line, nb_pixels), sim_consume(PROCESSING_TIME))
+
+//the static functions and variables of the processing are used directly
+#include "../source/process_image.c"
+
+#include "include/approach.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define FRAME_PERIOD			MS2ST(66)
+#define WINDOW_START			MS2ST(27)
+#define WINDOW_LENGTH			MS2ST(1)
+
+#define BACKGROUND				128
+#define FLOWER_GREEN			60
+#define NOISE					4.0
+#define BALLOON_RADIUS			125.0
+
+//speed of the search, like NORMAL_SPEED of the controller, in steps/s
+#define SEARCH_SPEED			150
+//the balloon is placed to the left of the robot, the way it turns
+#define BALLOON_DISTANCE		1500.0
+#define BALLOON_BEARING			(60 * M_PI / 180)
+//distance given while the camera cannot estimate it, the TOF sensor out of range
+#define FAR_DISTANCE			8190
+
+#define SAMPLE_PERIOD			MS2ST(5)
+#define APPROACH_TIME			MS2ST(3000)
+//time without the balloon before the search, no track left from the start
+#define PAUSE_TIME				MS2ST(2 * TRACK_TIMEOUT)
+
+//overshoot allowed, in degrees
+#define MAX_OVERSHOOT			1.0
+//crossings of the center farther than it count as oscillations, in degrees
+#define OSCILLATION_MARGIN		0.5
+
+#define BALLOON_EVENT			EVENT_MASK(0)
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+//results of a run
+typedef struct run_t
+{
+	double overshoot;		//in degrees
+	double final_error;		//in degrees
+	uint32_t oscillations;
+	double mean_latency;	//from the writing of the lines to the update of the approach, in ms
+	double max_latency;
+	uint32_t detections;
+} run_t;
+
+/*===========================================================================*/
+/* Global variables.                                                         */
+/*===========================================================================*/
+
+messagebus_t bus;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static sim_pose_t pose = {0};
+static double balloon_x = 0, balloon_y = 0;
+static bool balloon_visible = false;
+//time the lines of the last frames were written at
+static systime_t write_times[FRAME_POOL_SIZE + 2];
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+//draws the balloon seen from the pose of the robot when the lines are written
+static void frame_source(uint32_t frame, uint8_t* buffer, uint16_t width, uint16_t height)
+{
+	double distance = 0, bearing = 0, half_angle = 0, first = width, last = -1;
+
+	sim_pose_update(&pose);
+	write_times[frame % (sizeof(write_times) / sizeof(write_times[0]))] = chVTGetSystemTime();
+	bearing = sim_pose_get_bearing(&pose, balloon_x, balloon_y, &distance);
+	half_angle = asin(BALLOON_RADIUS / distance);
+	if(balloon_visible && fabs(bearing) + half_angle < M_PI / 2)
+	{
+		first = width / 2 + FOCAL_LENGTH * tan(bearing - half_angle);
+		last = width / 2 + FOCAL_LENGTH * tan(bearing + half_angle);
+	}
+	for(uint16_t line = 0 ; line < height ; line++){
+		for(uint16_t i = 0 ; i < width ; i++){
+			sim_write_pixel(&buffer[2 * (line * width + i)],
+						(i >= first && i <= last ? FLOWER_GREEN : BACKGROUND) + NOISE * test_gaussian());
+		}
+	}
+}
+
+/**
+ * @brief               	Gets the time the lines of a detection were written at.
+ * @param[in]	detection	the detection
+ * @return              	the latest writing started before the end of the capture of its frame
+**/
+static systime_t get_write_time(const balloon_snapshot_t* detection)
+{
+	systime_t latest = 0;
+
+	for(uint8_t i = 0 ; i < sizeof(write_times) / sizeof(write_times[0]) ; i++){
+		if((systime_t)(detection->timestamp - write_times[i]) < (systime_t)(detection->timestamp - latest))
+		{
+			latest = write_times[i];
+		}
+	}
+	return latest;
+}
+
+/**
+ * @brief               	Searches the balloon and turns toward it.
+ * @param[out]	run     	the results
+ * @return              	none
+**/
+static void run_search(run_t* run)
+{
+	event_listener_t listener;
+	balloon_snapshot_t detection = {.type = NONE};
+	messagebus_topic_t* topic = messagebus_find_topic(&bus, BALLOON_TOPIC);
+	systime_t approach_start = 0, latency = 0;
+	double bearing = 0, distance = 0, last_bearing = 0, latencies = 0;
+	bool approaching = false, faced = false;
+	eventmask_t wakeup = 0;
+
+	memset(run, 0, sizeof(*run));
+	//the robot starts still at the origin, with the balloon on its left
+	left_motor_set_speed(0);
+	right_motor_set_speed(0);
+	balloon_visible = false;
+	chThdSleep(PAUSE_TIME);
+	sim_pose_reset(&pose);
+	balloon_x = BALLOON_DISTANCE * cos(BALLOON_BEARING);
+	balloon_y = BALLOON_DISTANCE * sin(BALLOON_BEARING);
+	balloon_visible = true;
+
+	chEvtRegisterMask(&balloon_event, &listener, BALLOON_EVENT);
+	approach_reset();
+	right_motor_set_speed(SEARCH_SPEED);
+	left_motor_set_speed(-SEARCH_SPEED);
+	while(!approaching || chVTGetSystemTime() - approach_start < APPROACH_TIME){
+		wakeup = chEvtWaitAnyTimeout(BALLOON_EVENT, SAMPLE_PERIOD);
+		sim_pose_update(&pose);
+		bearing = sim_pose_get_bearing(&pose, balloon_x, balloon_y, &distance);
+		if(faced)
+		{
+			run->overshoot = fmax(run->overshoot, bearing * 180 / M_PI);
+			if(fabs(bearing - last_bearing) * 180 / M_PI > 2 * OSCILLATION_MARGIN)
+			{
+				run->oscillations++;
+				last_bearing = bearing;
+			}
+		} else if(approaching && bearing >= 0) {
+			faced = true;
+			last_bearing = OSCILLATION_MARGIN * M_PI / 180;
+		}
+		if(!(wakeup & BALLOON_EVENT))
+		{
+			continue;
+		}
+		messagebus_topic_read(topic, &detection, sizeof(detection));
+		if(detection.type == NONE)
+		{
+			continue;
+		}
+		if(!approaching)
+		{
+			approaching = true;
+			approach_start = chVTGetSystemTime();
+		}
+		approach_update(detection.distance ? detection.distance : FAR_DISTANCE, detection.position);
+		latency = chVTGetSystemTime() - get_write_time(&detection);
+		latencies += ST2MS(latency);
+		run->max_latency = fmax(run->max_latency, ST2MS(latency));
+		run->detections++;
+	}
+	chEvtUnregister(&balloon_event, &listener);
+	run->final_error = bearing * 180 / M_PI;
+	run->mean_latency = run->detections ? latencies / run->detections : 0;
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	run_t run;
+	image_stats_t stats;
+
+	srand(1);
+	messagebus_init(&bus, NULL, NULL);
+	sim_camera_set_source(frame_source, FRAME_PERIOD, WINDOW_START, WINDOW_LENGTH);
+	set_mode(MOVING_TO_BALLOON);
+	motors_init();
+	process_image_start();
+	sensor_start();
+
+	run_search(&run);
+	get_image_stats(&stats);
+
+	printf("# turning at %d steps/s, %u ms of processing: from the lines to the approach %.0f ms on average and"
+			" %.0f ms at most, detection latency up to %u ms\n", SEARCH_SPEED, (unsigned)ST2MS(PROCESSING_TIME),
+			run.mean_latency, run.max_latency, (unsigned)stats.max_latency);
+	printf("# overshoot %.1f deg, %u oscillations, %.1f deg off after %u ms\n", run.overshoot,
+			(unsigned)run.oscillations, run.final_error, (unsigned)ST2MS(APPROACH_TIME));
+	CHECK(run.detections > 0, "balloon never approached");
+	CHECK(run.max_latency <= ST2MS(FRAME_PERIOD + PROCESSING_TIME), "latency up to %.0f ms", run.max_latency);
+	CHECK(run.overshoot <= MAX_OVERSHOOT && run.oscillations == 0, "overshoot of %.1f deg and %u oscillations",
+			run.overshoot, (unsigned)run.oscillations);
+	return test_result();
+}
@@ -0,0 +1,224 @@
+/**
+ * @file	test_segmentation.c
+ * @brief	Segments lines containing several balloons with the green edges.
+ * @note	The lines are made of flat balloons, darker or lighter than the
+ * 			background, with the noise of the sensor on each of the two lines of
+ * 			the band. Every balloon separated from the next one by more than
+ * 			WIDTH_SLOPE pixels must be found with its type and its width, the
+ * 			runs narrower than MIN_BALLOON_WIDTH and the steps too weak must not
+ * 			be. At most DENSEST_LINE balloons fit in a line this way, fewer than
+ * 			MAX_CANDIDATES.
+**/
+
+//the static functions and variables of the processing are tested directly
+#include "../source/process_image.c"
+
+#include "sim.h"
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define BACKGROUND				128
+#define FLOWER_GREEN			60
+#define ENNEMY_GREEN			200
+//green step below the detection threshold
+#define WEAK_STEP				(DETECTION_THRESHOLD - 4)
+#define NOISE					4.0
+
+#define NB_RANDOM_LINES			5000
+#define MIN_WIDTH				MIN_BALLOON_WIDTH
+#define MAX_WIDTH				120
+#define MIN_GAP					(WIDTH_SLOPE + 1)
+//balloons of MIN_WIDTH MIN_GAP apart, the first opening edge at the start of the line
+#define DENSEST_LINE			((IMAGE_BUFFER_SIZE - WIDTH_SLOPE + MIN_GAP) / (MIN_WIDTH + MIN_GAP))
+#define MAX_GAP					80
+//pixels the edges of a balloon can be found off by in the noise
+#define EDGE_TOLERANCE			2
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+//balloon drawn on the line, from its first to its last pixel
+typedef struct drawn_t
+{
+	uint16_t first;
+	uint16_t last;
+	uint8_t green;
+} drawn_t;
+
+/*===========================================================================*/
+/* Global variables.                                                         */
+/*===========================================================================*/
+
+messagebus_t bus;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static uint8_t lines[2 * LINE_SIZE];
+static drawn_t drawn[MAX_CANDIDATES];
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               	Draws the balloons on both lines of a band, with noise.
+ * @param[in]	balloons	the balloons, from left to right
+ * @param[in]	nb_balloons	the number of balloons
+ * @param[in]	noise   	the standard deviation of the noise of each line
+ * @return              	none
+**/
+static void draw_band(const drawn_t* balloons, uint8_t nb_balloons, double noise)
+{
+	uint8_t next = 0;
+	int green = 0;
+
+	for(uint16_t i = 0 ; i < IMAGE_BUFFER_SIZE ; i++){
+		while(next < nb_balloons && balloons[next].last < i)
+		{
+			next++;
+		}
+		green = next < nb_balloons && balloons[next].first <= i ? balloons[next].green : BACKGROUND;
+		sim_write_pixel(&lines[2 * i], green + noise * test_gaussian());
+		sim_write_pixel(&lines[LINE_SIZE + 2 * i], green + noise * test_gaussian());
+	}
+}
+
+/**
+ * @brief               	Tells if a candidate is a drawn balloon, its edges found
+ * 							WIDTH_SLOPE pixels early.
+ * @param[in]	found   	the candidate
+ * @param[in]	balloon 	the balloon drawn
+ * @return              	true if the type and the edges match
+**/
+static bool matches(const candidate_t* found, const drawn_t* balloon)
+{
+	balloon_type_t type = balloon->green < BACKGROUND ? FLOWER : ENNEMY;
+
+	return found->type == type
+			&& abs(found->begin + WIDTH_SLOPE - balloon->first) <= EDGE_TOLERANCE
+			&& abs(found->end - 1 - balloon->last) <= EDGE_TOLERANCE
+			&& abs(BALLOON_WIDTH(found->begin, found->end) - (balloon->last + 1 - balloon->first)) <= EDGE_TOLERANCE;
+}
+
+/**
+ * @brief               	Segments the band and compares the candidates with the balloons.
+ * @param[in]	balloons	the balloons expected, from left to right
+ * @param[in]	nb_balloons	the number of balloons expected
+ * @return              	true if each balloon was found, and nothing else
+**/
+static bool segment(const drawn_t* balloons, uint8_t nb_balloons)
+{
+	process_band(lines, MAIN_BAND, 0, IMAGE_BUFFER_SIZE);
+	if(nb_candidates[MAIN_BAND] != nb_balloons)
+	{
+		return false;
+	}
+	for(uint8_t i = 0 ; i < nb_balloons ; i++){
+		if(!matches(&candidates[MAIN_BAND][i], &balloons[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief               	Draws a random line of balloons of both types.
+ * @return              	the number of balloons
+**/
+static uint8_t random_line(void)
+{
+	uint8_t nb_balloons = 0;
+	//the opening edge is found WIDTH_SLOPE pixels before the balloon
+	uint16_t first = WIDTH_SLOPE + rand() % MAX_GAP;
+	uint16_t width = MIN_WIDTH + rand() % (MAX_WIDTH - MIN_WIDTH);
+
+	while(nb_balloons < MAX_CANDIDATES && first + width < IMAGE_BUFFER_SIZE){
+		drawn[nb_balloons].first = first;
+		drawn[nb_balloons].last = first + width - 1;
+		drawn[nb_balloons].green = rand() % 2 ? FLOWER_GREEN : ENNEMY_GREEN;
+		nb_balloons++;
+		first += width + MIN_GAP + rand() % (MAX_GAP - MIN_GAP);
+		width = MIN_WIDTH + rand() % (MAX_WIDTH - MIN_WIDTH);
+	}
+	draw_band(drawn, nb_balloons, NOISE);
+	return nb_balloons;
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	uint32_t exact = 0, balloons = 0, lines_found = 0;
+	uint8_t nb_balloons = 0;
+
+	srand(1);
+
+	//a flower and an ennemy, the background on both sides
+	drawn[0] = (drawn_t){100, 219, FLOWER_GREEN};
+	drawn[1] = (drawn_t){300, 379, ENNEMY_GREEN};
+	draw_band(drawn, 2, 0);
+	CHECK(segment(drawn, 2), "flower and ennemy not segmented");
+
+	//balloons of the same type barely separated
+	drawn[0] = (drawn_t){100, 199, FLOWER_GREEN};
+	drawn[1] = (drawn_t){200 + WIDTH_SLOPE + 1, 300, FLOWER_GREEN};
+	draw_band(drawn, 2, 0);
+	CHECK(segment(drawn, 2), "close flowers not segmented");
+
+	//a balloon of each contrast, the weak one is not seen
+	drawn[0] = (drawn_t){100, 199, BACKGROUND - WEAK_STEP};
+	drawn[1] = (drawn_t){300, 399, FLOWER_GREEN};
+	drawn[2] = (drawn_t){500, 599, BACKGROUND + WEAK_STEP};
+	draw_band(drawn, 3, 0);
+	CHECK(segment(&drawn[1], 1), "weak balloons found");
+
+	//runs too narrow to be balloons between two balloons, one narrower than WIDTH_SLOPE
+	drawn[0] = (drawn_t){50, 149, ENNEMY_GREEN};
+	drawn[1] = (drawn_t){200, 200 + WIDTH_SLOPE / 2, FLOWER_GREEN};
+	drawn[2] = (drawn_t){300, 300 + MIN_WIDTH - 2, ENNEMY_GREEN};
+	drawn[3] = (drawn_t){450, 549, ENNEMY_GREEN};
+	draw_band(drawn, 4, 0);
+	process_band(lines, MAIN_BAND, 0, IMAGE_BUFFER_SIZE);
+	CHECK(nb_candidates[MAIN_BAND] == 2 && matches(&candidates[MAIN_BAND][0], &drawn[0])
+			&& matches(&candidates[MAIN_BAND][1], &drawn[3]), "narrow runs found, %u balloons", nb_candidates[MAIN_BAND]);
+
+	//the densest line, balloons of both types at the smallest width and distance
+	for(uint8_t i = 0 ; i < DENSEST_LINE ; i++){
+		drawn[i].first = WIDTH_SLOPE + i * (MIN_WIDTH + MIN_GAP);
+		drawn[i].last = drawn[i].first + MIN_WIDTH - 1;
+		drawn[i].green = i % 2 ? ENNEMY_GREEN : FLOWER_GREEN;
+	}
+	draw_band(drawn, DENSEST_LINE, 0);
+	CHECK(DENSEST_LINE < MAX_CANDIDATES, "%d balloons fit in a line", DENSEST_LINE);
+	CHECK(segment(drawn, DENSEST_LINE), "densest line not segmented");
+
+	//random lines of up to MAX_CANDIDATES balloons in the noise of the sensor
+	for(uint32_t line = 0 ; line < NB_RANDOM_LINES ; line++){
+		nb_balloons = random_line();
+		balloons += nb_balloons;
+		lines_found += segment(drawn, nb_balloons);
+		for(uint8_t i = 0 ; i < nb_balloons ; i++){
+			for(uint8_t j = 0 ; j < nb_candidates[MAIN_BAND] ; j++){
+				if(matches(&candidates[MAIN_BAND][j], &drawn[i]))
+				{
+					exact++;
+					break;
+				}
+			}
+		}
+	}
+	CHECK(lines_found == NB_RANDOM_LINES, "%u lines out of %d segmented exactly",
+			(unsigned)lines_found, NB_RANDOM_LINES);
+	printf("# %d random lines of %.1f balloons on average: %u/%u balloons found within %d pixels\n",
+			NB_RANDOM_LINES, (double)balloons / NB_RANDOM_LINES, (unsigned)exact, (unsigned)balloons, EDGE_TOLERANCE);
+	return test_result();
+}
@@ -0,0 +1,198 @@
+/**
+ * @file	test_tone_canceller.c
+ * @brief	Whistles STOP while the robot plays its tune, with and without the
+ * 			cancellation of the notes, and measures the time the canceller takes.
+ * @note	The music thread plays Miel pops on the speaker stub, the microphones hear
+ * 			the note played with its harmonics, louder than the whistles, over noise.
+ * 			The same recording is processed twice by the pipeline of process_audio.c,
+ * 			with and without tone_canceller_process. A whistle is detected if STOP is
+ * 			recognised before DETECTION_DELAY after its end, any other recognition of
+ * 			STOP is a false detection.
+**/
+
+//the static functions and constants of the pipeline are tested directly
+#include "../source/process_audio.c"
+
+#include "sim.h"
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define NOISE				300
+#define WHISTLE_AMPLITUDE	3000
+#define WHISTLE_LENGTH		(SAMPLING_FREQUENCY * 3 / 10)
+//a whistle every 2 to 3 s, over the notes and the rests of the tune
+#define WHISTLE_PERIOD		(2 * SAMPLING_FREQUENCY)
+#define WHISTLE_JITTER		SAMPLING_FREQUENCY
+#define NB_WHISTLES			100
+#define DETECTION_DELAY		(SAMPLING_FREQUENCY / 5)
+
+//the speaker is next to the microphones, its notes are louder than the whistles
+#define ECHO_AMPLITUDE		6000
+static const float echo_harmonics[] = {1, 0.5f, 0.25f};
+#define NB_ECHO_HARMONICS	(sizeof(echo_harmonics) / sizeof(echo_harmonics[0]))
+
+#define MIN_DETECTION_RATE	0.9f
+
+//the lowest note of the tune, all the harmonics of the canceller are below the Nyquist frequency
+#define TIMED_NOTE			233
+#define TIMED_BLOCKS		20000
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+typedef struct result_t
+{
+	uint16_t detected;
+	uint16_t false_detections;
+	uint16_t over_notes;		//whistles during which a note was played
+	uint16_t detected_over_notes;
+	uint32_t blocks;
+	uint32_t notes;			//blocks during which a note was played
+} result_t;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static int16_t block[NB_MICS * MIC_BLOCK_SIZE];
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               	Processes a block like process_audio_data.
+ * @param[in]	cancel  	false to leave the notes in the signal
+ * @return              	none
+**/
+static void process(bool cancel)
+{
+	uint16_t length = mic_array_process(block, NB_MICS * MIC_BLOCK_SIZE, micArray_block);
+
+	if(cancel)
+	{
+		tone_canceller_process(micArray_block, length);
+	}
+	arm_fir_decimate_f32(&decimation_instance, micArray_block, micArray_decimated, length);
+	process_block(micArray_decimated, length / DECIMATION_FACTOR);
+}
+
+/**
+ * @brief               	Plays the tune and whistles STOP NB_WHISTLES times over it.
+ * @param[in]	cancel  	false to leave the notes in the signal
+ * @param[out]	result  	the whistles detected and the false detections
+ * @return              	none
+**/
+static void run(bool cancel, result_t* result)
+{
+	uint32_t start = processed_samples, sample = 0, onset = 0, last_change = mode_change_sample;
+	uint16_t note = 0, whistle = 0;
+	double echo_phase = 0, whistle_phase = 0;
+	bool detected = false, over_note = false;
+	float value = 0;
+
+	//the same recording for both runs
+	srand(1);
+	*result = (result_t){0};
+	music_play(&miel_pops);
+	onset = WHISTLE_PERIOD + rand() % WHISTLE_JITTER;
+
+	while(whistle < NB_WHISTLES){
+		//the note changes every 10 ms at most, on the blocks
+		note = sim_dac_get_note();
+		result->blocks++;
+		result->notes += note != 0;
+		over_note = over_note || (note != 0 && sample + MIC_BLOCK_SIZE > onset && sample < onset + WHISTLE_LENGTH);
+		for(uint16_t n = 0 ; n < MIC_BLOCK_SIZE ; n++, sample++){
+			value = 0;
+			for(uint8_t i = 0 ; i < NB_ECHO_HARMONICS ; i++){
+				value += ECHO_AMPLITUDE * echo_harmonics[i] * sin((i + 1) * echo_phase);
+			}
+			echo_phase += 2 * M_PI * note / SAMPLING_FREQUENCY;
+			if(sample >= onset && sample < onset + WHISTLE_LENGTH)
+			{
+				value += WHISTLE_AMPLITUDE * sin(whistle_phase);
+				whistle_phase += 2 * M_PI * FREQ_STOP / FRAME_SIZE;
+			}
+			for(uint8_t mic = 0 ; mic < NB_MICS ; mic++){
+				block[NB_MICS * n + mic] = (int16_t)lrintf(value + NOISE * test_gaussian());
+			}
+		}
+		process(cancel);
+
+		if(mode_change_sample != last_change)
+		{
+			last_change = mode_change_sample;
+			if(last_change - start >= onset && last_change - start <= onset + WHISTLE_LENGTH + DETECTION_DELAY
+				&& !detected)
+			{
+				detected = true;
+				result->detected++;
+			} else {
+				result->false_detections++;
+			}
+			set_mode(COMMUNICATING_WITH_PEERS);
+		}
+		if(sample > onset + WHISTLE_LENGTH + DETECTION_DELAY)
+		{
+			whistle++;
+			result->over_notes += over_note;
+			result->detected_over_notes += over_note && detected;
+			detected = false;
+			over_note = false;
+			onset += WHISTLE_PERIOD + rand() % WHISTLE_JITTER;
+		}
+		//the music thread plays the notes meanwhile
+		chThdSleep(US2ST(1000000ULL * MIC_BLOCK_SIZE / SAMPLING_FREQUENCY));
+	}
+	music_stop();
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	result_t with = {0}, without = {0};
+	double start = 0, elapsed = 0;
+	float data[MIC_BLOCK_SIZE];
+
+	process_audio_start();
+	music_start();
+
+	run(false, &without);
+	run(true, &with);
+
+	printf("# %d STOP whistles over the tune, a note is played %.0f%% of the time\n", NB_WHISTLES,
+			100.0 * with.notes / with.blocks);
+	printf("# without the canceller: %u detected, %u of the %u over a note, %u false detections\n",
+			without.detected, without.detected_over_notes, without.over_notes, without.false_detections);
+	printf("# with the canceller:    %u detected, %u of the %u over a note, %u false detections\n",
+			with.detected, with.detected_over_notes, with.over_notes, with.false_detections);
+	CHECK(with.detected >= MIN_DETECTION_RATE * NB_WHISTLES, "%u whistles out of %d detected",
+			with.detected, NB_WHISTLES);
+	CHECK(with.detected_over_notes >= MIN_DETECTION_RATE * with.over_notes, "%u whistles out of the %u over a note detected",
+			with.detected_over_notes, with.over_notes);
+	CHECK(with.false_detections == 0, "%u false detections", with.false_detections);
+	CHECK(with.detected > without.detected, "the canceller detects %u whistles, %u without it",
+			with.detected, without.detected);
+
+	//cost of the canceller on a block, with the references of every harmonic
+	for(uint16_t n = 0 ; n < MIC_BLOCK_SIZE ; n++){
+		data[n] = NOISE * test_gaussian();
+	}
+	tone_canceller_set_note(TIMED_NOTE);
+	start = test_cpu_time();
+	for(uint32_t i = 0 ; i < TIMED_BLOCKS ; i++){
+		tone_canceller_process(data, MIC_BLOCK_SIZE);
+	}
+	elapsed = test_cpu_time() - start;
+	printf("# canceller: %.2f us per 10 ms block on the host, about 10 multiplications per harmonic and sample\n",
+			1e6 * elapsed / TIMED_BLOCKS);
+	return test_result();
+}
@@ -0,0 +1,256 @@
+/**
+ * @file	test_tracking.c
+ * @brief	Measures the pixels searched per frame and the stability of the track on
+ * 			a sequence of frames.
+ * @note	A flower swings across the line and grows, as the robot turns and comes
+ * 			closer, with the noise of the sensor. It is hidden for a few frames now
+ * 			and then, and a wider flower appears next to it once it is tracked. The
+ * 			frames go through the search window, the bands and the detection like
+ * 			in ProcessImage. The position expected is the center of the flower
+ * 			drawn. The sequence is run again with the first flower hidden
+ * 			for longer than TRACK_MAX_MISSES, while the window grows over the other
+ * 			one, then choosing the balloon again at every frame, like before the
+ * 			tracking.
+**/
+
+//C headers
+#include <string.h>
+
+//the static functions and variables of the processing are tested directly
+#include "../source/process_image.c"
+
+#include "sim.h"
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define BACKGROUND				128
+#define FLOWER_GREEN			60
+#define NOISE					4.0
+
+#define NB_FRAMES				300
+#define FRAME_PERIOD			MS2ST(66)
+//swing of the flower, in pixels and frames, and its width at the start and at the end
+#define SWING_CENTER			240
+#define SWING_AMPLITUDE			80
+#define SWING_PERIOD			90
+#define START_WIDTH				80
+#define END_WIDTH				180
+//short occlusions, every OCCLUSION_PERIOD frames, and the long one, at the end of a swing
+#define OCCLUSION_PERIOD		50
+#define OCCLUSION_LENGTH		3
+#define LOST_FRAME				200
+//the other flower, wider than the first one at first
+#define DISTRACTOR_FRAME		20
+#define DISTRACTOR_FIRST		500
+#define DISTRACTOR_LAST			599
+
+#define MAX_RMS_ERROR			1.0
+#define MAX_ERROR				2
+//frames the other flower is given in at the end, once the first one is lost
+#define FRAMES_TO_SWITCH		5
+#define MAX_COAST_ERROR			10
+#define MAX_PIXELS_SHARE		0.5
+
+/*===========================================================================*/
+/* File data structures and types.                                           */
+/*===========================================================================*/
+
+//results of a run of the sequence
+typedef struct run_t
+{
+	double sum_square_error;
+	uint32_t visible_frames;
+	uint16_t max_error;
+	uint16_t max_coast_error;
+	uint32_t coasted_frames;
+	uint32_t switches;			//frames the other flower is given instead of the first one
+	uint32_t losses;			//frames the flower is visible but not given
+	uint64_t tracked_pixels;
+	uint32_t tracked_frames;
+} run_t;
+
+/*===========================================================================*/
+/* Global variables.                                                         */
+/*===========================================================================*/
+
+messagebus_t bus;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+static uint8_t lines[2 * LINE_SIZE];
+//first frame of the long occlusion, none if NB_FRAMES
+static uint32_t lost_frame = NB_FRAMES;
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+static bool is_hidden(uint32_t seq)
+{
+	return seq % OCCLUSION_PERIOD >= OCCLUSION_PERIOD / 2 && seq % OCCLUSION_PERIOD < OCCLUSION_PERIOD / 2 + OCCLUSION_LENGTH;
+}
+
+static bool is_lost(uint32_t seq)
+{
+	return seq >= lost_frame;
+}
+
+/**
+ * @brief               	Draws a frame of the sequence on both lines of the band.
+ * @param[in]	seq     	the number of the frame
+ * @param[in]	noise   	the standard deviation of the noise of each line
+ * @return              	the center of the flower
+**/
+static float draw_frame(uint32_t seq, double noise)
+{
+	float center = SWING_CENTER + SWING_AMPLITUDE * sinf(2 * M_PI * seq / SWING_PERIOD);
+	float width = START_WIDTH + (END_WIDTH - START_WIDTH) * (float)seq / NB_FRAMES;
+	uint16_t first = center - width / 2, last = center + width / 2;
+	bool visible = !is_hidden(seq) && !is_lost(seq);
+	int green = 0;
+
+	for(uint8_t line = 0 ; line < 2 ; line++){
+		for(uint16_t i = 0 ; i < IMAGE_BUFFER_SIZE ; i++){
+			green = BACKGROUND;
+			if((visible && i >= first && i <= last)
+				|| (seq >= DISTRACTOR_FRAME && i >= DISTRACTOR_FIRST && i <= DISTRACTOR_LAST))
+			{
+				green = FLOWER_GREEN;
+			}
+			sim_write_pixel(&lines[line * LINE_SIZE + 2 * i], green + noise * test_gaussian());
+		}
+	}
+	return (first + last) / 2.0f;
+}
+
+/**
+ * @brief               	Runs the sequence through the processing.
+ * @param[in]	tracking	false to choose the balloon again at every frame
+ * @param[out]	run     	the results
+ * @return              	none
+**/
+static void run_sequence(bool tracking, run_t* run)
+{
+	frame_t frame = {.data = lines};
+	uint16_t first = 0, end = 0, error = 0;
+	float expected = 0;
+	bool given = false;
+
+	memset(run, 0, sizeof(*run));
+	memset(&track, 0, sizeof(track));
+	srand(1);
+	for(uint32_t seq = 0 ; seq < NB_FRAMES ; seq++){
+		expected = draw_frame(seq, NOISE);
+		frame.seq = seq;
+		frame.timestamp = seq * FRAME_PERIOD;
+		if(!tracking)
+		{
+			track.active = false;
+		}
+		if(track.active)
+		{
+			run->tracked_frames++;
+		}
+		get_search_window(&frame, &first, &end);
+		process_band(lines, MAIN_BAND, first, end);
+		detect_balloon(&frame);
+		if(run->tracked_frames && track.active)
+		{
+			run->tracked_pixels += end - first;
+		}
+
+		given = balloon.type == FLOWER;
+		error = abs((int)balloon.position - (int)roundf(expected));
+		if(given && balloon.position > DISTRACTOR_FIRST - WIDTH_SLOPE)
+		{
+			run->switches++;
+		} else if(is_hidden(seq)) {
+			run->coasted_frames += given;
+			run->max_coast_error = given && error > run->max_coast_error ? error : run->max_coast_error;
+		} else if(!given) {
+			run->losses++;
+		} else {
+			run->visible_frames++;
+			run->sum_square_error += error * error;
+			run->max_error = error > run->max_error ? error : run->max_error;
+		}
+	}
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	run_t tracked, untracked;
+	double rms = 0, untracked_rms = 0, pixels = 0;
+	uint32_t hidden = 0, coasted = 0;
+
+	//the TOF sensor gives no distance, the range model is not calibrated
+	messagebus_init(&bus, NULL, NULL);
+	sensor_start();
+	tof_topic = messagebus_find_topic(&bus, TOF_TOPIC);
+
+	for(uint32_t seq = 0 ; seq < NB_FRAMES ; seq++){
+		hidden += is_hidden(seq);
+	}
+
+	run_sequence(true, &tracked);
+	rms = tracked.visible_frames ? sqrt(tracked.sum_square_error / tracked.visible_frames) : INFINITY;
+	pixels = tracked.tracked_frames ? (double)tracked.tracked_pixels / tracked.tracked_frames : IMAGE_BUFFER_SIZE;
+	CHECK(rms <= MAX_RMS_ERROR && tracked.max_error <= MAX_ERROR, "position off by %.2f pixels rms and %u at most",
+			rms, tracked.max_error);
+	CHECK(tracked.losses == 0 && tracked.switches == 0, "flower lost in %u frames, the other one given in %u",
+			(unsigned)tracked.losses, (unsigned)tracked.switches);
+	CHECK(tracked.coasted_frames == hidden && tracked.max_coast_error <= MAX_COAST_ERROR,
+			"coasted through %u hidden frames out of %u, off by %u pixels at most",
+			(unsigned)tracked.coasted_frames, (unsigned)hidden, tracked.max_coast_error);
+	CHECK(pixels <= MAX_PIXELS_SHARE * IMAGE_BUFFER_SIZE, "%.0f pixels searched per tracked frame", pixels);
+
+	//the window covers the other flower while the first one is coasted, the track
+	//moves to it once the first one is missed more than TRACK_MAX_MISSES times
+	srand(1);
+	memset(&track, 0, sizeof(track));
+	lost_frame = LOST_FRAME;
+	for(uint32_t seq = 0 ; seq < LOST_FRAME + TRACK_MAX_MISSES + FRAMES_TO_SWITCH ; seq++){
+		frame_t frame = {lines, seq, seq * FRAME_PERIOD, 0, 0};
+		uint16_t first = 0, end = 0;
+
+		draw_frame(seq, NOISE);
+		get_search_window(&frame, &first, &end);
+		process_band(lines, MAIN_BAND, first, end);
+		if(seq == LOST_FRAME + TRACK_MAX_MISSES - 1)
+		{
+			CHECK(nb_candidates[MAIN_BAND] == 1, "other flower not in the window from %u to %u", first, end);
+		}
+		detect_balloon(&frame);
+		if(seq >= LOST_FRAME && seq < LOST_FRAME + TRACK_MAX_MISSES)
+		{
+			coasted += balloon.type == FLOWER && track.misses == seq + 1 - LOST_FRAME;
+		}
+	}
+	CHECK(coasted == TRACK_MAX_MISSES, "coasted for %u frames out of %d", (unsigned)coasted, TRACK_MAX_MISSES);
+	CHECK(balloon.type == FLOWER && balloon.position > DISTRACTOR_FIRST - WIDTH_SLOPE, "other flower not given %d frames"
+			" after the first one was lost", FRAMES_TO_SWITCH);
+	lost_frame = NB_FRAMES;
+
+	//the position of the balloon found is measured like without the tracking
+	run_sequence(false, &untracked);
+	untracked_rms = untracked.visible_frames ? sqrt(untracked.sum_square_error / untracked.visible_frames) : 0;
+	CHECK(rms <= untracked_rms, "position off by %.2f pixels rms, %.2f chosen at every frame", rms, untracked_rms);
+	printf("# tracked: %.0f pixels searched per frame, position off by %.2f pixels rms and %u at most,"
+			" %u/%u hidden frames coasted off by %u at most, the other flower given in %u frames\n",
+			pixels, rms, tracked.max_error, (unsigned)tracked.coasted_frames, (unsigned)hidden,
+			tracked.max_coast_error, (unsigned)tracked.switches);
+	printf("# chosen at every frame: %d pixels searched per frame, position off by %.2f pixels rms,"
+			" %u/%u hidden frames given, the other flower given in %u frames\n", IMAGE_BUFFER_SIZE,
+			untracked_rms,
+			(unsigned)untracked.coasted_frames, (unsigned)hidden, (unsigned)untracked.switches);
+	return test_result();
+}
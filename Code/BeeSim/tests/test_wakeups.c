@@ -0,0 +1,401 @@
+/**
+ * @file	test_wakeups.c
+ * @brief	Counts the wakeups of the controller thread in each mode, measures
+ * 			the time from the commands recognised to the motors set against the
+ * 			old polling loop and checks the robot stops on stale inputs.
+ * @note	The commands are recognised like by the audio pipeline, with their
+ * 			time and their event, then the pipeline processes the rest of its
+ * 			block before giving the CPU back. The old loop of the controller, a
+ * 			POLL_PERIOD polling of the mode, runs first over the same phases and
+ * 			commands to measure its wakeups and its latency. The detections are
+ * 			published at the rate of the camera and the distances by the test.
+ * 			The controller must set the motors once the pipeline gives the CPU
+ * 			back, the maneuvers at their first update a MOTION_PERIOD later,
+ * 			wake neither while stopped nor more than once per detection while
+ * 			searching, nor more than once per MOTION_PERIOD while a maneuver
+ * 			runs, and stop the wheels within the watchdog of the search and of
+ * 			the approach once their inputs stop.
+**/
+
+//the commands are recognised by the static function of the pipeline
+#include "../source/process_audio.c"
+
+//E-puck 2 headers
+#include <msgbus/messagebus.h>
+#include <motors.h>
+
+//Project headers
+#include "include/controller.h"
+#include "include/process_image.h"
+#include "include/TOF_sensor.h"
+#include "sim.h"
+#include "test.h"
+
+/*===========================================================================*/
+/* File constants.                                                           */
+/*===========================================================================*/
+
+#define FRAME_PERIOD			MS2ST(66)
+#define TOF_PERIOD				MS2ST(30)
+//period of the old polling, MOTION_PERIOD of the controller
+#define POLL_PERIOD				MS2ST(10)
+//speed of the search, NORMAL_SPEED of the controller, in steps/s
+#define SEARCH_SPEED			150
+//watchdogs of the search and of the approach in the controller
+#define SEARCH_WATCHDOG			MS2ST(500)
+#define APPROACH_WATCHDOG		MS2ST(100)
+
+#define IDLE_TIME				MS2ST(10000)
+#define SEARCH_TIME				MS2ST(5000)
+//time the four turns of the dance take at most
+#define DANCE_TIME				MS2ST(20000)
+//delay of the commands after the last detection, off the period of the polling
+#define COMMAND_DELAY			MS2ST(7)
+//time the audio pipeline takes to process the rest of the block of a command
+#define BLOCK_REST				MS2ST(2)
+//commands given one frame apart, their times sweeping the period of the polling
+#define NB_SWITCHES				20
+//distance of the balloon approached, out of reach of the goal
+#define APPROACH_DISTANCE		300
+#define APPROACH_TIME			MS2ST(300)
+
+/*===========================================================================*/
+/* Global variables.                                                         */
+/*===========================================================================*/
+
+messagebus_t bus;
+
+/*===========================================================================*/
+/* File local variables.                                                     */
+/*===========================================================================*/
+
+//detections and distances published by the test in place of the image
+//processing and of the TOF sensor
+static messagebus_topic_t test_balloon_topic;
+static MUTEX_DECL(test_balloon_topic_lock);
+static CONDVAR_DECL(test_balloon_topic_condvar);
+static balloon_snapshot_t test_balloon_topic_value;
+
+static messagebus_topic_t test_tof_topic;
+static MUTEX_DECL(test_tof_topic_lock);
+static CONDVAR_DECL(test_tof_topic_condvar);
+static tof_snapshot_t test_tof_topic_value;
+
+//old loop of the controller, stopped once measured
+static THD_WORKING_AREA(waPoller, 256);
+static volatile bool polling = false;
+static uint32_t polls = 0;
+
+/*===========================================================================*/
+/* File threads.                                                             */
+/*===========================================================================*/
+
+/**
+ * @brief	Polls the mode like the old loop of the controller, the search
+ * 			turning and the other modes stopping the robot.
+**/
+static THD_FUNCTION(Poller, arg)
+{
+	systime_t time = 0;
+
+	(void)arg;
+	while(polling){
+		time = chVTGetSystemTime();
+		polls++;
+		if(get_mode() == MOVING_TO_BALLOON)
+		{
+			right_motor_set_speed(SEARCH_SPEED);
+			left_motor_set_speed(-SEARCH_SPEED);
+		} else {
+			right_motor_set_speed(0);
+			left_motor_set_speed(0);
+		}
+		chThdSleepUntilWindowed(time, time + POLL_PERIOD);
+	}
+}
+
+/*===========================================================================*/
+/* File local functions.                                                     */
+/*===========================================================================*/
+
+/**
+ * @brief               	Publishes a detection of the camera.
+ * @param[in]	type    	the type of the balloon, NONE for a frame without any
+ * @return              	none
+**/
+static void publish_balloon(balloon_type_t type)
+{
+	static balloon_snapshot_t detection = {.position = IMAGE_BUFFER_SIZE/2};
+
+	detection.seq++;
+	detection.timestamp = chVTGetSystemTime();
+	detection.type = type;
+	detection.distance = type == NONE ? 0 : APPROACH_DISTANCE;
+	messagebus_topic_publish(&test_balloon_topic, &detection, sizeof(detection));
+	chEvtBroadcast(&balloon_event);
+}
+
+/**
+ * @brief               	Publishes a reading of the TOF sensor.
+ * @param[in]	distance	the distance in mm
+ * @return              	none
+**/
+static void publish_tof(uint16_t distance)
+{
+	static tof_snapshot_t reading = {0};
+
+	reading.seq++;
+	reading.timestamp = chVTGetSystemTime();
+	reading.distance = distance;
+	messagebus_topic_publish(&test_tof_topic, &reading, sizeof(reading));
+	chEvtBroadcast(&tof_event);
+}
+
+/**
+ * @brief               	Publishes a frame without any balloon until a time or the
+ * 							end of the maneuvers.
+ * @param[in]	duration	the time to publish for
+ * @param[in]	maneuver	true to stop once the robot stops turning
+ * @return              	the number of detections published
+**/
+static uint32_t run_camera(systime_t duration, bool maneuver)
+{
+	systime_t begin = chVTGetSystemTime();
+	int16_t left = 0, right = 0;
+	uint32_t published = 0;
+
+	while(chVTGetSystemTime() - begin < duration){
+		chThdSleep(FRAME_PERIOD);
+		publish_balloon(NONE);
+		published++;
+		sim_motors_get_speed(&left, &right);
+		//the dance ends in the search, the wheels turning at its speed
+		if(maneuver && left == -SEARCH_SPEED && right == SEARCH_SPEED)
+		{
+			break;
+		}
+	}
+	return published;
+}
+
+/**
+ * @brief               	Tells if the motors are set for a mode.
+ * @param[in]	mode    	the mode
+ * @return              	true if they are
+**/
+static bool is_actuated(mode_selected_t mode)
+{
+	int16_t left = 0, right = 0;
+
+	sim_motors_get_speed(&left, &right);
+	switch(mode){
+		case MOVING_TO_BALLOON:
+			return left == -SEARCH_SPEED && right == SEARCH_SPEED;
+		//the dance turns on the spot
+		case COMMUNICATING_WITH_PEERS:
+			return left != 0 && left == -right;
+		default:
+			return left == 0 && right == 0;
+	}
+}
+
+/**
+ * @brief               	Recognises a command like the audio pipeline and measures the
+ * 							time the motors take to be set.
+ * @param[in]	mode    	the mode of the command
+ * @return              	the time from the recognition to the motors set
+**/
+static systime_t recognise(mode_selected_t mode)
+{
+	systime_t given = 0;
+
+	chThdSleep(COMMAND_DELAY);
+	given = chVTGetSystemTime();
+	command_recognised(mode);
+	//the rest of the block, then the motors are read every tick
+	sim_consume(BLOCK_REST);
+	chThdYield();
+	while(!is_actuated(mode) && chVTGetSystemTime() - given <= 2 * POLL_PERIOD){
+		chThdSleep(1);
+	}
+	CHECK(is_actuated(mode), "mode %u: motors not set", mode);
+	return chVTGetSystemTime() - given;
+}
+
+/**
+ * @brief               	Starts and stops the search a frame apart and measures the
+ * 							time the motors take to be set.
+ * @return              	the longest time from a recognition to the motors set
+**/
+static systime_t run_commands(void)
+{
+	systime_t actuation = 0, max_actuation = 0;
+
+	for(uint8_t i = 0 ; i < NB_SWITCHES ; i++){
+		run_camera(FRAME_PERIOD, false);
+		actuation = recognise(i % 2 == 0 ? MOVING_TO_BALLOON : STOPPED);
+		max_actuation = actuation > max_actuation ? actuation : max_actuation;
+	}
+	return max_actuation;
+}
+
+/**
+ * @brief               	Waits for the wheels to stop.
+ * @param[in]	timeout 	the time to wait for at most
+ * @return              	the time the wheels took to stop
+**/
+static systime_t wait_stopped(systime_t timeout)
+{
+	systime_t begin = chVTGetSystemTime();
+
+	while(!is_actuated(STOPPED) && chVTGetSystemTime() - begin <= timeout){
+		chThdSleep(1);
+	}
+	return chVTGetSystemTime() - begin;
+}
+
+/**
+ * @brief               	Gets the wakeups of the controller since the last call.
+ * @return              	the number of wakeups
+**/
+static uint32_t new_wakeups(void)
+{
+	static uint32_t last = 0;
+	controller_stats_t stats;
+	uint32_t wakeups = 0;
+
+	get_controller_stats(&stats);
+	wakeups = stats.wakeups - last;
+	last = stats.wakeups;
+	return wakeups;
+}
+
+/**
+ * @brief               	Gets the polls of the old loop since the last call.
+ * @return              	the number of polls
+**/
+static uint32_t new_polls(void)
+{
+	static uint32_t last = 0;
+	uint32_t new = polls - last;
+
+	last = polls;
+	return new;
+}
+
+/*===========================================================================*/
+/* Main function.                                                            */
+/*===========================================================================*/
+
+int main(void)
+{
+	systime_t begin = 0, duration = 0, polled_actuation = 0, actuation = 0;
+	uint32_t wakeups = 0, detections = 0, idle_polls = 0, search_polls = 0;
+	controller_stats_t stats;
+
+	messagebus_init(&bus, NULL, NULL);
+	motors_init();
+	messagebus_topic_init(&test_balloon_topic, &test_balloon_topic_lock, &test_balloon_topic_condvar,
+							&test_balloon_topic_value, sizeof(test_balloon_topic_value));
+	messagebus_advertise_topic(&bus, &test_balloon_topic, BALLOON_TOPIC);
+	messagebus_topic_init(&test_tof_topic, &test_tof_topic_lock, &test_tof_topic_condvar,
+							&test_tof_topic_value, sizeof(test_tof_topic_value));
+	messagebus_advertise_topic(&bus, &test_tof_topic, TOF_TOPIC);
+	//a still distance until the approach
+	publish_tof(APPROACH_DISTANCE);
+
+	//the old loop over the same phases and commands
+	polling = true;
+	chThdCreateStatic(waPoller, sizeof(waPoller), NORMALPRIO, Poller, NULL);
+	new_polls();
+	run_camera(IDLE_TIME, false);
+	idle_polls = new_polls();
+	recognise(MOVING_TO_BALLOON);
+	new_polls();
+	run_camera(SEARCH_TIME, false);
+	search_polls = new_polls();
+	recognise(STOPPED);
+	polled_actuation = run_commands();
+	polling = false;
+	chThdSleep(POLL_PERIOD);
+
+	controller_start();
+	chThdSleep(FRAME_PERIOD);
+	new_wakeups();
+
+	//stopped, the detections are not waited for
+	detections = run_camera(IDLE_TIME, false);
+	wakeups = new_wakeups();
+	printf("# stopped:   %4u wakeups in %u ms and %u detections, %u by polling\n", (unsigned)wakeups,
+			(unsigned)ST2MS(IDLE_TIME), (unsigned)detections, (unsigned)idle_polls);
+	CHECK(wakeups == 0, "%u wakeups while stopped", (unsigned)wakeups);
+
+	//searching, one wakeup per detection and one for those pending while stopped
+	actuation = recognise(MOVING_TO_BALLOON);
+	CHECK(actuation <= BLOCK_REST, "search started after %u ms", (unsigned)ST2MS(actuation));
+	new_wakeups();
+	detections = run_camera(SEARCH_TIME, false);
+	wakeups = new_wakeups();
+	printf("# searching: %4u wakeups in %u ms and %u detections, %u by polling\n", (unsigned)wakeups,
+			(unsigned)ST2MS(SEARCH_TIME), (unsigned)detections, (unsigned)search_polls);
+	CHECK(wakeups <= detections + 1, "%u wakeups for %u detections while searching", (unsigned)wakeups,
+			(unsigned)detections);
+
+	//dancing, one wakeup per period of the maneuvers and none for the detections
+	recognise(STOPPED);
+	actuation = recognise(COMMUNICATING_WITH_PEERS);
+	CHECK(actuation <= BLOCK_REST + POLL_PERIOD, "dance started after %u ms", (unsigned)ST2MS(actuation));
+	new_wakeups();
+	begin = chVTGetSystemTime();
+	detections = run_camera(DANCE_TIME, true);
+	duration = chVTGetSystemTime() - begin;
+	wakeups = new_wakeups();
+	printf("# dancing:   %4u wakeups in %u ms and %u detections\n", (unsigned)wakeups,
+			(unsigned)ST2MS(duration), (unsigned)detections);
+	CHECK(duration < DANCE_TIME, "dance not ended in %u ms", (unsigned)ST2MS(DANCE_TIME));
+	CHECK(wakeups <= duration / POLL_PERIOD + detections + 1, "%u wakeups in %u ms of dance", (unsigned)wakeups,
+			(unsigned)ST2MS(duration));
+
+	//stopped again, the detections pending stay so
+	recognise(STOPPED);
+	new_wakeups();
+	detections = run_camera(IDLE_TIME, false);
+	wakeups = new_wakeups();
+	CHECK(wakeups == 0, "%u wakeups while stopped after the dance", (unsigned)wakeups);
+
+	//the commands handled once the pipeline gives the CPU back, before the next poll
+	actuation = run_commands();
+	get_controller_stats(&stats);
+	printf("# commands: motors set up to %u ms after the recognition, latency up to %u ms, up to %u ms by polling\n",
+			(unsigned)ST2MS(actuation), (unsigned)stats.max_command_latency, (unsigned)ST2MS(polled_actuation));
+	CHECK(actuation <= BLOCK_REST && actuation < polled_actuation, "motors set up to %u ms after the commands",
+			(unsigned)ST2MS(actuation));
+	CHECK(stats.max_command_latency == ST2MS(BLOCK_REST), "command latency up to %u ms",
+			(unsigned)stats.max_command_latency);
+
+	//the camera stops while searching, the robot turns again at the next detection
+	recognise(MOVING_TO_BALLOON);
+	duration = wait_stopped(2 * SEARCH_WATCHDOG);
+	printf("# stale detections: stopped after %u ms\n", (unsigned)ST2MS(duration));
+	CHECK(duration <= SEARCH_WATCHDOG, "search not stopped in %u ms", (unsigned)ST2MS(duration));
+	run_camera(FRAME_PERIOD, false);
+	chThdYield();
+	CHECK(is_actuated(MOVING_TO_BALLOON), "search not resumed");
+
+	//the camera is off close to the balloon, only the TOF sensor updates the approach
+	chThdSleep(FRAME_PERIOD);
+	publish_balloon(FLOWER);
+	begin = chVTGetSystemTime();
+	while(chVTGetSystemTime() - begin < APPROACH_TIME){
+		chThdSleep(TOF_PERIOD);
+		publish_tof(APPROACH_DISTANCE);
+	}
+	CHECK(!is_actuated(STOPPED), "balloon not approached");
+	duration = wait_stopped(2 * APPROACH_WATCHDOG);
+	printf("# stale distances: stopped after %u ms\n", (unsigned)ST2MS(duration));
+	CHECK(duration <= APPROACH_WATCHDOG, "approach not stopped in %u ms", (unsigned)ST2MS(duration));
+
+	get_controller_stats(&stats);
+	CHECK(stats.stalls == 2, "%u stalls", (unsigned)stats.stalls);
+	return test_result();
+}
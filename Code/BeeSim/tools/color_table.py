@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""
+Generates include/color_table.h, the class of every RGB565 color quantized
+to 4 bits per channel, used by process_image.c to classify a pixel with a
+single table load.
+
+Without argument, the classes are given by the hue ranges of CLASSES.
+With a file of labelled pixels, each color takes the class of the nearest
+sample, NONE if no sample is close enough. One pixel per line:
+    CLASS,red,green,blue
+with 8 bits components, the lines starting with # are ignored.
+Labelling pixels of the background as NONE improves the table.
+
+    python3 tools/color_table.py [samples.csv]
+"""
+
+import colorsys
+import os
+import sys
+
+# classes in the order of balloon_type_t, after NONE
+# name, hue ranges in degrees, minimum saturation and value between 0 and 1
+CLASSES = [
+    ("FLOWER", [(300, 360), (0, 30)], 0.35, 0.2),
+    ("ENNEMY", [(50, 170)], 0.35, 0.2),
+]
+
+# highest distance to a labelled sample, components between 0 and 255
+MAX_SAMPLE_DISTANCE = 60
+
+OUTPUT = os.path.join(os.path.dirname(__file__), "..", "include", "color_table.h")
+
+NAMES = ["NONE"] + [name for name, _, _, _ in CLASSES]
+
+
+def cell_color(index):
+    """Color at the center of a cell, components between 0 and 255."""
+    red, green, blue = (index >> 8) & 15, (index >> 4) & 15, index & 15
+    # the 4 bits are the MSbits of the 5, 6 and 5 bits of RGB565
+    return ((2 * red + 0.5) * 255 / 31,
+            (4 * green + 1.5) * 255 / 63,
+            (2 * blue + 0.5) * 255 / 31)
+
+
+def classify_by_hue(color):
+    hue, saturation, value = colorsys.rgb_to_hsv(*(c / 255 for c in color))
+    for i, (_, ranges, min_saturation, min_value) in enumerate(CLASSES):
+        if saturation < min_saturation or value < min_value:
+            continue
+        if any(low <= hue * 360 < high for low, high in ranges):
+            return i + 1
+    return 0
+
+
+def load_samples(path):
+    samples = []
+    with open(path) as file:
+        for number, line in enumerate(file, 1):
+            line = line.strip()
+            if not line or line.startswith("#"):
+                continue
+            name, *components = [field.strip() for field in line.split(",")]
+            if name not in NAMES or len(components) != 3:
+                sys.exit("%s:%d: expected CLASS,red,green,blue with CLASS in %s"
+                         % (path, number, ", ".join(NAMES)))
+            samples.append((NAMES.index(name), tuple(int(c) for c in components)))
+    return samples
+
+
+def classify_by_samples(color, samples):
+    best_class, best_distance = 0, MAX_SAMPLE_DISTANCE ** 2
+    for label, sample in samples:
+        distance = sum((a - b) ** 2 for a, b in zip(color, sample))
+        if distance < best_distance:
+            best_class, best_distance = label, distance
+    return best_class
+
+
+def main():
+    if len(sys.argv) > 1:
+        samples = load_samples(sys.argv[1])
+        source = "labelled pixels of " + os.path.basename(sys.argv[1])
+        classify = lambda color: classify_by_samples(color, samples)
+    else:
+        source = "hue ranges of tools/color_table.py"
+        classify = classify_by_hue
+
+    table = [classify(cell_color(index)) for index in range(4096)]
+
+    lines = ["    " + ", ".join("%d" % c for c in table[i:i + 16]) + ","
+             for i in range(0, 4096, 16)]
+    with open(OUTPUT, "w") as file:
+        file.write("""/**
+ * @file	color_table.h
+ * @brief	Class of every RGB565 color, quantized to the 4 MSbits of each channel.
+ * @note	Generated by tools/color_table.py from the %s, do not edit.
+**/
+
+#ifndef COLOR_TABLE_H
+#define COLOR_TABLE_H
+
+//classes in the order of balloon_type_t: %s
+#define NB_COLOR_CLASSES	%d
+
+//index: red << 8 | green << 4 | blue
+static const uint8_t color_table[4096] = {
+%s
+};
+
+#endif /* COLOR_TABLE_H */
+""" % (source, ", ".join(NAMES), len(NAMES), "\n".join(lines)))
+
+    for i, name in enumerate(NAMES):
+        print("%-8s %4d colors" % (name, table.count(i)))
+
+
+if __name__ == "__main__":
+    main()